@@ -0,0 +1,102 @@
+/*
+  AudioArena
+  Simple stack-like allocator running out of a caller-supplied block
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AudioArena.h"
+
+void AudioArena::begin(void *space, int sz)
+{
+  base = reinterpret_cast<uint8_t*>(space);
+  size = sz;
+  if (base) {
+    // Everything we hand out is 8-byte aligned relative to the start of the block
+    int skew = (8 - (reinterpret_cast<uintptr_t>(base) & 7)) & 7;
+    base += skew;
+    size -= skew;
+    if (size <= 0) {
+      base = NULL;
+      size = 0;
+    }
+  } else {
+    size = 0;
+  }
+  used = 0;
+  peak = 0;
+  last = -1;
+}
+
+void *AudioArena::allocate(int bytes)
+{
+  if (!base || (bytes < 0)) return NULL;
+  int need = (bytes + 7) & ~7;
+  if (used + headerSize + need > size) return NULL;
+
+  header *h = hdr(used);
+  h->bytes = need;
+  h->prev = (last < 0) ? noBlock : (uint32_t)last;
+  last = used;
+  used += headerSize + need;
+  if (used > peak) peak = used;
+  return reinterpret_cast<uint8_t*>(h) + headerSize;
+}
+
+void AudioArena::release(void *ptr)
+{
+  if (!ptr || !owns(ptr)) return;
+  int off = reinterpret_cast<uint8_t*>(ptr) - base - headerSize;
+  hdr(off)->bytes |= freedFlag;
+
+  // Pop every freed block off the top so their space can be reused
+  while ((last >= 0) && (hdr(last)->bytes & freedFlag)) {
+    used = last;
+    last = (hdr(last)->prev == noBlock) ? -1 : (int)hdr(last)->prev;
+  }
+}
+
+void *AudioArena::reallocate(void *ptr, int bytes)
+{
+  if (!ptr) return allocate(bytes);
+  if (!owns(ptr)) return NULL;
+  if (bytes <= 0) {
+    release(ptr);
+    return NULL;
+  }
+
+  int off = reinterpret_cast<uint8_t*>(ptr) - base - headerSize;
+  header *h = hdr(off);
+  int have = h->bytes & ~freedFlag;
+  int need = (bytes + 7) & ~7;
+
+  if (off == last) {
+    // Top of the stack, can grow or shrink in place
+    if (off + headerSize + need > size) goto move;
+    h->bytes = need;
+    used = off + headerSize + need;
+    if (used > peak) peak = used;
+    return ptr;
+  }
+  if (need <= have) return ptr;
+
+move:
+  void *newPtr = allocate(bytes);
+  if (!newPtr) return NULL;
+  memcpy(newPtr, ptr, (have < need) ? have : need);
+  release(ptr);
+  return newPtr;
+}
@@ -0,0 +1,67 @@
+/*
+  AudioArena
+  Simple stack-like allocator running out of a caller-supplied block
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUDIOARENA_H
+#define _AUDIOARENA_H
+
+#include <Arduino.h>
+
+// Used by the generators (and the codec libraries under them) to run entirely out
+// of one preallocated block, so the same static buffer can be handed from format
+// to format without ever touching the heap.  Blocks are carved linearly; freeing
+// the most recent block (or a run of already-freed ones under it) returns the
+// space, anything else is only reclaimed at the next begin().
+class AudioArena
+{
+  public:
+    AudioArena() { begin(NULL, 0); }
+    void begin(void *space, int size);
+    void *allocate(int bytes);
+    void *reallocate(void *ptr, int bytes);
+    void release(void *ptr);
+    bool owns(const void *ptr) const { return base && ((const uint8_t*)ptr >= base) && ((const uint8_t*)ptr < base + size); }
+    bool isActive() const { return base != NULL; }
+    int getSize() const { return size; }
+    int getUsed() const { return used; }
+    int getPeak() const { return peak; }
+
+    // Bytes of arena a single allocation of the given size will consume, for preAllocSize() sums
+    static constexpr int blockSize(int bytes) { return ((bytes + 7) & ~7) + headerSize; }
+
+  private:
+    enum { headerSize = 8 };
+    static const uint32_t freedFlag = 0x80000000;
+    static const uint32_t noBlock = 0xffffffff;
+    typedef struct {
+      uint32_t bytes; // Payload size rounded to 8, freedFlag set once released
+      uint32_t prev;  // Offset of the previous header, noBlock for the first one
+    } header;
+
+    header *hdr(uint32_t off) const { return reinterpret_cast<header*>(base + off); }
+
+    uint8_t *base;
+    int size;
+    int used;
+    int peak;
+    int last; // Offset of the most recent header, -1 when empty
+};
+
+#endif
+
@@ -38,10 +38,23 @@ class AudioFileSource
     virtual uint32_t getSize() { return 0; };
     virtual uint32_t getPos() { return 0; };
     virtual bool loop() { return true; };
+    // Whether a seek elsewhere and back is cheap enough to do just to take a look, as with a local file
+    // or memory.  Streams and read-ahead buffers say no, there it would cost a refetch or the buffer.
+    virtual bool isSeekCheap() { return false; };
+
+    // Optional zero-copy reading for sources whose data is already in memory.  acquire() lends a
+    // pointer to up to len contiguous bytes at the current position and says how many in *avail,
+    // without moving the position, or returns NULL if the source can't.  The bytes stay put until
+    // the next call into the source; release() then consumes len of them, like a read would.
+    virtual const uint8_t *acquire(uint32_t len, uint32_t *avail) { (void)len; *avail = 0; return NULL; };
+    virtual void release(uint32_t len) { seek(len, SEEK_CUR); };
 
   public:
     virtual bool RegisterMetadataCB(AudioStatus::metadataCBFn fn, void *data) { return cb.RegisterMetadataCB(fn, data); }
     virtual bool RegisterStatusCB(AudioStatus::statusCBFn fn, void *data) { return cb.RegisterStatusCB(fn, data); }
+    virtual bool RegisterReportCB(AudioStatus::reportCBFn fn, void *data) { return cb.RegisterReportCB(fn, data); }
+    void SetStatusRateLimit(uint32_t ms) { cb.SetRateLimit(ms); }
+    uint32_t GetStatusCount(int code) const { return cb.GetCount(code); }
 
   protected:
     AudioStatus cb;
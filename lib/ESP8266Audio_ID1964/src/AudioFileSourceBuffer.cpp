@@ -34,6 +34,11 @@ AudioFileSourceBuffer::AudioFileSourceBuffer(AudioFileSource *source, uint32_t b
   src = source;
   length = 0;
   filled = false;
+  lowWater = 0;
+  startWater = 0;
+  low = false;
+  growLimit = 0;
+  ResetStats();
 }
 
 AudioFileSourceBuffer::AudioFileSourceBuffer(AudioFileSource *source, void *inBuff, uint32_t buffSizeBytes)
@@ -46,6 +51,11 @@ AudioFileSourceBuffer::AudioFileSourceBuffer(AudioFileSource *source, void *inBu
   src = source;
   length = 0;
   filled = false;
+  lowWater = 0;
+  startWater = 0;
+  low = false;
+  growLimit = 0;
+  ResetStats();
 }
 
 AudioFileSourceBuffer::~AudioFileSourceBuffer()
@@ -56,10 +66,21 @@ AudioFileSourceBuffer::~AudioFileSourceBuffer()
 
 bool AudioFileSourceBuffer::seek(int32_t pos, int dir)
 {
+  if (dir == SEEK_CUR) {
+    // Short hops forward stay inside what's already buffered
+    if ((pos >= 0) && ((uint32_t)pos <= length)) {
+      readPtr = (readPtr + pos) % buffSize;
+      length -= pos;
+      return true;
+    }
+    // Otherwise src is ahead of the reader by everything still in the ring
+    pos -= length;
+  }
   // Invalidate
   readPtr = 0;
   writePtr = 0;
   length = 0;
+  filled = false; // Wait for the new position to buffer rather than calling it an underflow
   return src->seek(pos, dir);
 }
 
@@ -82,7 +103,7 @@ uint32_t AudioFileSourceBuffer::getSize()
 
 uint32_t AudioFileSourceBuffer::getPos()
 {
-  return src->getPos();
+  return src->getPos() - length;
 }
 
 uint32_t AudioFileSourceBuffer::getFillLevel()
@@ -90,18 +111,55 @@ uint32_t AudioFileSourceBuffer::getFillLevel()
   return length;
 }
 
+void AudioFileSourceBuffer::SetWatermarks(uint32_t lowBytes, uint32_t startBytes)
+{
+  lowWater = lowBytes;
+  startWater = startBytes;
+  low = false;
+}
+
+void AudioFileSourceBuffer::ResetStats()
+{
+  st.minFill = length;
+  st.avgFill = length;
+  st.inRate = 0;
+  st.outRate = 0;
+  avgFill16 = length << 4;
+  windowMs = millis();
+  windowIn = 0;
+  windowOut = 0;
+}
+
+void AudioFileSourceBuffer::account(uint32_t in, uint32_t out)
+{
+  windowIn += in;
+  windowOut += out;
+  uint32_t now = millis();
+  if (now - windowMs >= 1000) {
+    st.inRate = ((uint64_t)windowIn * 1000) / (now - windowMs);
+    st.outRate = ((uint64_t)windowOut * 1000) / (now - windowMs);
+    windowMs = now;
+    windowIn = 0;
+    windowOut = 0;
+  }
+  if (!out) return;
+
+  // Only sample the level when someone takes data, which is when it matters
+  if (length < st.minFill) st.minFill = length;
+  avgFill16 += length - (avgFill16 >> 4);
+  st.avgFill = avgFill16 >> 4;
+  if (length < lowWater) {
+    if (!low) cb.st(STATUS_LOWWATER, PSTR("Buffer low"));
+    low = true;
+  }
+}
+
 uint32_t AudioFileSourceBuffer::read(void *data, uint32_t len)
 {
   if (!buffer) return src->read(data, len);
 
   uint32_t bytes = 0;
-  if (!filled) {
-    // Fill up completely before returning any data at all
-    cb.st(STATUS_FILLING, PSTR("Refilling buffer"));
-    length = src->read(buffer, buffSize);
-    writePtr = length % buffSize;
-    filled = true;
-  }
+  if (!filled) refill();
 
   // Pull from buffer until we've got none left or we've satisfied the request
   uint8_t *ptr = reinterpret_cast<uint8_t*>(data);
@@ -126,15 +184,15 @@ uint32_t AudioFileSourceBuffer::read(void *data, uint32_t len)
     toReadFromBuffer -= toReadFromBuffer;
   }
 
+  account(0, bytes);
+
   if (len) {
     // Still need more, try direct read from src
-    bytes += src->read(ptr, len);
-    // We're out of buffered data, need to force a complete refill.  Thanks, @armSeb
-    readPtr = 0;
-    writePtr = 0;
-    length = 0;
-    filled = false;
-    cb.st(STATUS_UNDERFLOW, PSTR("Buffer underflow"));
+    uint32_t direct = src->read(ptr, len);
+    bytes += direct;
+    account(direct, direct);
+    // We're out of buffered data, need to force a refill.  Thanks, @armSeb
+    underflow();
   }
 
   fill();
@@ -142,10 +200,74 @@ uint32_t AudioFileSourceBuffer::read(void *data, uint32_t len)
   return bytes;
 }
 
+void AudioFileSourceBuffer::underflow()
+{
+  readPtr = 0;
+  writePtr = 0;
+  length = 0;
+  filled = false;
+  low = true;
+  cb.st(STATUS_UNDERFLOW, PSTR("Buffer underflow"));
+
+  // Nothing is buffered now, so a bigger buffer is just a realloc away
+  if (deallocateBuffer && (growLimit > buffSize)) {
+    uint32_t newSize = buffSize + buffSize / 2;
+    if (newSize > growLimit) newSize = growLimit;
+    uint8_t *newBuffer = (uint8_t*)realloc(buffer, newSize);
+    if (newBuffer) {
+      buffer = newBuffer;
+      buffSize = newSize;
+    }
+  }
+}
+
+void AudioFileSourceBuffer::refill()
+{
+  // Fill up to the start watermark (or completely) before returning any data at all.  fill() may
+  // already have started on it from the front, so only top up what's missing.
+  cb.st(STATUS_FILLING, PSTR("Refilling buffer"));
+  uint32_t want = (startWater && (startWater < buffSize)) ? startWater : buffSize;
+  if (length < want) {
+    uint32_t got = src->read(&buffer[writePtr], want - length);
+    length += got;
+    writePtr = (writePtr + got) % buffSize;
+    account(got, 0);
+  }
+  filled = true;
+}
+
+const uint8_t *AudioFileSourceBuffer::acquire(uint32_t len, uint32_t *avail)
+{
+  *avail = 0;
+  if (!buffer) return NULL;
+  if (filled && !length) {
+    // Ran dry, so start over just like read() does
+    underflow();
+  }
+  if (!filled) refill();
+
+  // Only up to the end of the ring, the rest comes with the next acquire()
+  uint32_t run = buffSize - readPtr;
+  if (run > length) run = length;
+  *avail = (len < run) ? len : run;
+  return &buffer[readPtr];
+}
+
+void AudioFileSourceBuffer::release(uint32_t len)
+{
+  if (!buffer) return;
+  if (len > length) len = length;
+  readPtr = (readPtr + len) % buffSize;
+  length -= len;
+  account(0, len);
+  fill();
+}
+
 void AudioFileSourceBuffer::fill()
 {
   if (!buffer) return;
 
+  uint32_t before = length;
   if (length < buffSize) {
     // Now try and opportunistically fill the buffer
     if (readPtr > writePtr) {
@@ -154,24 +276,24 @@ void AudioFileSourceBuffer::fill()
       int cnt = src->readNonBlock(&buffer[writePtr], bytesAvailMid);
       length += cnt;
       writePtr = (writePtr + cnt) % buffSize;
-      return;
-    }
-
-    if (buffSize > writePtr) {
-      uint32_t bytesAvailEnd = buffSize - writePtr;
-      int cnt = src->readNonBlock(&buffer[writePtr], bytesAvailEnd);
-      length += cnt;
-      writePtr = (writePtr + cnt) % buffSize;
-      if (cnt != bytesAvailEnd) return;
-    }
-
-    if (readPtr > 1) {
-      uint32_t bytesAvailStart = readPtr - 1;
-      int cnt = src->readNonBlock(&buffer[writePtr], bytesAvailStart);
-      length += cnt;
-      writePtr = (writePtr + cnt) % buffSize;
+    } else {
+      if (buffSize > writePtr) {
+        uint32_t bytesAvailEnd = buffSize - writePtr;
+        int cnt = src->readNonBlock(&buffer[writePtr], bytesAvailEnd);
+        length += cnt;
+        writePtr = (writePtr + cnt) % buffSize;
+      }
+      if ((writePtr == 0) && (readPtr > 1)) {
+        uint32_t bytesAvailStart = readPtr - 1;
+        int cnt = src->readNonBlock(&buffer[writePtr], bytesAvailStart);
+        length += cnt;
+        writePtr = (writePtr + cnt) % buffSize;
+      }
     }
   }
+  account(length - before, 0);
+  uint32_t rearm = (startWater && (startWater < buffSize)) ? startWater : buffSize;
+  if (low && (length >= rearm)) low = false;
 }
 
 
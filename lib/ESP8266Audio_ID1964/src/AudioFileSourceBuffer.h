@@ -38,13 +38,37 @@ class AudioFileSourceBuffer : public AudioFileSource
     virtual uint32_t getSize() override;
     virtual uint32_t getPos() override;
     virtual bool loop() override;
+    virtual const uint8_t *acquire(uint32_t len, uint32_t *avail) override;
+    virtual void release(uint32_t len) override;
 
     virtual uint32_t getFillLevel();
+    uint32_t getBufferSize() const { return buffSize; }
 
-    enum { STATUS_FILLING=2, STATUS_UNDERFLOW };
+    // After starting, seeking or running dry, wait only for startBytes before handing out data again
+    // instead of the whole buffer (0, the default, means the whole buffer).  Dropping below lowBytes
+    // reports STATUS_LOWWATER, once until the level gets back up to startBytes.
+    void SetWatermarks(uint32_t lowBytes, uint32_t startBytes);
+    // Grow the buffer by half each time it runs dry, to at most maxBytes.  Only buffers allocated here can grow.
+    void SetGrowLimit(uint32_t maxBytes) { growLimit = maxBytes; }
+
+    // How the buffer has been doing since the last ResetStats().  Underflow and low water
+    // counts come from GetStatusCount().
+    typedef struct {
+      uint32_t minFill;    // Lowest fill level seen, in bytes
+      uint32_t avgFill;    // Fill level averaged over roughly the last 16 reads
+      uint32_t inRate;     // Bytes/second arriving from the source over the last full second
+      uint32_t outRate;    // Bytes/second handed to the reader over the last full second
+    } Stats;
+    void GetStats(Stats *stats) const { *stats = st; }
+    void ResetStats();
+
+    enum { STATUS_FILLING=2, STATUS_UNDERFLOW, STATUS_LOWWATER };
 
   private:
     virtual void fill();
+    void refill();
+    void underflow();
+    void account(uint32_t in, uint32_t out);
 
   private:
     AudioFileSource *src;
@@ -55,6 +79,17 @@ class AudioFileSourceBuffer : public AudioFileSource
     uint32_t readPtr;
     uint32_t length;
     bool filled;
+
+    uint32_t lowWater;
+    uint32_t startWater;
+    bool low;
+    uint32_t growLimit;
+
+    Stats st;
+    uint32_t avgFill16;  // avgFill scaled by 16 to keep the fraction
+    uint32_t windowMs;   // When the current rate window started
+    uint32_t windowIn;
+    uint32_t windowOut;
 };
 
 
@@ -20,30 +20,33 @@
 
 #include "AudioFileSourceID3.h"
 
-// Handle unsync operation in ID3 with custom class
+// Reads a span of a tag (the whole tag, or one frame of it) and undoes unsynchronization on the way.
+// len counts bytes in the file, what comes out can be shorter when unsync'd.
 class AudioFileSourceUnsync : public AudioFileSource
 {
   public:
-    AudioFileSourceUnsync(AudioFileSource *src, int len, bool unsync);
+    AudioFileSourceUnsync(AudioFileSource *src, uint32_t len, bool unsync);
     virtual ~AudioFileSourceUnsync() override;
     virtual uint32_t read(void *data, uint32_t len) override;
+    virtual bool seek(int32_t pos, int dir) override;
 
     int getByte();
+    void skip(uint32_t len); // Skips len bytes of output, or to the end if there aren't that many
     bool eof();
 
   private:
     AudioFileSource *src;
-    int remaining;
+    uint32_t remaining;
     bool unsync;
-    int savedByte;
+    bool lastFF;
 };
 
-AudioFileSourceUnsync::AudioFileSourceUnsync(AudioFileSource *src, int len, bool unsync)
+AudioFileSourceUnsync::AudioFileSourceUnsync(AudioFileSource *src, uint32_t len, bool unsync)
 {
   this->src = src;
   this->remaining = len;
   this->unsync = unsync;
-  this->savedByte = -1;
+  this->lastFF = false;
 }
 
 AudioFileSourceUnsync::~AudioFileSourceUnsync()
@@ -52,67 +55,68 @@ AudioFileSourceUnsync::~AudioFileSourceUnsync()
 
 uint32_t AudioFileSourceUnsync::read(void *data, uint32_t len)
 {
-  uint32_t bytes = 0;
   uint8_t *ptr = reinterpret_cast<uint8_t*>(data);
+  uint32_t bytes = 0;
 
-  // This is only used during ID3 parsing, so no need to optimize here...
-  while (len--) {
-    int b = getByte();
-    if (b >= 0) {
-      *(ptr++) = (uint8_t)b;
-      bytes++;
+  while ((bytes < len) && remaining) {
+    uint32_t want = len - bytes;
+    if (want > remaining) want = remaining;
+    uint32_t got = src->read(ptr + bytes, want);
+    if (!got) break;
+    remaining -= got;
+    if (!unsync) {
+      bytes += got;
+      continue;
+    }
+    // Squeeze out the 0x00 that follows every 0xff, even when the pair straddles two reads
+    uint32_t w = bytes;
+    for (uint32_t r = bytes; r < bytes + got; r++) {
+      uint8_t c = ptr[r];
+      if (lastFF && !c) {
+        lastFF = false;
+        continue;
+      }
+      lastFF = (c == 0xff);
+      ptr[w++] = c;
     }
+    bytes = w;
   }
   return bytes;
 }
 
-int AudioFileSourceUnsync::getByte()
+bool AudioFileSourceUnsync::seek(int32_t pos, int dir)
 {
-  // If we're not unsync, just read.
-  if (!unsync) {
-    uint8_t c;
-    if (!remaining) return -1;
-    remaining--;
-    if (1 != src->read(&c, 1)) return -1;
-    return c;
-  }
+  // Only forwards, and only when bytes in and out are the same
+  if (unsync || (dir != SEEK_CUR) || (pos < 0) || ((uint32_t)pos > remaining)) return false;
+  if (!src->seek(pos, SEEK_CUR)) return false;
+  remaining -= pos;
+  return true;
+}
 
-  // If we've saved a pre-read character, return it immediately
-  if (savedByte >= 0) {
-    int s = savedByte;
-    savedByte = -1;
-    return s;
-  }
+int AudioFileSourceUnsync::getByte()
+{
+  uint8_t c;
+  if (1 != read(&c, 1)) return -1;
+  return c;
+}
 
-  if (remaining <= 0) {
-    return -1;
-  } else if (remaining == 1) {
-    remaining--;
-    uint8_t c;
-    if (1 != src->read(&c, 1)) return -1;
-    else return c;
-  } else {
-    uint8_t c;
-    remaining--;
-    if (1 != src->read(&c, 1)) return -1;
-    if (c != 0xff) {
-      return c;
-    }
-    // Saw 0xff, check next byte.  If 0 then eat it, OTW return the 0xff
-    uint8_t d;
-    remaining--;
-    if (1 != src->read(&d, 1)) return c;
-    if (d != 0x00) {
-      savedByte = d;
-    }
-    return c;
+void AudioFileSourceUnsync::skip(uint32_t len)
+{
+  if (!unsync && (len > remaining)) len = remaining;
+  if (!len || seek(len, SEEK_CUR)) return;
+
+  // Can't seek (a stream, or unsync'd data that needs looking at), so read it in blocks
+  uint8_t junk[128];
+  while (len) {
+    uint32_t got = read(junk, (len < sizeof(junk)) ? len : sizeof(junk));
+    if (!got) break;
+    len -= got;
   }
 }
 
 bool AudioFileSourceUnsync::eof()
 {
-  if (remaining<=0) return true;
-  else return false;
+  return !remaining;
 }
 
 
@@ -121,6 +125,7 @@ AudioFileSourceID3::AudioFileSourceID3(AudioFileSource *src)
 {
   this->src = src;
   this->checked = false;
+  this->audioEnd = 0;
 }
 
 AudioFileSourceID3::~AudioFileSourceID3()
@@ -129,114 +134,195 @@ AudioFileSourceID3::~AudioFileSourceID3()
 
 uint32_t AudioFileSourceID3::read(void *data, uint32_t len)
 {
-  int rev = 0;
+  uint32_t bytes = 0;
+  if (!checked) {
+    checked = true;
+    // <10 bytes initial read, not enough space to check header
+    if (len >= 10) {
+      uint8_t *buff = reinterpret_cast<uint8_t*>(data);
+      int ret = src->read(data, 10);
+      if (ret<10) return ret;
+
+      if (IsTagHeader(buff)) {
+        ParseTag(buff);
+      } else {
+        data = buff + 10;
+        len -= 10;
+        bytes = 10;
+      }
+    }
+    TrimTail();
+  }
+
+  if (audioEnd) {
+    uint32_t pos = src->getPos();
+    if (pos >= audioEnd) return bytes;
+    if (len > audioEnd - pos) len = audioEnd - pos;
+  }
+  return bytes + src->read(data, len);
+}
 
-  if (checked) {
-    return src->read(data, len);
+const uint8_t *AudioFileSourceID3::acquire(uint32_t len, uint32_t *avail)
+{
+  if (!checked) {
+    // Peek at the start of the file, and only take the tag off it if there is one
+    uint32_t got;
+    const uint8_t *p = src->acquire(10, &got);
+    if (!p) {
+      *avail = 0;
+      return NULL;
+    }
+    checked = true;
+    if ((got == 10) && IsTagHeader(p)) {
+      uint8_t hdr[10];
+      memcpy(hdr, p, 10);
+      src->release(10);
+      ParseTag(hdr);
+    }
+    TrimTail();
+  }
+
+  if (audioEnd) {
+    uint32_t pos = src->getPos();
+    if (pos >= audioEnd) {
+      *avail = 0;
+      return NULL;
+    }
+    if (len > audioEnd - pos) len = audioEnd - pos;
   }
-  checked = true;
-  // <10 bytes initial read, not enough space to check header
-  if (len<10) return src->read(data, len);
+  return src->acquire(len, avail);
+}
 
-  uint8_t *buff = reinterpret_cast<uint8_t*>(data);
-  int ret = src->read(data, 10);
-  if (ret<10) return ret;
+void AudioFileSourceID3::release(uint32_t len)
+{
+  src->release(len);
+}
 
-  if ((buff[0]!='I') || (buff[1]!='D') || (buff[2]!='3') || (buff[3]>0x04) || (buff[3]<0x02) || (buff[4]!=0)) {
-    return 10 + src->read(buff+10, len-10);
+// Looks for an ID3v1 tag, an APE tag, or both at the end of the file, so they aren't handed out as
+// audio.  Only done when the source knows its size and can seek there and back cheaply, a stream or
+// a read-ahead buffer just plays the tags out rather than refetching or losing what it has.
+void AudioFileSourceID3::TrimTail()
+{
+  audioEnd = 0;
+  uint32_t size = src->getSize();
+  if (!size || !src->isSeekCheap()) return;
+  uint32_t pos = src->getPos();
+  uint32_t end = size;
+  uint8_t tail[32];
+
+  if ((end >= pos + 128) && src->seek(end - 128, SEEK_SET)) {
+    if ((src->read(tail, 3) == 3) && (tail[0]=='T') && (tail[1]=='A') && (tail[2]=='G')) end -= 128;
   }
+  if ((end >= pos + 32) && src->seek(end - 32, SEEK_SET)) {
+    if ((src->read(tail, 32) == 32) && !memcmp(tail, "APETAGEX", 8)) {
+      // Size covers the items and this footer, flags say whether there's a header ahead of them too
+      uint32_t apeSize = tail[12] | (tail[13]<<8) | (tail[14]<<16) | ((uint32_t)tail[15]<<24);
+      if (tail[23] & 0x80) apeSize += 32;
+      if (apeSize <= end - pos) end -= apeSize;
+    }
+  }
+  if (!src->seek(pos, SEEK_SET)) return;
+  if (end < size) audioEnd = end;
+}
 
-  rev = buff[3];
-  bool unsync = false;
-  bool exthdr = false;
-
-  switch(rev) {
-    case 2:
-      unsync = (buff[5] & 0x80);
-      exthdr = false;
-      break;
-    case 3:
-    case 4:
-      unsync = (buff[5] & 0x80);
-      exthdr = (buff[5] & 0x40);
-      break;
-  };
-
-  int id3Size = buff[6];
+bool AudioFileSourceID3::IsTagHeader(const uint8_t *buff)
+{
+  return (buff[0]=='I') && (buff[1]=='D') && (buff[2]=='3') && (buff[3]<=0x04) && (buff[3]>=0x02) && (buff[4]==0);
+}
+
+// Reads the rest of the tag whose 10 byte header is in buff, leaving src at the audio data
+void AudioFileSourceID3::ParseTag(const uint8_t *buff)
+{
+  int rev = buff[3];
+  bool unsync = (buff[5] & 0x80);
+  bool exthdr = (rev >= 3) && (buff[5] & 0x40);
+  bool footer = (rev == 4) && (buff[5] & 0x10);
+
+  uint32_t id3Size = buff[6];
   id3Size = id3Size << 7;
   id3Size |= buff[7];
   id3Size = id3Size << 7;
   id3Size |= buff[8];
   id3Size = id3Size << 7;
   id3Size |= buff[9];
-  // Every read from now may be unsync'd
-  AudioFileSourceUnsync id3(src, id3Size, unsync);
+  if (footer) id3Size += 10;
+
+  // v2.2 and v2.3 unsync the whole tag, frame headers included.  v2.4 does it frame by frame.
+  AudioFileSourceUnsync id3(src, id3Size, unsync && (rev < 4));
+
+  // Nobody to tell about what's in the tag, so don't even look
+  if (!cb.HasMetadataCB()) {
+    id3.skip(id3Size);
+    return;
+  }
 
   if (exthdr) {
-    int ehsz = (id3.getByte()<<24) | (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
-    for (int j=0; j<ehsz-4; j++) id3.getByte(); // Throw it away
+    uint8_t b[4];
+    id3.read(b, 4);
+    if (rev == 3) {
+      id3.skip(((uint32_t)b[0]<<24) | (b[1]<<16) | (b[2]<<8) | b[3]); // Size doesn't count itself
+    } else {
+      id3.skip(((b[0]<<21) | (b[1]<<14) | (b[2]<<7) | b[3]) - 4);
+    }
   }
 
-  do {
-    unsigned char frameid[4];
-    int framesize;
-    bool compressed;
-
-    frameid[0] = id3.getByte();
-    frameid[1] = id3.getByte();
-    frameid[2] = id3.getByte();
-    if (rev==2) frameid[3] = 0;
-    else frameid[3] = id3.getByte();
-
-    if (frameid[0]==0 && frameid[1]==0 && frameid[2]==0 && frameid[3]==0) {
-      // We're in padding
-      while (!id3.eof()) {
-        id3.getByte();
-      }
+  while (!id3.eof()) {
+    uint8_t hdr[10];
+    int hdrLen = (rev == 2) ? 6 : 10;
+    if (id3.read(hdr, hdrLen) != (uint32_t)hdrLen) break;
+    if (!hdr[0]) break; // We're in padding, skipped below
+
+    uint32_t framesize;
+    bool skipIt = false;
+    bool frameUnsync = false;
+    bool dataLen = false;
+    if (rev == 2) {
+      framesize = (hdr[3]<<16) | (hdr[4]<<8) | hdr[5];
+    } else if (rev == 3) {
+      framesize = ((uint32_t)hdr[4]<<24) | (hdr[5]<<16) | (hdr[6]<<8) | hdr[7];
+      skipIt = hdr[9] & 0xc0; // Compressed or encrypted
     } else {
-      if (rev==2) {
-        framesize = (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
-        compressed = false;
-      } else {
-        framesize = (id3.getByte()<<24) | (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
-        id3.getByte(); // skip 1st flag
-        compressed = id3.getByte()&0x80;
-      }
-      if (compressed) {
-        int decompsize = (id3.getByte()<<24) | (id3.getByte()<<16) | (id3.getByte()<<8) | (id3.getByte());
-        // TODO - add libz decompression, for now ignore this one...
-        (void)decompsize;
-        for (int j=0; j<framesize; j++)
-          id3.getByte();
-      }
+      framesize = (hdr[4]<<21) | (hdr[5]<<14) | (hdr[6]<<7) | hdr[7];
+      skipIt = hdr[9] & 0x0c; // Compressed or encrypted
+      frameUnsync = unsync || (hdr[9] & 0x02);
+      dataLen = hdr[9] & 0x01;
+    }
 
-      // Read the value and send to callback
-      char value[64];
-      uint16_t i;
-      bool isUnicode = (id3.getByte()==1) ? true : false;
-      for (i=0; i<framesize-1; i++) {
-        if (i<sizeof(value)-1) value[i] = id3.getByte();
-        else (void)id3.getByte();
-      }
-      value[i<sizeof(value)-1?i:sizeof(value)-1] = 0; // Terminate the string...
-      if ( (frameid[0]=='T' && frameid[1]=='A' && frameid[2]=='L' && frameid[3] == 'B' ) ||
-           (frameid[0]=='T' && frameid[1]=='A' && frameid[2]=='L' && rev==2) ) {
-        cb.md("Album", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='I' && frameid[2]=='T' && frameid[3] == '2') ||
-                  (frameid[0]=='T' && frameid[1]=='T' && frameid[2]=='2' && rev==2) ) {
-        cb.md("Title", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='E' && frameid[3] == '1') ||
-                  (frameid[0]=='T' && frameid[1]=='P' && frameid[2]=='1' && rev==2) ) {
-        cb.md("Performer", isUnicode, value);
-      } else if ( (frameid[0]=='T' && frameid[1]=='Y' && frameid[2]=='E' && frameid[3] == 'R') ||
-                  (frameid[0]=='T' && frameid[1]=='Y' && frameid[2]=='E' && rev==2) ) {
-        cb.md("Year", isUnicode, value);
-      }
+    const char *name = NULL;
+    if ( (hdr[0]=='T' && hdr[1]=='A' && hdr[2]=='L' && hdr[3] == 'B' ) ||
+         (hdr[0]=='T' && hdr[1]=='A' && hdr[2]=='L' && rev==2) ) {
+      name = "Album";
+    } else if ( (hdr[0]=='T' && hdr[1]=='I' && hdr[2]=='T' && hdr[3] == '2') ||
+                (hdr[0]=='T' && hdr[1]=='T' && hdr[2]=='2' && rev==2) ) {
+      name = "Title";
+    } else if ( (hdr[0]=='T' && hdr[1]=='P' && hdr[2]=='E' && hdr[3] == '1') ||
+                (hdr[0]=='T' && hdr[1]=='P' && hdr[2]=='1' && rev==2) ) {
+      name = "Performer";
+    } else if ( (hdr[0]=='T' && hdr[1]=='Y' && hdr[2]=='E' && hdr[3] == 'R') ||
+                (hdr[0]=='T' && hdr[1]=='D' && hdr[2]=='R' && hdr[3] == 'C') ||
+                (hdr[0]=='T' && hdr[1]=='Y' && hdr[2]=='E' && rev==2) ) {
+      name = "Year";
     }
-  } while (!id3.eof());
 
-  // All ID3 processing done, return to main caller
-  return src->read(data, len);
+    // Pictures and everything else nobody asked for are passed over without being read
+    if (!name || skipIt || !framesize) {
+      id3.skip(framesize);
+      continue;
+    }
+
+    // Read the value and send to callback
+    AudioFileSourceUnsync frame(&id3, framesize, frameUnsync);
+    if (dataLen) frame.skip(4);
+    char value[64];
+    bool isUnicode = (frame.getByte()==1) ? true : false;
+    uint32_t i = frame.read(value, sizeof(value)-1);
+    value[i] = 0; // Terminate the string...
+    frame.skip(framesize);
+    cb.md(name, isUnicode, value);
+  }
+
+  // Padding, or a frame we couldn't make sense of
+  id3.skip(id3Size);
 }
 
 bool AudioFileSourceID3::seek(int32_t pos, int dir)
@@ -256,7 +342,7 @@ bool AudioFileSourceID3::isOpen()
 
 uint32_t AudioFileSourceID3::getSize()
 {
-  return src->getSize();
+  return audioEnd ? audioEnd : src->getSize();
 }
 
 uint32_t AudioFileSourceID3::getPos()
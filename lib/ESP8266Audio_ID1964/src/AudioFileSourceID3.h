@@ -37,10 +37,18 @@ class AudioFileSourceID3 : public AudioFileSource
     virtual bool isOpen() override;
     virtual uint32_t getSize() override;
     virtual uint32_t getPos() override;
+    virtual bool isSeekCheap() override { return src->isSeekCheap(); };
+    virtual const uint8_t *acquire(uint32_t len, uint32_t *avail) override;
+    virtual void release(uint32_t len) override;
 
   private:
+    void TrimTail();
+    bool IsTagHeader(const uint8_t *buff);
+    void ParseTag(const uint8_t *buff);
+
     AudioFileSource *src;
     bool checked;
+    uint32_t audioEnd; // Where an ID3v1 or APE tag at the end of the file starts, 0 if there's none
 };
 
 
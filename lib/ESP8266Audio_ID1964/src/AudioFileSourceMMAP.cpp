@@ -0,0 +1,133 @@
+/*
+  AudioFileSourceMMAP
+  Input file mapped into memory, to be used by AudioGenerator
+  Only for host-based testing
+  
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <Arduino.h>
+#ifndef ARDUINO
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "AudioFileSourceMMAP.h"
+
+AudioFileSourceMMAP::AudioFileSourceMMAP()
+{
+  opened = false;
+  map = NULL;
+  size = 0;
+  pos = 0;
+}
+
+AudioFileSourceMMAP::AudioFileSourceMMAP(const char *filename)
+{
+  opened = false;
+  map = NULL;
+  size = 0;
+  pos = 0;
+  open(filename);
+}
+
+AudioFileSourceMMAP::~AudioFileSourceMMAP()
+{
+  if (opened) close();
+}
+
+bool AudioFileSourceMMAP::open(const char *filename)
+{
+  if (opened) close();
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if ((fstat(fd, &st) < 0) || (st.st_size > 0xffffffffLL)) {
+    ::close(fd);
+    return false;
+  }
+  size = st.st_size;
+  if (size) {
+    void *m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+      ::close(fd);
+      size = 0;
+      return false;
+    }
+    // Decoders walk the file front to back, so let the kernel read ahead aggressively
+    madvise(m, size, MADV_SEQUENTIAL);
+    madvise(m, size, MADV_WILLNEED);
+    map = reinterpret_cast<const uint8_t*>(m);
+  }
+  ::close(fd); // The mapping holds its own reference to the file
+  pos = 0;
+  opened = true;
+  return true;
+}
+
+bool AudioFileSourceMMAP::close()
+{
+  if (map) munmap(const_cast<uint8_t*>(map), size);
+  opened = false;
+  map = NULL;
+  size = 0;
+  pos = 0;
+  return true;
+}
+
+uint32_t AudioFileSourceMMAP::read(void *data, uint32_t len)
+{
+  if (!opened || (pos >= size)) return 0;
+  uint32_t toRead = size - pos;
+  if (toRead > len) toRead = len;
+  memcpy(data, map + pos, toRead);
+  pos += toRead;
+  return toRead;
+}
+
+bool AudioFileSourceMMAP::seek(int32_t offset, int dir)
+{
+  if (!opened) return false;
+  int64_t newPos;
+  switch (dir) {
+    case SEEK_SET: newPos = offset; break;
+    case SEEK_CUR: newPos = (int64_t)pos + offset; break;
+    case SEEK_END: newPos = (int64_t)size + offset; break;
+    default: return false;
+  }
+  if ((newPos < 0) || (newPos > size)) return false;
+  pos = newPos;
+  return true;
+}
+
+const uint8_t *AudioFileSourceMMAP::acquire(uint32_t len, uint32_t *avail)
+{
+  *avail = 0;
+  if (!opened || (pos >= size)) return NULL;
+  uint32_t left = size - pos;
+  *avail = (len < left) ? len : left;
+  return map + pos;
+}
+
+void AudioFileSourceMMAP::release(uint32_t len)
+{
+  if (!opened) return;
+  uint32_t left = size - pos;
+  pos += (len < left) ? len : left;
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+  AudioFileSourceMMAP
+  Input file mapped into memory, to be used by AudioGenerator
+  Only for host-based testing, not Arduino
+  
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUDIOFILESOURCEMMAP_H
+#define _AUDIOFILESOURCEMMAP_H
+
+#include <Arduino.h>
+
+#ifndef ARDUINO
+
+#include "AudioFileSource.h"
+
+// Drop-in for AudioFileSourceSTDIO that maps the whole file read-only, so reads are plain
+// memcpy()s and acquire() can lend the decoders the mapping itself
+class AudioFileSourceMMAP : public AudioFileSource
+{
+  public:
+    AudioFileSourceMMAP();
+    AudioFileSourceMMAP(const char *filename);
+    virtual ~AudioFileSourceMMAP() override;
+    
+    virtual bool open(const char *filename) override;
+    virtual uint32_t read(void *data, uint32_t len) override;
+    virtual bool seek(int32_t pos, int dir) override;
+    virtual bool close() override;
+    virtual bool isOpen() override { return opened; };
+    virtual uint32_t getSize() override { return opened ? size : 0; };
+    virtual uint32_t getPos() override { return opened ? pos : 0; };
+    virtual bool isSeekCheap() override { return true; };
+    virtual const uint8_t *acquire(uint32_t len, uint32_t *avail) override;
+    virtual void release(uint32_t len) override;
+
+  private:
+    bool opened;
+    const uint8_t *map; // NULL for an empty file, which can't be mapped
+    uint32_t size;
+    uint32_t pos;
+};
+
+#endif // !ARDUINO
+
+#endif
+
@@ -96,4 +96,24 @@ uint32_t AudioFileSourcePROGMEM::read(void *data, uint32_t len)
   return toRead;
 }
 
+const uint8_t *AudioFileSourcePROGMEM::acquire(uint32_t len, uint32_t *avail)
+{
+  *avail = 0;
+#ifdef ESP8266
+  // Flash here can only be read a 32-bit word at a time, which decoders poking at bytes won't do
+  (void)len;
+  return NULL;
+#else
+  if (!opened) return NULL;
+  uint32_t left = progmemLen - filePointer;
+  *avail = (len < left) ? len : left;
+  return reinterpret_cast<const uint8_t*>(progmemData) + filePointer;
+#endif
+}
 
+void AudioFileSourcePROGMEM::release(uint32_t len)
+{
+  if (!opened) return;
+  uint32_t left = progmemLen - filePointer;
+  filePointer += (len < left) ? len : left;
+}
@@ -35,6 +35,9 @@ class AudioFileSourcePROGMEM : public AudioFileSource
     virtual bool isOpen() override;
     virtual uint32_t getSize() override;
     virtual uint32_t getPos() override { if (!opened) return 0; else return filePointer; };
+    virtual bool isSeekCheap() override { return true; };
+    virtual const uint8_t *acquire(uint32_t len, uint32_t *avail) override;
+    virtual void release(uint32_t len) override;
 
     bool open(const void *data, uint32_t len);
 
@@ -40,6 +40,7 @@ class AudioFileSourceSPIFFS : public AudioFileSource
     virtual bool isOpen() override;
     virtual uint32_t getSize() override;
     virtual uint32_t getPos() override { if (!f) return 0; else return f.position(); };
+    virtual bool isSeekCheap() override { return true; };
 
   private:
     fs::File f;
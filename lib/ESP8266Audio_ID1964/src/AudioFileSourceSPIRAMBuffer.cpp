@@ -21,34 +21,70 @@
 
 #include <Arduino.h>
 #include "AudioFileSourceSPIRAMBuffer.h"
+#ifdef ARDUINO
+#include <SPI.h>
+#include <ESP8266Spiram.h> // https://github.com/Gianbacchio/ESP8266_Spiram
+#endif
 
 #pragma GCC optimize ("O3")
 
+#ifdef ARDUINO
+class AudioSPIRAMDriverESP8266 : public AudioSPIRAMDriver
+{
+  public:
+    AudioSPIRAMDriverESP8266(uint8_t csPin) : spiram(csPin, 40e6) { spiram.begin(); spiram.setSeqMode(); }
+    virtual void read(uint32_t addr, uint8_t *data, uint32_t len) override { spiram.read(addr, data, len); }
+    virtual void write(uint32_t addr, const uint8_t *data, uint32_t len) override { spiram.write(addr, const_cast<uint8_t*>(data), len); }
+
+  private:
+    ESP8266Spiram spiram;
+};
+
 AudioFileSourceSPIRAMBuffer::AudioFileSourceSPIRAMBuffer(AudioFileSource *source, uint8_t csPin, uint32_t buffSizeBytes)
 {
-  Spiram = new ESP8266Spiram(csPin, 40e6);
-  Spiram->begin();
-  Spiram->setSeqMode();
-  ramSize = buffSizeBytes;
-  writePtr = 0;
-  readPtr = 0;
+  init(source, new AudioSPIRAMDriverESP8266(csPin), buffSizeBytes);
+  ownRam = true;
+  Serial.printf_P(PSTR("SPI RAM buffer size: %u Bytes\n"), ramSize);
+}
+#endif
+
+AudioFileSourceSPIRAMBuffer::AudioFileSourceSPIRAMBuffer(AudioFileSource *source, AudioSPIRAMDriver *ramDriver, uint32_t buffSizeBytes)
+{
+  init(source, ramDriver, buffSizeBytes);
+  ownRam = false;
+}
+
+void AudioFileSourceSPIRAMBuffer::init(AudioFileSource *source, AudioSPIRAMDriver *ramDriver, uint32_t buffSizeBytes)
+{
   src = source;
-  length = 0;
+  ram = ramDriver;
+  ramSize = buffSizeBytes;
+  ramRd = 0;
+  ramWr = 0;
+  ramUsed = 0;
+  prefill = 0;
   filled = false;
-  bytesAvailable = 0;
-  Serial.printf_P(PSTR("SPI RAM buffer size: %u Bytes\n"), ramSize);
+  rdPos = 0;
+  rdLen = 0;
+  wrPos = 0;
+  wrLen = 0;
 }
 
 AudioFileSourceSPIRAMBuffer::~AudioFileSourceSPIRAMBuffer()
 {
+  if (ownRam) delete ram;
+  ram = NULL;
 }
 
 bool AudioFileSourceSPIRAMBuffer::seek(int32_t pos, int dir)
 {
   // Invalidate
-  readPtr = 0;
-  writePtr = 0;
-  length = 0;
+  ramRd = 0;
+  ramWr = 0;
+  ramUsed = 0;
+  rdPos = rdLen = 0;
+  wrPos = wrLen = 0;
+  filled = false;
   return src->seek(pos, dir);
 }
 
@@ -69,83 +105,129 @@ uint32_t AudioFileSourceSPIRAMBuffer::getSize()
 
 uint32_t AudioFileSourceSPIRAMBuffer::getPos()
 {
-  return src->getPos();
+  // The source is ahead of the reader by whatever is sitting in here
+  return src->getPos() - getFillLevel();
+}
+
+// Moves what wrBuf has gathered to the end of the RAM ring, as much as fits
+void AudioFileSourceSPIRAMBuffer::flush()
+{
+  uint32_t len = wrLen - wrPos;
+  if (len > ramSize - ramUsed) len = ramSize - ramUsed;
+  if (!len) return;
+  uint32_t toEnd = ramSize - ramWr;
+  if (len <= toEnd) {
+    ram->write(ramWr, wrBuf + wrPos, len);
+  } else {
+    ram->write(ramWr, wrBuf + wrPos, toEnd);
+    ram->write(0, wrBuf + wrPos + toEnd, len - toEnd);
+  }
+  ramWr = (ramWr + len) % ramSize;
+  ramUsed += len;
+  wrPos += len;
+  if (wrPos == wrLen) wrPos = wrLen = 0;
+#ifdef SPIBUF_DEBUG
+  Serial.printf_P(PSTR("RamWrite: %u | RamAvail: %u\n"), len, ramUsed);
+#endif
+}
+
+// Takes len (no more than ramUsed) bytes from the front of the RAM ring
+void AudioFileSourceSPIRAMBuffer::ramRead(uint8_t *data, uint32_t len)
+{
+  uint32_t toEnd = ramSize - ramRd;
+  if (len <= toEnd) {
+    ram->read(ramRd, data, len);
+  } else {
+    ram->read(ramRd, data, toEnd);
+    ram->read(0, data + toEnd, len - toEnd);
+  }
+  ramRd = (ramRd + len) % ramSize;
+  ramUsed -= len;
 }
 
 uint32_t AudioFileSourceSPIRAMBuffer::read(void *data, uint32_t len)
 {
-  uint32_t bytes = 0;
-  // Check if the buffer isn't empty, otherwise we try to fill completely
   if (!filled) {
-    uint8_t buffer[256];
-    writePtr = readPtr = 0;
-    uint16_t toRead = sizeof(buffer);
-    // Fill up completely before returning any data at all
-    Serial.printf_P(PSTR("Buffering...\n"));
-    while (bytesAvailable!=ramSize) {
-      length = src->read(buffer, toRead);
-      if(length>0) {
-        Spiram->write(writePtr, buffer, length);
-        bytesAvailable+=length;
-        writePtr = bytesAvailable % ramSize;
-        if ((ramSize-bytesAvailable)<toRead) {
-          toRead=ramSize-bytesAvailable;
-        }
-      } else {
-        // EOF, break out of read loop
-        break;
+    // Gather up to the prefill point (or the whole RAM) before returning any data at all
+    cb.st(STATUS_FILLING, PSTR("Buffering"));
+    uint32_t want = (prefill && (prefill < ramSize)) ? prefill : ramSize;
+    while (getFillLevel() < want) {
+      if (wrPos) {
+        memmove(wrBuf, wrBuf + wrPos, wrLen - wrPos);
+        wrLen -= wrPos;
+        wrPos = 0;
+      }
+      uint32_t cnt = src->read(wrBuf + wrLen, burstBytes - wrLen);
+      if (!cnt) break; // EOF
+      wrLen += cnt;
+      if (wrLen == burstBytes) {
+        flush();
+        if (wrLen == burstBytes) break; // RAM's full
       }
     }
-    writePtr = bytesAvailable % ramSize;
     filled = true;
-    Serial.printf_P(PSTR("Filling Done !\n"));
   }
 
-//  Serial.printf("Buffer: %u%\n", bytesAvailable*100/ramSize);
-
   uint8_t *ptr = reinterpret_cast<uint8_t*>(data);
-  uint32_t toReadFromBuffer = (len < bytesAvailable) ? len : bytesAvailable;
-  if (toReadFromBuffer>0) {
-     // Pull from buffer until we've got none left or we've satisfied the request
-    Spiram->read(readPtr, ptr, toReadFromBuffer);
-    readPtr = (readPtr+toReadFromBuffer) % ramSize;
-    bytes = toReadFromBuffer;
-    bytesAvailable-=toReadFromBuffer;
-    len-=toReadFromBuffer;
-    ptr += toReadFromBuffer;
+  uint32_t bytes = 0;
+  while (len) {
+    uint32_t cnt;
+    if (rdPos < rdLen) {
+      cnt = (len < rdLen - rdPos) ? len : rdLen - rdPos;
+      memcpy(ptr, rdBuf + rdPos, cnt);
+      rdPos += cnt;
+    } else if (ramUsed) {
+      if (len >= burstBytes) {
+        // Big enough to go straight from the chip to the caller as its own burst
+        cnt = (len < ramUsed) ? len : ramUsed;
+        ramRead(ptr, cnt);
+      } else {
+        rdLen = (burstBytes < ramUsed) ? burstBytes : ramUsed;
+        rdPos = 0;
+        ramRead(rdBuf, rdLen);
+        continue;
+      }
+    } else if (wrPos < wrLen) {
+      // Nothing's made it out to the chip yet, so take it from the staging buffer directly
+      cnt = (len < wrLen - wrPos) ? len : wrLen - wrPos;
+      memcpy(ptr, wrBuf + wrPos, cnt);
+      wrPos += cnt;
+      if (wrPos == wrLen) wrPos = wrLen = 0;
+    } else {
+      break;
+    }
+    ptr += cnt;
+    bytes += cnt;
+    len -= cnt;
   }
 
   // If len>O there is no data left in buffer and we try to read more directly from source.
-  // Then, we trigger a complete buffer refill
+  // Then, we trigger a buffer refill
   if (len) {
     bytes += src->read(ptr, len);
-    bytesAvailable = 0;
     filled = false;
+    cb.st(STATUS_UNDERFLOW, PSTR("Buffer underflow"));
   }
   return bytes;
 }
 
 void AudioFileSourceSPIRAMBuffer::fill()
 {
-  // Make sure the buffer is pre-filled before make partial fill.
-  if (!filled) return;
-
-  // Now trying to refill SPI RAM Buffer
-  uint8_t buffer[128];
-  // Make sure there is at least buffer size free in RAM
-  if ((ramSize - bytesAvailable)<sizeof(buffer)) {
-	return;
+  // Top up the staging buffer with whatever the source has ready, and once it holds a whole
+  // burst move it out to the chip.  At most one burst per call keeps loop() short.
+  if (wrPos) {
+    memmove(wrBuf, wrBuf + wrPos, wrLen - wrPos);
+    wrLen -= wrPos;
+    wrPos = 0;
   }
-  uint16_t cnt = src->readNonBlock(buffer, sizeof(buffer));
-  if (cnt) {
-    Spiram->write(writePtr, buffer, cnt);
-    bytesAvailable+=cnt;
-    writePtr = (writePtr + cnt) % ramSize;
+  if (wrLen < burstBytes) {
+    uint32_t cnt = src->readNonBlock(wrBuf + wrLen, burstBytes - wrLen);
+    wrLen += cnt;
 #ifdef SPIBUF_DEBUG
-    Serial.printf_P(PSTR("SockRead: %u | RamAvail: %u\n"), cnt, bytesAvailable);
+    if (cnt) Serial.printf_P(PSTR("SockRead: %u | RamAvail: %u\n"), cnt, ramUsed);
 #endif
   }
-  return;
+  if (wrLen == burstBytes) flush();
 }
 
 bool AudioFileSourceSPIRAMBuffer::loop()
@@ -23,15 +23,26 @@
 #define _AUDIOFILESOURCESPIRAMBUFFER_H
 
 #include "AudioFileSource.h"
-#include <SPI.h>
-#include <ESP8266Spiram.h> // https://github.com/Gianbacchio/ESP8266_Spiram
 
 // #define SPIBUF_DEBUG
 
+// What the buffer needs from the RAM chip.  The default one drives a 23LC1024 through
+// ESP8266Spiram, host tests can hand in a fake to count transactions and check the data.
+class AudioSPIRAMDriver
+{
+  public:
+    virtual ~AudioSPIRAMDriver() {}
+    virtual void read(uint32_t addr, uint8_t *data, uint32_t len) = 0;
+    virtual void write(uint32_t addr, const uint8_t *data, uint32_t len) = 0;
+};
+
 class AudioFileSourceSPIRAMBuffer : public AudioFileSource
 {
   public:
+#ifdef ARDUINO
     AudioFileSourceSPIRAMBuffer(AudioFileSource *in, uint8_t csPin, uint32_t bufferBytes);
+#endif
+    AudioFileSourceSPIRAMBuffer(AudioFileSource *in, AudioSPIRAMDriver *ram, uint32_t bufferBytes); // Driver stays the app's
     virtual ~AudioFileSourceSPIRAMBuffer() override;
 
     virtual uint32_t read(void *data, uint32_t len) override;
@@ -42,18 +53,41 @@ class AudioFileSourceSPIRAMBuffer : public AudioFileSource
     virtual uint32_t getPos() override;
     virtual bool loop() override;
 
+    // Start (and restart after running dry) once this much is buffered, rather than the whole RAM
+    void SetPrefill(uint32_t bytes) { prefill = bytes; }
+    uint32_t getFillLevel() const { return (rdLen - rdPos) + ramUsed + (wrLen - wrPos); }
+
+    enum { STATUS_FILLING=2, STATUS_UNDERFLOW };
+
   private:
     virtual void fill();
+    void init(AudioFileSource *in, AudioSPIRAMDriver *ram, uint32_t bufferBytes);
+    void flush();
+    void ramRead(uint8_t *data, uint32_t len);
 
   private:
+    // Data moves to and from the chip in bursts of this size, going through two staging buffers:
+    // wrBuf gathers what the source delivers until there's a whole burst to write, and rdBuf
+    // holds a burst read ahead for the decoder's many small reads.  In order, the stream is
+    // rdBuf, then the RAM ring, then wrBuf.
+    static const uint32_t burstBytes = 512;
+
     AudioFileSource *src;
-    ESP8266Spiram *Spiram;
+    AudioSPIRAMDriver *ram;
+    bool ownRam;
     uint32_t ramSize;
-    uint32_t writePtr;
-    uint32_t readPtr;
-    uint16_t length;
-    uint32_t bytesAvailable;
+    uint32_t ramRd;
+    uint32_t ramWr;
+    uint32_t ramUsed;
+    uint32_t prefill;
     bool filled;
+
+    uint8_t rdBuf[burstBytes];
+    uint32_t rdPos;
+    uint32_t rdLen;
+    uint8_t wrBuf[burstBytes];
+    uint32_t wrPos;
+    uint32_t wrLen;
 };
 
 
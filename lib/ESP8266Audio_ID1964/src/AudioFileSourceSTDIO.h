@@ -42,6 +42,7 @@ class AudioFileSourceSTDIO : public AudioFileSource
     virtual bool isOpen() override;
     virtual uint32_t getSize() override;
     virtual uint32_t getPos() override { if (!f) return 0; else return (uint32_t)ftell(f); };
+    virtual bool isSeekCheap() override { return true; };
 
   private:
     FILE *f;
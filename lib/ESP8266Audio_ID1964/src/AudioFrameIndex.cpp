@@ -0,0 +1,167 @@
+/*
+  AudioFrameIndex
+  Sparse byte offset index of the frames in an MPEG audio or ADTS AAC stream
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AudioFrameIndex.h"
+#include "AudioSyncScan.h"
+
+void AudioFrameIndex::ResetIndex()
+{
+  src = NULL;
+  frames = 0;
+  usedSlots = 0;
+  stride = 1;
+  scanFrame = 0;
+  scanPos = 0;
+  scanDone = false;
+}
+
+void AudioFrameIndex::StartIndex(AudioFileSource *source, uint32_t firstFrame)
+{
+  src = source;
+  scanPos = firstFrame;
+}
+
+void AudioFrameIndex::AddSlot(uint32_t frame, uint32_t offset)
+{
+  if (frame % stride) return;
+  if (usedSlots == indexSlots) {
+    // Full, so keep every other entry and space them twice as far apart from here on
+    for (int i = 0; i < indexSlots / 2; i++) slots[i] = slots[i * 2];
+    usedSlots = indexSlots / 2;
+    stride *= 2;
+    if (frame % stride) return;
+  }
+  slots[usedSlots++] = offset;
+}
+
+int AudioFrameIndex::FrameBytesAt(uint32_t pos)
+{
+  uint8_t hdr[maxHdrBytes];
+  if (!src->seek(pos, SEEK_SET) || (src->read(hdr, hdrBytes) != (uint32_t)hdrBytes)) return -1;
+  return HeaderFrameBytes(hdr);
+}
+
+bool AudioFrameIndex::Resync(uint32_t *pos)
+{
+  uint8_t buff[64];
+  uint32_t p = *pos + 1;
+  while (p < *pos + resyncLimit) {
+    if (!src->seek(p, SEEK_SET)) return false;
+    int n = src->read(buff, sizeof(buff));
+    if (n < 4) return false;
+    for (int i = 0; ; i++) {
+      int off = AudioSyncFind(buff + i, n - i, syncMask);
+      if (off < 0) break;
+      i += off;
+      // Trust it only if there's another frame right behind it
+      int len = FrameBytesAt(p + i);
+      if ((len > 0) && (FrameBytesAt(p + i + len) > 0)) {
+        *pos = p + i;
+        return true;
+      }
+    }
+    p += n - 1; // Last byte could be the first half of a sync word
+  }
+  return false;
+}
+
+bool AudioFrameIndex::Scan(uint32_t toFrame)
+{
+  while (!scanDone && (scanFrame <= toFrame)) {
+    int len = FrameBytesAt(scanPos);
+    if ((len <= 0) && Resync(&scanPos)) len = FrameBytesAt(scanPos);
+    if (len <= 0) {
+      // Out of frames (or ones whose length can't be told, which can't be indexed)
+      scanDone = true;
+      if (!frames) frames = scanFrame;
+      break;
+    }
+    AddSlot(scanFrame, scanPos);
+    scanPos += len;
+    scanFrame++;
+  }
+  return (toFrame < scanFrame) || (usedSlots && scanDone && (toFrame < frames));
+}
+
+uint32_t AudioFrameIndex::FrameOffset(uint32_t frame)
+{
+  int i = frame / stride;
+  if (i >= usedSlots) i = usedSlots - 1;
+  uint32_t pos = slots[i];
+  for (uint32_t f = i * stride; f < frame; f++) {
+    int len = FrameBytesAt(pos);
+    if (len <= 0) break; // Junk in the way, or an approximate table entry.  Close enough, the decoder will resync
+    pos += len;
+  }
+  return pos;
+}
+
+uint32_t AudioFrameIndex::CountFrames()
+{
+  if (!frames && src && !scanDone) {
+    uint32_t saved = src->getPos();
+    Scan(0xffffffff);
+    src->seek(saved, SEEK_SET);
+  }
+  return frames;
+}
+
+
+void AudioADTSIndex::reset()
+{
+  ResetIndex();
+  memset(firstHdr, 0, sizeof(firstHdr));
+  sampleRate = 0;
+  frameSamples = 0;
+}
+
+bool AudioADTSIndex::begin(AudioFileSource *source, const uint8_t *hdr, uint32_t offset)
+{
+  reset();
+  if (AudioSyncADTSFrameBytes(hdr) <= 0) return false;
+  memcpy(firstHdr, hdr, sizeof(firstHdr));
+  sampleRate = AudioSyncADTSSampleRate(hdr);
+  frameSamples = AudioSyncADTSFrameSamples(hdr);
+  StartIndex(source, offset);
+  return true;
+}
+
+int AudioADTSIndex::HeaderFrameBytes(const uint8_t *hdr)
+{
+  // Must match the stream's version, profile and sample rate, too
+  if (((hdr[1] ^ firstHdr[1]) & 0x08) || ((hdr[2] ^ firstHdr[2]) & 0xfc)) return -1;
+  return AudioSyncADTSFrameBytes(hdr);
+}
+
+bool AudioADTSIndex::locate(uint32_t ms, int preroll, uint32_t *offset, uint32_t *frame, uint32_t *skip)
+{
+  if (!isValid() || !src) return false;
+  uint32_t target = ((uint64_t)ms * sampleRate) / 1000 / frameSamples;
+  uint32_t start = (target > (uint32_t)preroll) ? target - preroll : 0;
+  uint32_t saved = src->getPos();
+  bool ok = Scan(target);
+  if (ok) {
+    *offset = FrameOffset(start);
+    *frame = target;
+    *skip = target - start;
+  }
+  src->seek(saved, SEEK_SET);
+  return ok;
+}
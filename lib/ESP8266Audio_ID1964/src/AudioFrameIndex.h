@@ -0,0 +1,98 @@
+/*
+  AudioFrameIndex
+  Sparse byte offset index of the frames in an MPEG audio or ADTS AAC stream
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUDIOFRAMEINDEX_H
+#define _AUDIOFRAMEINDEX_H
+
+#include <Arduino.h>
+#include "AudioFileSource.h"
+
+// Finds frames by hopping from header to header without decoding anything, remembering
+// where every stride'th one starts.  Filled in only as far as a seek or duration request
+// needs, and when it fills up every other entry is dropped so it stays the same size
+// however long the file is.  Subclasses say how long the frame behind a header is.
+class AudioFrameIndex
+{
+  public:
+    AudioFrameIndex(int hdrBytes, uint8_t syncMask) : hdrBytes(hdrBytes), syncMask(syncMask) { ResetIndex(); }
+    virtual ~AudioFrameIndex() {}
+
+  protected:
+    static const int indexSlots = 64;
+    static const int maxHdrBytes = 8;
+    static const int resyncLimit = 4096;
+
+    // Length of the frame behind hdr, 0 if it can't be told and -1 if it isn't a header of this stream
+    virtual int HeaderFrameBytes(const uint8_t *hdr) = 0;
+
+    void ResetIndex();
+    void StartIndex(AudioFileSource *source, uint32_t firstFrame);
+    void AddSlot(uint32_t frame, uint32_t offset);
+    int FrameBytesAt(uint32_t pos);
+    bool Resync(uint32_t *pos);
+    bool Scan(uint32_t toFrame);
+    uint32_t FrameOffset(uint32_t frame);
+    uint32_t CountFrames(); // Scans to the end, if needed, preserving the source position
+
+    AudioFileSource *src;
+    uint32_t frames; // 0 until something (a tag or a complete scan) says
+
+    // slots[i] is the offset of audio frame i * stride
+    uint32_t slots[indexSlots];
+    int usedSlots;
+    uint32_t stride;
+    uint32_t scanFrame; // Next frame whose header the scan will read...
+    uint32_t scanPos;   // ...and where it's expected to be
+    bool scanDone;
+
+  private:
+    int hdrBytes;
+    uint8_t syncMask;
+};
+
+// ADTS AAC streams have no tags, so everything comes from the scan
+class AudioADTSIndex : public AudioFrameIndex
+{
+  public:
+    AudioADTSIndex() : AudioFrameIndex(7, 0xf0) { reset(); }
+    void reset();
+
+    // Start from the header of the first frame, found at byte offset in src
+    bool begin(AudioFileSource *src, const uint8_t *hdr, uint32_t offset);
+    bool isValid() const { return sampleRate != 0; }
+
+    uint32_t getSampleRate() const { return sampleRate; }
+    uint32_t getFrameSamples() const { return frameSamples; }
+    uint32_t getDurationMs() { return isValid() ? ((uint64_t)CountFrames() * frameSamples * 1000) / sampleRate : 0; }
+
+    // How to restart playback at ms: the byte offset to seek to, the number of the frame that will
+    // be playing, and how many frames ahead of it to decode and drop so the decoder's overlap is primed
+    bool locate(uint32_t ms, int preroll, uint32_t *offset, uint32_t *frame, uint32_t *skip);
+
+  protected:
+    virtual int HeaderFrameBytes(const uint8_t *hdr) override;
+
+    uint8_t firstHdr[7];
+    uint32_t sampleRate;
+    uint32_t frameSamples;
+};
+
+#endif
+
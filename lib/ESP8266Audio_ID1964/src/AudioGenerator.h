@@ -29,16 +29,37 @@
 class AudioGenerator
 {
   public:
-    AudioGenerator() { lastSample[0] = 0; lastSample[1] = 0; };
+    AudioGenerator() { lastSample[0] = 0; lastSample[1] = 0; preallocateSpace = NULL; preallocateSize = 0; budgetUsec = 0; budgetSamples = 0; ResetLoopStats(); };
     virtual ~AudioGenerator() {};
     virtual bool begin(AudioFileSource *source, AudioOutput *output) { (void)source; (void)output; return false; };
     virtual bool loop() { return false; };
     virtual bool stop() { return false; };
     virtual bool isRunning() { return false;};
 
+    // Jump to ms from the start and report the current position in ms.  Each format lands as
+    // close as it can without decoding what it skips (see its header), and generators that
+    // can't seek at all return false.
+    virtual bool seekTo(uint32_t ms) { (void)ms; return false; };
+    virtual uint32_t tell() { return 0; };
+
   public:
     virtual bool RegisterMetadataCB(AudioStatus::metadataCBFn fn, void *data) { return cb.RegisterMetadataCB(fn, data); }
     virtual bool RegisterStatusCB(AudioStatus::statusCBFn fn, void *data) { return cb.RegisterStatusCB(fn, data); }
+    virtual bool RegisterReportCB(AudioStatus::reportCBFn fn, void *data) { return cb.RegisterReportCB(fn, data); }
+    void SetStatusRateLimit(uint32_t ms) { cb.SetRateLimit(ms); }
+    uint32_t GetStatusCount(int code) const { return cb.GetCount(code); }
+
+    // Optional cap on the work one loop() call may do, so a long decode can't starve WiFi
+    // and the rest of the sketch.  Only checked at frame/block boundaries, so a call can
+    // overrun by up to one frame.  A value of 0 disables that limit (the default).
+    void SetLoopBudget(uint32_t usec, uint32_t samples = 0) { budgetUsec = usec; budgetSamples = samples; }
+    typedef struct {
+      uint32_t calls;      // loop() calls made while running
+      uint32_t budgetHits; // ...which returned because the budget ran out
+      uint32_t outputFull; // ...which returned because the output refused a sample
+    } LoopStats;
+    const LoopStats &GetLoopStats() const { return loopStats; }
+    void ResetLoopStats() { loopStats.calls = 0; loopStats.budgetHits = 0; loopStats.outputFull = 0; }
 
   protected:
     bool running;
@@ -46,6 +67,40 @@ class AudioGenerator
     AudioOutput *output;
     int16_t lastSample[2];
 
+    // Optional caller-supplied block every large allocation is carved from instead of the heap.
+    // Each generator has a static preAllocSize() reporting how much it needs.
+    void *preallocateSpace;
+    int preallocateSize;
+
+    // Budget helpers for loop(): BudgetStart() on entry, BudgetSpend() as each frame/block
+    // is produced, and BudgetExhausted() at each boundary to decide whether to return early
+    void BudgetStart() { loopStats.calls++; loopSamples = 0; if (budgetUsec) loopStartUsec = micros(); }
+    void BudgetSpend(uint32_t samples) { loopSamples += samples; }
+    bool BudgetExhausted() {
+      if ((budgetSamples && (loopSamples >= budgetSamples)) || (budgetUsec && ((uint32_t)(micros() - loopStartUsec) >= budgetUsec))) {
+        loopStats.budgetHits++;
+        return true;
+      }
+      return false;
+    }
+    bool SendSample(int16_t sample[2]) {
+      if (output->ConsumeSample(sample)) return true;
+      loopStats.outputFull++;
+      return false;
+    }
+    uint16_t SendSamples(int16_t *samples, uint16_t count) {
+      uint16_t sent = output->ConsumeSamples(samples, count);
+      if (sent < count) loopStats.outputFull++;
+      return sent;
+    }
+
+  private:
+    uint32_t budgetUsec;
+    uint32_t budgetSamples;
+    uint32_t loopStartUsec;
+    uint32_t loopSamples;
+    LoopStats loopStats;
+
   protected:
     AudioStatus cb;
 };
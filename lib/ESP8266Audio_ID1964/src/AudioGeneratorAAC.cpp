@@ -21,6 +21,7 @@
 #pragma GCC optimize ("O3")
 
 #include "AudioGeneratorAAC.h"
+#include "AudioSyncScan.h"
 
 AudioGeneratorAAC::AudioGeneratorAAC()
 {
@@ -31,9 +32,10 @@ AudioGeneratorAAC::AudioGeneratorAAC()
   file = NULL;
   output = NULL;
 
-  buff = (uint8_t*)malloc(buffLen);
+  // No input buffer, the window only allocates one if the source can't lend its data
+  buff = NULL;
   outSample = (int16_t*)malloc(1024 * 2 * sizeof(uint16_t));
-  if (!buff || !outSample) {
+  if (!outSample) {
     Serial.printf_P(PSTR("ERROR: Out of memory in AAC\n"));
     Serial.flush();
   }
@@ -44,12 +46,14 @@ AudioGeneratorAAC::AudioGeneratorAAC()
     Serial.flush();
   }
 
-  buffValid = 0;
-  lastFrameEnd = 0;
+  input.begin(buff, buffLen);
   validSamples = 0;
   curSample = 0;
   lastRate = 0;
   lastChannels = 0;
+  memset(&syncStats, 0, sizeof(syncStats));
+  frameNum = 0;
+  skipFrames = 0;
 }
 
 AudioGeneratorAAC::AudioGeneratorAAC(void *preallocateData, int preallocateSz)
@@ -77,12 +81,14 @@ AudioGeneratorAAC::AudioGeneratorAAC(void *preallocateData, int preallocateSz)
     Serial.printf_P(PSTR("Out of memory error! hAACDecoder==NULL\n"));
     Serial.flush();
   }
-  buffValid = 0;
-  lastFrameEnd = 0;
+  input.begin(buff, buffLen);
   validSamples = 0;
   curSample = 0;
   lastRate = 0;
   lastChannels = 0;
+  memset(&syncStats, 0, sizeof(syncStats));
+  frameNum = 0;
+  skipFrames = 0;
 }
 
 
@@ -91,7 +97,7 @@ AudioGeneratorAAC::~AudioGeneratorAAC()
 {
   if (!preallocateSpace) {
     AACFreeDecoder(hAACDecoder);
-    free(buff);
+    input.end();
     free(outSample);
   }
 }
@@ -110,62 +116,61 @@ bool AudioGeneratorAAC::isRunning()
 
 bool AudioGeneratorAAC::FillBufferWithValidFrame()
 {
-  buff[0] = 0; // Destroy any existing sync word @ 0
-  int nextSync;
-  do {
-    nextSync = AACFindSyncWord(buff + lastFrameEnd, buffValid - lastFrameEnd);
-    if (nextSync >= 0) nextSync += lastFrameEnd;
-    lastFrameEnd = 0;
-    if (nextSync == -1) {
-      if (buffValid && buff[buffValid-1]==0xff) { // Could be 1st half of syncword, preserve it...
-        buff[0] = 0xff;
-        buffValid = file->read(buff+1, buffLen-1);
-        if (buffValid==0) return false; // No data available, EOF
-      } else { // Try a whole new buffer
-        buffValid = file->read(buff, buffLen-1);
-        if (buffValid==0) return false; // No data available, EOF
-      }
+  while (true) {
+    // Short of that is either EOF or a stream with nothing more yet, loop() tells them apart
+    if (input.fill(file, 2) < 2) return false;
+    int nextSync = AudioSyncFindADTS(input.data(), input.available(), &syncStats);
+    if (nextSync >= 0) {
+      input.consume(nextSync); // Throw out prior to nextSync
+      break;
     }
-  } while (nextSync == -1);
-
-  // Move the frame to start at offset 0 in the buffer
-  buffValid -= nextSync; // Throw out prior to nextSync
-  memmove(buff, buff+nextSync, buffValid);
-
-  // We have a sync word at 0 now, try and fill remainder of buffer
-  buffValid += file->read(buff + buffValid, buffLen - buffValid);
+    if (input.isEOF()) return false;
+    // Could be 1st half of syncword in the last byte, preserve it...
+    input.consume(input.available() - ((input.data()[input.available() - 1] == 0xff) ? 1 : 0));
+  }
 
-  return true;
+  // We have a sync word at the start of the window now, make sure the whole frame is in it.
+  // ADTS headers carry the frame length, otherwise just get as much as will fit.
+  int want = input.getCapacity();
+  if (input.fill(file, 6) >= 6) {
+    int frameLen = AudioSyncADTSFrameBytes(input.data());
+    if (frameLen > 0) want = frameLen;
+  }
+  // Try again once the rest of the frame has arrived, unless it never will
+  return (input.fill(file, want) >= want) || input.isEOF();
 }
 
 bool AudioGeneratorAAC::loop()
 {
   if (!running) goto done; // Nothing to do here!
+  BudgetStart();
 
   // If we've got data, try and pump it out...
   while (validSamples) {
     lastSample[0] = outSample[curSample*2];
     lastSample[1] = outSample[curSample*2 + 1];
-    if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
+    if (!SendSample(lastSample)) goto done; // Can't send, but no error detected
     validSamples--;
     curSample++;
   }
 
-  // No samples available, need to decode a new frame
+  // No samples available, need to decode a new frame unless we're out of time for this call
+  if (BudgetExhausted()) goto done;
   if (FillBufferWithValidFrame()) {
-    // buff[0] start of frame, decode it...
-    unsigned char *inBuff = reinterpret_cast<unsigned char *>(buff);
-    int bytesLeft = buffValid;
+    if (!index.isValid() && (input.available() >= 7)) index.begin(file, input.data(), input.getPos(file));
+    // input.data() start of frame, decode it...
+    unsigned char *inBuff = input.data();
+    int bytesLeft = input.available();
     int ret = AACDecode(hAACDecoder, &inBuff, &bytesLeft, outSample);
     if (ret) {
       // Error, skip the frame...
-      char buff[48];
-      sprintf_P(buff, PSTR("AAC decode error %d"), ret);
-      cb.st(ret, buff);
+      cb.report(ret, input.getPos(file), PSTR("AAC decode error"));
+      input.consume(1);
     } else {
-      lastFrameEnd = buffValid - bytesLeft;
+      input.consume(input.available() - bytesLeft);
       AACFrameInfo fi;
       AACGetLastFrameInfo(hAACDecoder, &fi);
+      if (!fi.nChans) goto done; // Corrupt frame that decoded to nothing, skip it
       if ((int)fi.sampRateOut != (int)lastRate) {
         output->SetRate(fi.sampRateOut);
         lastRate = fi.sampRateOut;
@@ -176,9 +181,16 @@ bool AudioGeneratorAAC::loop()
       }
       curSample = 0;
       validSamples = fi.outputSamps / lastChannels;
+      BudgetSpend(validSamples);
+      frameNum++;
+      if (skipFrames) {
+        // Only here to prime the decoder after a seek
+        skipFrames--;
+        validSamples = 0;
+      }
     }
   } else {
-    running = false; // No more data, we're done here...
+    if (input.isEOF()) running = false; // No more data, we're done here...
   }
 
 done:
@@ -202,8 +214,12 @@ bool AudioGeneratorAAC::begin(AudioFileSource *source, AudioOutput *output)
   output->SetBitsPerSample(16);
  
 
-  memset(buff, 0, buffLen);
+  input.reset();
+  memset(&syncStats, 0, sizeof(syncStats));
   memset(outSample, 0, 1024*2*sizeof(int16_t));
+  index.reset();
+  frameNum = 0;
+  skipFrames = 0;
 
  
   running = true;
@@ -211,4 +227,27 @@ bool AudioGeneratorAAC::begin(AudioFileSource *source, AudioOutput *output)
   return true;
 }
 
+bool AudioGeneratorAAC::seekTo(uint32_t ms)
+{
+  uint32_t offset, frame, skip;
+  if (!running || !index.locate(ms, seekPreroll, &offset, &frame, &skip)) return false;
+  if (!file->seek(offset, SEEK_SET)) return false;
+
+  // Start over with an empty window and a clean decoder, the frames ahead of the target are decoded and dropped
+  AACFlushCodec(hAACDecoder);
+  input.reset();
+  validSamples = 0;
+  curSample = 0;
+  frameNum = frame - skip;
+  skipFrames = skip;
+  return true;
+}
+
+uint32_t AudioGeneratorAAC::tell()
+{
+  if (!index.isValid() || !lastRate) return 0;
+  uint64_t ms = ((uint64_t)(frameNum + skipFrames) * index.getFrameSamples() * 1000) / index.getSampleRate();
+  uint64_t pending = ((uint64_t)validSamples * 1000) / lastRate;
+  return (ms > pending) ? ms - pending : 0;
+}
 
@@ -22,6 +22,9 @@
 #define _AUDIOGENERATORAAC_H
 
 #include "AudioGenerator.h"
+#include "AudioInputWindow.h"
+#include "AudioSyncScan.h"
+#include "AudioFrameIndex.h"
 #include "libhelix-aac/aacdec.h"
 
 class AudioGeneratorAAC : public AudioGenerator
@@ -35,19 +38,28 @@ class AudioGeneratorAAC : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override;
 
-  protected:
-    void *preallocateSpace;
-    int preallocateSize;
+    // ADTS streams are seekable to the nearest frame (1024 samples) by hopping over the frame
+    // headers without decoding, which needs a seekable source and the first frame to have been seen
+    virtual bool seekTo(uint32_t ms) override;
+    virtual uint32_t tell() override;
+
+    // What the sync word scanner has been through since begin():  searches, bytes skipped looking and
+    // false syncs thrown out, a rough measure of how damaged or noisy the stream is
+    void GetSyncStats(AudioSyncStats *stats) { *stats = syncStats; }
+
+    // Bytes needed by the preallocate constructor
+    static int preAllocSize() { return ((buffLen + 7) & ~7) + ((1024 * 2 * sizeof(int16_t) + 7) & ~7) + AACInitDecoderPreSize(); }
 
+  protected:
     // Helix AAC decoder
     HAACDecoder hAACDecoder;
 
     // Input buffering
-    const int buffLen = 1600;
+    static const int buffLen = 1600;
     uint8_t *buff; //[1600]; // File buffer required to store at least a whole compressed frame
-    int16_t buffValid;
-    int16_t lastFrameEnd;
-    bool FillBufferWithValidFrame(); // Read until we get a valid syncword and min(feof, 2048) butes in the buffer
+    AudioInputWindow input;
+    AudioSyncStats syncStats;
+    bool FillBufferWithValidFrame(); // Read until input starts with a valid syncword and holds the whole frame
 
     // Output buffering
     int16_t *outSample; //[1024 * 2]; // Interleaved L/R
@@ -58,6 +70,12 @@ class AudioGeneratorAAC : public AudioGenerator
     unsigned int lastRate;
     int lastChannels;
 
+    // Seeking
+    static const int seekPreroll = 2;
+    AudioADTSIndex index;
+    uint32_t frameNum;   // Frames decoded since the start of the stream
+    uint32_t skipFrames; // Decoded frames still to drop after a seek
+
 };
 
 #endif
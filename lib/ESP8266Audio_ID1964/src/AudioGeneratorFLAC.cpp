@@ -20,6 +20,25 @@
 
 #include <AudioGeneratorFLAC.h>
 
+// The arena libflac's malloc/calloc/realloc/free (see libflac/share/alloc.h) draw from, NULL for the heap.
+// The hooks get no decoder to go on, so this only ever holds the arena of the decoder whose call is in
+// progress:  ArenaScope points it there on the way into libflac and puts back what was there on the
+// way out.  FreeRTOS tasks on the ESP32 each get their own, so decoders on different tasks can't meet.
+#ifdef ESP32
+static __thread AudioArena *flacArena = NULL;
+#else
+static AudioArena *flacArena = NULL;
+#endif
+
+class AudioGeneratorFLAC::ArenaScope
+{
+  public:
+    ArenaScope(AudioArena *arena) { prev = flacArena; flacArena = arena->isActive() ? arena : NULL; }
+    ~ArenaScope() { flacArena = prev; }
+  private:
+    AudioArena *prev;
+};
+
 AudioGeneratorFLAC::AudioGeneratorFLAC()
 {
   flac = NULL;
@@ -30,10 +49,18 @@ AudioGeneratorFLAC::AudioGeneratorFLAC()
   buff[1] = NULL;
   buffPtr = 0;
   buffLen = 0;
+  buffSample = 0;
+}
+
+AudioGeneratorFLAC::AudioGeneratorFLAC(void *space, int size) : AudioGeneratorFLAC()
+{
+  preallocateSpace = space;
+  preallocateSize = size;
 }
 
 AudioGeneratorFLAC::~AudioGeneratorFLAC()
 {
+  ArenaScope scope(&arena);
   if (flac)
     FLAC__stream_decoder_delete(flac);
   flac = NULL;
@@ -47,6 +74,10 @@ bool AudioGeneratorFLAC::begin(AudioFileSource *source, AudioOutput *output)
   this->output = output;
   if (!file->isOpen()) return false; // Error
 
+  // Any prior decoder has been deleted by stop(), so the whole arena is ours again
+  arena.begin(preallocateSpace, preallocateSize);
+  ArenaScope scope(&arena);
+
   flac = FLAC__stream_decoder_new();
   if (!flac) return false;
   
@@ -67,10 +98,12 @@ bool AudioGeneratorFLAC::begin(AudioFileSource *source, AudioOutput *output)
 bool AudioGeneratorFLAC::loop()
 {
   FLAC__bool ret;
+  ArenaScope scope(&arena);
 
   if (!running) goto done;
+  BudgetStart();
 
-  if (!output->ConsumeSample(lastSample)) goto done; // Try and send last buffered sample
+  if (!SendSample(lastSample)) goto done; // Try and send last buffered sample
 
   do {
     if (buffPtr == buffLen) {
@@ -90,6 +123,7 @@ bool AudioGeneratorFLAC::loop()
         if (newsr != sampleRate) output->SetRate(sampleRate = newsr);
         if (newch != channels) output->SetChannels(channels = newch);
         if (newbps != bitsPerSample) output->SetBitsPerSample( bitsPerSample = newbps);
+        BudgetSpend(buffLen);
       }
     }
 
@@ -111,7 +145,8 @@ bool AudioGeneratorFLAC::loop()
       else lastSample[AudioOutput::RIGHTCHANNEL] = lastSample[AudioOutput::LEFTCHANNEL];
     }
     buffPtr++;
-  } while (running && output->ConsumeSample(lastSample));
+    // Leave the sample pending if the next one needs a new frame and we're out of time
+  } while (running && !((buffPtr == buffLen) && BudgetExhausted()) && SendSample(lastSample));
 
 done:
   file->loop();
@@ -120,8 +155,30 @@ done:
   return running;
 }
 
+bool AudioGeneratorFLAC::seekTo(uint32_t ms)
+{
+  if (!running || !sampleRate) return false;
+  ArenaScope scope(&arena);
+  // On success the write callback has already been handed the frame, trimmed to start at the target
+  if (FLAC__stream_decoder_seek_absolute(flac, ((FLAC__uint64)ms * sampleRate) / 1000)) return true;
+  // A failed seek leaves the decoder lost in the middle of the file until it's told to look for a frame again
+  if (FLAC__stream_decoder_get_state(flac) == FLAC__STREAM_DECODER_SEEK_ERROR) {
+    FLAC__stream_decoder_flush(flac);
+    buffPtr = 0;
+    buffLen = 0;
+  }
+  return false;
+}
+
+uint32_t AudioGeneratorFLAC::tell()
+{
+  if (!running || !sampleRate) return 0;
+  return ((buffSample + buffPtr) * 1000) / sampleRate;
+}
+
 bool AudioGeneratorFLAC::stop()
 {
+  ArenaScope scope(&arena);
   if (flac)
     FLAC__stream_decoder_delete(flac);
   flac = NULL;
@@ -176,6 +233,7 @@ FLAC__StreamDecoderWriteStatus AudioGeneratorFLAC::write_cb(const FLAC__StreamDe
   // Hackish warning here.  FLAC sends the buffer but doesn't free it until the next call to decode_frame, so we stash
   // the pointers here and use it in our loop() instead of memcpy()'ing into yet another buffer.
   buffLen = frame->header.blocksize;
+  buffSample = frame->header.number.sample_number;
   buff[0] = buffer[0];
   if (frame->header.channels>1) buff[1] = buffer[1];
   else buff[1] = buffer[0];
@@ -194,3 +252,36 @@ void AudioGeneratorFLAC::error_cb(const FLAC__StreamDecoder *decoder, FLAC__Stre
   cb.st((int)status, FLAC__StreamDecoderErrorStatusString[status]);
 }
 
+
+// Allocation hooks for libflac, see libflac/share/alloc.h
+extern "C" {
+  void *FLAC__malloc(size_t size)
+  {
+    if (!flacArena) return malloc(size);
+    void *p = flacArena->allocate(size);
+    if (!p) Serial.printf_P(PSTR("OOM error in FLAC:  Want %d bytes, have %d of %d bytes preallocated free.\n"), (int)size, flacArena->getSize() - flacArena->getUsed(), flacArena->getSize());
+    return p;
+  }
+
+  void *FLAC__calloc(size_t nmemb, size_t size)
+  {
+    if (!flacArena) return calloc(nmemb, size);
+    void *p = FLAC__malloc(nmemb * size);
+    if (p) memset(p, 0, nmemb * size);
+    return p;
+  }
+
+  void *FLAC__realloc(void *ptr, size_t size)
+  {
+    if (!flacArena || (ptr && !flacArena->owns(ptr))) return realloc(ptr, size);
+    void *p = flacArena->reallocate(ptr, size);
+    if (!p && size) Serial.printf_P(PSTR("OOM error in FLAC:  Want %d bytes, have %d of %d bytes preallocated free.\n"), (int)size, flacArena->getSize() - flacArena->getUsed(), flacArena->getSize());
+    return p;
+  }
+
+  void FLAC__free(void *ptr)
+  {
+    if (flacArena && flacArena->owns(ptr)) flacArena->release(ptr);
+    else free(ptr);
+  }
+}
@@ -22,6 +22,7 @@
 #define _AUDIOGENERATORFLAC_H
 
 #include <AudioGenerator.h>
+#include "AudioArena.h"
 extern "C" {
     #include "libflac/FLAC/stream_decoder.h"
 };
@@ -30,13 +31,30 @@ class AudioGeneratorFLAC : public AudioGenerator
 {
   public:
     AudioGeneratorFLAC();
+    AudioGeneratorFLAC(void *preallocateSpace, int preallocateSize);
     virtual ~AudioGeneratorFLAC() override;
     virtual bool begin(AudioFileSource *source, AudioOutput *output) override;
     virtual bool loop() override;
     virtual bool stop() override;
     virtual bool isRunning() override;
 
+    // Seeks go through libflac, which uses the SEEKTABLE when the file has one and bisects the
+    // file otherwise, only decoding the frame it lands in.  Needs a seekable source, and the
+    // first frame to have been played so the sample rate is known.
+    virtual bool seekTo(uint32_t ms) override;
+    virtual uint32_t tell() override;
+
+    // Bytes needed by the preallocate constructor to play streams up to the given limits
+    static int preAllocSize(int maxBlockSize = 4608, int channels = 2, int seekPoints = 128) {
+      return FLAC__stream_decoder_get_alloc_size(maxBlockSize, channels, seekPoints, AudioArena::blockSize(0));
+    }
+    int getArenaPeak() const { return arena.getPeak(); }
+
   protected:
+    // libflac's allocations are routed here while we're inside the decoder when preallocated
+    AudioArena arena;
+    class ArenaScope;
+
     // FLAC info
     uint16_t channels;
     uint32_t sampleRate;
@@ -46,6 +64,7 @@ class AudioGeneratorFLAC : public AudioGenerator
     const int *buff[2];
     uint16_t buffPtr;
     uint16_t buffLen;
+    FLAC__uint64 buffSample; // Stream position of buff[][0]
     FLAC__StreamDecoder *flac;
 
     // FLAC callbacks, need static functions to bounce into c++ from c
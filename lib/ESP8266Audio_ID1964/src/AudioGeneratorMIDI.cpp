@@ -60,17 +60,84 @@
 
 #pragma GCC optimize ("O3")
 
+// TinySoundFont allocates through the arena when we've been given one, the heap otherwise
+static AudioArena *tsfArena = NULL;
+
+static void *tsf_arena_malloc(size_t size)
+{
+  if (!tsfArena) return malloc(size);
+  void *p = tsfArena->allocate(size);
+  if (!p) Serial.printf_P(PSTR("OOM error in MIDI:  Want %d bytes, have %d of %d bytes preallocated free.\n"), (int)size, tsfArena->getSize() - tsfArena->getUsed(), tsfArena->getSize());
+  return p;
+}
+
+static void *tsf_arena_realloc(void *ptr, size_t size)
+{
+  if (!tsfArena || (ptr && !tsfArena->owns(ptr))) return realloc(ptr, size);
+  void *p = tsfArena->reallocate(ptr, size);
+  if (!p && size) Serial.printf_P(PSTR("OOM error in MIDI:  Want %d bytes, have %d of %d bytes preallocated free.\n"), (int)size, tsfArena->getSize() - tsfArena->getUsed(), tsfArena->getSize());
+  return p;
+}
+
+static void tsf_arena_free(void *ptr)
+{
+  if (tsfArena && tsfArena->owns(ptr)) tsfArena->release(ptr);
+  else free(ptr);
+}
+
+#define TSF_MALLOC  tsf_arena_malloc
+#define TSF_REALLOC tsf_arena_realloc
+#define TSF_FREE    tsf_arena_free
+
 #define TSF_NO_STDIO
 #define TSF_IMPLEMENTATION
 #include "libtinysoundfont/tsf.h"
 
+void AudioGeneratorMIDI::UseArena()
+{
+  tsfArena = arena.isActive() ? &arena : NULL;
+}
+
+int AudioGeneratorMIDI::preAllocSize(int sf2Presets, int usedPresets, int usedRegions, int maxVoices, int timelineEvents)
+{
+  int sz = 0;
+
+  // Cached MIDI file stream, see PrepareMIDI()
+  sz += AudioArena::blockSize(sizeof(struct tsf_stream_cached_data));
+  sz += 3 * AudioArena::blockSize(sizeof(void*) * 32);
+  sz += 32 * AudioArena::blockSize(64);
+
+  // tsf_load_sparse(), with a table of just the presets the song uses
+  (void) sf2Presets;
+  sz += AudioArena::blockSize(sizeof(tsf));
+  sz += AudioArena::blockSize(usedPresets * sizeof(short));
+  sz += AudioArena::blockSize(usedPresets * sizeof(struct tsf_preset));
+  sz += AudioArena::blockSize(sizeof(struct tsf_hydra));
+  sz += AudioArena::blockSize(sizeof(struct tsf_stream));
+  sz += TSF_BUFFS * AudioArena::blockSize(TSF_BUFFSIZE * sizeof(short));
+
+  // One block of regions per preset, see LoadSoundfont()
+  sz += usedRegions * sizeof(struct tsf_region) + usedPresets * AudioArena::blockSize(7);
+
+  // Voices grow 4 at a time by realloc(), and the older copies usually can't be reclaimed
+  for (int v = 4; v < maxVoices + 4; v += 4) sz += AudioArena::blockSize(v * sizeof(struct tsf_voice));
+
+  // Mono mix buffer tsf_render_short_fast() sums the voices into, see LoadSoundfont()
+  sz += AudioArena::blockSize(TSF_MIXSAMPLES * sizeof(int32_t));
+
+  // Compiled timeline, see CompileMIDI()
+  if (timelineEvents) sz += AudioArena::blockSize(timelineEvents * sizeof(uint32_t));
+
+  return sz;
+}
+
 /****************  utility routines  **********************/
 
 /* announce a fatal MIDI file format error */
 
 void AudioGeneratorMIDI::midi_error(const char *msg, int curpos)
 {
-  cb.st(curpos, msg);
+  cb.report(STATUS_MIDI_PARSE, curpos, msg);
 #if 0
   int ptr;
   Serial.printf("---> MIDI file error at position %04X (%d): %s\n", (uint16_t) curpos, (uint16_t) curpos, msg);
@@ -346,17 +413,207 @@ void AudioGeneratorMIDI::PrepareMIDI(AudioFileSource *src)
   if (num_tracks > MAX_TRACKS)
     midi_error ("Too many tracks", buffer.tell (buffer.data));
 
+  trackhdrptr = hdrptr;
+  if (!CompileMIDI()) {
+    RestartMIDI();
+    notes_skipped = 0;
+  }
+}
+
+// Runs the tracks through PlayMIDI() once to count the events it would send and again to record
+// them, so playback is a walk along one array and seeks and the duration come straight from it.
+// Returns false, to stream from the file instead, if there's no room for it.
+bool AudioGeneratorMIDI::CompileMIDI()
+{
+  compiling = true;
+  timeline = NULL;
+  for (int pass = 0; running && (pass < 2); pass++) {
+    RestartMIDI();
+    for (int i=0; i<MAX_TONEGENS; i++) memset(&tonegen[i], 0, sizeof(struct tonegen_status));
+    notes_skipped = 0;
+    num_tonegens_used = 0;
+    timelineEvents = 0;
+    timelineSamples = 0;
+    int samples;
+    while (running && ((samples = PlayMIDI()) != -1)) {
+      // A gap too long for one delay (hours) goes in as several
+      for (uint32_t left = samples; left; ) {
+        uint32_t d = (left > delayMask) ? delayMask : left;
+        Emit(Event(EV_DELAY, 0, 0, 0) | d);
+        left -= d;
+      }
+    }
+    if (pass == 0) {
+      int bytes = timelineEvents * sizeof(uint32_t);
+      if (bytes) timeline = (uint32_t*)(arena.isActive() ? arena.allocate(bytes) : malloc(bytes));
+      if (!timeline) break;
+    }
+  }
+  compiling = false;
+  for (int i=0; i<MAX_TONEGENS; i++) memset(&tonegen[i], 0, sizeof(struct tonegen_status));
+  if (!timeline) {
+    num_tonegens_used = 0;
+    return false;
+  }
+
+  timelinePos = 0;
+  midiSample = 0;
+  samplesToPlay = 0;
+  sawEOF = false;
+  return true;
+}
+
+void AudioGeneratorMIDI::Emit(uint32_t event)
+{
+  if (timeline) timeline[timelineEvents] = event;
+  timelineEvents++;
+  if (EventKind(event) == EV_DELAY) timelineSamples += event & delayMask;
+}
+
+void AudioGeneratorMIDI::NoteOn(int channel, int instrument, int note, int velocity)
+{
+  if (compiling) {
+    keyPreset[instrument] = -1;
+    Emit(Event(EV_NOTEON, instrument, note, velocity, channel));
+  } else {
+    tsf_note_on_priority(g_tsf, keyPreset[instrument], note, velocity / 256.0, channelPriority[channel]);
+  }
+}
+
+void AudioGeneratorMIDI::NoteOff(int instrument, int note)
+{
+  if (compiling) Emit(Event(EV_NOTEOFF, instrument, note, 0));
+  else tsf_note_off(g_tsf, keyPreset[instrument], note);
+}
+
+// Sounds everything up to the next delay and returns its length in samples, -1 at the end
+int AudioGeneratorMIDI::PlayTimeline()
+{
+  while (timelinePos < timelineEvents) {
+    uint32_t ev = timeline[timelinePos++];
+    int note = ev & 0xff;
+    int preset = keyPreset[(ev >> 8) & 0xff];
+    switch (EventKind(ev)) {
+      case EV_DELAY:
+        return ev & delayMask;
+      case EV_NOTEON:
+        tsf_note_on_priority(g_tsf, preset, note, ((ev >> 16) & 0xff) / 256.0, channelPriority[(ev >> 24) & 0xf]);
+        break;
+      case EV_NOTEOFF:
+        tsf_note_off(g_tsf, preset, note);
+        break;
+    }
+  }
+  return -1;
+}
+
+// SkipMIDI() for the compiled timeline, always from the top since it's only adding up delays
+bool AudioGeneratorMIDI::SkipTimeline(uint32_t toSample)
+{
+  timelinePos = 0;
+  midiSample = 0;
+  samplesToPlay = 0;
+  sawEOF = false;
+  while (timelinePos < timelineEvents) {
+    if (midiSample >= toSample) {
+      samplesToPlay = midiSample - toSample;
+      return true;
+    }
+    uint32_t ev = timeline[timelinePos++];
+    if (EventKind(ev) == EV_DELAY) midiSample += ev & delayMask;
+  }
+  return false;
+}
+
+// Put every track back at its first note, as at the start of the song
+void AudioGeneratorMIDI::RestartMIDI()
+{
+  for (int i=0; i<MAX_TRACKS; i++) memset(&track[i], 0, sizeof(struct track_status));
+  memset(midi_chan_instrument, 0, sizeof(midi_chan_instrument));
+  tracks_done = 0;
+  timenow = 0;
+  tempo = 500000; /* 120 BPM until the song says otherwise */
+
   /* initialize processing of all the tracks */
 
+  hdrptr = trackhdrptr;
   for (tracknum = 0; tracknum < num_tracks; ++tracknum) {
     start_track (tracknum);   /* process the track header */
     find_note (tracknum);     /* position to the first note on/off */
   }
 
-  notes_skipped = 0;
   tracknum = 0;
   earliest_tracknum = 0;
   earliest_time = 0;
+  samplesToPlay = 0;
+  midiSample = 0;
+  sawEOF = false;
+}
+
+// Let go of every sounding note
+void AudioGeneratorMIDI::SilenceMIDI()
+{
+  if (timeline) {
+    tsf_note_off_all(g_tsf);
+    return;
+  }
+  for (int tgnum = 0; tgnum < num_tonegens; ++tgnum) {
+    if (tonegen[tgnum].playing) NoteOff(tonegen[tgnum].instrument, tonegen[tgnum].note);
+    tonegen[tgnum].playing = false;
+  }
+  for (int i = 0; i < num_tracks; ++i)
+    memset(track[i].tonegens, 0, sizeof(track[i].tonegens));
+}
+
+// Samples to wait for delta_time ticks at the current tempo
+int AudioGeneratorMIDI::DelaySamples(unsigned long delta_time, int curpos)
+{
+  /* Convert ticks to milliseconds based on the current tempo */
+  unsigned long long temp;
+  unsigned long delta_msec;
+  temp = ((unsigned long long) delta_time * tempo) / ticks_per_beat;
+  delta_msec = temp / 1000;      // get around LCC compiler bug
+  if (delta_msec > 0x7fff)
+    midi_error ("INTERNAL: time delta too big", curpos);
+  return (((int) delta_msec) * freq) / 1000;
+}
+
+// The unfinished track with the earliest next event, looking from the one after tracknum
+int AudioGeneratorMIDI::EarliestTrack()
+{
+  earliest_time = 0x7fffffff;
+  for (int count_tracks = num_tracks; count_tracks; --count_tracks) {
+    if (++tracknum >= num_tracks)
+      tracknum = 0;
+    struct track_status *trk = &track[tracknum];
+    if (trk->cmd != CMD_TRACKDONE && trk->time < earliest_time) {
+      earliest_time = trk->time;
+      earliest_tracknum = tracknum;
+    }
+  }
+  return tracknum = earliest_tracknum;
+}
+
+// Follow the events without playing them up to the first one due at or after toSample,
+// leaving the wait until then in samplesToPlay.  False if the song ends first.
+bool AudioGeneratorMIDI::SkipMIDI(uint32_t toSample)
+{
+  while (running && (tracks_done < num_tracks)) {
+    if (midiSample >= toSample) {
+      samplesToPlay = midiSample - toSample;
+      return true;
+    }
+    struct track_status *trk = &track[EarliestTrack()];
+    if (earliest_time > timenow) {
+      midiSample += DelaySamples(earliest_time - timenow, trk->trkptr);
+      timenow = earliest_time;
+    } else {
+      if (trk->cmd == CMD_TEMPO)
+        tempo = trk->tempo;
+      find_note (tracknum);   // use it up, note or not
+    }
+  }
+  return false;
 }
 
 // Parses the note on/offs ujntil we are ready to render some more samples.  Then return the
@@ -370,8 +627,7 @@ int AudioGeneratorMIDI::PlayMIDI()
     static struct track_status *trk;
     static struct tonegen_status *tg;
     static int tgnum;
-    static int count_tracks;
-    static unsigned long delta_time, delta_msec;
+    static unsigned long delta_time;
 
     /* Find the track with the earliest event time,
        and output a delay command if time has advanced.
@@ -382,27 +638,13 @@ int AudioGeneratorMIDI::PlayMIDI()
        files do all the STOPNOTEs first anyway, so it won't have much effect.
     */
 
-    earliest_time = 0x7fffffff;
-
     /* Usually we start with the track after the one we did last time (tracknum),
        so that if we run out of tone generators, we have been fair to all the tracks.
        The alternate "strategy1" says we always start with track 0, which means
        that we favor early tracks over later ones when there aren't enough tone generators.
     */
 
-    count_tracks = num_tracks;
-    do {
-      if (++tracknum >= num_tracks)
-        tracknum = 0;
-      trk = &track[tracknum];
-      if (trk->cmd != CMD_TRACKDONE && trk->time < earliest_time) {
-        earliest_time = trk->time;
-        earliest_tracknum = tracknum;
-      }
-    } while (--count_tracks);
-
-    tracknum = earliest_tracknum;     /* the track we picked */
-    trk = &track[tracknum];
+    trk = &track[EarliestTrack()];     /* the track we picked */
     if (earliest_time < timenow)
       midi_error ("INTERNAL: time went backwards", trk->trkptr);
 
@@ -410,13 +652,7 @@ int AudioGeneratorMIDI::PlayMIDI()
 
     delta_time = earliest_time - timenow;
     if (delta_time) {
-      /* Convert ticks to milliseconds based on the current tempo */
-      unsigned long long temp;
-      temp = ((unsigned long long) delta_time * tempo) / ticks_per_beat;
-      delta_msec = temp / 1000;      // get around LCC compiler bug
-      if (delta_msec > 0x7fff)
-        midi_error ("INTERNAL: time delta too big", trk->trkptr);
-      int samples = (((int) delta_msec) * freq) / 1000;
+      int samples = DelaySamples(delta_time, trk->trkptr);
       timenow = earliest_time;
       return samples;
     }
@@ -439,7 +675,7 @@ int AudioGeneratorMIDI::PlayMIDI()
         for (tgnum = 0; tgnum < num_tonegens; ++tgnum) {    /* find which generator is playing it */
           tg = &tonegen[tgnum];
           if (tg->playing && tg->track == tracknum && tg->note == trk->note) {
-            tsf_note_off (g_tsf, tg->instrument, tg->note);
+            NoteOff(tg->instrument, tg->note);
             tg->playing = false;
             trk->tonegens[tgnum] = false;
           }
@@ -469,10 +705,9 @@ int AudioGeneratorMIDI::PlayMIDI()
         tg->note = trk->note;
         trk->tonegens[tgnum] = true;
         trk->preferred_tonegen = tgnum;
-        if (tg->instrument != midi_chan_instrument[trk->chan]) {    /* new instrument for this generator */
-          tg->instrument = midi_chan_instrument[trk->chan];
-        }
-        tsf_note_on (g_tsf, tg->instrument, tg->note, trk->velocity / 256.0);
+        /* channel 10 plays the drum kits, bank 128 in the SoundFont */
+        tg->instrument = (midi_chan_instrument[trk->chan] & 0x7f) | ((trk->chan == 9) ? 0x80 : 0);
+        NoteOn(trk->chan, tg->instrument, tg->note, trk->velocity);
       } else {
         ++notes_skipped;
       }
@@ -488,7 +723,12 @@ void AudioGeneratorMIDI::StopMIDI()
 {
 
   buffer.close(buffer.data);
+  tsf_arena_free(timeline);
+  timeline = NULL;
+  if (g_tsf) tsf_get_cache_stats(g_tsf, &cacheStats);
+  if (g_tsf) GetVoiceStats(&voiceStats);
   tsf_close(g_tsf);
+  g_tsf = NULL;
   printf ("  %s %d tone generators were used.\n",
           num_tonegens_used < num_tonegens ? "Only" : "All", num_tonegens_used);
   if (notes_skipped)
@@ -499,16 +739,134 @@ void AudioGeneratorMIDI::StopMIDI()
 }
 
 
+// Loads the presets marked by CompileMIDI()'s pre-scan and reads in all their regions now, so that no
+// note has to wait for the SoundFont mid-song.  A drum kit the SoundFont doesn't have gets its standard
+// kit, any other missing program stays silent.
+bool AudioGeneratorMIDI::LoadSoundfont()
+{
+  int used = 0;
+  for (int i=0; i<256; i++) if (keyPreset[i] == -1) used++;
+
+  g_tsf = tsf_load_sparse(&afsSF2, used);
+  if (!g_tsf) return false;
+  tsf_set_output (g_tsf, TSF_MONO, freq, -10 /* dB gain -10 */ );
+  // The mix buffer rendering sums voices into, taken now so a block too small fails here and not as silence
+  g_tsf->mix = (int32_t*)TSF_MALLOC(TSF_MIXSAMPLES * sizeof(int32_t));
+  if (!g_tsf->mix) return false;
+  voiceCap = maxVoices;
+  tsf_set_max_voices(g_tsf, voiceCap, stealPolicy);
+
+  memset(&songStats, 0, sizeof(songStats));
+  for (int i=0; i<256; i++) {
+    if (keyPreset[i] != -1) continue;
+    int bank = (i & 0x80) ? 128 : 0;
+    int preset = tsf_get_presetindex(g_tsf, bank, i & 0x7f);
+    if ((preset < 0) && bank) preset = tsf_get_presetindex(g_tsf, bank, 0);
+    int regions = (preset < 0) ? -1 : tsf_preload(g_tsf, preset);
+    if (regions < 0) {
+      cb.st(STATUS_MIDI_NO_PRESET, PSTR("No preset in the SoundFont"));
+      songStats.missingPresets++;
+      preset = -1;
+    } else {
+      bool again = false; // The standard kit may already be standing in for another
+      for (int j=0; j<i; j++) if (keyPreset[j] == preset) again = true;
+      if (!again) {
+        songStats.presets++;
+        songStats.regions += regions;
+      }
+    }
+    keyPreset[i] = preset;
+  }
+  songStats.presetBytes = tsf_get_preset_memory(g_tsf);
+  songStats.timelineBytes = timeline ? timelineEvents * sizeof(uint32_t) : 0;
+  return true;
+}
+
+void AudioGeneratorMIDI::GetCacheStats(CacheStats *stats)
+{
+  if (g_tsf) tsf_get_cache_stats(g_tsf, &cacheStats);
+  *stats = cacheStats;
+}
+
+void AudioGeneratorMIDI::SetMaxVoices(int voices, StealPolicy policy, bool adaptive)
+{
+  maxVoices = (voices > 0) ? voices : 0;
+  stealPolicy = policy;
+  adaptiveCap = adaptive;
+  voiceCap = maxVoices;
+  if (g_tsf) tsf_set_max_voices(g_tsf, voiceCap, stealPolicy);
+}
+
+void AudioGeneratorMIDI::GetVoiceStats(VoiceStats *stats)
+{
+  if (g_tsf) {
+    struct tsf_voice_stats vs;
+    tsf_get_voice_stats(g_tsf, &vs);
+    voiceStats.cap = voiceCap;
+    voiceStats.peak = vs.peak;
+    voiceStats.stolen = vs.stolen;
+    voiceStats.load = (loadAvg + 128) >> 8;
+    voiceStats.headroom = 100 - voiceStats.load;
+  }
+  *stats = voiceStats;
+}
+
+// Renders the next samples and keeps track of how long that takes against how long they play for.  With
+// an adaptive cap, a load of CAP_LOWER_LOAD or more twice running (once may just be the SoundFont being read)
+// brings the cap down below the voices now sounding, and each 100ms spent under CAP_RAISE_LOAD lets one
+// back, until it's at maxVoices (or gone, if that's 0).
+void AudioGeneratorMIDI::RenderBlock(int samples)
+{
+  uint32_t start = micros();
+  tsf_render_short_fast(g_tsf, samplesRendered, samples, 0);
+  renderUsec += micros() - start;
+  renderSamples += samples;
+  // Gaps between notes can make for tiny blocks, too short to time on their own
+  if (renderSamples < 256) return;
+
+  int load = (int)((uint64_t)renderUsec * freq / renderSamples / 10000);
+  if (load > voiceStats.worstLoad) voiceStats.worstLoad = load;
+  loadAvg += ((load << 8) - loadAvg) / 16;
+  uint32_t span = renderSamples;
+  bool overloaded = lastOverloaded;
+  lastOverloaded = (load >= CAP_LOWER_LOAD);
+  renderUsec = 0;
+  renderSamples = 0;
+  if (!adaptiveCap) return;
+
+  if (load >= CAP_LOWER_LOAD) {
+    calmSamples = 0;
+    if (!overloaded) return;
+    int active = tsf_active_voice_count(g_tsf);
+    int cap = ((voiceCap && voiceCap < active) ? voiceCap : active) - 1;
+    if (cap < MIN_VOICE_CAP) cap = MIN_VOICE_CAP;
+    if (voiceCap && cap >= voiceCap) return;
+    voiceCap = cap;
+    voiceStats.capLowered++;
+    tsf_set_max_voices(g_tsf, voiceCap, stealPolicy);
+  } else if (load >= CAP_RAISE_LOAD) {
+    calmSamples = 0;
+  } else if (voiceCap != maxVoices) {
+    calmSamples += span;
+    if (calmSamples < (uint32_t)freq / 10) return;
+    calmSamples = 0;
+    voiceCap++;
+    if ((maxVoices && voiceCap >= maxVoices) || (!maxVoices && voiceCap > MAX_TONEGENS)) voiceCap = maxVoices;
+    tsf_set_max_voices(g_tsf, voiceCap, stealPolicy);
+  }
+}
+
 bool AudioGeneratorMIDI::begin(AudioFileSource *src, AudioOutput *out)
 {
   // Clear out status variables
   for (int i=0; i<MAX_TONEGENS; i++) memset(&tonegen[i], 0, sizeof(struct tonegen_status));
   for (int i=0; i<MAX_TRACKS; i++) memset(&track[i], 0, sizeof(struct track_status));
   memset(midi_chan_instrument, 0, sizeof(midi_chan_instrument));
+  memset(&voiceStats, 0, sizeof(voiceStats));
 
-  g_tsf = tsf_load(&afsSF2);
-  if (!g_tsf) return false;
-  tsf_set_output (g_tsf, TSF_MONO, freq, -10 /* dB gain -10 */ );
+  // Nothing from a prior song survives stop(), so the whole arena is ours again
+  arena.begin(preallocateSpace, preallocateSize);
+  UseArena();
 
   if (!out->SetRate( freq )) return false;
   if (!out->SetBitsPerSample( 16 )) return false;
@@ -520,11 +878,23 @@ bool AudioGeneratorMIDI::begin(AudioFileSource *src, AudioOutput *out)
 
   running = true;
 
+  // Compiling the song finds the instruments it plays, and only those are loaded from the SoundFont
+  for (int i=0; i<256; i++) keyPreset[i] = -2;
   PrepareMIDI(src);
+  if (running && !LoadSoundfont()) running = false;
+  if (!running) {
+    StopMIDI();
+    return false;
+  }
 
   samplesToPlay = 0;
   numSamplesRendered = 0;
   sentSamplesRendered = 0;
+  renderUsec = 0;
+  renderSamples = 0;
+  calmSamples = 0;
+  loadAvg = 0;
+  lastOverloaded = false;
   
   sawEOF = false;
   return running;
@@ -537,8 +907,12 @@ bool AudioGeneratorMIDI::loop()
 
   if (!running) goto done; // Nothing to do here!
 
+  BudgetStart();
+
   // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
+  if (!SendSample(lastSample)) goto done; // Can't send, but no error detected
+
+  UseArena();
 
   // Try and stuff the buffer one sample at a time
   do {
@@ -554,7 +928,8 @@ play:
     } else if (samplesToPlay) {
       numSamplesRendered = sizeof(samplesRendered)/sizeof(samplesRendered[0]);
       if ((int)samplesToPlay < (int)(sizeof(samplesRendered)/sizeof(samplesRendered[0]))) numSamplesRendered = samplesToPlay;
-      tsf_render_short_fast(g_tsf, samplesRendered, numSamplesRendered, 0);
+      RenderBlock(numSamplesRendered);
+      BudgetSpend(numSamplesRendered);
       lastSample[AudioOutput::LEFTCHANNEL] = samplesRendered[0];
       lastSample[AudioOutput::RIGHTCHANNEL] = samplesRendered[0];
       sentSamplesRendered = 1;
@@ -565,15 +940,17 @@ play:
       if (sawEOF) {
         running = false;
       } else {
-        samplesToPlay = PlayMIDI();
+        samplesToPlay = timeline ? PlayTimeline() : PlayMIDI();
         if (samplesToPlay == -1) {
             sawEOF = true;
             samplesToPlay = freq / 2;
         }
+        midiSample += samplesToPlay;
         goto play;
       }
     }
-  } while (running && output->ConsumeSample(lastSample));
+    // Leave the sample pending if the next one needs another render and we're out of time
+  } while (running && !((sentSamplesRendered >= numSamplesRendered) && BudgetExhausted()) && SendSample(lastSample));
 
 done:
   file->loop();
@@ -581,9 +958,47 @@ done:
 
   return running;
 }
- 
+
+bool AudioGeneratorMIDI::seekTo(uint32_t ms)
+{
+  if (!running) return false;
+  uint32_t now = midiSample - samplesToPlay - (numSamplesRendered - sentSamplesRendered);
+  uint32_t target = ((uint64_t)ms * freq) / 1000;
+
+  UseArena();
+  SilenceMIDI();
+  numSamplesRendered = 0;
+  sentSamplesRendered = 0;
+  if (timeline) {
+    if (SkipTimeline(target)) return true;
+    SkipTimeline(now);
+    return false;
+  }
+  if ((target < now) || sawEOF) RestartMIDI();
+  if (SkipMIDI(target)) return true;
+
+  // Ran off the end of the song, so go back to where we were
+  RestartMIDI();
+  SkipMIDI(now);
+  return false;
+}
+
+uint32_t AudioGeneratorMIDI::getDuration()
+{
+  if (!timeline) return 0;
+  return ((uint64_t)(timelineSamples + freq / 2) * 1000) / freq;
+}
+
+uint32_t AudioGeneratorMIDI::tell()
+{
+  if (!running) return 0;
+  uint32_t pos = midiSample - samplesToPlay - (numSamplesRendered - sentSamplesRendered);
+  return ((uint64_t)pos * 1000) / freq;
+}
+
 bool AudioGeneratorMIDI::stop()
 {
+  UseArena();
   StopMIDI();
   return true;
 }
@@ -22,6 +22,7 @@
 #define _AUDIOGENERATORMOD_H
 
 #include "AudioGenerator.h"
+#include "AudioArena.h"
 
 #define TSF_NO_STDIO
 #include "libtinysoundfont/tsf.h"
@@ -29,7 +30,8 @@
 class AudioGeneratorMIDI : public AudioGenerator
 {
   public:
-    AudioGeneratorMIDI() { freq=44100; };
+    AudioGeneratorMIDI() { running=false; freq=44100; g_tsf=NULL; timeline=NULL; ResetVoiceSettings(); memset(&cacheStats, 0, sizeof(cacheStats)); memset(&songStats, 0, sizeof(songStats)); memset(&voiceStats, 0, sizeof(voiceStats)); };
+    AudioGeneratorMIDI(void *preallocateSpace, int preallocateSize) { running=false; freq=44100; g_tsf=NULL; timeline=NULL; ResetVoiceSettings(); memset(&cacheStats, 0, sizeof(cacheStats)); memset(&songStats, 0, sizeof(songStats)); memset(&voiceStats, 0, sizeof(voiceStats)); this->preallocateSpace = preallocateSpace; this->preallocateSize = preallocateSize; };
     virtual ~AudioGeneratorMIDI() override {};
     bool SetSoundfont(AudioFileSource *newsf2) {
       if (isRunning()) return false;
@@ -47,15 +49,116 @@ class AudioGeneratorMIDI : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override { return running; };
 
+    // begin() compiles the tracks into one timeline of note events and sample delays, so a seek
+    // is a walk along it without sounding or rendering anything.  When the timeline doesn't fit,
+    // the tracks are read as they play and a seek follows their events and tempo changes instead,
+    // carrying on forward from where playback is or starting again from the top.  Either way notes
+    // held across the target aren't restarted.
+    virtual bool seekTo(uint32_t ms) override;
+    virtual uint32_t tell() override;
+    // Length of the song in ms, including the half second left for the last notes to ring out.
+    // Only known once begin() has compiled the timeline, 0 otherwise.
+    uint32_t getDuration();
+    // Events in the compiled timeline, 4 bytes each, or 0 if playback is streaming from the file
+    int getTimelineEvents() const { return timeline ? timelineEvents : 0; }
+
+    // Bytes needed by the preallocate constructor.  Only the presets the song uses are loaded, so this depends
+    // on those and their total regions (see GetSongStats()), and the voices it sounds at once, plus the song's
+    // timeline (see getTimelineEvents()), without which it streams from the file.  sf2Presets no longer matters.
+    // When those aren't known, play the song once with a generous block and check getArenaPeak().
+    static int preAllocSize(int sf2Presets, int usedPresets, int usedRegions, int maxVoices = MAX_TONEGENS, int timelineEvents = 0);
+    int getArenaPeak() const { return arena.getPeak(); }
+
+    // SoundFont sample cache activity for the current (or last) song:  hits and misses count voices
+    // moving onto another page of samples, readAheads the pages fetched before a voice got to them
+    typedef struct tsf_cache_stats CacheStats;
+    void GetCacheStats(CacheStats *stats);
+
+    // What begin() loaded from the SoundFont for the song:  the presets its programs (and drum kits, on
+    // channel 10) use and their regions, and the bytes those and the timeline take.  missingPresets counts
+    // the programs the SoundFont has nothing for, which stay silent.
+    typedef struct {
+      int presets;
+      int regions;
+      int presetBytes;
+      int timelineBytes;
+      int missingPresets;
+    } SongStats;
+    void GetSongStats(SongStats *stats) { *stats = songStats; }
+
+    // Caps the voices sounding at once (0, the default, for no cap).  A note past the cap takes over the voice
+    // policy picks, which fades out over 10ms:  TSF_STEAL_QUIETEST, TSF_STEAL_OLDEST_RELEASED, or
+    // TSF_STEAL_LOWEST_PRIORITY by SetChannelPriority().  When adaptive, the cap also comes down a voice at a
+    // time while rendering takes more than 3/4 of the time the audio plays for, and goes back up after 100ms
+    // under half.  Can be changed while playing.  With a cap, pass it plus 4 as preAllocSize()'s maxVoices.
+    typedef enum TSFStealPolicy StealPolicy;
+    void SetMaxVoices(int voices, StealPolicy policy = TSF_STEAL_OLDEST_RELEASED, bool adaptive = true);
+    // Higher priority channels (0-15, 9 being the drums) lose their voices last under TSF_STEAL_LOWEST_PRIORITY
+    void SetChannelPriority(int channel, int8_t priority) { if (channel >= 0 && channel < 16) channelPriority[channel] = priority; }
+
+    // Voices and rendering for the current (or last) song.  Load is the time spent rendering as a percentage
+    // of the time that audio takes to play, which has to stay well under 100 for the output to keep up.
+    typedef struct {
+      int cap;             // Voices allowed now, 0 for no cap, after any lowering for load
+      int peak;            // Most voices sounding at once
+      uint32_t stolen;     // Voices taken over by a note or faded out as the cap came down
+      uint32_t capLowered; // Times the cap came down because rendering was taking too long
+      int load;            // Recent average load
+      int worstLoad;       // Highest load over 256 samples
+      int headroom;        // 100 - load
+    } VoiceStats;
+    void GetVoiceStats(VoiceStats *stats);
+
+    // Status codes for a MIDI file that can't be parsed, the report's offset is where in the file, and
+    // for each program the SoundFont has no preset for
+    enum { STATUS_MIDI_PARSE=2, STATUS_MIDI_NO_PRESET };
+
   private:
+    AudioArena arena;
+    void UseArena();
+
     int freq;
     tsf *g_tsf;
+    CacheStats cacheStats;
+    SongStats songStats;
+    VoiceStats voiceStats;
+    // SetMaxVoices() and SetChannelPriority() settings, and the cap they come to while playing
+    int maxVoices;
+    StealPolicy stealPolicy;
+    bool adaptiveCap;
+    int8_t channelPriority[16];
+    void ResetVoiceSettings() { maxVoices = 0; stealPolicy = TSF_STEAL_OLDEST_RELEASED; adaptiveCap = false; voiceCap = 0; memset(channelPriority, 0, sizeof(channelPriority)); }
+    int voiceCap;
+    enum { CAP_LOWER_LOAD = 75, CAP_RAISE_LOAD = 50, MIN_VOICE_CAP = 4 };
+    uint32_t renderUsec;    // Rendering time and samples since the load was last worked out
+    uint32_t renderSamples;
+    uint32_t calmSamples;   // Samples rendered since the load was last at CAP_RAISE_LOAD or more
+    int loadAvg;            // Average load, in 256ths of a percent
+    bool lastOverloaded;    // The last load worked out was CAP_LOWER_LOAD or more
+    void RenderBlock(int samples);
+    // Preset index for each program, plus 0x80 for the drum channel's kits.  The pre-scan while
+    // compiling marks the ones played as -1, LoadSoundfont() then fills them in; -2 is never played.
+    int16_t keyPreset[256];
     struct tsf_stream buffer;
     struct tsf_stream afsMIDI;
     struct tsf_stream afsSF2;
     AudioFileSource *sf2;
     AudioFileSource *midi;
 
+    // Compiled song:  events as emitted by PlayMIDI() while compiling, in the order they're due
+    enum { EV_DELAY = 0, EV_NOTEON = 1, EV_NOTEOFF = 2 };
+    // Packed as kind:2 channel:6 velocity:8 instrument:8 note:8, or kind:2 samples:30 for a delay
+    static uint32_t Event(int kind, int instrument, int note, int velocity, int channel = 0) {
+      return ((uint32_t)kind << 30) | ((uint32_t)(channel & 0x3f) << 24) | ((uint32_t)(velocity & 0xff) << 16) | ((uint32_t)(instrument & 0xff) << 8) | (uint32_t)(note & 0xff);
+    }
+    static uint32_t EventKind(uint32_t ev) { return ev >> 30; }
+    static const uint32_t delayMask = 0x3fffffff;
+    uint32_t *timeline;
+    int timelineEvents;
+    int timelinePos;
+    uint32_t timelineSamples; // Sum of every delay
+    bool compiling;
+
   protected:
     struct midi_header {
       int8_t MThd[4];
@@ -75,6 +178,7 @@ class AudioGeneratorMIDI : public AudioGenerator
          };         /* max number of MIDI tracks we will process */
 
     int hdrptr;
+    int trackhdrptr;                /* first track header */
     unsigned long buflen;
     int num_tracks;
     int tracks_done = 0;
@@ -93,7 +197,7 @@ class AudioGeneratorMIDI : public AudioGenerator
       bool playing;                /* is it playing? */
       char track;                   /* if so, which track is the note from? */
       char note;                    /* what note is playing? */
-      char instrument;              /* what instrument? */
+      unsigned char instrument;     /* what instrument?  program, + 0x80 for a drum kit */
     } tonegen[MAX_TONEGENS];
 
     struct track_status {           /* current processing point of a MIDI track */
@@ -157,8 +261,20 @@ class AudioGeneratorMIDI : public AudioGenerator
     unsigned long get_varlen (int *ptr);
     void find_note (int tracknum);
     void PrepareMIDI(AudioFileSource *src);
+    void RestartMIDI();
+    void SilenceMIDI();
+    int DelaySamples(unsigned long delta_time, int curpos);
+    int EarliestTrack();
+    bool SkipMIDI(uint32_t toSample);
     int PlayMIDI();
     void StopMIDI();
+    void NoteOn(int channel, int instrument, int note, int velocity);
+    void NoteOff(int instrument, int note);
+    void Emit(uint32_t event);
+    bool CompileMIDI();
+    int PlayTimeline();
+    bool SkipTimeline(uint32_t toSample);
+    bool LoadSoundfont();
 
     // tsf_stream <-> AudioFileSource
     static int afs_read(void *data, void *ptr, unsigned int size);
@@ -170,6 +286,7 @@ class AudioGeneratorMIDI : public AudioGenerator
     void MakeStreamFromAFS(AudioFileSource *src, tsf_stream *afs);
 
     int samplesToPlay;
+    uint32_t midiSample;  // Where the end of samplesToPlay falls in the song
     bool sawEOF;
     int numSamplesRendered;
     int sentSamplesRendered ;
@@ -34,7 +34,9 @@
 
 #pragma GCC optimize ("O3")
 
-#define NOTE(r, c) (Player.currentPattern.note8[r][c]==NONOTE8?NONOTE:8*Player.currentPattern.note8[r][c])
+// Where channel c of row r is in the current pattern
+#define CELL(r, c) ((r) * Mod.numberOfChannels + (c))
+#define NOTE(r, c) (Player.currentPattern.note8[CELL(r, c)]==NONOTE8?NONOTE:8*Player.currentPattern.note8[CELL(r, c)])
 
 #ifndef min
 #define min(X,Y) ((X) < (Y) ? (X) : (Y))
@@ -46,28 +48,45 @@ AudioGeneratorMOD::AudioGeneratorMOD()
   fatBufferSize = 6 * 1024;
   stereoSeparation = 32;
   mixerTick = 0;
+  playedSamples = 0;
+  mixedLen = 0;
+  mixedPos = 0;
   usePAL = false;
+  preload = false;
+  interpolate = true;
+  sampleData = SAMPLEDATA_STREAMED;
+  sampleStart = 0;
+  sampleBytes = 0;
+  sampleMem = NULL;
+  sampleMemOwned = false;
+  lentMem = NULL;
   UpdateAmiga();
   running = false;
   file = NULL;
   output = NULL;
+  Mod.numberOfChannels = 0;
+  channelState = NULL;
+  memset(&Player, 0, sizeof(Player));
+  memset(&Mixer, 0, sizeof(Mixer));
+  memset(&FatBuffer, 0, sizeof(FatBuffer));
+}
+
+AudioGeneratorMOD::AudioGeneratorMOD(void *space, int size) : AudioGeneratorMOD()
+{
+  preallocateSpace = space;
+  preallocateSize = size;
 }
 
 AudioGeneratorMOD::~AudioGeneratorMOD()
 {
   // Free any remaining buffers
-  for (int i = 0; i < CHANNELS; i++) {
-    FatBuffer.channels[i] = NULL;
-  }
+  FreeChannels();
 }
 
 bool AudioGeneratorMOD::stop()
 {
   // We may be stopping because of allocation failures, so always deallocate
-  for (int i = 0; i < CHANNELS; i++) {
-    free(FatBuffer.channels[i]);
-    FatBuffer.channels[i] = NULL;
-  }
+  FreeChannels();
   if (file) file->close();
   running = false;
   return true;
@@ -76,25 +95,35 @@ bool AudioGeneratorMOD::stop()
 bool AudioGeneratorMOD::loop()
 {
   if (!running) goto done; // Easy-peasy
+  BudgetStart();
 
   // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(lastSample)) goto done; // FIFO full, wait...
+  if (!SendSample(lastSample)) goto done; // FIFO full, wait...
 
   // Now advance enough times to fill the i2s buffer
   do {
-    if (mixerTick == 0) {
-      running = RunPlayer();
-      if (!running) {
-        stop();
-        goto done;
+    if (mixedPos == mixedLen) {
+      if (mixerTick == 0) {
+        running = RunPlayer();
+        if (!running) {
+          stop();
+          goto done;
+        }
+        mixerTick = Player.samplesPerTick;
+        playedSamples += mixerTick;
+        BudgetSpend(mixerTick);
       }
-      mixerTick = Player.samplesPerTick;
+      MixBlock(min(mixerTick, (int)MIXBLOCK));
+      if (!running) goto done;
     }
-    GetSample( lastSample );
-    mixerTick--;
-  } while (output->ConsumeSample(lastSample));
+    lastSample[AudioOutput::LEFTCHANNEL] = mixed[mixedPos][AudioOutput::LEFTCHANNEL];
+    lastSample[AudioOutput::RIGHTCHANNEL] = mixed[mixedPos][AudioOutput::RIGHTCHANNEL];
+    mixedPos++;
+    // Leave the sample pending if the next one starts a new tick and we're out of time
+  } while (!((mixedPos == mixedLen) && (mixerTick == 0) && BudgetExhausted()) && SendSample(lastSample));
 
 done:
+  lentMem = NULL;
   file->loop();
   output->loop();
 
@@ -120,15 +149,10 @@ bool AudioGeneratorMOD::begin(AudioFileSource *source, AudioOutput *out)
   if (!output->begin()) return false;
 
   UpdateAmiga();
+  // Nothing's left in the preallocated block since stop()
+  arena.begin(preallocateSpace, preallocateSize);
 
-  for (int i = 0; i < CHANNELS; i++) {
-    FatBuffer.channels[i] = reinterpret_cast<uint8_t*>(malloc(fatBufferSize));
-    if (!FatBuffer.channels[i]) {
-      stop();
-      return false;
-    }
-  }
-  if (!LoadMOD()) {
+  if (!LoadMOD() || !SetupSampleData()) {
     stop();
     return false;
   }
@@ -136,6 +160,129 @@ bool AudioGeneratorMOD::begin(AudioFileSource *source, AudioOutput *out)
   return true;
 }
 
+// Where mixing reads samples from:  the source's own memory if it lends it, everything read into RAM if
+// SetPreload() asked and there's room, otherwise a buffer per channel refilled from the file as it plays
+bool AudioGeneratorMOD::SetupSampleData()
+{
+  uint32_t avail = 0;
+  sampleData = SAMPLEDATA_STREAMED;
+  if (sampleBytes && file->seek(sampleStart, SEEK_SET) && file->acquire(sampleBytes, &avail) && (avail == sampleBytes)) {
+    sampleData = SAMPLEDATA_LENT;
+    return true;
+  }
+
+  if (preload && sampleBytes) {
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+    if (!arena.isActive()) sampleMem = reinterpret_cast<int8_t*>(ps_malloc(sampleBytes));
+#endif
+    if (!sampleMem) sampleMem = reinterpret_cast<int8_t*>(Allocate(sampleBytes));
+    sampleMemOwned = (sampleMem != NULL);
+    if (sampleMem && file->seek(sampleStart, SEEK_SET)) {
+      uint32_t got = 0, n;
+      while ((got < sampleBytes) && ((n = file->read(sampleMem + got, sampleBytes - got)) > 0)) got += n;
+      if (got == sampleBytes) {
+        sampleData = SAMPLEDATA_LOADED;
+        return true;
+      }
+    }
+    if (sampleMemOwned) Free(sampleMem);
+    sampleMem = NULL;
+    sampleMemOwned = false;
+  }
+
+  if (preallocateSpace && (preAllocSize(fatBufferSize, Mod.numberOfChannels) > preallocateSize)) {
+    Serial.printf_P(PSTR("OOM error in MOD:  Want %d bytes, have %d bytes preallocated.\n"), preAllocSize(fatBufferSize, Mod.numberOfChannels), preallocateSize);
+    return false;
+  }
+  for (int i = 0; i < Mod.numberOfChannels; i++) {
+    FatBuffer.channels[i] = reinterpret_cast<uint8_t*>(Allocate(fatBufferSize));
+    if (!FatBuffer.channels[i]) return false;
+  }
+  return true;
+}
+
+// Next array of n T's in the channel state block
+template <typename T> static T *Carve(uint8_t **p, int n)
+{
+  T *array = reinterpret_cast<T*>(*p);
+  *p += (n * sizeof(T) + 7) & ~7;
+  return array;
+}
+
+// Lays out the per-channel arrays for the song's channel count in one block, in the order
+// channelStateSize() adds them up
+bool AudioGeneratorMOD::SetupChannels()
+{
+  int n = Mod.numberOfChannels;
+  int size = channelStateSize(n);
+  channelState = reinterpret_cast<uint8_t*>(Allocate(size));
+  if (!channelState) {
+    Serial.printf_P(PSTR("OOM error in MOD:  Want %d bytes for %d channels.\n"), size, n);
+    return false;
+  }
+  memset(channelState, 0, size);
+
+  uint8_t *p = channelState;
+  Player.lastNote = Carve<uint16_t>(&p, n);
+  Player.amigaPeriod = Carve<uint16_t>(&p, n);
+  Player.lastAmigaPeriod = Carve<int16_t>(&p, n);
+  Player.portamentoNote = Carve<uint16_t>(&p, n);
+  Player.patternLoopCount = Carve<uint8_t>(&p, n);
+  Player.patternLoopRow = Carve<uint8_t>(&p, n);
+  Player.lastSampleNumber = Carve<uint8_t>(&p, n);
+  Player.volume = Carve<int8_t>(&p, n);
+  Player.portamentoSpeed = Carve<uint8_t>(&p, n);
+  Player.waveControl = Carve<uint8_t>(&p, n);
+  Player.vibratoSpeed = Carve<uint8_t>(&p, n);
+  Player.vibratoDepth = Carve<uint8_t>(&p, n);
+  Player.vibratoPos = Carve<int8_t>(&p, n);
+  Player.tremoloSpeed = Carve<uint8_t>(&p, n);
+  Player.tremoloDepth = Carve<uint8_t>(&p, n);
+  Player.tremoloPos = Carve<int8_t>(&p, n);
+
+  Player.currentPattern.sampleNumber = Carve<uint8_t>(&p, ROWS * n);
+  Player.currentPattern.note8 = Carve<uint8_t>(&p, ROWS * n);
+  Player.currentPattern.effectNumber = Carve<uint8_t>(&p, ROWS * n);
+  Player.currentPattern.effectParameter = Carve<uint8_t>(&p, ROWS * n);
+
+  Mixer.channelSampleOffset = Carve<uint32_t>(&p, n);
+  Mixer.channelFrequency = Carve<uint16_t>(&p, n);
+  Mixer.channelSampleNumber = Carve<uint8_t>(&p, n);
+  Mixer.channelVolume = Carve<uint8_t>(&p, n);
+  Mixer.channelPanning = Carve<uint8_t>(&p, n);
+
+  FatBuffer.channels = Carve<uint8_t*>(&p, n);
+  FatBuffer.samplePointer = Carve<uint32_t>(&p, n);
+  FatBuffer.length = Carve<uint32_t>(&p, n);
+  FatBuffer.channelSampleNumber = Carve<uint8_t>(&p, n);
+  return true;
+}
+
+// Everything begin() allocated, newest first so an arena gets all of it back
+void AudioGeneratorMOD::FreeChannels()
+{
+  if (FatBuffer.channels) {
+    for (int i = Mod.numberOfChannels - 1; i >= 0; i--) {
+      Free(FatBuffer.channels[i]);
+      FatBuffer.channels[i] = NULL;
+    }
+  }
+  if (sampleMemOwned) Free(sampleMem);
+  sampleMem = NULL;
+  sampleMemOwned = false;
+  lentMem = NULL;
+  sampleData = SAMPLEDATA_STREAMED;
+  Free(channelState);
+  channelState = NULL;
+  memset(&Player, 0, sizeof(Player));
+  memset(&FatBuffer, 0, sizeof(FatBuffer));
+  Mixer.channelSampleOffset = NULL;
+  Mixer.channelFrequency = NULL;
+  Mixer.channelSampleNumber = NULL;
+  Mixer.channelVolume = NULL;
+  Mixer.channelPanning = NULL;
+}
+
 // Sorted Amiga periods
 static const uint16_t amigaPeriods[296] PROGMEM = {
   907, 900, 894, 887, 881, 875, 868, 862, //  -8 to -1
@@ -188,6 +335,7 @@ static const uint8_t sine[64] PROGMEM = {
 
 
 static inline uint16_t MakeWord(uint8_t h, uint8_t l) { return h << 8 | l; }
+static inline bool IsDigit(uint8_t c) { return (c >= '0') && (c <= '9'); }
 
 bool AudioGeneratorMOD::LoadHeader()
 {
@@ -224,12 +372,30 @@ bool AudioGeneratorMOD::LoadHeader()
 
   // Offset 1080
   if (4 != file->read(temp, 4)) return false;;
-  if (!strncmp(reinterpret_cast<const char*>(temp + 1), "CHN", 3))
+  const char *tag = reinterpret_cast<const char*>(temp);
+  Mod.flt8 = !strncmp(tag, "FLT8", 4);
+  if (IsDigit(temp[0]) && !strncmp(tag + 1, "CHN", 3))
     Mod.numberOfChannels = temp[0] - '0';
-  else if (!strncmp(reinterpret_cast<const char*>(temp + 2), "CH", 2))
+  else if (IsDigit(temp[0]) && IsDigit(temp[1]) && (!strncmp(tag + 2, "CH", 2) || !strncmp(tag + 2, "CN", 2)))
     Mod.numberOfChannels = (temp[0] - '0') * 10 + temp[1] - '0';
+  else if (!strncmp(tag, "TDZ", 3) && IsDigit(temp[3]))
+    Mod.numberOfChannels = temp[3] - '0';
+  else if (Mod.flt8 || !strncmp(tag, "OCTA", 4) || !strncmp(tag, "CD81", 4))
+    Mod.numberOfChannels = 8;
   else
     Mod.numberOfChannels = 4;
+  if ((Mod.numberOfChannels < 1) || (Mod.numberOfChannels > MAXCHANNELS)) return false;
+
+  if (Mod.flt8) {
+    // The order list counts in 4 channel patterns, always the first of a pair
+    Mod.numberOfPatterns = 0;
+    for (i = 0; i < 128; i++) {
+      Mod.order[i] >>= 1;
+      if (Mod.order[i] > Mod.numberOfPatterns)
+        Mod.numberOfPatterns = Mod.order[i];
+    }
+    Mod.numberOfPatterns++;
+  }
 
   return true;
 }
@@ -239,6 +405,9 @@ void AudioGeneratorMOD::LoadSamples()
   uint8_t i;
   uint32_t fileOffset = 1084 + Mod.numberOfPatterns * ROWS * Mod.numberOfChannels * 4 - 1;
 
+  // Samples sit one after another, and the mixer can look one past the end of each
+  sampleStart = fileOffset;
+
   for (i = 0; i < SAMPLES; i++) {
 
     if (Mod.samples[i].length) {
@@ -258,6 +427,9 @@ void AudioGeneratorMOD::LoadSamples()
 
   }
 
+  sampleBytes = fileOffset + 2 - sampleStart;
+  if (file->getSize() && (sampleStart + sampleBytes > file->getSize()))
+    sampleBytes = (sampleStart < file->getSize()) ? file->getSize() - sampleStart : 0;
 }
 
 bool AudioGeneratorMOD::LoadPattern(uint8_t pattern)
@@ -265,28 +437,36 @@ bool AudioGeneratorMOD::LoadPattern(uint8_t pattern)
   uint8_t row;
   uint8_t channel;
   uint8_t i;
-  uint8_t temp[4];
+  uint8_t temp[MAXCHANNELS * 4];
   uint16_t amigaPeriod;
 
-  if (!file->seek(1084 + pattern * ROWS * Mod.numberOfChannels * 4, SEEK_SET)) return false;
+  // A whole row at a time, or for FLT8 the rows of channels 0-3 and then those of 4-7
+  uint8_t parts = Mod.flt8 ? 2 : 1;
+  uint8_t partChannels = Mod.numberOfChannels / parts;
+  lentMem = NULL;
+  for (uint8_t part = 0; part < parts; part++) {
+    if (!file->seek(1084 + (pattern * parts + part) * ROWS * partChannels * 4, SEEK_SET)) return false;
 
-  for (row = 0; row < ROWS; row++) {
-    for (channel = 0; channel < Mod.numberOfChannels; channel++) {
+    for (row = 0; row < ROWS; row++) {
+      if (partChannels * 4 != file->read(temp, partChannels * 4)) return false;
 
-      if (4 != file->read(temp, 4)) return false;
+      for (uint8_t c = 0; c < partChannels; c++) {
+        const uint8_t *cell = temp + c * 4;
+        channel = part * partChannels + c;
 
-      Player.currentPattern.sampleNumber[row][channel] = (temp[0] & 0xF0) + (temp[2] >> 4);
+        Player.currentPattern.sampleNumber[CELL(row, channel)] = (cell[0] & 0xF0) + (cell[2] >> 4);
 
-      amigaPeriod = ((temp[0] & 0xF) << 8) + temp[1];
-      //   Player.currentPattern.note[row][channel] = NONOTE;
-      Player.currentPattern.note8[row][channel] = NONOTE8;
-      for (i = 1; i < 37; i++)
-        if (amigaPeriod > ReadAmigaPeriods(i * 8) - 3 &&
-            amigaPeriod < ReadAmigaPeriods(i * 8) + 3)
-          Player.currentPattern.note8[row][channel] = i;
+        amigaPeriod = ((cell[0] & 0xF) << 8) + cell[1];
+        //   Player.currentPattern.note[row][channel] = NONOTE;
+        Player.currentPattern.note8[CELL(row, channel)] = NONOTE8;
+        for (i = 1; i < 37; i++)
+          if (amigaPeriod > ReadAmigaPeriods(i * 8) - 3 &&
+              amigaPeriod < ReadAmigaPeriods(i * 8) + 3)
+            Player.currentPattern.note8[CELL(row, channel)] = i;
 
-      Player.currentPattern.effectNumber[row][channel] = temp[2] & 0xF;
-      Player.currentPattern.effectParameter[row][channel] = temp[3];
+        Player.currentPattern.effectNumber[CELL(row, channel)] = cell[2] & 0xF;
+        Player.currentPattern.effectParameter[CELL(row, channel)] = cell[3];
+      }
     }
   }
 
@@ -405,10 +585,10 @@ bool AudioGeneratorMOD::ProcessRow()
   breakFlag = false;
   for (channel = 0; channel < Mod.numberOfChannels; channel++) {
 
-    sampleNumber = Player.currentPattern.sampleNumber[Player.lastRow][channel];
+    sampleNumber = Player.currentPattern.sampleNumber[CELL(Player.lastRow, channel)];
     note = NOTE(Player.lastRow, channel);
-    effectNumber = Player.currentPattern.effectNumber[Player.lastRow][channel];
-    effectParameter = Player.currentPattern.effectParameter[Player.lastRow][channel];
+    effectNumber = Player.currentPattern.effectNumber[CELL(Player.lastRow, channel)];
+    effectParameter = Player.currentPattern.effectParameter[CELL(Player.lastRow, channel)];
     effectParameterX = effectParameter >> 4;
     effectParameterY = effectParameter & 0xF;
     sampleOffset = 0;
@@ -592,11 +772,11 @@ bool AudioGeneratorMOD::ProcessTick()
 
     if (Player.lastAmigaPeriod[channel]) {
 
-      sampleNumber = Player.currentPattern.sampleNumber[Player.lastRow][channel];
+      sampleNumber = Player.currentPattern.sampleNumber[CELL(Player.lastRow, channel)];
       //   note = Player.currentPattern.note[Player.lastRow][channel];
       note = NOTE(Player.lastRow, channel);
-      effectNumber = Player.currentPattern.effectNumber[Player.lastRow][channel];
-      effectParameter = Player.currentPattern.effectParameter[Player.lastRow][channel];
+      effectNumber = Player.currentPattern.effectNumber[CELL(Player.lastRow, channel)];
+      effectParameter = Player.currentPattern.effectParameter[CELL(Player.lastRow, channel)];
       effectParameterX = effectParameter >> 4;
       effectParameterY = effectParameter & 0xF;
 
@@ -731,103 +911,176 @@ bool AudioGeneratorMOD::RunPlayer()
   return true;
 }
 
-void AudioGeneratorMOD::GetSample(int16_t sample[2])
+// Mixes the next samples of the current tick into mixed[].  Nothing the player does changes mid-tick, so
+// each channel's step, volume and panning hold for the whole block and it can be mixed in one go.
+void AudioGeneratorMOD::MixBlock(int samples)
 {
-  int16_t sumL;
-  int16_t sumR;
+  int32_t mixL[MIXBLOCK];
+  int32_t mixR[MIXBLOCK];
+  const int8_t *mem = sampleMem;
   uint8_t channel;
-  uint32_t samplePointer;
-  int8_t current;
-  int8_t next;
-  int16_t out;
 
-  if (!running) return;
+  if ((sampleData == SAMPLEDATA_LENT) && !lentMem) {
+    // Only good until the next call into the source, so asked for again after a pattern read or loop()
+    uint32_t avail = 0;
+    lentMem = file->seek(sampleStart, SEEK_SET) ? reinterpret_cast<const int8_t*>(file->acquire(sampleBytes, &avail)) : NULL;
+    if (!lentMem || (avail != sampleBytes)) {
+      lentMem = NULL;
+      stop();
+      return;
+    }
+  }
+  if (sampleData == SAMPLEDATA_LENT) mem = lentMem;
 
-  sumL = 0;
-  sumR = 0;
+  memset(mixL, 0, samples * sizeof(mixL[0]));
+  memset(mixR, 0, samples * sizeof(mixR[0]));
   for (channel = 0; channel < Mod.numberOfChannels; channel++) {
+    if (!MixChannel(channel, mem, mixL, mixR, samples)) {
+      stop();
+      return;
+    }
+  }
 
-    if (!Mixer.channelFrequency[channel] ||
-        !Mod.samples[Mixer.channelSampleNumber[channel]].length) continue;
-
-    Mixer.channelSampleOffset[channel] += Mixer.channelFrequency[channel];
-
-    if (!Mixer.channelVolume[channel]) continue;
+  for (int i = 0; i < samples; i++) {
+    // Downscale to BITDEPTH
+    int16_t sumL = mixL[i] / Mod.numberOfChannels;
+    int16_t sumR = mixR[i] / Mod.numberOfChannels;
 
-    samplePointer = Mixer.sampleBegin[Mixer.channelSampleNumber[channel]] +
-                    (Mixer.channelSampleOffset[channel] >> DIVIDER);
+    // Fill the sound buffer with unsigned values
+    mixed[i][AudioOutput::LEFTCHANNEL] = sumL + (1 << (BITDEPTH - 1));
+    mixed[i][AudioOutput::RIGHTCHANNEL] = sumR + (1 << (BITDEPTH - 1));
+  }
+  mixerTick -= samples;
+  mixedLen = samples;
+  mixedPos = 0;
+}
 
-    if (Mixer.sampleLoopLength[Mixer.channelSampleNumber[channel]]) {
+// Adds the channel's next samples to mixL/mixR, reading them from mem when sampleData is in memory and
+// through the channel's buffer otherwise.  False if the file couldn't be read.
+bool AudioGeneratorMOD::MixChannel(uint8_t channel, const int8_t *mem, int32_t *mixL, int32_t *mixR, int samples)
+{
+  uint8_t s = Mixer.channelSampleNumber[channel];
+  uint32_t frequency = Mixer.channelFrequency[channel];
+  uint32_t offset = Mixer.channelSampleOffset[channel];
+  int volume = Mixer.channelVolume[channel];
 
-      if (samplePointer >= Mixer.sampleLoopEnd[Mixer.channelSampleNumber[channel]]) {
-        Mixer.channelSampleOffset[channel] -= Mixer.sampleLoopLength[Mixer.channelSampleNumber[channel]] << DIVIDER;
-        samplePointer -= Mixer.sampleLoopLength[Mixer.channelSampleNumber[channel]];
-      }
+  if (!frequency || !Mod.samples[s].length) return true;
 
-    } else {
+  // Silent channels still move along, as far as they would have one sample at a time
+  if (!volume) {
+    Mixer.channelSampleOffset[channel] = offset + frequency * samples;
+    return true;
+  }
 
-      if (samplePointer >= Mixer.sampleEnd[Mixer.channelSampleNumber[channel]]) {
-        Mixer.channelFrequency[channel] = 0;
-        samplePointer = Mixer.sampleEnd[Mixer.channelSampleNumber[channel]];
+  uint32_t begin = Mixer.sampleBegin[s];
+  uint32_t end = Mixer.sampleEnd[s];
+  uint32_t loopLength = Mixer.sampleLoopLength[s];
+  uint32_t loopEnd = Mixer.sampleLoopEnd[s];
+  int panL = min(128 - Mixer.channelPanning[channel], 64);
+  int panR = min(Mixer.channelPanning[channel], 64);
+  bool lerp = interpolate;
+
+  for (int i = 0; i < samples; i++) {
+    offset += frequency;
+    uint32_t samplePointer = begin + (offset >> DIVIDER);
+
+    if (loopLength) {
+      if (samplePointer >= loopEnd) {
+        offset -= loopLength << DIVIDER;
+        samplePointer -= loopLength;
       }
-
+    } else if (samplePointer >= end) {
+      // Play the last point, then the channel stops
+      frequency = 0;
+      samplePointer = end;
     }
 
-    if (samplePointer < FatBuffer.samplePointer[channel] ||
-        samplePointer >= FatBuffer.samplePointer[channel] + fatBufferSize - 1 ||
-        Mixer.channelSampleNumber[channel] != FatBuffer.channelSampleNumber[channel]) {
-
-      uint16_t toRead = Mixer.sampleEnd[Mixer.channelSampleNumber[channel]] - samplePointer + 1;
-      if (toRead > fatBufferSize) toRead  = fatBufferSize;
-
-      if (!file->seek(samplePointer, SEEK_SET)) {
-        stop();
-        return;
-      }
-      if (toRead != file->read(FatBuffer.channels[channel], toRead)) {
-        stop();
-        return;
+    int8_t current, next;
+    if (mem) {
+      uint32_t at = samplePointer - sampleStart;
+      if (at + 1 < sampleBytes) {
+        current = mem[at];
+        next = mem[at + 1];
+      } else {
+        current = (at < sampleBytes) ? mem[at] : 0;
+        next = 0;
       }
-
-      FatBuffer.samplePointer[channel] = samplePointer;
-      FatBuffer.channelSampleNumber[channel] = Mixer.channelSampleNumber[channel];
+    } else if (!StreamSample(channel, samplePointer, &current, &next)) {
+      return false;
     }
 
-    current = FatBuffer.channels[channel][(samplePointer - FatBuffer.samplePointer[channel]) /*& (FATBUFFERSIZE - 1)*/];
-    next = FatBuffer.channels[channel][(samplePointer + 1 - FatBuffer.samplePointer[channel]) /*& (FATBUFFERSIZE - 1)*/];
-
-    out = current;
+    int out = current;
 
     // Integer linear interpolation
-    out += (next - current) * (Mixer.channelSampleOffset[channel] & ((1 << DIVIDER) - 1)) >> DIVIDER;
+    if (lerp) out += ((next - current) * (int)(offset & ((1 << DIVIDER) - 1))) >> DIVIDER;
 
     // Upscale to BITDEPTH
     out <<= BITDEPTH - 8;
 
     // Channel volume
-    out = out * Mixer.channelVolume[channel] >> 6;
+    out = out * volume >> 6;
 
     // Channel panning
-    sumL += out * min(128 - Mixer.channelPanning[channel], 64) >> 6;
-    sumR += out * min(Mixer.channelPanning[channel], 64) >> 6;
+    mixL[i] += out * panL >> 6;
+    mixR[i] += out * panR >> 6;
+
+    if (!frequency) break;
   }
 
-  // Downscale to BITDEPTH
-  sumL /= Mod.numberOfChannels;
-  sumR /= Mod.numberOfChannels;
+  Mixer.channelSampleOffset[channel] = offset;
+  Mixer.channelFrequency[channel] = frequency;
+  return true;
+}
+
+// The sample point at samplePointer and the one after, refilling the channel's buffer from the file when
+// they aren't both in it
+bool AudioGeneratorMOD::StreamSample(uint8_t channel, uint32_t samplePointer, int8_t *current, int8_t *next)
+{
+  if (samplePointer < FatBuffer.samplePointer[channel] ||
+      samplePointer + 1 >= FatBuffer.samplePointer[channel] + FatBuffer.length[channel] ||
+      Mixer.channelSampleNumber[channel] != FatBuffer.channelSampleNumber[channel]) {
+
+    // Through the point after the end, which the last one interpolates towards, when the file has it.  A
+    // sample offset effect can leave a looped sample playing past its end, from whatever follows it.
+    uint32_t end = Mixer.sampleEnd[Mixer.channelSampleNumber[channel]];
+    uint32_t toRead = (samplePointer <= end) ? end - samplePointer + 2 : fatBufferSize;
+    if (toRead > (uint32_t)fatBufferSize) toRead = fatBufferSize;
+
+    if (!file->seek(samplePointer, SEEK_SET)) return false;
+    uint32_t got = file->read(FatBuffer.channels[channel], toRead);
+    if (got + 1 < toRead) return false;
+    if (got < toRead) FatBuffer.channels[channel][got] = 0;
+
+    FatBuffer.samplePointer[channel] = samplePointer;
+    FatBuffer.length[channel] = toRead;
+    FatBuffer.channelSampleNumber[channel] = Mixer.channelSampleNumber[channel];
+  }
 
-  // Fill the sound buffer with unsigned values
-  sample[AudioOutput::LEFTCHANNEL] = sumL + (1 << (BITDEPTH - 1));
-  sample[AudioOutput::RIGHTCHANNEL] = sumR + (1 << (BITDEPTH - 1));
+  *current = FatBuffer.channels[channel][(samplePointer - FatBuffer.samplePointer[channel]) /*& (FATBUFFERSIZE - 1)*/];
+  *next = FatBuffer.channels[channel][(samplePointer + 1 - FatBuffer.samplePointer[channel]) /*& (FATBUFFERSIZE - 1)*/];
+  return true;
 }
 
 bool AudioGeneratorMOD::LoadMOD()
 {
-  uint8_t channel;
-
   if (!LoadHeader()) return false;
+  if (!SetupChannels()) return false;
   LoadSamples();
+  ResetPlayer();
+  return true;
+}
 
+void AudioGeneratorMOD::ResetPlayer()
+{
+  uint8_t channel;
+
+  mixerTick = 0;
+  playedSamples = 0;
+  mixedLen = 0;
+  mixedPos = 0;
+
+  // Nothing left over from the last time through when a seek restarts the song
+  memset(channelState, 0, playerChannelSize(Mod.numberOfChannels));
   Player.amiga = AMIGA;
   Player.samplesPerTick = sampleRate / (2 * 125 / 5); // Hz = 2 * BPM / 5
   Player.speed = 6;
@@ -855,6 +1108,7 @@ bool AudioGeneratorMOD::LoadMOD()
     Player.tremoloPos[channel] = 0;
 
     FatBuffer.samplePointer[channel] = 0;
+    FatBuffer.length[channel] = 0;
     FatBuffer.channelSampleNumber[channel] = 0xFF;
 
     Mixer.channelSampleOffset[channel] = 0;
@@ -869,6 +1123,61 @@ bool AudioGeneratorMOD::LoadMOD()
         Mixer.channelPanning[channel] = 128 - stereoSeparation;
     }
   }
+}
+
+bool AudioGeneratorMOD::seekTo(uint32_t ms)
+{
+  if (!running) return false;
+  uint32_t now = playedSamples - mixerTick - (mixedLen - mixedPos);
+  uint32_t target = ((uint64_t)ms * sampleRate) / 1000;
+
+  if (target < now) {
+    ResetPlayer();
+  } else {
+    // Carry on from here, after finishing off the current tick
+    SkipMixer(mixerTick);
+    mixerTick = 0;
+    mixedLen = 0;
+    mixedPos = 0;
+  }
+  if (SkipRows(target)) return true;
+
+  // Ran off the end of the song, so go back to where we were
+  ResetPlayer();
+  SkipRows(now);
+  return false;
+}
+
+// Run the player a tick at a time until the next row starts at or after toSample, only
+// moving the mixer's sample positions along instead of mixing
+bool AudioGeneratorMOD::SkipRows(uint32_t toSample)
+{
+  while ((Player.tick != Player.speed) || (playedSamples < toSample)) {
+    if (!RunPlayer()) return false;
+    playedSamples += Player.samplesPerTick;
+    SkipMixer(Player.samplesPerTick);
+  }
   return true;
 }
 
+// What MixBlock() does to the channel positions over that many samples
+void AudioGeneratorMOD::SkipMixer(uint32_t samples)
+{
+  for (uint8_t channel = 0; channel < Mod.numberOfChannels; channel++) {
+    uint8_t s = Mixer.channelSampleNumber[channel];
+    if (!Mixer.channelFrequency[channel] || !Mod.samples[s].length) continue;
+
+    Mixer.channelSampleOffset[channel] += Mixer.channelFrequency[channel] * samples;
+    uint32_t samplePointer = Mixer.sampleBegin[s] + (Mixer.channelSampleOffset[channel] >> DIVIDER);
+
+    if (Mixer.sampleLoopLength[s]) {
+      if (samplePointer >= Mixer.sampleLoopEnd[s]) {
+        uint32_t loops = (samplePointer - Mixer.sampleLoopEnd[s]) / Mixer.sampleLoopLength[s] + 1;
+        Mixer.channelSampleOffset[channel] -= (loops * Mixer.sampleLoopLength[s]) << DIVIDER;
+      }
+    } else if (samplePointer >= Mixer.sampleEnd[s]) {
+      Mixer.channelFrequency[channel] = 0;
+    }
+  }
+}
+
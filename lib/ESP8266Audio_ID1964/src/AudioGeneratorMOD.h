@@ -22,27 +22,66 @@
 #define _AUDIOGENERATORMOD_H
 
 #include "AudioGenerator.h"
+#include "AudioArena.h"
 
 class AudioGeneratorMOD : public AudioGenerator
 {
   public:
     AudioGeneratorMOD();
+    AudioGeneratorMOD(void *preallocateSpace, int preallocateSize);
     virtual ~AudioGeneratorMOD() override;
     virtual bool begin(AudioFileSource *source, AudioOutput *output) override;
     virtual bool loop() override;
     virtual bool stop() override;
     virtual bool isRunning() override { return running; }
     bool SetSampleRate(int hz) { if (running || (hz < 1) || (hz > 96000) ) return false; sampleRate = hz; return true; }
-    bool SetBufferSize(int sz) { if (running || (sz < 1) ) return false; fatBufferSize = sz; return true; }
+    bool SetBufferSize(int sz) { if (running || (sz < 2) ) return false; fatBufferSize = sz; return true; }
     bool SetStereoSeparation(int sep) { if (running || (sep<0) || (sep>64)) return false; stereoSeparation = sep; return true; }
     bool SetPAL(bool use) { if (running) return false; usePAL = use; return true; }
 
+    // Sources that can lend their memory (see AudioFileSource::acquire()) are always mixed from in place.
+    // Otherwise samples stream through a SetBufferSize() buffer per channel, with a seek and read each time a
+    // channel moves off its buffer, unless SetPreload() has begin() read every sample into RAM up front:  PSRAM
+    // on an ESP32 that has it, or the preallocated block if that's at least GetSampleBytes().  A song that
+    // doesn't fit streams as usual.
+    bool SetPreload(bool use) { if (running) return false; preload = use; return true; }
+    // Linear interpolation between sample points, on by default.  Off is cheaper and sounds grittier.
+    void SetInterpolation(bool use) { interpolate = use; }
+    enum { SAMPLEDATA_STREAMED, SAMPLEDATA_LENT, SAMPLEDATA_LOADED };
+    int GetSampleData() const { return sampleData; }
+    // Bytes of sample data in the song, known after begin()
+    uint32_t GetSampleBytes() const { return sampleBytes; }
+
+    // Seeks land on the first row starting at or after ms.  The rows ahead of it are run through
+    // the player without mixing, so tempo changes, jumps and loops are followed exactly and every
+    // channel picks up mid-note where it would have been.  Going backwards starts over from the top.
+    virtual bool seekTo(uint32_t ms) override;
+    virtual uint32_t tell() override { return running ? ((uint64_t)(playedSamples - mixerTick - (mixedLen - mixedPos)) * 1000) / sampleRate : 0; }
+
+    // 4 to 32 channel songs play:  M.K. and the other 4 channel tags, xCHN, xxCH, TDZx, and the 8 channel
+    // FLT8, OCTA and CD81.  Everything kept per channel is sized for the song at begin().
+    int GetChannels() const { return running ? Mod.numberOfChannels : 0; }
+
+    // Bytes needed by the preallocate constructor for songs of up to that many channels, when streaming
+    // samples through SetBufferSize() buffers
+    static constexpr int preAllocSize(int fatBufferSize = 6 * 1024, int channels = 4) {
+      return AudioArena::blockSize(channelStateSize(channels)) + channels * AudioArena::blockSize(fatBufferSize);
+    }
+
   protected:
     bool LoadMOD();
+    void ResetPlayer();
+    bool SkipRows(uint32_t toSample);
+    void SkipMixer(uint32_t samples);
     bool LoadHeader();
-    void GetSample(int16_t sample[2]);
     bool RunPlayer();
     void LoadSamples();
+    bool SetupChannels();
+    void FreeChannels();
+    bool SetupSampleData();
+    void MixBlock(int samples);
+    bool MixChannel(uint8_t channel, const int8_t *mem, int32_t *mixL, int32_t *mixR, int samples);
+    bool StreamSample(uint8_t channel, uint32_t samplePointer, int8_t *current, int8_t *next);
     bool LoadPattern(uint8_t pattern);
     bool ProcessTick();
     bool ProcessRow();
@@ -52,20 +91,42 @@ class AudioGeneratorMOD : public AudioGenerator
 
 
   protected:
-    int mixerTick;
+    int mixerTick;          // Samples of the current tick still to mix
+    uint32_t playedSamples; // Including the rest of the current tick
+    enum {MIXBLOCK = 64};   // Samples mixed at a time, never across a tick
+    int16_t mixed[MIXBLOCK][2];
+    int mixedLen;
+    int mixedPos;           // Next of mixed[] to send
     enum {BITDEPTH = 16};
     int sampleRate; 
-    int fatBufferSize; //(6*1024) // File system buffers per-CHANNEL (i.e. total mem required is 4 * FATBUFFERSIZE)
+    int fatBufferSize; //(6*1024) // File system buffers per-CHANNEL (i.e. total mem required is channels * FATBUFFERSIZE)
     enum {DIVIDER = 10};             // Fixed-point mantissa used for integer arithmetic
     int stereoSeparation; //STEREOSEPARATION = 32;    // 0 (max) to 64 (mono)
     bool usePAL;
+    bool preload;
+    bool interpolate;
+
+    // Where samples are mixed from:  sampleBytes of the file from sampleStart, covering every sample plus the
+    // byte after, either lent by the source or loaded into sampleMem (ours to free if sampleMemOwned)
+    int sampleData;
+    uint32_t sampleStart;
+    uint32_t sampleBytes;
+    int8_t *sampleMem;
+    bool sampleMemOwned;
+    const int8_t *lentMem; // What the source last lent, NULL once we've called into it again since
+
+    // The preallocated block, when there is one, holds the channel state and then either the samples or
+    // the channels' file buffers
+    AudioArena arena;
+    void *Allocate(int bytes) { return arena.isActive() ? arena.allocate(bytes) : malloc(bytes); }
+    void Free(void *ptr) { if (arena.owns(ptr)) arena.release(ptr); else free(ptr); }
     
     // Hz = 7093789 / (amigaPeriod * 2) for PAL
     // Hz = 7159091 / (amigaPeriod * 2) for NTSC
     int AMIGA;
     void UpdateAmiga() { AMIGA = ((usePAL?7159091:7093789) / 2 / sampleRate << DIVIDER); }
     
-    enum {ROWS = 64, SAMPLES = 31, CHANNELS = 4, NONOTE = 0xFFFF, NONOTE8 = 0xff };
+    enum {ROWS = 64, SAMPLES = 31, MAXCHANNELS = 32, NONOTE = 0xFFFF, NONOTE8 = 0xff };
 
     typedef struct Sample {
       uint16_t length;
@@ -81,14 +142,16 @@ class AudioGeneratorMOD : public AudioGenerator
       uint8_t numberOfPatterns;
       uint8_t order[128];
       uint8_t numberOfChannels;
+      bool flt8;                   // Patterns stored as pairs of 4 channel ones, channels 0-3 then 4-7
     } mod;
     
-    // Save 256 bytes by storing raw note values, unpack with macro NOTE
+    // Save 256 bytes a channel by storing raw note values, unpack with macro NOTE.  ROWS x channels each,
+    // a row at a time.
     typedef struct Pattern {
-      uint8_t sampleNumber[ROWS][CHANNELS];
-      uint8_t note8[ROWS][CHANNELS];
-      uint8_t effectNumber[ROWS][CHANNELS];
-      uint8_t effectParameter[ROWS][CHANNELS];
+      uint8_t *sampleNumber;
+      uint8_t *note8;
+      uint8_t *effectNumber;
+      uint8_t *effectParameter;
     } Pattern;
     
     typedef struct player {
@@ -104,27 +167,30 @@ class AudioGeneratorMOD : public AudioGenerator
       uint8_t orderIndex;
       uint8_t oldOrderIndex;
       uint8_t patternDelay;
-      uint8_t patternLoopCount[CHANNELS];
-      uint8_t patternLoopRow[CHANNELS];
+
+      // One entry per channel in each of these
+      uint16_t *lastNote;
+      uint16_t *amigaPeriod;
+      int16_t *lastAmigaPeriod;
+      uint16_t *portamentoNote;
+
+      uint8_t *patternLoopCount;
+      uint8_t *patternLoopRow;
     
-      uint8_t lastSampleNumber[CHANNELS];
-      int8_t volume[CHANNELS];
-      uint16_t lastNote[CHANNELS];
-      uint16_t amigaPeriod[CHANNELS];
-      int16_t lastAmigaPeriod[CHANNELS];
+      uint8_t *lastSampleNumber;
+      int8_t *volume;
     
-      uint16_t portamentoNote[CHANNELS];
-      uint8_t portamentoSpeed[CHANNELS];
+      uint8_t *portamentoSpeed;
     
-      uint8_t waveControl[CHANNELS];
+      uint8_t *waveControl;
     
-      uint8_t vibratoSpeed[CHANNELS];
-      uint8_t vibratoDepth[CHANNELS];
-      int8_t vibratoPos[CHANNELS];
+      uint8_t *vibratoSpeed;
+      uint8_t *vibratoDepth;
+      int8_t *vibratoPos;
     
-      uint8_t tremoloSpeed[CHANNELS];
-      uint8_t tremoloDepth[CHANNELS];
-      int8_t tremoloPos[CHANNELS];
+      uint8_t *tremoloSpeed;
+      uint8_t *tremoloDepth;
+      int8_t *tremoloPos;
     } player;
     
     typedef struct mixer {
@@ -134,19 +200,33 @@ class AudioGeneratorMOD : public AudioGenerator
       uint16_t sampleLoopLength[SAMPLES];
       uint32_t sampleLoopEnd[SAMPLES];
     
-      uint8_t channelSampleNumber[CHANNELS];
-      uint32_t channelSampleOffset[CHANNELS];
-      uint16_t channelFrequency[CHANNELS];
-      uint8_t channelVolume[CHANNELS];
-      uint8_t channelPanning[CHANNELS];
+      // One entry per channel in each of these
+      uint32_t *channelSampleOffset;
+      uint16_t *channelFrequency;
+      uint8_t *channelSampleNumber;
+      uint8_t *channelVolume;
+      uint8_t *channelPanning;
     } mixer;
     
     typedef struct fatBuffer {
-      uint8_t *channels[CHANNELS]; // Make dynamically allocated [FATBUFFERSIZE];
-      uint32_t samplePointer[CHANNELS];
-      uint8_t channelSampleNumber[CHANNELS];
+      // One entry per channel in each of these
+      uint8_t **channels;          // Each fatBufferSize bytes, allocated when streaming
+      uint32_t *samplePointer;
+      uint32_t *length;            // Bytes read in from samplePointer
+      uint8_t *channelSampleNumber;
     } fatBuffer;
 
+    // Everything above kept per channel lives in one block of this size, an array per field.  The
+    // player's arrays come first, so ResetPlayer() can clear them all at once.
+    static constexpr int arraySize(int bytes) { return (bytes + 7) & ~7; }
+    static constexpr int playerChannelSize(int channels) { return 4 * arraySize(2 * channels) + 12 * arraySize(channels); }
+    static constexpr int channelStateSize(int channels) {
+      return playerChannelSize(channels) + 4 * arraySize(ROWS * channels) +
+             arraySize(4 * channels) + arraySize(2 * channels) + 3 * arraySize(channels) +
+             arraySize(sizeof(uint8_t*) * channels) + 2 * arraySize(4 * channels) + arraySize(channels);
+    }
+    uint8_t *channelState;
+
     // Effects
     typedef enum { ARPEGGIO = 0, PORTAMENTOUP, PORTAMENTODOWN, TONEPORTAMENTO, VIBRATO, PORTAMENTOVOLUMESLIDE,
                    VIBRATOVOLUMESLIDE, TREMOLO, SETCHANNELPANNING, SETSAMPLEOFFSET, VOLUMESLIDE, JUMPTOORDER,
@@ -27,8 +27,20 @@ AudioGeneratorMP3::AudioGeneratorMP3()
   file = NULL;
   output = NULL;
   buff = NULL;
+  stream = NULL;
+  frame = NULL;
+  synth = NULL;
   nsCountMax = 1152/32;
   madInitted = false;
+  waiting = false;
+  samplePos = 0;
+  skipSamples = 0;
+  endSample = 0;
+  decodeMode = DECODE_FULL;
+  autoMode = true;
+  options = 0;
+  ResetDecodeStats();
+  memset(&syncStats, 0, sizeof(syncStats));
   preallocateSpace = NULL;
   preallocateSize = 0;
 }
@@ -39,8 +51,20 @@ AudioGeneratorMP3::AudioGeneratorMP3(void *space, int size)
   file = NULL;
   output = NULL;
   buff = NULL;
+  stream = NULL;
+  frame = NULL;
+  synth = NULL;
   nsCountMax = 1152/32;
   madInitted = false;
+  waiting = false;
+  samplePos = 0;
+  skipSamples = 0;
+  endSample = 0;
+  decodeMode = DECODE_FULL;
+  autoMode = true;
+  options = 0;
+  ResetDecodeStats();
+  memset(&syncStats, 0, sizeof(syncStats));
   preallocateSpace = space;
   preallocateSize = size;
 }
@@ -48,7 +72,7 @@ AudioGeneratorMP3::AudioGeneratorMP3(void *space, int size)
 AudioGeneratorMP3::~AudioGeneratorMP3()
 {
   if (!preallocateSpace) {
-    free(buff);
+    input.end();
     free(synth);
     free(frame);
     free(stream);
@@ -66,7 +90,7 @@ bool AudioGeneratorMP3::stop()
   }
 
   if (!preallocateSpace) {
-    free(buff);
+    input.end();
     free(synth);
     free(frame);
     free(stream);
@@ -89,43 +113,43 @@ bool AudioGeneratorMP3::isRunning()
 
 enum mad_flow AudioGeneratorMP3::ErrorToFlow()
 {
-  char err[64];
-  char errLine[128];
-
   // Special case - eat "lost sync @ byte 0" as it always occurs and is not really correct....it never had sync!
   if ((lastReadPos==0) && (stream->error==MAD_ERROR_LOSTSYNC)) return MAD_FLOW_CONTINUE;
 
-  strcpy_P(err, mad_stream_errorstr(stream));
-  snprintf_P(errLine, sizeof(errLine), PSTR("Decoding error '%s' at byte offset %d"),
-           err, (stream->this_frame - buff) + lastReadPos);
-  yield(); // Something bad happened anyway, ensure WiFi gets some time, too
-  cb.st(stream->error, errLine);
+  // Just the raw facts, any text is only built if someone registered for it
+  cb.report(stream->error, (stream->this_frame - stream->buffer) + lastReadPos, mad_stream_errorstr(stream));
   return MAD_FLOW_CONTINUE;
 }
 
 enum mad_flow AudioGeneratorMP3::Input()
 {
-  int unused = 0;
-
   if (stream->next_frame) {
-    unused = buffLen - (stream->next_frame - buff);
-    memmove(buff, stream->next_frame, unused);
+    input.consume(stream->next_frame - input.data());
     stream->next_frame = NULL;
+  } else {
+    input.consume(input.available());
   }
+  int unused = input.available();
   if (unused == buffLen) {
     // Something wicked this way came, throw it all out and try again
+    input.consume(unused);
     unused = 0;
   }
 
-  lastReadPos = file->getPos() - unused;
-  int len = buffLen - unused;
-  len = file->read(buff + unused, len);
+  // libmad can't tell us how much it wants, so top the window up completely
+  int len = input.fill(file, buffLen) - unused;
+  if ((len == 0) && !input.isEOF()) {
+    // A stream with nothing new yet, keep what's here and pick up from it on the next loop()
+    stream->next_frame = input.data();
+    return MAD_FLOW_BREAK;
+  }
   if (len == 0) {
     Serial.printf_P(PSTR("MP3 stop, len==0\n"));
     return MAD_FLOW_STOP;
   }
+  lastReadPos = input.getPos(file);
 
-  mad_stream_buffer(stream, buff, len + unused);
+  mad_stream_buffer(stream, input.data(), input.available());
 
   return MAD_FLOW_CONTINUE;
 }
@@ -133,33 +157,68 @@ enum mad_flow AudioGeneratorMP3::Input()
 
 bool AudioGeneratorMP3::DecodeNextFrame()
 {
-  if (mad_frame_decode(frame, stream) == -1) {
+  uint32_t start = micros();
+  bool ok = (mad_frame_decode(frame, stream) != -1);
+  uint32_t usec = micros() - start;
+
+  // Errors from here on mean the header was good, so the frame is there even if its audio isn't
+  bool haveHeader = ok || (stream->error >= MAD_ERROR_BADCRC);
+  if (haveHeader && !index.isValid()) {
+    // First frame, which may be a Xing/VBRI tag instead of audio
+    bool tag = index.begin(file, stream->this_frame, stream->next_frame - stream->this_frame, lastReadPos + (stream->this_frame - stream->buffer));
+    skipSamples = index.getStartSkip();
+    endSample = index.hasGaplessInfo() ? index.getTaggedSamples() : 0;
+    if (tag) {
+      stream->error = MAD_ERROR_NONE; // Nothing wrong, but nothing to play either
+      return false;
+    }
+  }
+
+  if (!ok) {
+    if (haveHeader) FrameLost();
     ErrorToFlow(); // Always returns CONTINUE
     return false;
   }
   nsCountMax  = MAD_NSBSAMPLES(&frame->header);
+
+  // Frames wholly inside the skip are decoded for their overlap but kept out of the filterbank,
+  // except for the last one, which primes it for the frame we're really after
+  uint32_t frameSamples = nsCountMax * 32;
+  if (skipSamples >= frameSamples) {
+    skipSamples -= frameSamples;
+    if (skipSamples < frameSamples) {
+      for (int ns = 0; ns < nsCountMax; ns++) mad_synth_frame_onens(synth, frame, ns);
+      BudgetSpend(frameSamples);
+    }
+    stream->error = MAD_ERROR_NONE;
+    return false;
+  }
+  DecodeTime(usec, 0);
   return true;
 }
 
-bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
+void AudioGeneratorMP3::FrameLost()
 {
-  if (synth->pcm.samplerate != lastRate) {
-    output->SetRate(synth->pcm.samplerate);
-    lastRate = synth->pcm.samplerate;
-  }
-  if (synth->pcm.channels != lastChannels) {
-    output->SetChannels(synth->pcm.channels);
-    lastChannels = synth->pcm.channels;
+  // A frame that decoded to nothing still moves the clock along
+  uint32_t n = index.getFrameSamples();
+  if (skipSamples >= n) {
+    skipSamples -= n;
+  } else {
+    samplePos += n - skipSamples;
+    skipSamples = 0;
   }
-    
+}
+
+bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
+{
+  // Positions are kept in samples at the file's rate, each of which is half a sample at half rate
+  int shift = (frame->options & MAD_OPTION_HALFSAMPLERATE) ? 1 : 0;
+
   // If we're here, we have one decoded frame and sent 0 or more samples out
-  if (samplePtr < synth->pcm.length) {
-    sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
-    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[1][samplePtr];
-    samplePtr++;
-  } else {
+  while (samplePtr >= synth->pcm.length) {
     samplePtr = 0;
     
+    uint32_t start = micros();
     switch ( mad_synth_frame_onens(synth, frame, nsCount++) ) {
         case MAD_FLOW_STOP:
         case MAD_FLOW_BREAK: Serial.printf_P(PSTR("msf1ns failed\n"));
@@ -167,11 +226,30 @@ bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
         default:
           break; // Do nothing
     }
-    // for IGNORE and CONTINUE, just play what we have now
-    sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
-    sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[1][samplePtr];
-    samplePtr++;
+    DecodeTime(micros() - start, synth->pcm.length << shift);
+    BudgetSpend(synth->pcm.length);
+    // for IGNORE and CONTINUE, just play what we have now, less anything still to be skipped.
+    // DecodeNextFrame() leaves less than a frame's worth of that, so this always ends in this frame.
+    if (skipSamples) {
+      uint32_t n = skipSamples >> shift;
+      if (n > (uint32_t)synth->pcm.length) n = synth->pcm.length;
+      samplePtr = n;
+      skipSamples = (n < (uint32_t)synth->pcm.length) ? 0 : skipSamples - (n << shift);
+    }
+  }
+  // Checked after synthesis, as a change of decode mode can change both from one frame to the next
+  if (synth->pcm.samplerate != lastRate) {
+    output->SetRate(synth->pcm.samplerate);
+    lastRate = synth->pcm.samplerate;
+  }
+  if (synth->pcm.channels != lastChannels) {
+    output->SetChannels(synth->pcm.channels);
+    lastChannels = synth->pcm.channels;
   }
+  sample[AudioOutput::LEFTCHANNEL ] = synth->pcm.samples[0][samplePtr];
+  sample[AudioOutput::RIGHTCHANNEL] = synth->pcm.samples[(synth->pcm.channels == 2) ? 1 : 0][samplePtr];
+  samplePtr++;
+  samplePos += 1 << shift;
   return true;
 }
 
@@ -179,22 +257,37 @@ bool AudioGeneratorMP3::GetOneSample(int16_t sample[2])
 bool AudioGeneratorMP3::loop()
 {
   if (!running) goto done; // Nothing to do here!
+  BudgetStart();
 
   // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
+  if (!waiting && !SendSample(lastSample)) goto done; // Can't send, but no error detected
+  waiting = false;
 
   // Try and stuff the buffer one sample at a time
   do
   {
+    if (endSample && (samplePos >= endSample)) {
+      running = false; // Only the encoder's padding is left
+      goto done;
+    }
+
     // Decode next frame if we're beyond the existing generated data
     if ( (samplePtr >= synth->pcm.length) && (nsCount >= nsCountMax) ) {
 retry:
-      if (Input() == MAD_FLOW_STOP) {
+      enum mad_flow flow = Input();
+      if (flow == MAD_FLOW_STOP) {
         return false;
       }
+      if (flow == MAD_FLOW_BREAK) {
+        waiting = true; // On the source, come back for the next frame without resending this sample
+        goto done;
+      }
 
-      if (!DecodeNextFrame()) {
-        goto retry;
+      while (!DecodeNextFrame()) {
+        // Refilling the buffer makes libmad assume it's in sync again, which turns one bad byte
+        // into an error per byte.  Recoverable errors have already skipped ahead, so let libmad
+        // resync from there and only go back for more data when it runs out.
+        if (!MAD_RECOVERABLE(stream->error)) goto retry;
       }
       samplePtr = 9999;
       nsCount = 0;
@@ -205,7 +298,8 @@ retry:
       running = false;
       goto done;
     }
-  } while (running && output->ConsumeSample(lastSample));
+    // Leave the sample pending if the next one needs a new synth pass and we're out of time
+  } while (running && !((samplePtr >= synth->pcm.length) && BudgetExhausted()) && SendSample(lastSample));
 
 done:
   file->loop();
@@ -238,6 +332,10 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
   lastRate = 0;
   lastChannels = 0;
   lastReadPos = 0;
+  index.reset();
+  samplePos = 0;
+  skipSamples = 0;
+  endSample = 0;
 
   // Allocate all large memory chunks
   if (preallocateSpace) {
@@ -252,20 +350,19 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
     p += (sizeof(struct mad_synth)+7) & ~7;
     int neededBytes = p - reinterpret_cast<uint8_t *>(preallocateSpace);
     if (neededBytes > preallocateSize) {
-      Serial.printf_P("OOM error in MP3:  Want %d bytes, have %d bytes preallocated.\n", neededBytes, preallocateSize);
+      Serial.printf_P(PSTR("OOM error in MP3:  Want %d bytes, have %d bytes preallocated.\n"), neededBytes, preallocateSize);
       return false;
     }
   } else {
-    buff = reinterpret_cast<unsigned char *>(malloc(buffLen));
+    // No input buffer, the window only allocates one if the source can't lend its data
+    buff = NULL;
     stream = reinterpret_cast<struct mad_stream *>(malloc(sizeof(struct mad_stream)));
     frame = reinterpret_cast<struct mad_frame *>(malloc(sizeof(struct mad_frame)));
     synth = reinterpret_cast<struct mad_synth *>(malloc(sizeof(struct mad_synth)));
-    if (!buff || !stream || !frame || !synth) {
-      free(buff);
+    if (!stream || !frame || !synth) {
       free(stream);
       free(frame);
       free(synth);
-      buff = NULL;
       stream = NULL;
       frame = NULL;
       synth = NULL;
@@ -273,17 +370,93 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
     }
   }
  
+  input.begin(buff, buffLen);
   mad_stream_init(stream);
+  memset(&syncStats, 0, sizeof(syncStats));
+  stream->syncStats = &syncStats;
   mad_frame_init(frame);
   mad_synth_init(synth);
   synth->pcm.length = 0;
-  mad_stream_options(stream, 0); // TODO - add options support
+  ResetDecodeStats();
+  SetDecodeMode(decodeMode, autoMode);
   madInitted = true;
+  waiting = false;
  
   running = true;
   return true;
 }
 
+bool AudioGeneratorMP3::seekMs(uint32_t ms)
+{
+  uint32_t offset, position, skip;
+  if (!running || !index.locate(ms, seekPreroll, &offset, &position, &skip)) return false;
+  if (!file->seek(offset, SEEK_SET)) return false;
+
+  // Start over with an empty window and a clean decoder, the frames ahead of the target are decoded and dropped
+  input.reset();
+  mad_stream_finish(stream);
+  mad_stream_init(stream);
+  stream->syncStats = &syncStats;
+  mad_stream_options(stream, options);
+  mad_frame_mute(frame);
+  mad_synth_mute(synth);
+  synth->pcm.length = 0;
+  samplePtr = 9999;
+  nsCount = 9999;
+  lastReadPos = offset;
+  samplePos = position;
+  skipSamples = skip;
+  return true;
+}
+
+void AudioGeneratorMP3::SetDecodeMode(int mode, bool automatic)
+{
+  decodeMode = mode;
+  autoMode = automatic;
+  options = mode;
+  // A channel asked for stands, otherwise a mono output may as well only get the mix
+  if (autoMode && output && output->IsMono() && !(options & DECODE_MONO)) options |= DECODE_MONO;
+  if (stream) mad_stream_options(stream, options);
+}
+
+// Keeps track of how long decoding takes against how long the audio plays for.  When automatic, a load of
+// HALFRATE_LOAD or more twice running (once may just be the source holding things up) halves the synthesis
+// rate, and a second spent under FULLRATE_LOAD brings it back.
+void AudioGeneratorMP3::DecodeTime(uint32_t usec, uint32_t samples)
+{
+  decodeUsec += usec;
+  decodeSamples += samples;
+  if (decodeSamples < 2 * 1152) return;
+
+  int rate = frame->header.samplerate;
+  int load = (int)((uint64_t)decodeUsec * rate / decodeSamples / 10000);
+  if (load > worstLoad) worstLoad = load;
+  loadAvg += ((load << 8) - loadAvg) / 16;
+  uint32_t span = decodeSamples;
+  bool overloaded = lastOverloaded;
+  lastOverloaded = (load >= HALFRATE_LOAD);
+  decodeUsec = 0;
+  decodeSamples = 0;
+  if (!autoMode || (decodeMode & DECODE_HALFRATE)) return;
+
+  if (load >= HALFRATE_LOAD) {
+    calmSamples = 0;
+    if (!overloaded || (options & DECODE_HALFRATE)) return;
+    options |= DECODE_HALFRATE;
+    halfRateSwitches++;
+  } else if (load >= FULLRATE_LOAD) {
+    calmSamples = 0;
+    return;
+  } else {
+    if (!(options & DECODE_HALFRATE)) return;
+    calmSamples += span;
+    if (calmSamples < (uint32_t)rate) return;
+    calmSamples = 0;
+    options &= ~DECODE_HALFRATE;
+  }
+  mad_stream_options(stream, options);
+}
+
 // The following are helper routines for use in libmad to check stack/heap free
 // and to determine if there's enough stack space to allocate some blocks there
 // instead of precious heap.
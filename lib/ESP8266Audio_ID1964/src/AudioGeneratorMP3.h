@@ -22,6 +22,9 @@
 #define _AUDIOGENERATORMP3_H
 
 #include "AudioGenerator.h"
+#include "AudioInputWindow.h"
+#include "AudioMP3Index.h"
+#include "AudioSyncScan.h"
 #include "libmad/config.h"
 #include "libmad/mad.h"
 
@@ -35,19 +38,67 @@ class AudioGeneratorMP3 : public AudioGenerator
     virtual bool loop() override;
     virtual bool stop() override;
     virtual bool isRunning() override;
+
+    // Length and play position in milliseconds, and a jump to a new position.  All three are
+    // quick when the file has a Xing/VBRI tag.  Otherwise the length is estimated from the file size
+    // and the first few frames (isDurationExact() says which), and a seek walks the frame headers
+    // (no decoding) as far as the target, which requires a seekable source.  Only valid once loop()
+    // has seen the first frame.
+    uint32_t getDuration() { return index.getDurationMs(); }
+    bool isDurationExact() const { return index.isDurationExact(); }
+    uint32_t getPosition() { return index.isValid() ? ((uint64_t)samplePos * 1000) / index.getSampleRate() : 0; }
+    bool seekMs(uint32_t ms);
+    virtual bool seekTo(uint32_t ms) override { return seekMs(ms); }
+    virtual uint32_t tell() override { return getPosition(); }
+
+    // Cheaper ways to decode, which can be ORed together.  DECODE_MONO plays the two channels mixed, which
+    // takes one channel's IMDCT and synthesis where their blocks line up (most frames), DECODE_LEFT and
+    // DECODE_RIGHT play just the one; these three apply to Layer III only, and Layer I/II (which this build
+    // of libmad leaves out anyway) would still come out in stereo, DECODE_HALFRATE synthesizes only the lower half of the band at half the
+    // sample rate, and DECODE_IGNORECRC plays frames with a bad CRC rather than dropping them.  When automatic,
+    // begin() adds DECODE_MONO if the output is mono anyway (see AudioOutput::IsMono()), and DECODE_HALFRATE
+    // comes in while decoding takes more than HALFRATE_LOAD% of the time the audio plays for, and goes again
+    // after a second under FULLRATE_LOAD%.  Changes take effect from the next frame.
+    enum {
+      DECODE_FULL      = 0,
+      DECODE_IGNORECRC = MAD_OPTION_IGNORECRC,
+      DECODE_HALFRATE  = MAD_OPTION_HALFSAMPLERATE,
+      DECODE_LEFT      = MAD_OPTION_LEFTCHANNEL,
+      DECODE_RIGHT     = MAD_OPTION_RIGHTCHANNEL,
+      DECODE_MONO      = MAD_OPTION_SINGLECHANNEL
+    };
+    void SetDecodeMode(int mode, bool automatic = true);
+    // The modes in use now, including any the automatic selection added
+    int GetDecodeMode() const { return options; }
+
+    // Decoding time as a percentage of the time the audio takes to play, which has to stay well under 100
+    typedef struct {
+      int load;                  // Recent average load
+      int worstLoad;             // Highest load over two frames
+      uint32_t halfRateSwitches; // Times the load brought in DECODE_HALFRATE
+    } DecodeStats;
+    void GetDecodeStats(DecodeStats *stats) { stats->load = (loadAvg + 128) >> 8; stats->worstLoad = worstLoad; stats->halfRateSwitches = halfRateSwitches; }
+
+    // What the sync word scanner has been through since begin():  searches, bytes skipped looking and
+    // false syncs thrown out, a rough measure of how damaged or noisy the stream is
+    void GetSyncStats(AudioSyncStats *stats) { *stats = syncStats; }
+
+    // Bytes needed by the preallocate constructor
+    static constexpr int preAllocSize() { return ((buffLen + 7) & ~7) + ((sizeof(struct mad_stream) + 7) & ~7) +
+                                                 ((sizeof(struct mad_frame) + 7) & ~7) + ((sizeof(struct mad_synth) + 7) & ~7); }
     
   protected:   
-    void *preallocateSpace;
-    int preallocateSize;
-
-    const int buffLen = 0x600; // Slightly larger than largest MP3 frame
+    static const int buffLen = 0x600; // Slightly larger than largest MP3 frame
     unsigned char *buff;
-    int lastReadPos;
+    AudioInputWindow input;
+    int lastReadPos; // File position of the start of the buffer handed to libmad
+    AudioSyncStats syncStats;
     unsigned int lastRate;
     int lastChannels;
     
     // Decoding bits
     bool madInitted;
+    bool waiting; // Input() found nothing new, after lastSample had already gone out
     struct mad_stream *stream;
     struct mad_frame *frame;
     struct mad_synth *synth;
@@ -55,6 +106,29 @@ class AudioGeneratorMP3 : public AudioGenerator
     int nsCount;
     int nsCountMax;
 
+    // Where we are, in samples with any LAME encoder delay and padding already trimmed off
+    AudioMP3Index index;
+    static const int seekPreroll = 3; // Frames, enough to refill the bit reservoir and IMDCT overlap
+    uint32_t samplePos;
+    uint32_t skipSamples; // Decoded samples still to drop (encoder delay, seek preroll)
+    uint32_t endSample;   // Encoder padding starts here, 0 if unknown
+    void FrameLost();
+
+    // SetDecodeMode() settings, the libmad options they come to, and how long decoding is taking
+    int decodeMode;
+    bool autoMode;
+    int options;
+    enum { HALFRATE_LOAD = 85, FULLRATE_LOAD = 40 };
+    uint32_t decodeUsec;    // Decoding time and samples (at the file's rate) since the load was last worked out
+    uint32_t decodeSamples;
+    uint32_t calmSamples;   // Samples decoded since the load was last FULLRATE_LOAD or more
+    int loadAvg;            // Average load, in 256ths of a percent
+    int worstLoad;
+    bool lastOverloaded;    // The last load worked out was HALFRATE_LOAD or more
+    uint32_t halfRateSwitches;
+    void ResetDecodeStats() { decodeUsec = 0; decodeSamples = 0; calmSamples = 0; loadAvg = 0; worstLoad = 0; lastOverloaded = false; halfRateSwitches = 0; }
+    void DecodeTime(uint32_t usec, uint32_t samples);
+
     // The internal helpers
     enum mad_flow ErrorToFlow();
     enum mad_flow Input();
@@ -21,6 +21,7 @@
 #pragma GCC optimize ("O3")
 
 #include "AudioGeneratorMP3a.h"
+#include "AudioSyncScan.h"
 
 
 AudioGeneratorMP3a::AudioGeneratorMP3a()
@@ -28,25 +29,79 @@ AudioGeneratorMP3a::AudioGeneratorMP3a()
   running = false;
   file = NULL;
   output = NULL;
+
+  // No input buffer, the window only allocates one if the source can't lend its data
+  buff = NULL;
+  outSample = (int16_t*)malloc(1152 * 2 * sizeof(int16_t));
+  if (!outSample) {
+    Serial.printf_P(PSTR("ERROR: Out of memory in MP3\n"));
+    Serial.flush();
+  }
+
   hMP3Decoder = MP3InitDecoder();
   if (!hMP3Decoder) {
     Serial.printf_P(PSTR("Out of memory error! hMP3Decoder==NULL\n"));
     Serial.flush();
   }
   // For sanity's sake...
-  memset(buff, 0, sizeof(buff));
-  memset(outSample, 0, sizeof(outSample));
-  buffValid = 0;
-  lastFrameEnd = 0;
+  if (outSample) memset(outSample, 0, 1152 * 2 * sizeof(int16_t));
+  input.begin(buff, buffLen);
+  validSamples = 0;
+  curSample = 0;
+  lastRate = 0;
+  lastChannels = 0;
+  memset(&syncStats, 0, sizeof(syncStats));
+  samplePos = 0;
+  skipSamples = 0;
+  endSample = 0;
+}
+
+AudioGeneratorMP3a::AudioGeneratorMP3a(void *preallocateData, int preallocateSz)
+{
+  preallocateSpace = preallocateData;
+  preallocateSize = preallocateSz;
+
+  running = false;
+  file = NULL;
+  output = NULL;
+
+  uint8_t *p = (uint8_t*)preallocateSpace;
+  buff = (uint8_t*) p;
+  p += (buffLen + 7) & ~7;
+  outSample = (int16_t*) p;
+  p += (1152 * 2 * sizeof(int16_t) + 7) & ~7;
+  int used = p - (uint8_t*)preallocateSpace;
+  int availSpace = preallocateSize - used;
+  if (availSpace < 0 ) {
+    Serial.printf_P(PSTR("ERROR: Out of memory in MP3\n"));
+  }
+
+  hMP3Decoder = MP3InitDecoderPre(p, availSpace);
+  if (!hMP3Decoder) {
+    Serial.printf_P(PSTR("Out of memory error! hMP3Decoder==NULL\n"));
+    Serial.flush();
+  } else {
+    memset(buff, 0, buffLen);
+    memset(outSample, 0, 1152 * 2 * sizeof(int16_t));
+  }
+  input.begin(buff, buffLen);
   validSamples = 0;
   curSample = 0;
   lastRate = 0;
   lastChannels = 0;
+  memset(&syncStats, 0, sizeof(syncStats));
+  samplePos = 0;
+  skipSamples = 0;
+  endSample = 0;
 }
 
 AudioGeneratorMP3a::~AudioGeneratorMP3a()
 {
-  MP3FreeDecoder(hMP3Decoder);
+  if (!preallocateSpace) {
+    MP3FreeDecoder(hMP3Decoder);
+    input.end();
+    free(outSample);
+  }
 }
 
 bool AudioGeneratorMP3a::stop()
@@ -63,62 +118,82 @@ bool AudioGeneratorMP3a::isRunning()
 
 bool AudioGeneratorMP3a::FillBufferWithValidFrame()
 {
-  buff[0] = 0; // Destroy any existing sync word @ 0
-  int nextSync;
-  do {
-    nextSync = MP3FindSyncWord(buff + lastFrameEnd, buffValid - lastFrameEnd);
-    if (nextSync >= 0) nextSync += lastFrameEnd;
-    lastFrameEnd = 0;
-    if (nextSync == -1) {
-      if (buff[buffValid-1]==0xff) { // Could be 1st half of syncword, preserve it...
-        buff[0] = 0xff;
-        buffValid = file->read(buff+1, sizeof(buff)-1);
-        if (buffValid==0) return false; // No data available, EOF
-      } else { // Try a whole new buffer
-        buffValid = file->read(buff, sizeof(buff));
-        if (buffValid==0) return false; // No data available, EOF
-      }
+  while (true) {
+    // Short of that is either EOF or a stream with nothing more yet, loop() tells them apart
+    if (input.fill(file, 2) < 2) return false;
+    int nextSync = AudioSyncFindMP3(input.data(), input.available(), 0xf0, &syncStats); // Helix has no MPEG2.5, 12 sync bits
+    if (nextSync >= 0) {
+      input.consume(nextSync); // Throw out prior to nextSync
+      break;
     }
-  } while (nextSync == -1);
-
-  // Move the frame to start at offset 0 in the buffer
-  buffValid -= nextSync; // Throw out prior to nextSync
-  memmove(buff, buff+nextSync, buffValid);
-
-  // We have a sync word at 0 now, try and fill remainder of buffer
-  buffValid += file->read(buff + buffValid, sizeof(buff) - buffValid);
+    if (input.isEOF()) return false;
+    // Could be 1st half of syncword in the last byte, preserve it...
+    input.consume(input.available() - ((input.data()[input.available() - 1] == 0xff) ? 1 : 0));
+  }
 
-  return true;
+  // We have a sync word at the start of the window now, make sure the whole frame is in it
+  int want = input.getCapacity();
+  if (input.fill(file, 4) >= 4) {
+    int frameLen = AudioSyncMP3FrameBytes(input.data());
+    if (frameLen > 0) want = frameLen;
+  }
+  // Try again once the rest of the frame has arrived, unless it never will
+  return (input.fill(file, want) >= want) || input.isEOF();
 }
 
 bool AudioGeneratorMP3a::loop()
 {
   if (!running) goto done; // Nothing to do here!
+  BudgetStart();
 
   // If we've got data, try and pump it out...
   while (validSamples) {
     lastSample[0] = outSample[curSample*2];
     lastSample[1] = outSample[curSample*2 + 1];
-    if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
+    if (!SendSample(lastSample)) goto done; // Can't send, but no error detected
     validSamples--;
     curSample++;
+    samplePos++;
   }
 
-  // No samples available, need to decode a new frame
+  if (endSample && (samplePos >= endSample)) {
+    running = false; // Only the encoder's padding is left
+    goto done;
+  }
+
+  // No samples available, need to decode a new frame unless we're out of time for this call
+  if (BudgetExhausted()) goto done;
   if (FillBufferWithValidFrame()) {
-    // buff[0] start of frame, decode it...
-    unsigned char *inBuff = reinterpret_cast<unsigned char *>(buff);
-    int bytesLeft = buffValid;
+    if (!index.isValid()) {
+      // First frame, which may be a Xing/VBRI tag instead of audio
+      bool tag = index.begin(file, input.data(), input.available(), input.getPos(file));
+      skipSamples = index.getStartSkip();
+      endSample = index.hasGaplessInfo() ? index.getTaggedSamples() : 0;
+      if (tag) {
+        int len = AudioSyncMP3FrameBytes(input.data());
+        input.consume((len > 0) ? len : 1);
+        goto done;
+      }
+    }
+
+    // input.data() start of frame, decode it...
+    unsigned char *inBuff = input.data();
+    int bytesLeft = input.available();
     int ret = MP3Decode(hMP3Decoder, &inBuff, &bytesLeft, outSample, 0);
-   if (ret) {
+    if (ret == ERR_MP3_MAINDATA_UNDERFLOW) {
+      // Expected right after a seek, the frame still went into the bit reservoir for the next one
+      input.consume(input.available() - bytesLeft);
+      FrameLost();
+    } else if (ret) {
       // Error, skip the frame...
-      char buff[48];
-      sprintf(buff, "MP3 decode error %d", ret);
-      cb.st(ret, buff);
+      cb.report(ret, input.getPos(file), PSTR("MP3 decode error"));
+      if (ret <= ERR_MP3_INVALID_SIDEINFO) FrameLost(); // The header was good, so it still took up time
+      input.consume(1);
     } else {
-      lastFrameEnd = buffValid - bytesLeft;
+      input.consume(input.available() - bytesLeft);
       MP3FrameInfo fi;
       MP3GetLastFrameInfo(hMP3Decoder, &fi);
+      if (!fi.nChans) goto done; // Corrupt frame that decoded to nothing, skip it
       if ((int)fi.samprate!= (int)lastRate) {
         output->SetRate(fi.samprate);
         lastRate = fi.samprate;
@@ -129,9 +204,19 @@ bool AudioGeneratorMP3a::loop()
       }
       curSample = 0;
       validSamples = fi.outputSamps / lastChannels;
+      BudgetSpend(validSamples);
+      if (skipSamples) {
+        int n = (skipSamples < (uint32_t)validSamples) ? skipSamples : validSamples;
+        curSample += n;
+        validSamples -= n;
+        skipSamples -= n;
+      }
+      if (endSample && (samplePos + validSamples > endSample)) {
+        validSamples = (endSample > samplePos) ? endSample - samplePos : 0;
+      }
     }
   } else {
-    running = false; // No more data, we're done here...
+    if (input.isEOF()) running = false; // No more data, we're done here...
   }
 
 done:
@@ -153,9 +238,44 @@ bool AudioGeneratorMP3a::begin(AudioFileSource *source, AudioOutput *output)
   
   // AAC always comes out at 16 bits
   output->SetBitsPerSample(16);
+
+  input.reset();
+  memset(&syncStats, 0, sizeof(syncStats));
+  index.reset();
+  validSamples = 0;
+  samplePos = 0;
+  skipSamples = 0;
+  endSample = 0;
   
   running = true;
   
   return true;
 }
 
+bool AudioGeneratorMP3a::seekMs(uint32_t ms)
+{
+  uint32_t offset, position, skip;
+  if (!running || !index.locate(ms, seekPreroll, &offset, &position, &skip)) return false;
+  if (!file->seek(offset, SEEK_SET)) return false;
+
+  // Start over with an empty window, the frames ahead of the target are decoded and dropped
+  input.reset();
+  validSamples = 0;
+  curSample = 0;
+  samplePos = position;
+  skipSamples = skip;
+  return true;
+}
+
+void AudioGeneratorMP3a::FrameLost()
+{
+  // A frame that decoded to nothing still moves the clock along
+  uint32_t n = index.getFrameSamples();
+  if (skipSamples >= n) {
+    skipSamples -= n;
+  } else {
+    samplePos += n - skipSamples;
+    skipSamples = 0;
+  }
+}
+
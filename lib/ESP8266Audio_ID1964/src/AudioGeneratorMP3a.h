@@ -22,36 +22,68 @@
 #define _AUDIOGENERATORMP3A_H
 
 #include "AudioGenerator.h"
+#include "AudioInputWindow.h"
+#include "AudioSyncScan.h"
+#include "AudioMP3Index.h"
 #include "libhelix-mp3/mp3dec.h"
 
 class AudioGeneratorMP3a : public AudioGenerator
 {
   public:
     AudioGeneratorMP3a();
+    AudioGeneratorMP3a(void *preallocateData, int preallocateSize);
     virtual ~AudioGeneratorMP3a() override;
     virtual bool begin(AudioFileSource *source, AudioOutput *output) override;
     virtual bool loop() override;
     virtual bool stop() override;
     virtual bool isRunning() override;
 
+    // Length and play position in milliseconds, and a jump to a new position.  All three are
+    // quick when the file has a Xing/VBRI tag.  Otherwise the length is estimated from the file size
+    // and the first few frames (isDurationExact() says which), and a seek walks the frame headers
+    // (no decoding) as far as the target, which requires a seekable source.  Only valid once loop()
+    // has seen the first frame.
+    uint32_t getDuration() { return index.getDurationMs(); }
+    bool isDurationExact() const { return index.isDurationExact(); }
+    uint32_t getPosition() { return index.isValid() ? ((uint64_t)samplePos * 1000) / index.getSampleRate() : 0; }
+    bool seekMs(uint32_t ms);
+    virtual bool seekTo(uint32_t ms) override { return seekMs(ms); }
+    virtual uint32_t tell() override { return getPosition(); }
+
+    // What the sync word scanner has been through since begin():  searches, bytes skipped looking and
+    // false syncs thrown out, a rough measure of how damaged or noisy the stream is
+    void GetSyncStats(AudioSyncStats *stats) { *stats = syncStats; }
+
+    // Bytes needed by the preallocate constructor
+    static int preAllocSize() { return ((buffLen + 7) & ~7) + ((1152 * 2 * sizeof(int16_t) + 7) & ~7) + MP3InitDecoderPreSize(); }
+
   protected:
     // Helix MP3 decoder
     HMP3Decoder hMP3Decoder;
 
     // Input buffering
-    uint8_t buff[1600]; // File buffer required to store at least a whole compressed frame
-    int16_t buffValid;
-    int16_t lastFrameEnd;
-    bool FillBufferWithValidFrame(); // Read until we get a valid syncword and min(feof, 2048) butes in the buffer
+    static const int buffLen = 1600;
+    uint8_t *buff; //[1600]; // File buffer required to store at least a whole compressed frame
+    AudioInputWindow input;
+    AudioSyncStats syncStats;
+    bool FillBufferWithValidFrame(); // Read until input starts with a valid syncword and holds the whole frame
 
     // Output buffering
-    int16_t outSample[1152 * 2]; // Interleaved L/R
+    int16_t *outSample; //[1152 * 2]; // Interleaved L/R
     int16_t validSamples;
     int16_t curSample;
 
     // Each frame may change this if they're very strange, I guess
     unsigned int lastRate;
     int lastChannels;
+
+    // Where we are, in samples with any LAME encoder delay and padding already trimmed off
+    AudioMP3Index index;
+    static const int seekPreroll = 3; // Frames, enough to refill the bit reservoir and IMDCT overlap
+    uint32_t samplePos;
+    uint32_t skipSamples; // Decoded samples still to drop (encoder delay, seek preroll)
+    uint32_t endSample;   // Encoder padding starts here, 0 if unknown
+    void FrameLost();
 };
 
 #endif
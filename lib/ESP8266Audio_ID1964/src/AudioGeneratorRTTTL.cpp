@@ -32,11 +32,35 @@ AudioGeneratorRTTTL::AudioGeneratorRTTTL()
   rate = 22050;
   buff = nullptr;
   ptr = 0;
+  song = nullptr;
+  songNotes = 0;
+  songPos = 0;
+  ttlSamples = 0;
+  samplesSent = 0;
+  pendLen = 0;
+  pendPtr = 0;
+}
+
+AudioGeneratorRTTTL::AudioGeneratorRTTTL(void *space, int size) : AudioGeneratorRTTTL()
+{
+  preallocateSpace = space;
+  preallocateSize = size;
 }
 
 AudioGeneratorRTTTL::~AudioGeneratorRTTTL()
 {
-  free(buff);
+  FreeSong();
+}
+
+void AudioGeneratorRTTTL::FreeSong()
+{
+  if (!preallocateSpace) {
+    free(buff);
+    free(song);
+  }
+  buff = nullptr;
+  song = nullptr;
+  songNotes = 0;
 }
 
 bool AudioGeneratorRTTTL::stop()
@@ -53,32 +77,30 @@ bool AudioGeneratorRTTTL::isRunning()
 
 bool AudioGeneratorRTTTL::loop()
 {
-  if (!running) goto done; // Nothing to do here!
+  bool started = false;
 
-  // Load the next note, if we've hit the end of the last one
-  if (samplesSent == ttlSamples) {
-    if (!GetNextNote()) {
-      running = false;
-      goto done;
-    }
-    samplesSent = 0;
-  }
-  
-  // Try and send out the remainder of the existing note, one per loop()
-  if (ttlSamplesPerWaveFP10 == 0) { // Mute
-    int16_t mute[2] = {0, 0};
-    while ((samplesSent < ttlSamples) && output->ConsumeSample(mute)) {
-      samplesSent++;
-    }
-  } else {
-    while (samplesSent < ttlSamples) {
-      int samplesSentFP10 = samplesSent << 10;
-      int rem = samplesSentFP10 % ttlSamplesPerWaveFP10;
-      int16_t val = (rem > ttlSamplesPerWaveFP10/2) ? 8192:-8192;
-      int16_t s[2] = { val, val };
-      if (!output->ConsumeSample(s)) goto done;
-      samplesSent++;
+  if (!running) goto done; // Nothing to do here!
+  BudgetStart();
+
+  while (running) {
+    if (pendPtr >= pendLen) {
+      // Load the next note, if we've hit the end of the last one.  Only one note is started per call,
+      // so the loop budget can never be exceeded by more than that.
+      if (samplesSent == ttlSamples) {
+        if (started) break;
+        if (songPos >= songNotes) {
+          running = false;
+          break;
+        }
+        StartNote();
+        started = true;
+        BudgetSpend(ttlSamples);
+      }
+      Synthesize();
     }
+    // Hand over as much of the block as the output will take, and keep the rest for next time
+    pendPtr += SendSamples(pend[pendPtr], pendLen - pendPtr);
+    if (pendPtr < pendLen) break;
   }
 
 done:
@@ -103,7 +125,7 @@ bool AudioGeneratorRTTTL::ReadInt(int *dest)
   if ((buff[ptr] <'0') || (buff[ptr] > '9')) return false;
 
   int t = 0;
-  while ((buff[ptr] >= '0') && (buff[ptr] <='9')) {
+  while ((ptr < len) && (buff[ptr] >= '0') && (buff[ptr] <='9')) {
     t = (t * 10) + (buff[ptr] - '0');
     ptr++;
   }
@@ -142,7 +164,7 @@ bool AudioGeneratorRTTTL::ParseHeader()
   ptr++;
   if (!SkipWhitespace()) return false;
   if (buff[ptr++] != '=') return false;
-  if (!ReadInt(&bpm)) return false;
+  if (!ReadInt(&bpm) || !bpm) return false;
   if (!SkipWhitespace()) return false;
   if (buff[ptr++] != ':') return false;
 
@@ -199,13 +221,14 @@ bool AudioGeneratorRTTTL::ParseHeader()
 #define NOTE_A7  3520
 #define NOTE_AS7 3729
 #define NOTE_B7 3951
-static int notes[49] = { 0,
+static const uint16_t notes[49] PROGMEM = { 0,
   NOTE_C4, NOTE_CS4, NOTE_D4, NOTE_DS4, NOTE_E4, NOTE_F4, NOTE_FS4, NOTE_G4, NOTE_GS4, NOTE_A4, NOTE_AS4, NOTE_B4,
   NOTE_C5, NOTE_CS5, NOTE_D5, NOTE_DS5, NOTE_E5, NOTE_F5, NOTE_FS5, NOTE_G5, NOTE_GS5, NOTE_A5, NOTE_AS5, NOTE_B5,
   NOTE_C6, NOTE_CS6, NOTE_D6, NOTE_DS6, NOTE_E6, NOTE_F6, NOTE_FS6, NOTE_G6, NOTE_GS6, NOTE_A6, NOTE_AS6, NOTE_B6,
   NOTE_C7, NOTE_CS7, NOTE_D7, NOTE_DS7, NOTE_E7, NOTE_F7, NOTE_FS7, NOTE_G7, NOTE_GS7, NOTE_A7, NOTE_AS7, NOTE_B7 };
 
-bool AudioGeneratorRTTTL::GetNextNote()
+// Parses the next note into the compiled form, false at the end of the song or anything unparseable
+bool AudioGeneratorRTTTL::GetNextNote(uint32_t *packed)
 {
   int dur, note, scale;
   if (ptr >= len) return false;
@@ -213,6 +236,7 @@ bool AudioGeneratorRTTTL::GetNextNote()
   if (!ReadInt(&dur)) {
     dur = defaultDuration;
   }
+  if (!dur) return false;
   dur = wholeNoteMS / dur;
 
   if (ptr >= len) return false;
@@ -232,13 +256,20 @@ bool AudioGeneratorRTTTL::GetNextNote()
     ptr++;
     note++;
   }
+  bool dotted = false;
   if ((ptr < len) && (buff[ptr] == '.')) {
     ptr++;
-    dur += dur / 2;
+    dotted = true;
   }
   if (!ReadInt(&scale)) {
     scale = defaultOctave;
   }
+  // Plenty of songs put the dot after the octave instead
+  if (!dotted && (ptr < len) && (buff[ptr] == '.')) {
+    ptr++;
+    dotted = true;
+  }
+  if (dotted) dur += dur / 2;
   // Eat any trailing whitespace and comma
   SkipWhitespace();
   if ((ptr < len) && (buff[ptr]==',')) {
@@ -247,18 +278,104 @@ bool AudioGeneratorRTTTL::GetNextNote()
 
   if (scale < 4) scale = 4;
   if (scale > 7) scale = 7;
+  if (note) note += (scale - 4) * 12;
+  uint32_t samples = ((uint32_t)rate * dur) / 1000;
+  if (samples > SAMPLEMASK) samples = SAMPLEMASK;
+  *packed = ((uint32_t)note << NOTESHIFT) | samples;
+
+  return true;
+}
+
+// Runs through every note after the header, storing them when notes isn't NULL, and returns how many
+// there were.  Playing stops at the first one that doesn't parse, as it always has.
+int AudioGeneratorRTTTL::CompileSong(uint32_t *notes)
+{
+  int start = ptr;
+  int count = 0;
+  uint32_t packed;
+  while (GetNextNote(&packed)) {
+    if (notes) notes[count] = packed;
+    count++;
+  }
+  ptr = start;
+  return count;
+}
+
+void AudioGeneratorRTTTL::StartNote()
+{
+  uint32_t packed = song[songPos++];
+  int note = packed >> NOTESHIFT;
+  ttlSamples = packed & SAMPLEMASK;
+  samplesSent = 0;
+  phase = 0;
   if (note) {
-    int freq = notes[(scale - 4) * 12 + note];
-    // Convert from frequency in Hz to high and low samples in fixed point
-    ttlSamplesPerWaveFP10 = (rate << 10) / freq;
+    uint32_t freq = pgm_read_word(notes + note);
+    phaseStep = ((uint64_t)freq << 32) / rate;
+    // An edge is smoothed over the one sample either side of it, the last and first phaseStep of a cycle
+    uint32_t step16 = phaseStep >> 16;
+    blepScale = step16 ? 0x80000000u / step16 : 0;
   } else {
-    ttlSamplesPerWaveFP10 = 0;
+    phaseStep = 0;
   }
-  ttlSamples = (rate * dur ) / 1000;
+  // 2ms to fade in and out, or half of a shorter note
+  ramp = rate / 500;
+  if (ramp > ttlSamples / 2) ramp = ttlSamples / 2;
+}
 
-  //Serial.printf("%d %d %d %d %d\n", dur, note, scale, ttlSamplesPerWaveFP10, ttlSamples );
+// How far into the polyBLEP correction for an upward edge at phase 0, Q15 from -32768 to 32768
+static inline int32_t PolyBLEP(uint32_t t, uint32_t step, uint32_t scale)
+{
+  if (t < step) {
+    int32_t x = 32768 - ((t * scale) >> 16);
+    return -((x * x) >> 15);
+  }
+  if (t > 65536 - step) {
+    int32_t x = 32768 - (((65536 - t) * scale) >> 16);
+    return (x * x) >> 15;
+  }
+  return 0;
+}
 
-  return true;
+// The next block of the note into pend[]:  a band-limited square wave at a quarter of full scale,
+// faded in and out over the ramp
+void AudioGeneratorRTTTL::Synthesize()
+{
+  int samples = ttlSamples - samplesSent;
+  if (samples > PENDFRAMES) samples = PENDFRAMES;
+
+  if (!phaseStep) {
+    memset(pend, 0, samples * sizeof(pend[0]));
+  } else {
+    uint32_t p = phase;
+    uint32_t step = phaseStep;
+    uint32_t step16 = step >> 16;
+    uint32_t scale = blepScale;
+    for (int i = 0; i < samples; i++) {
+      uint32_t t = p >> 16;
+      int32_t v = (t < 32768) ? 32767 : -32768;
+      // Only the samples either side of an edge, at 0 or half way round, need smoothing
+      if (((t + step16) & 0x7fff) < 2 * step16) {
+        v += PolyBLEP(t, step16, scale);
+        v -= PolyBLEP((t + 32768) & 0xffff, step16, scale);
+      }
+      pend[i][0] = pend[i][1] = v >> 2;
+      p += step;
+    }
+    phase = p;
+
+    // Only the ends of the note need the ramp applied
+    int pos = samplesSent;
+    if ((pos < ramp) || (pos + samples > ttlSamples - ramp)) {
+      for (int i = 0; i < samples; i++, pos++) {
+        int left = ttlSamples - pos;
+        int env = (pos < left) ? pos : left;
+        if (env < ramp) pend[i][0] = pend[i][1] = (pend[i][0] * env) / ramp;
+      }
+    }
+  }
+  samplesSent += samples;
+  pendLen = samples;
+  pendPtr = 0;
 }
 
 bool AudioGeneratorRTTTL::begin(AudioFileSource *source, AudioOutput *output)
@@ -269,16 +386,38 @@ bool AudioGeneratorRTTTL::begin(AudioFileSource *source, AudioOutput *output)
   this->output = output;
   if (!file->isOpen()) return false; // Error
   
+  FreeSong();
   len = file->getSize();
-  buff = (char *)malloc(len);
+  if (preallocateSpace) {
+    if (preAllocSize(len) > preallocateSize) {
+      Serial.printf_P(PSTR("OOM error in RTTTL:  Want %d bytes, have %d bytes preallocated.\n"), preAllocSize(len), preallocateSize);
+      return false;
+    }
+    arena.begin(preallocateSpace, preallocateSize);
+    buff = (char *)arena.allocate(len);
+  } else {
+    buff = (char *)malloc(len);
+  }
   if (!buff) return false;
   if (file->read(buff, len) != (uint32_t)len) return false;
 
   ptr = 0;
+  if (!ParseHeader()) return false;
+
+  // Compile the notes into song[], so playing them never has to look at the text
+  songNotes = CompileSong(NULL);
+  song = (uint32_t *)(preallocateSpace ? arena.allocate(songNotes * sizeof(uint32_t)) : malloc(songNotes * sizeof(uint32_t)));
+  if (!song && songNotes) return false;
+  CompileSong(song);
+  if (preallocateSpace) arena.release(buff);
+  else free(buff);
+  buff = nullptr;
+
+  songPos = 0;
   samplesSent = 0;
   ttlSamples = 0;
-
-  if (!ParseHeader()) return false;
+  pendLen = 0;
+  pendPtr = 0;
 
   if (!output->SetRate( rate )) return false;
   if (!output->SetBitsPerSample( 16 )) return false;
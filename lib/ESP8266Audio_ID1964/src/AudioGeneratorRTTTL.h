@@ -25,11 +25,13 @@
 #define _AUDIOGENERATORRTTTL_H
 
 #include "AudioGenerator.h"
+#include "AudioArena.h"
 
 class AudioGeneratorRTTTL : public AudioGenerator
 {
   public:
     AudioGeneratorRTTTL();
+    AudioGeneratorRTTTL(void *preallocateSpace, int preallocateSize);
     virtual ~AudioGeneratorRTTTL() override;
     virtual bool begin(AudioFileSource *source, AudioOutput *output) override;
     virtual bool loop() override;
@@ -37,16 +39,25 @@ class AudioGeneratorRTTTL : public AudioGenerator
     virtual bool isRunning() override;
     void SetRate(uint16_t hz) { rate = hz; }
 
+    // Bytes needed by the preallocate constructor to hold a song of the given length while begin()
+    // compiles it, and the notes it compiles to.  Every note takes at least a letter and a comma.
+    static constexpr int preAllocSize(int songLen) { return AudioArena::blockSize(songLen) + AudioArena::blockSize(sizeof(uint32_t) * (songLen / 2 + 1)); }
+
   private:
     bool SkipWhitespace();
     bool ReadInt(int *dest);
     bool ParseHeader();
-    bool GetNextNote();
+    bool GetNextNote(uint32_t *note);
+    int CompileSong(uint32_t *notes);
+    void FreeSong();
+    void StartNote();
+    void Synthesize();
     
   protected:
     uint16_t rate;
+    AudioArena arena;
 
-    // We copy the entire tiny song to a buffer for easier access
+    // We copy the entire tiny song to a buffer while begin() compiles it
     char *buff;
     int len;
     int ptr;
@@ -56,10 +67,27 @@ class AudioGeneratorRTTTL : public AudioGenerator
     int defaultOctave;
     int wholeNoteMS;
 
-    // The note we're currently playing
-    int ttlSamplesPerWaveFP10;
+    // The compiled song, a note (1-48 from C4, 0 for a rest) in the top byte of each and its length
+    // in samples in the rest
+    enum { NOTESHIFT = 24, SAMPLEMASK = (1 << NOTESHIFT) - 1 };
+    uint32_t *song;
+    int songNotes;
+    int songPos;
+
+    // The note we're currently playing, a square wave with its edges smoothed by polyBLEP.  Phase
+    // runs once round the 32 bits per cycle.
+    uint32_t phase;
+    uint32_t phaseStep;
+    uint32_t blepScale;     // Turns 16 bits of phase into how far through an edge it is, Q15
+    int ramp;               // Samples of fade in at the start and fade out at the end
     int ttlSamples;
     int samplesSent;
+
+    // Synthesized a block at a time into pend[]
+    enum { PENDFRAMES = 32 };
+    int16_t pend[PENDFRAMES][2];
+    uint8_t pendLen;
+    uint8_t pendPtr;
 };
 
 #endif
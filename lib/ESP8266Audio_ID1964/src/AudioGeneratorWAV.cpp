@@ -1,6 +1,6 @@
 /*
   AudioGeneratorWAV
-  Audio output generator that reads 8 and 16-bit WAV files
+  Audio output generator that reads 8 and 16-bit PCM, G.711 and ADPCM WAV files
   
   Copyright (C) 2017  Earle F. Philhower, III
 
@@ -21,6 +21,96 @@
 
 #include "AudioGeneratorWAV.h"
 
+// G.711 bytes straight to 16-bit samples
+static const int16_t mulawTable[256] PROGMEM = {
+  -32124, -31100, -30076, -29052, -28028, -27004, -25980, -24956,
+  -23932, -22908, -21884, -20860, -19836, -18812, -17788, -16764,
+  -15996, -15484, -14972, -14460, -13948, -13436, -12924, -12412,
+  -11900, -11388, -10876, -10364,  -9852,  -9340,  -8828,  -8316,
+   -7932,  -7676,  -7420,  -7164,  -6908,  -6652,  -6396,  -6140,
+   -5884,  -5628,  -5372,  -5116,  -4860,  -4604,  -4348,  -4092,
+   -3900,  -3772,  -3644,  -3516,  -3388,  -3260,  -3132,  -3004,
+   -2876,  -2748,  -2620,  -2492,  -2364,  -2236,  -2108,  -1980,
+   -1884,  -1820,  -1756,  -1692,  -1628,  -1564,  -1500,  -1436,
+   -1372,  -1308,  -1244,  -1180,  -1116,  -1052,   -988,   -924,
+    -876,   -844,   -812,   -780,   -748,   -716,   -684,   -652,
+    -620,   -588,   -556,   -524,   -492,   -460,   -428,   -396,
+    -372,   -356,   -340,   -324,   -308,   -292,   -276,   -260,
+    -244,   -228,   -212,   -196,   -180,   -164,   -148,   -132,
+    -120,   -112,   -104,    -96,    -88,    -80,    -72,    -64,
+     -56,    -48,    -40,    -32,    -24,    -16,     -8,      0,
+   32124,  31100,  30076,  29052,  28028,  27004,  25980,  24956,
+   23932,  22908,  21884,  20860,  19836,  18812,  17788,  16764,
+   15996,  15484,  14972,  14460,  13948,  13436,  12924,  12412,
+   11900,  11388,  10876,  10364,   9852,   9340,   8828,   8316,
+    7932,   7676,   7420,   7164,   6908,   6652,   6396,   6140,
+    5884,   5628,   5372,   5116,   4860,   4604,   4348,   4092,
+    3900,   3772,   3644,   3516,   3388,   3260,   3132,   3004,
+    2876,   2748,   2620,   2492,   2364,   2236,   2108,   1980,
+    1884,   1820,   1756,   1692,   1628,   1564,   1500,   1436,
+    1372,   1308,   1244,   1180,   1116,   1052,    988,    924,
+     876,    844,    812,    780,    748,    716,    684,    652,
+     620,    588,    556,    524,    492,    460,    428,    396,
+     372,    356,    340,    324,    308,    292,    276,    260,
+     244,    228,    212,    196,    180,    164,    148,    132,
+     120,    112,    104,     96,     88,     80,     72,     64,
+      56,     48,     40,     32,     24,     16,      8,      0
+};
+
+static const int16_t alawTable[256] PROGMEM = {
+   -5504,  -5248,  -6016,  -5760,  -4480,  -4224,  -4992,  -4736,
+   -7552,  -7296,  -8064,  -7808,  -6528,  -6272,  -7040,  -6784,
+   -2752,  -2624,  -3008,  -2880,  -2240,  -2112,  -2496,  -2368,
+   -3776,  -3648,  -4032,  -3904,  -3264,  -3136,  -3520,  -3392,
+  -22016, -20992, -24064, -23040, -17920, -16896, -19968, -18944,
+  -30208, -29184, -32256, -31232, -26112, -25088, -28160, -27136,
+  -11008, -10496, -12032, -11520,  -8960,  -8448,  -9984,  -9472,
+  -15104, -14592, -16128, -15616, -13056, -12544, -14080, -13568,
+    -344,   -328,   -376,   -360,   -280,   -264,   -312,   -296,
+    -472,   -456,   -504,   -488,   -408,   -392,   -440,   -424,
+     -88,    -72,   -120,   -104,    -24,     -8,    -56,    -40,
+    -216,   -200,   -248,   -232,   -152,   -136,   -184,   -168,
+   -1376,  -1312,  -1504,  -1440,  -1120,  -1056,  -1248,  -1184,
+   -1888,  -1824,  -2016,  -1952,  -1632,  -1568,  -1760,  -1696,
+    -688,   -656,   -752,   -720,   -560,   -528,   -624,   -592,
+    -944,   -912,  -1008,   -976,   -816,   -784,   -880,   -848,
+    5504,   5248,   6016,   5760,   4480,   4224,   4992,   4736,
+    7552,   7296,   8064,   7808,   6528,   6272,   7040,   6784,
+    2752,   2624,   3008,   2880,   2240,   2112,   2496,   2368,
+    3776,   3648,   4032,   3904,   3264,   3136,   3520,   3392,
+   22016,  20992,  24064,  23040,  17920,  16896,  19968,  18944,
+   30208,  29184,  32256,  31232,  26112,  25088,  28160,  27136,
+   11008,  10496,  12032,  11520,   8960,   8448,   9984,   9472,
+   15104,  14592,  16128,  15616,  13056,  12544,  14080,  13568,
+     344,    328,    376,    360,    280,    264,    312,    296,
+     472,    456,    504,    488,    408,    392,    440,    424,
+      88,     72,    120,    104,     24,      8,     56,     40,
+     216,    200,    248,    232,    152,    136,    184,    168,
+    1376,   1312,   1504,   1440,   1120,   1056,   1248,   1184,
+    1888,   1824,   2016,   1952,   1632,   1568,   1760,   1696,
+     688,    656,    752,    720,    560,    528,    624,    592,
+     944,    912,   1008,    976,    816,    784,    880,    848
+};
+
+// IMA ADPCM quantizer step sizes, and how each nibble moves the index into them
+static const uint16_t imaStep[89] PROGMEM = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+  12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t imaIndex[16] PROGMEM = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// MS ADPCM step size adaptation, in 1/256ths
+static const int16_t msAdapt[16] PROGMEM = { 230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230 };
+
+static inline int16_t Clip16(int32_t v)
+{
+  return (v > 32767) ? 32767 : (v < -32768) ? -32768 : v;
+}
+
 AudioGeneratorWAV::AudioGeneratorWAV()
 {
   running = false;
@@ -30,11 +120,42 @@ AudioGeneratorWAV::AudioGeneratorWAV()
   buff = NULL;
   buffPtr = 0;
   buffLen = 0;
+  dataStart = 0;
+  dataSize = 0;
+  format = FORMAT_PCM;
+  pendLen = 0;
+  pendPtr = 0;
+  blockLeft = 0;
+  blockSamples = 0;
+  skipSamples = 0;
+  samplePos = 0;
+}
+
+AudioGeneratorWAV::AudioGeneratorWAV(void *space, int size)
+{
+  running = false;
+  file = NULL;
+  output = NULL;
+  buffSize = 128;
+  buff = NULL;
+  buffPtr = 0;
+  buffLen = 0;
+  dataStart = 0;
+  dataSize = 0;
+  format = FORMAT_PCM;
+  pendLen = 0;
+  pendPtr = 0;
+  blockLeft = 0;
+  blockSamples = 0;
+  skipSamples = 0;
+  samplePos = 0;
+  preallocateSpace = space;
+  preallocateSize = size;
 }
 
 AudioGeneratorWAV::~AudioGeneratorWAV()
 {
-  free(buff);
+  if (!preallocateSpace) free(buff);
   buff = NULL;
 }
 
@@ -42,7 +163,7 @@ bool AudioGeneratorWAV::stop()
 {
   if (!running) return true;
   running = false;
-  free(buff);
+  if (!preallocateSpace) free(buff);
   buff = NULL;
   return file->close();
 }
@@ -58,17 +179,38 @@ bool AudioGeneratorWAV::GetBufferedData(int bytes, void *dest)
 {
   if (!running) return false; // Nothing to do here!
   uint8_t *p = reinterpret_cast<uint8_t*>(dest);
-  while (bytes--) {
+  if (!buff) {
+    // Nothing to buffer, the source lends its memory
+    while (bytes) {
+      uint32_t got;
+      const uint8_t *src = availBytes ? file->acquire(((uint32_t)bytes < availBytes) ? bytes : availBytes, &got) : NULL;
+      if (!src || !got) return false; // No data left!
+      memcpy(p, src, got);
+      file->release(got);
+      availBytes -= got;
+      BudgetSpend((got * 8) / (bitsPerSample * channels));
+      p += got;
+      bytes -= got;
+    }
+    return true;
+  }
+  while (bytes) {
     // Potentially load next batch of data...
     if (buffPtr >= buffLen) {
       buffPtr = 0;
       uint32_t toRead = availBytes > buffSize ? buffSize : availBytes;
       buffLen = file->read( buff, toRead );
       availBytes -= buffLen;
+      BudgetSpend((buffLen * 8) / (bitsPerSample * channels));
     }
     if (buffPtr >= buffLen)
       return false; // No data left!
-    *(p++) = buff[buffPtr++];
+    int n = buffLen - buffPtr;
+    if (n > bytes) n = bytes;
+    memcpy(p, buff + buffPtr, n);
+    p += n;
+    buffPtr += n;
+    bytes -= n;
   }
   return true;
 }
@@ -76,32 +218,23 @@ bool AudioGeneratorWAV::GetBufferedData(int bytes, void *dest)
 bool AudioGeneratorWAV::loop()
 {
   if (!running) goto done; // Nothing to do here!
+  BudgetStart();
 
-  // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(lastSample)) goto done; // Can't send, but no error detected
-
-  // Try and stuff the buffer one sample at a time
-  do
-  {
-    if (bitsPerSample == 8) {
-      uint8_t l, r;
-      if (!GetBufferedData(1, &l)) stop();
-      if (channels == 2) {
-        if (!GetBufferedData(1, &r)) stop();
-      } else {
-        r = 0;
-      }
-      lastSample[AudioOutput::LEFTCHANNEL] = l;
-      lastSample[AudioOutput::RIGHTCHANNEL] = r;
-    } else if (bitsPerSample == 16) {
-      if (!GetBufferedData(2, &lastSample[AudioOutput::LEFTCHANNEL])) stop();
-      if (channels == 2) {
-        if (!GetBufferedData(2, &lastSample[AudioOutput::RIGHTCHANNEL])) stop();
-      } else {
-        lastSample[AudioOutput::RIGHTCHANNEL] = 0;
+  while (running) {
+    if (pendPtr >= pendLen) {
+      // Stop early if the next batch needs another file read and we're out of time
+      if ((buffPtr >= buffLen) && BudgetExhausted()) break;
+      if (!FillFrames()) {
+        stop();
+        break;
       }
     }
-  } while (running && output->ConsumeSample(lastSample));
+    // Hand over as much of the batch as the output will take, and keep the rest for next time
+    int sent = SendSamples(pend[pendPtr], pendLen - pendPtr);
+    pendPtr += sent;
+    samplePos += sent;
+    if (pendPtr < pendLen) break; // Can't send, but no error detected
+  }
 
 done:
   file->loop();
@@ -110,11 +243,269 @@ done:
   return running;
 }
 
+bool AudioGeneratorWAV::seekTo(uint32_t ms)
+{
+  if (!running) return false;
+  uint32_t frame = ((uint64_t)ms * sampleRate) / 1000;
+  uint32_t offset;
+  if ((format == FORMAT_IMAADPCM) || (format == FORMAT_MSADPCM)) {
+    // Blocks stand alone, so start at the one holding frame and decode up to it
+    uint32_t block = frame / samplesPerBlock;
+    offset = block * blockAlign;
+    skipSamples = frame - block * samplesPerBlock;
+  } else {
+    offset = frame * blockAlign;
+    skipSamples = 0;
+  }
+  if (offset >= dataSize) return false;
+  if (!file->seek(dataStart + offset, SEEK_SET)) return false;
+
+  // Drop whatever's buffered, the next read starts at the new block
+  availBytes = dataSize - offset;
+  buffPtr = 0;
+  buffLen = 0;
+  pendLen = 0;
+  pendPtr = 0;
+  blockLeft = 0;
+  blockSamples = 0;
+  samplePos = frame;
+  return true;
+}
+
+uint32_t AudioGeneratorWAV::tell()
+{
+  if (!running) return 0;
+  return ((uint64_t)samplePos * 1000) / sampleRate;
+}
+
+
+bool AudioGeneratorWAV::FillFrames()
+{
+  do {
+    pendPtr = 0;
+    pendLen = 0;
+    if (!DecodeMore()) return false;
+    // Still working through a block to get to the seek target, which samplePos already counts
+    uint32_t skip = (skipSamples < pendLen) ? skipSamples : pendLen;
+    pendPtr = skip;
+    skipSamples -= skip;
+  } while (pendPtr >= pendLen);
+
+  // Outputs only look at the left channel of mono data, but keep whatever's in the right sane
+  if ((channels == 1) && ((format == FORMAT_IMAADPCM) || (format == FORMAT_MSADPCM))) {
+    for (int i = pendPtr; i < pendLen; i++) pend[i][1] = pend[i][0];
+  }
+  return true;
+}
+
+// PCM and G.711, a fixed number of bytes per sample frame
+bool AudioGeneratorWAV::DecodePCM()
+{
+  if (!buff) {
+    // Convert straight out of the source's memory
+    uint32_t want = pendFrames * blockAlign;
+    if (want > availBytes) want = availBytes;
+    uint32_t got;
+    const uint8_t *p = want ? file->acquire(want, &got) : NULL;
+    if (!p) return false; // No data left!
+    int frames = got / blockAlign;
+    if (!frames) {
+      // A sample frame split across the end of a ring buffer
+      uint8_t frame[4];
+      if (!GetBufferedData(blockAlign, frame)) return false;
+      ConvertFrames(frame, 1);
+      return true;
+    }
+    ConvertFrames(p, frames);
+    file->release(frames * blockAlign);
+    availBytes -= frames * blockAlign;
+    BudgetSpend(frames);
+    return true;
+  }
+
+  // Only ever convert whole sample frames, so move any partial one to the front and refill behind it
+  uint32_t have = buffLen - buffPtr;
+  if (have < blockAlign) {
+    if (have) memmove(buff, buff + buffPtr, have);
+    buffPtr = 0;
+    uint32_t toRead = buffSize - have;
+    if (toRead > availBytes) toRead = availBytes;
+    uint32_t got = file->read(buff + have, toRead);
+    availBytes -= got;
+    buffLen = have + got;
+    BudgetSpend((got * 8) / (bitsPerSample * channels));
+    if (buffLen < blockAlign) return false; // No data left!
+  }
+
+  int frames = (buffLen - buffPtr) / blockAlign;
+  if (frames > pendFrames) frames = pendFrames;
+  ConvertFrames(buff + buffPtr, frames);
+  buffPtr += frames * blockAlign;
+  return true;
+}
+
+void AudioGeneratorWAV::ConvertFrames(const uint8_t *p, int frames)
+{
+  int16_t *d = pend[0];
+  // Data is little-endian whatever the CPU is, and 8 bit samples are unsigned
+  if (format != FORMAT_PCM) {
+    const int16_t *table = (format == FORMAT_MULAW) ? mulawTable : alawTable;
+    if (channels == 2) {
+      for (int i = 0; i < frames; i++, p += 2, d += 2) {
+        d[0] = pgm_read_word(&table[p[0]]);
+        d[1] = pgm_read_word(&table[p[1]]);
+      }
+    } else {
+      for (int i = 0; i < frames; i++, p++, d += 2) {
+        d[0] = d[1] = pgm_read_word(&table[p[0]]);
+      }
+    }
+  } else if (bitsPerSample == 16) {
+    if (channels == 2) {
+      for (int i = 0; i < frames; i++, p += 4, d += 2) {
+        d[0] = (int16_t)(p[0] | (p[1] << 8));
+        d[1] = (int16_t)(p[2] | (p[3] << 8));
+      }
+    } else {
+      for (int i = 0; i < frames; i++, p += 2, d += 2) {
+        d[0] = d[1] = (int16_t)(p[0] | (p[1] << 8));
+      }
+    }
+  } else {
+    if (channels == 2) {
+      for (int i = 0; i < frames; i++, p += 2, d += 2) {
+        d[0] = (p[0] - 128) << 8;
+        d[1] = (p[1] - 128) << 8;
+      }
+    } else {
+      for (int i = 0; i < frames; i++, p++, d += 2) {
+        d[0] = d[1] = (p[0] - 128) << 8;
+      }
+    }
+  }
+  pendLen = frames;
+}
+
+bool AudioGeneratorWAV::DecodeMore()
+{
+  if ((format == FORMAT_PCM) || (format == FORMAT_MULAW) || (format == FORMAT_ALAW)) return DecodePCM();
+
+  bool ima = (format == FORMAT_IMAADPCM);
+  if (blockSamples) return ima ? DecodeIMAGroup() : DecodeMSByte();
+
+  // Skip any padding at the end of the last block and start the next one
+  while (blockLeft) {
+    uint8_t ign;
+    if (!ReadBlockData(1, &ign)) return false;
+  }
+  blockLeft = blockAlign;
+  blockSamples = samplesPerBlock;
+  return ima ? StartIMABlock() : StartMSBlock();
+}
+
+bool AudioGeneratorWAV::ReadBlockData(int bytes, void *dest)
+{
+  if (bytes > blockLeft) return false;
+  blockLeft -= bytes;
+  return GetBufferedData(bytes, dest);
+}
+
+// Returns the new sample and updates the channel's predictor and step index
+static inline int16_t IMANibble(int32_t *predictor, int16_t *index, int nib)
+{
+  int step = pgm_read_word(&imaStep[*index]);
+  int diff = step >> 3;
+  if (nib & 4) diff += step;
+  if (nib & 2) diff += step >> 1;
+  if (nib & 1) diff += step >> 2;
+  *predictor = Clip16((nib & 8) ? *predictor - diff : *predictor + diff);
+  *index += (int8_t)pgm_read_byte(&imaIndex[nib]);
+  if (*index < 0) *index = 0;
+  else if (*index > 88) *index = 88;
+  return *predictor;
+}
+
+bool AudioGeneratorWAV::StartIMABlock()
+{
+  // Each channel starts with its first sample and step index, stored as-is
+  for (int c = 0; c < channels; c++) {
+    uint8_t h[4];
+    if (!ReadBlockData(4, h)) return false;
+    predictor[c] = (int16_t)(h[0] | (h[1] << 8));
+    index[c] = (h[2] > 88) ? 88 : h[2];
+    pend[0][c] = predictor[c];
+  }
+  pendLen = 1;
+  blockSamples--;
+  return true;
+}
+
+bool AudioGeneratorWAV::DecodeIMAGroup()
+{
+  // Channels take turns, 4 bytes (8 samples, low nibble first) at a time
+  for (int c = 0; c < channels; c++) {
+    uint8_t d[4];
+    if (!ReadBlockData(4, d)) return false;
+    for (int i = 0; i < 4; i++) {
+      pend[i * 2][c] = IMANibble(&predictor[c], &index[c], d[i] & 0x0f);
+      pend[i * 2 + 1][c] = IMANibble(&predictor[c], &index[c], d[i] >> 4);
+    }
+  }
+  pendLen = (blockSamples < 8) ? blockSamples : 8;
+  blockSamples -= pendLen;
+  return true;
+}
+
+bool AudioGeneratorWAV::StartMSBlock()
+{
+  // All the channels' coefficient indexes, then their deltas, then their second and first samples
+  uint8_t h[14];
+  if (!ReadBlockData(7 * channels, h)) return false;
+  for (int c = 0; c < channels; c++) {
+    index[c] = (h[c] > 6) ? 6 : h[c];
+    delta[c] = (int16_t)(h[channels + c * 2] | (h[channels + c * 2 + 1] << 8));
+    predictor[c] = (int16_t)(h[channels * 3 + c * 2] | (h[channels * 3 + c * 2 + 1] << 8));
+    sample2[c] = (int16_t)(h[channels * 5 + c * 2] | (h[channels * 5 + c * 2 + 1] << 8));
+    pend[0][c] = sample2[c];
+    pend[1][c] = predictor[c];
+  }
+  pendLen = (blockSamples < 2) ? blockSamples : 2;
+  blockSamples -= pendLen;
+  return true;
+}
+
+int16_t AudioGeneratorWAV::MSNibble(int ch, int nib)
+{
+  int32_t pred = (predictor[ch] * msCoef[index[ch]][0] + sample2[ch] * msCoef[index[ch]][1]) >> 8;
+  int16_t s = Clip16(pred + ((nib & 8) ? nib - 16 : nib) * delta[ch]);
+  sample2[ch] = predictor[ch];
+  predictor[ch] = s;
+  delta[ch] = (delta[ch] * (int16_t)pgm_read_word(&msAdapt[nib])) >> 8;
+  if (delta[ch] < 16) delta[ch] = 16;
+  return s;
+}
+
+bool AudioGeneratorWAV::DecodeMSByte()
+{
+  // High nibble first.  Mono gets two samples out of a byte, stereo one of each channel
+  uint8_t b;
+  if (!ReadBlockData(1, &b)) return false;
+  if (channels == 1) {
+    pend[0][0] = MSNibble(0, b >> 4);
+    pend[1][0] = MSNibble(0, b & 0x0f);
+    pendLen = (blockSamples < 2) ? blockSamples : 2;
+  } else {
+    pend[0][0] = MSNibble(0, b >> 4);
+    pend[0][1] = MSNibble(1, b & 0x0f);
+    pendLen = 1;
+  }
+  blockSamples -= pendLen;
+  return true;
+}
 
 bool AudioGeneratorWAV::ReadWAVInfo()
 {
   uint32_t u32;
-  uint16_t u16;
   int toSkip;
 
   // Header == "RIFF"
@@ -132,25 +523,41 @@ bool AudioGeneratorWAV::ReadWAVInfo()
   if (u32 != 0x20746d66) return false; // "fmt "
   // subchunk size
   if (!ReadU32(&u32)) return false;
-  if (u32 == 16) { toSkip = 0; }
-  else if (u32 == 18) { toSkip = 18 - 16; }
-  else if (u32 == 40) { toSkip = 40 - 16; }
-  else { return false; } // we only do standard PCM
+  if (u32 < 16) return false;
+  toSkip = u32 - 16;
   // AudioFormat
-  if (!ReadU16(&u16)) return false;
-  if (u16 != 1) return false; // we only do standard PCM
+  if (!ReadU16(&format)) return false;
   // NumChannels
   if (!ReadU16(&channels)) return false;
   if ((channels<1) || (channels>2)) return false; // Mono or stereo support only
   // SampleRate
   if (!ReadU32(&sampleRate)) return false;
   if (sampleRate < 1) return false; // Weird rate, punt.  Will need to check w/DAC to see if supported
-  // Ignore byterate and blockalign
+  // Ignore byterate
   if (!ReadU32(&u32)) return false;
-  if (!ReadU16(&u16)) return false;
+  // BlockAlign, only trusted for ADPCM where the encoder picks it
+  if (!ReadU16(&blockAlign)) return false;
   // Bits per sample
   if (!ReadU16(&bitsPerSample)) return false;
-  if ((bitsPerSample!=8) && (bitsPerSample != 16)) return false; // Only 8 or 16 bits
+  switch (format) {
+    case FORMAT_PCM:
+      if ((bitsPerSample!=8) && (bitsPerSample != 16)) return false; // Only 8 or 16 bits
+      blockAlign = (bitsPerSample / 8) * channels;
+      if (buffSize < blockAlign) buffSize = blockAlign; // Must hold a whole sample frame
+      break;
+    case FORMAT_MULAW:
+    case FORMAT_ALAW:
+      if (bitsPerSample != 8) return false;
+      blockAlign = channels;
+      break;
+    case FORMAT_IMAADPCM:
+    case FORMAT_MSADPCM:
+      if (bitsPerSample != 4) return false;
+      if (!ReadFmtExtra(&toSkip)) return false;
+      break;
+    default:
+      return false; // Nothing else is supported
+  }
   // Skip any extra header
   while (toSkip) {
     uint8_t ign;
@@ -172,13 +579,77 @@ bool AudioGeneratorWAV::ReadWAVInfo()
   // Skip size, read until end of file...
   if (!ReadU32(&u32)) return false;
   availBytes = u32;
+  dataSize = u32;
+  dataStart = file->getPos();
 
-  // Now set up the buffer or fail
-  buff = reinterpret_cast<uint8_t *>(malloc(buffSize));
-  if (!buff) return false;
+  // Sources that can lend their memory need no buffer at all
+  uint32_t lent;
+  if (file->acquire(1, &lent)) {
+    buff = NULL;
+  } else {
+    // Now set up the buffer or fail
+    if (preallocateSpace) {
+      if (preAllocSize(buffSize) > preallocateSize) {
+        Serial.printf_P(PSTR("OOM error in WAV:  Want %d bytes, have %d bytes preallocated.\n"), preAllocSize(buffSize), preallocateSize);
+        return false;
+      }
+      buff = reinterpret_cast<uint8_t *>(preallocateSpace);
+    } else {
+      buff = reinterpret_cast<uint8_t *>(malloc(buffSize));
+    }
+    if (!buff) return false;
+  }
   buffPtr = 0;
   buffLen = 0;
+  pendLen = 0;
+  pendPtr = 0;
+  blockLeft = 0;
+  blockSamples = 0;
+  skipSamples = 0;
+  samplePos = 0;
+
+  return true;
+}
+
+bool AudioGeneratorWAV::ReadFmtExtra(int *toSkip)
+{
+  uint16_t u16;
+
+  // cbSize (the chunk size is trusted instead) and samples per block
+  if (*toSkip < 4) return false;
+  if (!ReadU16(&u16)) return false;
+  if (!ReadU16(&samplesPerBlock)) return false;
+  *toSkip -= 4;
+
+  int maxSamples;
+  if (format == FORMAT_IMAADPCM) {
+    // A 4 byte header per channel holding the first sample, then groups of 4 bytes per channel
+    int data = blockAlign - 4 * channels;
+    if ((data <= 0) || (data % (4 * channels))) return false;
+    maxSamples = data * 2 / channels + 1;
+  } else {
+    // A 7 byte header per channel holding the first two samples, then a nibble per sample
+    int data = blockAlign - 7 * channels;
+    if (data <= 0) return false;
+    maxSamples = data * 2 / channels + 2;
 
+    // The predictor coefficient pairs.  Everyone uses the standard 7, but they're in the file anyway
+    uint16_t numCoef;
+    if ((*toSkip < 2) || !ReadU16(&numCoef)) return false;
+    *toSkip -= 2;
+    if (!numCoef || (*toSkip < numCoef * 4)) return false;
+    memset(msCoef, 0, sizeof(msCoef));
+    for (int i = 0; i < numCoef; i++) {
+      int16_t c[2];
+      if (!ReadU16(reinterpret_cast<uint16_t*>(&c[0])) || !ReadU16(reinterpret_cast<uint16_t*>(&c[1]))) return false;
+      if (i < 7) {
+        msCoef[i][0] = c[0];
+        msCoef[i][1] = c[1];
+      }
+    }
+    *toSkip -= numCoef * 4;
+  }
+  if (!samplesPerBlock || (samplesPerBlock > maxSamples)) return false;
   return true;
 }
 
@@ -193,7 +664,7 @@ bool AudioGeneratorWAV::begin(AudioFileSource *source, AudioOutput *output)
   if (!ReadWAVInfo()) return false;
 
   if (!output->SetRate( sampleRate )) return false;
-  if (!output->SetBitsPerSample( bitsPerSample )) return false;
+  if (!output->SetBitsPerSample( 16 )) return false; // Everything's converted on the way in
   if (!output->SetChannels( channels )) return false;
   if (!output->begin()) return false;
 
@@ -1,6 +1,6 @@
 /*
   AudioGeneratorWAV
-  Audio output generator that reads 8 and 16-bit WAV files
+  Audio output generator that reads 8 and 16-bit PCM, G.711 and ADPCM WAV files
     
   Copyright (C) 2017  Earle F. Philhower, III
 
@@ -27,6 +27,7 @@ class AudioGeneratorWAV : public AudioGenerator
 {
   public:
     AudioGeneratorWAV();
+    AudioGeneratorWAV(void *preallocateSpace, int preallocateSize);
     virtual ~AudioGeneratorWAV() override;
     virtual bool begin(AudioFileSource *source, AudioOutput *output) override;
     virtual bool loop() override;
@@ -34,27 +35,70 @@ class AudioGeneratorWAV : public AudioGenerator
     virtual bool isRunning() override;
     void SetBufferSize(int sz) { buffSize = sz; }
 
+    // PCM and G.711 are a fixed number of bytes per sample, so a seek is a single file seek.  ADPCM
+    // seeks to the start of the block holding the target and decodes the part of it in the way.
+    virtual bool seekTo(uint32_t ms) override;
+    virtual uint32_t tell() override;
+
+    // Bytes needed by the preallocate constructor for a given SetBufferSize()
+    static constexpr int preAllocSize(int buffSize = 128) { return (buffSize + 7) & ~7; }
+
   private:
     bool ReadU32(uint32_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 4); }
     bool ReadU16(uint16_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 2); }
     bool ReadU8(uint8_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 1); }
     bool GetBufferedData(int bytes, void *dest);
     bool ReadWAVInfo();
+    bool ReadFmtExtra(int *toSkip);
+
+    // Every format is decoded a batch of 16-bit stereo sample frames at a time into pend[]
+    bool FillFrames();
+    bool DecodeMore();
+    bool DecodePCM();
+    void ConvertFrames(const uint8_t *p, int frames);
+    bool ReadBlockData(int bytes, void *dest);
+    bool StartIMABlock();
+    bool DecodeIMAGroup();
+    bool StartMSBlock();
+    bool DecodeMSByte();
+    int16_t MSNibble(int ch, int nib);
 
     
   protected:
     // WAV info
+    enum { FORMAT_PCM = 1, FORMAT_MSADPCM = 2, FORMAT_ALAW = 6, FORMAT_MULAW = 7, FORMAT_IMAADPCM = 0x11 };
+    uint16_t format;
     uint16_t channels;
     uint32_t sampleRate;
     uint16_t bitsPerSample;
+    uint16_t blockAlign;
+    uint16_t samplesPerBlock; // ADPCM only
     
     uint32_t availBytes;
+    uint32_t dataStart; // File offset of the first sample...
+    uint32_t dataSize;  // ...and how many bytes of them there are
 
-    // We need to buffer some data in-RAM to avoid doing 1000s of small reads
+    // We need to buffer some data in-RAM to avoid doing 1000s of small reads, unless the source
+    // can lend us its memory (buff is NULL then)
     uint32_t buffSize;
     uint8_t *buff;
     uint16_t buffPtr;
     uint16_t buffLen;
+
+    // Decode state
+    static const int pendFrames = 32;
+    int16_t pend[pendFrames][2]; // Decoded sample frames not yet played
+    uint8_t pendLen;
+    uint8_t pendPtr;
+    uint16_t blockLeft;     // Bytes of the current ADPCM block still unread
+    uint16_t blockSamples;  // Sample frames still to come out of it
+    uint32_t skipSamples;   // Decoded sample frames to drop after a seek
+    uint32_t samplePos;     // Sample frames played so far
+    int32_t predictor[2];   // Per-channel ADPCM state:  IMA uses predictor and index,
+    int16_t index[2];       // MS ADPCM predictor, index (into msCoef), delta and sample2
+    int32_t delta[2];
+    int32_t sample2[2];
+    int16_t msCoef[7][2];
 };
 
 #endif
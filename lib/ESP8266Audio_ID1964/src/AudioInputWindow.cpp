@@ -0,0 +1,135 @@
+/*
+  AudioInputWindow
+  Sliding window over a compressed bitstream for the frame-based decoders
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AudioInputWindow.h"
+
+void AudioInputWindow::consume(int bytes)
+{
+  if (bytes > available()) bytes = available();
+  if (view) {
+    source->release(bytes);
+    view += bytes;
+    viewLen -= bytes;
+    return;
+  }
+  // Bytes copied out of the source go first, then ones it still holds
+  int copied = available() - pending;
+  rdPtr += bytes;
+  if (bytes > copied) {
+    source->release(bytes - copied);
+    pending -= bytes - copied;
+  }
+}
+
+bool AudioInputWindow::Allocate()
+{
+  if (buff) return true;
+  buff = reinterpret_cast<uint8_t*>(malloc(capacity));
+  if (!buff) {
+    Serial.printf_P(PSTR("OOM error in AudioInputWindow:  Want %d bytes.\n"), capacity);
+    return false;
+  }
+  ownBuff = true;
+  return true;
+}
+
+// Whether lent bytes run to the end of the stream, so there's nothing more to put after them
+bool AudioInputWindow::AtEnd(AudioFileSource *src, uint32_t lent)
+{
+  uint32_t size = src->getSize();
+  return size && (src->getPos() + lent >= size);
+}
+
+// Whether the source has really run out, rather than just having nothing for us this moment
+bool AudioInputWindow::Ended(AudioFileSource *src)
+{
+  if (!src->isOpen()) return true;
+  uint32_t size = src->getSize();
+  return size && (src->getPos() >= size);
+}
+
+int AudioInputWindow::fill(AudioFileSource *src, int want)
+{
+  if (want > capacity) want = capacity;
+  if (src != source) lends = false;
+  source = src;
+
+  // Nothing that's only in the buffer is left, so everything unread starts at the source's position
+  // and it can be asked to lend from there afresh
+  if (view || (available() == pending)) {
+    uint32_t got = 0;
+    const uint8_t *p = src->acquire(capacity, &got);
+    if (p) lends = true;
+    // A source that lends has nothing to lend at the end, which isn't worth a buffer to find out
+    bool end = lends && (got < (uint32_t)want) && AtEnd(src, got);
+    if ((p || end) && ((got >= (uint32_t)want) || end || !Allocate())) {
+      rdPtr = 0;
+      wrPtr = 0;
+      pending = 0;
+      view = p;
+      viewLen = got;
+      eof = end;
+      return viewLen;
+    }
+    // Not all in one piece, so what there is gets copied and the rest put after it
+    view = NULL;
+    viewLen = 0;
+  }
+  eof = false;
+  if (available() >= want) return available();
+  if (!Allocate()) return available();
+
+  // Only move the unread tail when there isn't room behind it for the request
+  if (capacity - rdPtr < want) {
+    int len = available();
+    if (len) memmove(buff, buff + rdPtr, len);
+    rdPtr = 0;
+    wrPtr = len;
+  }
+
+  while (available() < want) {
+    // Lent bytes already copied have to be let go of to get at the ones after them
+    if (pending) {
+      src->release(pending);
+      pending = 0;
+    }
+    uint32_t got;
+    const uint8_t *p = src->acquire(want - available(), &got);
+    if (p) {
+      // Only as much as the request needs, so the copy is soon consumed and lending can resume
+      if (!got) {
+        eof = Ended(src);
+        break;
+      }
+      memcpy(buff + wrPtr, p, got);
+      wrPtr += got;
+      pending = got;
+      continue;
+    }
+    // Grab everything that fits while we're here, fewer calls into the source
+    uint32_t len = src->read(buff + wrPtr, capacity - wrPtr);
+    if (!len) {
+      eof = Ended(src);
+      break;
+    }
+    wrPtr += len;
+  }
+  return available();
+}
@@ -0,0 +1,83 @@
+/*
+  AudioInputWindow
+  Sliding window over a compressed bitstream for the frame-based decoders
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUDIOINPUTWINDOW_H
+#define _AUDIOINPUTWINDOW_H
+
+#include <Arduino.h>
+#include "AudioFileSource.h"
+
+// Hands a decoder a contiguous view of the next bytes of the stream.  Consumed
+// bytes are simply skipped over; the unread tail is only slid back to the start
+// of the buffer when a request would run off its end, so a buffer several frames
+// long is compacted once every few frames instead of being shifted every frame.
+// Sources that can lend their data in place (see AudioFileSource::acquire()) are
+// looked at directly and asked again on every fill().  Only a stretch the source
+// can't lend in one piece, like a ring buffer wrapping, is copied, and lending
+// starts again as soon as that copy has been consumed.
+class AudioInputWindow
+{
+  public:
+    AudioInputWindow() { buff = NULL; ownBuff = false; source = NULL; lends = false; begin(NULL, 0); }
+    ~AudioInputWindow() { end(); }
+    // With no buffer one of size bytes is malloc()ed the first time something has to be copied,
+    // which never happens for sources that lend the whole stream (PROGMEM, MMAP), and end() frees it
+    void begin(uint8_t *buffer, int size) { end(); buff = buffer; capacity = size; reset(); }
+    void end() { if (ownBuff) { free(buff); buff = NULL; ownBuff = false; } }
+    void reset() { rdPtr = 0; wrPtr = 0; pending = 0; eof = false; view = NULL; viewLen = 0; }
+
+    uint8_t *data() const { return view ? const_cast<uint8_t*>(view) : buff + rdPtr; }
+    int available() const { return view ? viewLen : wrPtr - rdPtr; }
+    int getCapacity() const { return capacity; }
+    bool isEOF() const { return eof; }
+    void consume(int bytes);
+    // Offset of data() in the stream
+    uint32_t getPos(AudioFileSource *src) const { return src->getPos() - (view ? 0 : available() - pending); }
+
+    // Try and get at least want bytes (capped to the capacity) contiguous at data(),
+    // reading as many times as needed to ride out short reads from network sources.
+    // Returns available(), which is less than asked for at the end of the stream or
+    // when a source that's still open has nothing more just now; isEOF() says which,
+    // and in the second case the caller should simply try again later.
+    int fill(AudioFileSource *src, int want);
+
+  private:
+    bool Allocate();
+    bool AtEnd(AudioFileSource *src, uint32_t lent);
+    bool Ended(AudioFileSource *src);
+
+    uint8_t *buff;
+    bool ownBuff;
+    int capacity;
+    int rdPtr;
+    int wrPtr;
+    // The last pending bytes copied into buff were lent and are still the source's, released as they're consumed
+    int pending;
+    bool eof;
+
+    // Bytes lent by the source, released as they're consumed
+    AudioFileSource *source;
+    bool lends;
+    const uint8_t *view;
+    int viewLen;
+};
+
+#endif
+
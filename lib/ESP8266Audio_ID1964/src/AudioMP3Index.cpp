@@ -0,0 +1,226 @@
+/*
+  AudioMP3Index
+  Duration and seek support for the MP3 decoders from Xing/VBRI/LAME tags or a frame header scan
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AudioMP3Index.h"
+#include "AudioSyncScan.h"
+
+static uint32_t BE32(const uint8_t *p)
+{
+  return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint16_t BE16(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+void AudioMP3Index::reset()
+{
+  ResetIndex();
+  memset(firstHdr, 0, sizeof(firstHdr));
+  sampleRate = 0;
+  frameSamples = 0;
+  tagOffset = 0;
+  audioOffset = 0;
+  tagBytes = 0;
+  hasToc = false;
+  gapless = false;
+  encDelay = 0;
+  encPadding = 0;
+}
+
+bool AudioMP3Index::begin(AudioFileSource *source, const uint8_t *frame, int len, uint32_t offset)
+{
+  reset();
+  if ((len < 4) || (AudioSyncMP3FrameBytes(frame) < 0)) return false;
+
+  memcpy(firstHdr, frame, 4);
+  sampleRate = AudioSyncMP3SampleRate(frame);
+  frameSamples = AudioSyncMP3FrameSamples(frame);
+  tagOffset = offset;
+  int bytes = AudioSyncMP3FrameBytes(frame);
+  audioOffset = offset + ((bytes > 0) ? bytes : len); // Assume it's a tag frame until we know better
+
+  bool tag = ParseXing(frame, len) || ParseVBRI(frame, len);
+  if (!tag) audioOffset = offset;
+  StartIndex(source, audioOffset);
+  return tag;
+}
+
+bool AudioMP3Index::ParseXing(const uint8_t *frame, int len)
+{
+  // The tag sits right after the side info, whose size depends on the version and channel count
+  bool mpeg1 = ((frame[1] >> 3) & 3) == 3;
+  bool mono = (frame[3] >> 6) == 3;
+  int p = 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+  if (p + 8 > len) return false;
+  if (memcmp_P(frame + p, PSTR("Xing"), 4) && memcmp_P(frame + p, PSTR("Info"), 4)) return false;
+
+  uint32_t flags = BE32(frame + p + 4);
+  p += 8;
+  if (flags & 1) {
+    if (p + 4 > len) return true;
+    frames = BE32(frame + p);
+    p += 4;
+  }
+  if (flags & 2) {
+    if (p + 4 > len) return true;
+    tagBytes = BE32(frame + p);
+    p += 4;
+  }
+  if (flags & 4) {
+    if (p + 100 > len) return true;
+    memcpy(toc, frame + p, 100);
+    hasToc = true;
+    p += 100;
+  }
+  if (flags & 8) p += 4; // Quality, not interesting
+
+  // LAME (and FFmpeg) append their own block: a 9 character version, 12 bytes we don't care about,
+  // then 12 bits each of encoder delay and padding
+  if (p + 24 > len) return true;
+  if (memcmp_P(frame + p, PSTR("LAME"), 4) && memcmp_P(frame + p, PSTR("Lavf"), 4) && memcmp_P(frame + p, PSTR("Lavc"), 4)) return true;
+  const uint8_t *d = frame + p + 21;
+  encDelay = (d[0] << 4) | (d[1] >> 4);
+  encPadding = ((d[1] & 0x0f) << 8) | d[2];
+  gapless = true;
+  return true;
+}
+
+bool AudioMP3Index::ParseVBRI(const uint8_t *frame, int len)
+{
+  // Always 32 bytes past the header, whatever the channel count
+  int p = 4 + 32;
+  if (p + 26 > len) return false;
+  if (memcmp_P(frame + p, PSTR("VBRI"), 4)) return false;
+
+  tagBytes = BE32(frame + p + 10);
+  frames = BE32(frame + p + 14);
+  int entries = BE16(frame + p + 18);
+  int scale = BE16(frame + p + 20);
+  int entrySize = BE16(frame + p + 22);
+  int perEntry = BE16(frame + p + 24);
+  p += 26;
+  if (!frames || !perEntry || (entrySize < 1) || (entrySize > 4)) return true;
+
+  // Each entry is the size of the next perEntry frames, so it drops straight into the index
+  stride = perEntry;
+  uint32_t pos = audioOffset;
+  AddSlot(0, pos);
+  for (int i = 0; (i < entries) && (p + entrySize <= len); i++, p += entrySize) {
+    uint32_t v = 0;
+    for (int j = 0; j < entrySize; j++) v = (v << 8) | frame[p + j];
+    pos += v * scale;
+    AddSlot((i + 1) * perEntry, pos);
+  }
+  scanDone = true;
+  return true;
+}
+
+int AudioMP3Index::HeaderFrameBytes(const uint8_t *hdr)
+{
+  // Must match the stream's version, layer and sample rate, too
+  if (((hdr[1] ^ firstHdr[1]) & 0x1e) || ((hdr[2] ^ firstHdr[2]) & 0x0c)) return -1;
+  return AudioSyncMP3FrameBytes(hdr);
+}
+
+uint32_t AudioMP3Index::getTaggedSamples() const
+{
+  if (!frames) return 0;
+  uint32_t total = frames * frameSamples;
+  uint32_t trim = gapless ? encDelay + encPadding : 0;
+  return (total > trim) ? total - trim : 0;
+}
+
+uint32_t AudioMP3Index::getFrames()
+{
+  return CountFrames();
+}
+
+uint32_t AudioMP3Index::getSamples()
+{
+  getFrames();
+  return getTaggedSamples();
+}
+
+// Frames the source should hold at the average size of the ones indexed so far (at least the first
+// few), without reading further.  CBR frames only differ by the padding byte, so that's close to exact.
+// Where seeking isn't cheap the first frame's size has to do, rather than lose a read-ahead buffer.
+uint32_t AudioMP3Index::EstimateFrames()
+{
+  uint32_t size = src ? src->getSize() : 0;
+  if (size <= audioOffset) return 0;
+  if (!src->isSeekCheap()) {
+    int first = AudioSyncMP3FrameBytes(firstHdr);
+    return (first > 0) ? (size - audioOffset + first / 2) / first : 0;
+  }
+  uint32_t saved = src->getPos();
+  Scan(probeFrames - 1);
+  src->seek(saved, SEEK_SET);
+  if (frames) return frames; // The whole file was shorter than the probe
+  if ((usedSlots < 2) || (slots[usedSlots - 1] <= slots[0])) return 0;
+  uint64_t bytes = slots[usedSlots - 1] - slots[0];
+  uint64_t spanned = (uint64_t)(usedSlots - 1) * stride;
+  return ((uint64_t)(size - audioOffset) * spanned + bytes / 2) / bytes;
+}
+
+uint32_t AudioMP3Index::getDurationMs()
+{
+  if (!isValid()) return 0;
+  if (frames) return ((uint64_t)getTaggedSamples() * 1000) / sampleRate;
+  return ((uint64_t)EstimateFrames() * frameSamples * 1000) / sampleRate;
+}
+
+bool AudioMP3Index::locate(uint32_t ms, int preroll, uint32_t *offset, uint32_t *position, uint32_t *skip)
+{
+  if (!isValid() || !src) return false;
+  uint32_t target = ((uint64_t)ms * sampleRate) / 1000;
+
+  if (hasToc && frames) {
+    // The Xing table maps percent of the duration to 256ths of the file, instant but approximate
+    uint32_t dur = getDurationMs();
+    if (ms >= dur) return false;
+    uint32_t pct = ((uint64_t)ms * 100000) / dur; // In 1/1000ths of a percent
+    int i = pct / 1000;
+    int a = toc[i];
+    int b = (i < 99) ? toc[i + 1] : 256;
+    int frac = a * 1000 + (b - a) * (int)(pct % 1000);
+    uint32_t bytes = tagBytes ? tagBytes : src->getSize() - tagOffset;
+    *offset = tagOffset + (uint32_t)(((uint64_t)((frac > 0) ? frac : 0) * bytes) / 256000);
+    if (*offset < audioOffset) *offset = audioOffset;
+    *position = target;
+    *skip = 0;
+    return true;
+  }
+
+  uint32_t saved = src->getPos();
+  target += getStartSkip();
+  uint32_t frame = target / frameSamples;
+  uint32_t start = (frame > (uint32_t)preroll) ? frame - preroll : 0;
+  bool ok = Scan(frame);
+  if (ok) {
+    *offset = FrameOffset(start);
+    *position = target - getStartSkip();
+    *skip = target - start * frameSamples;
+  }
+  src->seek(saved, SEEK_SET);
+  return ok;
+}
+
@@ -0,0 +1,93 @@
+/*
+  AudioMP3Index
+  Duration and seek support for the MP3 decoders from Xing/VBRI/LAME tags or a frame header scan
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUDIOMP3INDEX_H
+#define _AUDIOMP3INDEX_H
+
+#include "AudioFrameIndex.h"
+
+// Knows where MP3 frames live in a file without decoding any of them.  The first frame is
+// checked for a Xing/Info or VBRI tag, which give the frame count (and so the duration) and
+// a seek table for free, plus the LAME tag's encoder delay and padding for gapless playback.
+// Files without a table get the sparse index of frame offsets AudioFrameIndex builds.
+class AudioMP3Index : public AudioFrameIndex
+{
+  public:
+    AudioMP3Index() : AudioFrameIndex(4, 0xe0) { reset(); }
+    void reset();
+
+    // Look at the first frame of a stream, found at byte offset in src.  Returns true when it's a
+    // Xing/Info/VBRI tag frame, which holds no audio and should be dropped instead of played.
+    bool begin(AudioFileSource *src, const uint8_t *frame, int len, uint32_t offset);
+    bool isValid() const { return sampleRate != 0; }
+
+    uint32_t getSampleRate() const { return sampleRate; }
+    uint32_t getFrameSamples() const { return frameSamples; }
+    bool hasGaplessInfo() const { return gapless; }
+    uint32_t getEncoderDelay() const { return encDelay; }
+    uint32_t getEncoderPadding() const { return encPadding; }
+    // Decoded samples to throw away before the first real one, the LAME delay plus the decoder's own
+    uint32_t getStartSkip() const { return gapless ? encDelay + decoderDelay : 0; }
+    // Playable samples when the tags say exactly, 0 otherwise.  Never scans.
+    uint32_t getTaggedSamples() const;
+
+    // Audio frames and playable samples in the stream, 0 if unknown.  With no tag to say so this
+    // reads every frame header once, so it's best avoided on slow or unseekable sources.
+    uint32_t getFrames();
+    uint32_t getSamples();
+    // Milliseconds in the stream, 0 if unknown.  Exact when a tag (or an earlier full scan) gave the
+    // frame count, see isDurationExact().  Otherwise it's estimated from the source's size and the
+    // bitrate of the first few frames, which is within a frame of the truth for CBR files and only
+    // a rough guess for untagged VBR ones.  Only those first frames are read, never the whole file.
+    uint32_t getDurationMs();
+    bool isDurationExact() const { return frames != 0; }
+
+    // How to restart playback at ms: the byte offset to seek to, the position (in samples) that will
+    // be playing, and how many decoded samples to drop first.  preroll frames ahead of the target are
+    // decoded and dropped so the bit reservoir and overlap are primed.  Offsets from a Xing table are
+    // approximate, everything else lands on the exact sample.
+    bool locate(uint32_t ms, int preroll, uint32_t *offset, uint32_t *position, uint32_t *skip);
+
+  protected:
+    virtual int HeaderFrameBytes(const uint8_t *hdr) override;
+
+  private:
+    static const int decoderDelay = 529;
+    static const int probeFrames = 8;
+
+    uint8_t firstHdr[4];
+    uint32_t sampleRate;
+    uint32_t frameSamples;
+    uint32_t tagOffset;   // Start of the tag frame, which Xing table offsets are relative to
+    uint32_t audioOffset; // Start of the first audio frame
+    uint32_t tagBytes;
+    bool hasToc;
+    uint8_t toc[100];
+    bool gapless;
+    uint16_t encDelay;
+    uint16_t encPadding;
+
+    bool ParseXing(const uint8_t *frame, int len);
+    bool ParseVBRI(const uint8_t *frame, int len);
+    uint32_t EstimateFrames();
+};
+
+#endif
+
@@ -34,6 +34,8 @@ class AudioOutput
     virtual bool SetChannels(int chan) { channels = chan; return true; }
     virtual bool SetGain(float f) { if (f>4.0) f = 4.0; if (f<0.0) f=0.0; gainF2P6 = (uint8_t)(f*(1<<6)); return true; }
     virtual bool begin() { return false; };
+    // Whether this only ever plays both channels mixed together, so a generator may as well send mono
+    virtual bool IsMono() { return false; }
     typedef enum { LEFTCHANNEL=0, RIGHTCHANNEL=1 } SampleIndex;
     virtual bool ConsumeSample(int16_t sample[2]) { (void)sample; return false; }
     virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count)
@@ -50,6 +52,9 @@ class AudioOutput
   public:
     virtual bool RegisterMetadataCB(AudioStatus::metadataCBFn fn, void *data) { return cb.RegisterMetadataCB(fn, data); }
     virtual bool RegisterStatusCB(AudioStatus::statusCBFn fn, void *data) { return cb.RegisterStatusCB(fn, data); }
+    virtual bool RegisterReportCB(AudioStatus::reportCBFn fn, void *data) { return cb.RegisterReportCB(fn, data); }
+    void SetStatusRateLimit(uint32_t ms) { cb.SetRateLimit(ms); }
+    uint32_t GetStatusCount(int code) const { return cb.GetCount(code); }
 
   protected:
     void MakeSampleStereo16(int16_t sample[2]) {
@@ -63,6 +68,16 @@ class AudioOutput
       }
     };
 
+    // Stores one frame the way a WAV file holds it (little-endian, unsigned if 8 bits), returning the bytes used
+    inline int PackFrame(uint8_t *dest, const int16_t sample[2]) {
+      int n = 0;
+      for (int i=0; i<channels; i++) {
+        dest[n++] = sample[i] & 0xff;
+        if (bps != 8) dest[n++] = (sample[i] >> 8) & 0xff;
+      }
+      return n;
+    }
+
     inline int16_t Amplify(int16_t s) {
       int32_t v = (s * gainF2P6)>>6;
       if (v < -32767) return -32767;
@@ -32,6 +32,7 @@ class AudioOutputBuffer : public AudioOutput
     virtual bool SetBitsPerSample(int bits) override;
     virtual bool SetChannels(int channels) override;
     virtual bool begin() override;
+    virtual bool IsMono() override { return sink->IsMono(); }
     virtual bool ConsumeSample(int16_t sample[2]) override;
     virtual bool stop() override;
     
@@ -33,6 +33,7 @@ class AudioOutputFilterDecimate : public AudioOutput
     virtual bool SetChannels(int chan) override;
     virtual bool SetGain(float f) override;
     virtual bool begin() override;
+    virtual bool IsMono() override { return sink->IsMono(); }
     virtual bool ConsumeSample(int16_t sample[2]) override;
     virtual bool stop() override;
 
@@ -39,33 +39,37 @@ void AudioOutputSPIFFSWAV::SetFilename(const char *name)
 
 bool AudioOutputSPIFFSWAV::begin()
 {
-  uint8_t wavHeader[sizeof(wavHeaderTemplate)];
-  memset(wavHeader, 0, sizeof(wavHeader));
-
   if (f) return false; // Already open!
   SPIFFS.remove(filename);
   f = SPIFFS.open(filename, "w+");
   if (!f) return false;
   
   // We'll fix the header up when we close the file
-  f.write(wavHeader, sizeof(wavHeader));
+  memset(block, 0, sizeof(wavHeaderTemplate));
+  blockLen = sizeof(wavHeaderTemplate);
   return true;
 }
 
+void AudioOutputSPIFFSWAV::Flush()
+{
+  if (blockLen) f.write(block, blockLen);
+  blockLen = 0;
+}
+
 bool AudioOutputSPIFFSWAV::ConsumeSample(int16_t sample[2])
 {
-  for (int i=0; i<channels; i++) {
-    if (bps == 8) {
-      uint8_t l = sample[i] & 0xff;
-      f.write(&l, sizeof(l));
-    } else {
-      uint8_t l = sample[i] & 0xff;
-      uint8_t h = (sample[i] >> 8) & 0xff;
-      f.write(&l, sizeof(l));
-      f.write(&h, sizeof(h));
-    }
+  return ConsumeSamples(sample, 1) == 1;
+}
+
+uint16_t AudioOutputSPIFFSWAV::ConsumeSamples(int16_t *samples, uint16_t count)
+{
+  int frameBytes = channels * ((bps == 8) ? 1 : 2);
+  for (uint16_t i=0; i<count; i++) {
+    if (blockLen + frameBytes > blockSize) Flush();
+    blockLen += PackFrame(block + blockLen, samples);
+    samples += 2;
   }
-  return true;
+  return count;
 }
 
 
@@ -73,6 +77,8 @@ bool AudioOutputSPIFFSWAV::stop()
 {
   uint8_t wavHeader[sizeof(wavHeaderTemplate)];
 
+  if (!f) return false;
+  Flush();
   memcpy_P(wavHeader, wavHeaderTemplate, sizeof(wavHeaderTemplate));
 
   int chunksize = f.size() - 8;
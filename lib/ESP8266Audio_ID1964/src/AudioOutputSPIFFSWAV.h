@@ -29,16 +29,25 @@
 class AudioOutputSPIFFSWAV : public AudioOutput
 {
   public:
-    AudioOutputSPIFFSWAV() { filename = NULL; };
+    AudioOutputSPIFFSWAV() { filename = NULL; blockLen = 0; };
     ~AudioOutputSPIFFSWAV() { free(filename); };
     virtual bool begin() override;
     virtual bool ConsumeSample(int16_t sample[2]) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override;
     virtual bool stop() override;
     void SetFilename(const char *name);
 
+  private:
+    void Flush();
+
   private:
     File f;
     char *filename;
+    // Writing whole, aligned flash pages instead of a few bytes per sample saves SPIFFS from
+    // rewriting the same page over and over.  The header shares the first block.
+    static const int blockSize = 512;
+    uint8_t block[blockSize];
+    int blockLen;
 };
 
 #endif
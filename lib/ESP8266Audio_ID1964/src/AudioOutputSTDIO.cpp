@@ -39,33 +39,37 @@ void AudioOutputSTDIO::SetFilename(const char *name)
 
 bool AudioOutputSTDIO::begin()
 {
-  uint8_t wavHeader[sizeof(wavHeaderTemplate)];
-  memset(wavHeader, 0, sizeof(wavHeader));
-
   if (f) return false; // Already open!
   unlink(filename);
   f = fopen(filename, "wb+");
   if (!f) return false;
   
   // We'll fix the header up when we close the file
-  fwrite(wavHeader, sizeof(wavHeader), 1, f);
+  memset(block, 0, sizeof(wavHeaderTemplate));
+  blockLen = sizeof(wavHeaderTemplate);
   return true;
 }
 
+void AudioOutputSTDIO::Flush()
+{
+  if (blockLen) fwrite(block, blockLen, 1, f);
+  blockLen = 0;
+}
+
 bool AudioOutputSTDIO::ConsumeSample(int16_t sample[2])
 {
-  for (int i=0; i<channels; i++) {
-    if (bps == 8) {
-      uint8_t l = sample[i] & 0xff;
-      fwrite(&l, sizeof(l), 1, f);
-    } else {
-      uint8_t l = sample[i] & 0xff;
-      uint8_t h = (sample[i] >> 8) & 0xff;
-      fwrite(&l, sizeof(l), 1, f);
-      fwrite(&h, sizeof(h), 1, f);
-    }
+  return ConsumeSamples(sample, 1) == 1;
+}
+
+uint16_t AudioOutputSTDIO::ConsumeSamples(int16_t *samples, uint16_t count)
+{
+  int frameBytes = channels * ((bps == 8) ? 1 : 2);
+  for (uint16_t i=0; i<count; i++) {
+    if (blockLen + frameBytes > blockSize) Flush();
+    blockLen += PackFrame(block + blockLen, samples);
+    samples += 2;
   }
-  return true;
+  return count;
 }
 
 
@@ -73,6 +77,8 @@ bool AudioOutputSTDIO::stop()
 {
   uint8_t wavHeader[sizeof(wavHeaderTemplate)];
 
+  if (!f) return false;
+  Flush();
   memcpy_P(wavHeader, wavHeaderTemplate, sizeof(wavHeaderTemplate));
 
   int chunksize = ftell(f) - 8;
@@ -108,6 +114,7 @@ bool AudioOutputSTDIO::stop()
   fseek(f, 0, SEEK_SET);
   fwrite(wavHeader, sizeof(wavHeader), 1, f);
   fclose(f);
+  f = NULL;
   return true;
 }
 
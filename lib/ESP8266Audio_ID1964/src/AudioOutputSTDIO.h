@@ -30,16 +30,25 @@
 class AudioOutputSTDIO : public AudioOutput
 {
   public:
-    AudioOutputSTDIO() { filename = NULL; f = NULL; };
+    AudioOutputSTDIO() { filename = NULL; f = NULL; blockLen = 0; };
     ~AudioOutputSTDIO() { free(filename); };
     virtual bool begin() override;
     virtual bool ConsumeSample(int16_t sample[2]) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override;
     virtual bool stop() override;
     void SetFilename(const char *name);
 
+  private:
+    void Flush();
+
   private:
     FILE *f;
     char *filename;
+    // Samples are gathered here and written a block at a time.  The header shares the first
+    // block, so every write after it starts on a block boundary of the file.
+    static const int blockSize = 4096;
+    uint8_t block[blockSize];
+    int blockLen;
 };
 
 #endif
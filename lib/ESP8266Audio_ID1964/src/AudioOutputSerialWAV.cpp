@@ -46,33 +46,42 @@ bool AudioOutputSerialWAV::begin()
   wavHeader[35] = 0;
   Serial.write(wavHeader, sizeof(wavHeader));
   count = 0;
+  blockLen = 0;
   return true;
 }
 
+void AudioOutputSerialWAV::Flush()
+{
+  if (blockLen) Serial.write(block, blockLen);
+  blockLen = 0;
+}
+
 bool AudioOutputSerialWAV::ConsumeSample(int16_t sample[2])
 {
-  if (++count == 200) {
-    count = 0;
-    return false;
-  }
-  for (int i=0; i<channels; i++) {
-    if (bps == 8) {
-      uint8_t l = sample[i] & 0xff;
-      Serial.write(l);
-    } else {
-      uint8_t l = sample[i] & 0xff;
-      uint8_t h = (sample[i] >> 8) & 0xff;
-      Serial.write(l);
-      Serial.write(h);
+  return ConsumeSamples(sample, 1) == 1;
+}
+
+uint16_t AudioOutputSerialWAV::ConsumeSamples(int16_t *samples, uint16_t num)
+{
+  int frameBytes = channels * ((bps == 8) ? 1 : 2);
+  for (uint16_t i=0; i<num; i++) {
+    // Push back every 200 samples so the caller gets a chance to yield
+    if (++count == 200) {
+      count = 0;
+      Flush();
+      return i;
     }
+    if (blockLen + frameBytes > blockSize) Flush();
+    blockLen += PackFrame(block + blockLen, samples);
+    samples += 2;
   }
-  return true;
+  return num;
 }
 
 
 bool AudioOutputSerialWAV::stop()
 {
+  Flush();
   Serial.printf_P(PSTR("\n\n\nEOF\n\n\n"));
   return true;
 }
- 
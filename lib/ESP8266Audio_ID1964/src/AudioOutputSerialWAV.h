@@ -26,13 +26,20 @@
 class AudioOutputSerialWAV : public AudioOutput
 {
   public:
-    AudioOutputSerialWAV() {};
+    AudioOutputSerialWAV() { blockLen = 0; };
     ~AudioOutputSerialWAV() {};
     virtual bool begin() override;
     virtual bool ConsumeSample(int16_t sample[2]) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t num) override;
     virtual bool stop() override;
+  private:
+    void Flush();
   private:
     int count;
+    // One UART FIFO's worth, handed to Serial.write() at once instead of a byte at a time
+    static const int blockSize = 128;
+    uint8_t block[blockSize];
+    int blockLen;
 };
 
 #endif
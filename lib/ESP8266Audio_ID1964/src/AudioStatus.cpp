@@ -0,0 +1,107 @@
+/*
+  AudioStatus
+  Base class for Audio* status/metadata reporting
+  
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AudioStatus.h"
+
+void AudioStatus::ResetCounts()
+{
+  memset(counters, 0, sizeof(counters));
+  usedSlots = 0;
+  total = 0;
+}
+
+uint32_t AudioStatus::GetCount(int code) const
+{
+  for (int i = 0; i < usedSlots; i++) {
+    if (counters[i].code == code) return counters[i].count;
+  }
+  return 0;
+}
+
+void AudioStatus::report(int code, uint32_t offset, const char *what)
+{
+  total++;
+
+  counter *c = &counters[codeSlots]; // Overflow slot
+  for (int i = 0; i < usedSlots; i++) {
+    if (counters[i].code == code) {
+      c = &counters[i];
+      break;
+    }
+  }
+  if ((c == &counters[codeSlots]) && (usedSlots < codeSlots)) {
+    c = &counters[usedSlots++];
+    c->code = code;
+  }
+  c->count++;
+
+  if (!stFn && !rpFn) return; // Nobody listening, counting is all there is to do
+
+  if (rateLimitMs) {
+    uint32_t now = millis();
+    if ((c->count > 1) && (now - c->lastMs < rateLimitMs)) {
+      c->suppressed++;
+      return;
+    }
+    c->lastMs = now;
+  }
+
+  Report r;
+  r.code = code;
+  r.offset = offset;
+  r.count = c->count;
+  r.suppressed = c->suppressed;
+  r.what = what;
+  c->suppressed = 0;
+
+  if (rpFn) rpFn(rpData, &r);
+  if (stFn) {
+    if ((offset == noOffset) && !r.suppressed) {
+      stFn(stData, code, what); // Nothing to add, hand it over as-is
+    } else {
+      char buff[96];
+      Format(&r, buff, sizeof(buff));
+      stFn(stData, code, buff);
+    }
+  }
+}
+
+int AudioStatus::Format(const Report *report, char *dest, int len)
+{
+  if (!dest || (len <= 0)) return 0;
+
+  if (report->what) {
+    strncpy_P(dest, report->what, len);
+    dest[len - 1] = 0;
+  } else {
+    snprintf_P(dest, len, PSTR("Status %d"), report->code);
+  }
+  int used = strlen(dest);
+  if ((report->offset != noOffset) && (used < len - 1)) {
+    snprintf_P(dest + used, len - used, PSTR(" at byte offset %u"), (unsigned)report->offset);
+    used = strlen(dest);
+  }
+  if (report->suppressed && (used < len - 1)) {
+    snprintf_P(dest + used, len - used, PSTR(" (%u more not shown)"), (unsigned)report->suppressed);
+    used = strlen(dest);
+  }
+  return used;
+}
+
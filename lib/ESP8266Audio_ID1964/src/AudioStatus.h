@@ -26,29 +26,66 @@
 class AudioStatus
 {
   public:
-    AudioStatus() { ClearCBs(); };
+    AudioStatus() { ClearCBs(); rateLimitMs = 0; ResetCounts(); };
     virtual ~AudioStatus() {};
 
-    void ClearCBs() { mdFn = NULL; stFn = NULL; };
+    void ClearCBs() { mdFn = NULL; stFn = NULL; rpFn = NULL; };
 
     typedef void (*metadataCBFn)(void *cbData, const char *type, bool isUnicode, const char *str);
     bool RegisterMetadataCB(metadataCBFn f, void *cbData) { mdFn = f; mdData = cbData; return true; }
+    bool HasMetadataCB() const { return mdFn != NULL; }
 
     // Returns a unique warning/error code, varying by the object.  The string may be a PSTR, use _P functions!
     typedef void (*statusCBFn)(void *cbData, int code, const char *string);
     bool RegisterStatusCB(statusCBFn f, void *cbData) { stFn = f; stData = cbData; return true; }
 
+    // The same reports in raw form, with nothing formatted.  Use Format() if you want the text.
+    static const uint32_t noOffset = 0xffffffff;
+    typedef struct {
+      int code;            // Same code the string callback would get
+      uint32_t offset;     // Byte offset in the source it refers to, or noOffset
+      uint32_t count;      // Times this code has been reported so far
+      uint32_t suppressed; // Reports of this code dropped by the rate limit since the last one delivered
+      const char *what;    // Short description, may be a PSTR
+    } Report;
+    typedef void (*reportCBFn)(void *cbData, const Report *report);
+    bool RegisterReportCB(reportCBFn f, void *cbData) { rpFn = f; rpData = cbData; return true; }
+    static int Format(const Report *report, char *dest, int len);
+
+    // Deliver at most one report per code every ms milliseconds, 0 (the default) delivers them all.
+    // The counters below are kept either way.
+    void SetRateLimit(uint32_t ms) { rateLimitMs = ms; }
+    uint32_t GetCount(int code) const;
+    uint32_t GetTotal() const { return total; }
+    void ResetCounts();
+
     // Safely call the md function, if defined
     inline void md(const char *type, bool isUnicode, const char *string) { if (mdFn) mdFn(mdData, type, isUnicode, string); }
 
-    // Safely call the st function, if defined
-    inline void st(int code, const char *string) { if (stFn) stFn(stData, code, string); }
+    // Count a status and pass it on to whoever is listening, subject to the rate limit
+    inline void st(int code, const char *string) { report(code, noOffset, string); }
+    void report(int code, uint32_t offset, const char *what);
 
   private:
     metadataCBFn mdFn;
     void *mdData;
     statusCBFn stFn;
     void *stData;
+    reportCBFn rpFn;
+    void *rpData;
+
+    // Per-code counters for the first few distinct codes seen, anything after shares the last slot
+    enum { codeSlots = 4 };
+    typedef struct {
+      int code;
+      uint32_t count;
+      uint32_t suppressed;
+      uint32_t lastMs;
+    } counter;
+    counter counters[codeSlots + 1];
+    uint8_t usedSlots;
+    uint32_t total;
+    uint32_t rateLimitMs;
 };
 
 #endif
@@ -0,0 +1,220 @@
+/*
+  AudioSyncScan
+  Shared frame sync scanner for the MP3 and AAC decoders
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <pgmspace.h>
+#include "AudioSyncScan.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Offset of the first 0xff in buf, or nBytes if there isn't one
+static int FindFF(const unsigned char *buf, int nBytes)
+{
+  int i = 0;
+#ifdef __SSE2__
+  const __m128i ff = _mm_set1_epi8((char)0xff);
+  for (; i + 16 <= nBytes; i += 16) {
+    int hits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), ff));
+    if (hits) return i + __builtin_ctz(hits);
+  }
+#else
+  // Get word aligned first, the ESP8266 can't do unaligned 32-bit loads
+  for (; (i < nBytes) && (((uintptr_t)(buf + i)) & 3); i++) {
+    if (buf[i] == 0xff) return i;
+  }
+  for (; i + 4 <= nBytes; i += 4) {
+    uint32_t w;
+    memcpy(&w, buf + i, 4);
+    w = ~w; // Any 0xff byte is now a zero byte, which the classic haszero() test spots
+    if ((w - 0x01010101) & ~w & 0x80808080) break;
+  }
+#endif
+  for (; i < nBytes; i++) {
+    if (buf[i] == 0xff) return i;
+  }
+  return nBytes;
+}
+
+int AudioSyncFind(const unsigned char *buf, int nBytes, unsigned char mask)
+{
+  int i = 0;
+  while (i < nBytes - 1) {
+    i += FindFF(buf + i, nBytes - 1 - i); // Need the byte after it, too
+    if (i >= nBytes - 1) break;
+    if ((buf[i + 1] & mask) == mask) return i;
+    i++;
+  }
+  return -1;
+}
+
+// kbps by [MPEG1 or not][layer-1][index]
+static const uint16_t mpegKbps[2][3][15] PROGMEM = {
+  { { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+    { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+    { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 } },
+  { { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256 },
+    { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 },
+    { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 } }
+};
+static const uint16_t mpegHz[3] PROGMEM = { 44100, 48000, 32000 };
+
+int AudioSyncMP3FrameBytes(const unsigned char *hdr)
+{
+  if ((hdr[0] != 0xff) || ((hdr[1] & 0xe0) != 0xe0)) return -1;
+  int ver = (hdr[1] >> 3) & 3; // 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+  int layer = 4 - ((hdr[1] >> 1) & 3);
+  int brIdx = hdr[2] >> 4;
+  int srIdx = (hdr[2] >> 2) & 3;
+  if ((ver == 1) || (layer == 4) || (brIdx == 15) || (srIdx == 3)) return -1;
+  if (brIdx == 0) return 0; // Free format, the length isn't in the header
+
+  int lsf = (ver == 3) ? 0 : 1;
+  long bitrate = pgm_read_word(&mpegKbps[lsf][layer - 1][brIdx]) * 1000L;
+  long rate = pgm_read_word(&mpegHz[srIdx]) >> ((ver == 3) ? 0 : (ver == 2) ? 1 : 2);
+  int pad = (hdr[2] >> 1) & 1;
+  if (layer == 1) return (12 * bitrate / rate + pad) * 4;
+  return ((layer == 3) && lsf ? 72 : 144) * bitrate / rate + pad;
+}
+
+int AudioSyncMP3SampleRate(const unsigned char *hdr)
+{
+  int ver = (hdr[1] >> 3) & 3;
+  int srIdx = (hdr[2] >> 2) & 3;
+  if ((ver == 1) || (srIdx == 3)) return -1; // Reserved
+  return pgm_read_word(&mpegHz[srIdx]) >> ((ver == 3) ? 0 : (ver == 2) ? 1 : 2);
+}
+
+int AudioSyncMP3FrameSamples(const unsigned char *hdr)
+{
+  int ver = (hdr[1] >> 3) & 3;
+  int layer = 4 - ((hdr[1] >> 1) & 3);
+  if (layer == 1) return 384;
+  return ((layer == 3) && (ver != 3)) ? 576 : 1152;
+}
+
+int AudioSyncADTSFrameBytes(const unsigned char *hdr)
+{
+  if ((hdr[0] != 0xff) || ((hdr[1] & 0xf6) != 0xf0)) return -1; // Sync and layer 0
+  if (((hdr[2] >> 2) & 0x0f) >= 12) return -1; // Sample rate index
+  int len = ((hdr[3] & 0x03) << 11) | (hdr[4] << 3) | (hdr[5] >> 5);
+  return (len >= 7) ? len : -1;
+}
+
+static const uint32_t adtsHz[12] PROGMEM = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000 };
+
+int AudioSyncADTSSampleRate(const unsigned char *hdr)
+{
+  int srIdx = (hdr[2] >> 2) & 0x0f;
+  if (srIdx >= 12) return -1; // Reserved
+  return pgm_read_dword(&adtsHz[srIdx]);
+}
+
+int AudioSyncADTSFrameSamples(const unsigned char *hdr)
+{
+  return 1024 * ((hdr[6] & 0x03) + 1);
+}
+
+// Next candidate at or after buf[from], -1 if none
+static int NextCandidate(const unsigned char *buf, int nBytes, unsigned char mask, int from)
+{
+  int off = AudioSyncFind(buf + from, nBytes - from, mask);
+  return (off < 0) ? -1 : from + off;
+}
+
+// What the bytes a frame length past a candidate say about it
+enum { NEXT_AGREES, NEXT_DISAGREES, NEXT_NOT_SYNC };
+
+static int Done(AudioSyncStats *stats, int found, int nBytes)
+{
+  if (stats) stats->bytesSkipped += (found < 0) ? nBytes : found;
+  return found;
+}
+
+static void FalseSync(AudioSyncStats *stats)
+{
+  if (stats) stats->falseSyncs++;
+}
+
+static int NextMP3(const unsigned char *hdr, const unsigned char *next)
+{
+  if ((next[0] != 0xff) || ((next[1] & 0xe0) != 0xe0)) return NEXT_NOT_SYNC;
+  // Same version, layer and sample rate expected in the following frame
+  return (((next[1] ^ hdr[1]) & 0x1e) || ((next[2] ^ hdr[2]) & 0x0c)) ? NEXT_DISAGREES : NEXT_AGREES;
+}
+
+static int NextADTS(const unsigned char *hdr, const unsigned char *next)
+{
+  if ((next[0] != 0xff) || ((next[1] & 0xf6) != 0xf0)) return NEXT_NOT_SYNC;
+  // Same sample rate expected in the following frame
+  return ((next[2] ^ hdr[2]) & 0x3c) ? NEXT_DISAGREES : NEXT_AGREES;
+}
+
+// A candidate whose header is valid but isn't followed by another sync word (the last frame before
+// an ID3v1 or APE tag, padding or junk) is only held back while a confirmed one might follow.  The
+// first of those is returned when nothing better turns up.
+int AudioSyncFindMP3(const unsigned char *buf, int nBytes, unsigned char mask, AudioSyncStats *stats)
+{
+  int i = 0, fallback = -1;
+  if (stats) stats->scans++;
+  while ((i = NextCandidate(buf, nBytes, mask, i)) >= 0) {
+    if (i + 4 > nBytes) break; // Can't tell yet
+    int len = AudioSyncMP3FrameBytes(buf + i);
+    if (len == 0) break; // Free format, nothing more to check
+    if (len > 0) {
+      if (i + len + 3 > nBytes) break; // Next header isn't here, take it on faith
+      int next = NextMP3(buf + i, buf + i + len);
+      if (next == NEXT_AGREES) {
+        if (fallback >= 0) FalseSync(stats); // Passed over for this one
+        return Done(stats, i, nBytes);
+      }
+      if (next == NEXT_DISAGREES) FalseSync(stats);
+      else if (fallback < 0) fallback = i;
+    } else {
+      FalseSync(stats);
+    }
+    i++;
+  }
+  return Done(stats, (fallback >= 0) ? fallback : i, nBytes);
+}
+
+int AudioSyncFindADTS(const unsigned char *buf, int nBytes, AudioSyncStats *stats)
+{
+  int i = 0, fallback = -1;
+  if (stats) stats->scans++;
+  while ((i = NextCandidate(buf, nBytes, 0xf0, i)) >= 0) {
+    if (i + 6 > nBytes) break; // Can't tell yet
+    int len = AudioSyncADTSFrameBytes(buf + i);
+    if (len > 0) {
+      if (i + len + 3 > nBytes) break; // Next header isn't here, take it on faith
+      int next = NextADTS(buf + i, buf + i + len);
+      if (next == NEXT_AGREES) {
+        if (fallback >= 0) FalseSync(stats); // Passed over for this one
+        return Done(stats, i, nBytes);
+      }
+      if (next == NEXT_DISAGREES) FalseSync(stats);
+      else if (fallback < 0) fallback = i;
+    } else {
+      FalseSync(stats);
+    }
+    i++;
+  }
+  return Done(stats, (fallback >= 0) ? fallback : i, nBytes);
+}
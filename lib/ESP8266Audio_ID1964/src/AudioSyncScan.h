@@ -0,0 +1,68 @@
+/*
+  AudioSyncScan
+  Shared frame sync scanner for the MP3 and AAC decoders
+
+  Copyright (C) 2017  Earle F. Philhower, III
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUDIOSYNCSCAN_H
+#define _AUDIOSYNCSCAN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Plain C so libmad, libhelix-mp3 and libhelix-aac can all use it.  Candidates are found
+// a word at a time (SSE2 on the host), then their header is sanity checked and, when the
+// frame length is known and the buffer holds it, a following header that disagrees rules
+// the candidate out.  One that isn't followed by a sync word at all is only used if no
+// confirmed candidate comes after it, so the last frame before a tag or padding still plays.
+
+// Kept by each decoder and passed in, NULL when nobody's counting
+typedef struct AudioSyncStats {
+  uint32_t scans;        // Sync searches made
+  uint32_t bytesSkipped; // Bytes stepped over looking for a sync word
+  uint32_t falseSyncs;   // Candidates rejected by header validation
+} AudioSyncStats;
+
+// Offset of the first 0xff byte whose successor has all bits of mask set, or -1
+int AudioSyncFind(const unsigned char *buf, int nBytes, unsigned char mask);
+
+// Validated searches, returning the offset of the frame or -1.  A candidate too close to
+// the end of the buffer to check is returned as-is for the caller to refill and retry.
+int AudioSyncFindMP3(const unsigned char *buf, int nBytes, unsigned char mask, AudioSyncStats *stats);
+int AudioSyncFindADTS(const unsigned char *buf, int nBytes, AudioSyncStats *stats);
+
+// Frame length from a 4 byte MPEG audio header (0 for free format) or a 6 byte ADTS one, -1 if invalid
+int AudioSyncMP3FrameBytes(const unsigned char *hdr);
+int AudioSyncADTSFrameBytes(const unsigned char *hdr);
+
+// Sample rate (-1 for a reserved one) and PCM samples per channel of the frame behind a valid
+// 4 byte MPEG audio header
+int AudioSyncMP3SampleRate(const unsigned char *hdr);
+int AudioSyncMP3FrameSamples(const unsigned char *hdr);
+// The same for a valid 7 byte ADTS header, counted before any SBR doubling
+int AudioSyncADTSSampleRate(const unsigned char *hdr);
+int AudioSyncADTSFrameSamples(const unsigned char *hdr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
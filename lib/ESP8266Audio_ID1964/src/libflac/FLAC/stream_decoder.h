@@ -750,6 +750,16 @@ FLAC_API FLAC__StreamDecoder *FLAC__stream_decoder_new(void);
  */
 FLAC_API void FLAC__stream_decoder_delete(FLAC__StreamDecoder *decoder);
 
+/** ESP8266 - Worst-case number of bytes a decoder allocates to play a stream
+ *  with at most \a max_blocksize samples per block, \a channels channels and a
+ *  SEEKTABLE of \a seek_points entries, when every allocation is rounded up to
+ *  8 bytes and costs \a overhead bytes of allocator bookkeeping.
+ *
+ * \retval size_t
+ *    Bytes required.
+ */
+FLAC_API size_t FLAC__stream_decoder_get_alloc_size(unsigned max_blocksize, unsigned channels, unsigned seek_points, unsigned overhead);
+
 
 /***********************************************************************
  *
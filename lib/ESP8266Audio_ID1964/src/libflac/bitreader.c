@@ -36,6 +36,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "share/alloc.h"
 #include "private/bitmath.h"
 #include "private/bitreader.h"
 #include "private/crc.h"
@@ -252,6 +253,12 @@ void FLAC__bitreader_delete(FLAC__BitReader *br)
 	free(br);
 }
 
+/* ESP8266 - bytes FLAC__bitreader_new() and FLAC__bitreader_init() allocate, see FLAC__stream_decoder_get_alloc_size() */
+size_t FLAC__bitreader_get_alloc_size(unsigned overhead)
+{
+	return ((sizeof(FLAC__BitReader) + 7) & ~7) + overhead + ((sizeof(brword) * FLAC__BITREADER_DEFAULT_CAPACITY + 7) & ~7) + overhead;
+}
+
 /***********************************************************************
  *
  * Public class methods
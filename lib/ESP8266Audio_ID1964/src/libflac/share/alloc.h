@@ -48,6 +48,25 @@
 #include <stdlib.h> /* for size_t, malloc(), etc */
 #include "compat.h"
 
+/* ESP8266 - All libflac heap traffic goes through these hooks, implemented in
+ * AudioGeneratorFLAC.cpp, so a decoder can run out of a caller-supplied arena.
+ * They fall back to the normal heap when no arena is active.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+void *FLAC__malloc(size_t size);
+void *FLAC__calloc(size_t nmemb, size_t size);
+void *FLAC__realloc(void *ptr, size_t size);
+void FLAC__free(void *ptr);
+#ifdef __cplusplus
+}
+#endif
+#define malloc(x)    FLAC__malloc(x)
+#define calloc(x, y) FLAC__calloc(x, y)
+#define realloc(x, y) FLAC__realloc(x, y)
+#define free(x)      FLAC__free(x)
+
 #ifndef SIZE_MAX
 # ifndef SIZE_T_MAX
 #  ifdef _MSC_VER
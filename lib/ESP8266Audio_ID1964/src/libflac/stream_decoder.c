@@ -330,6 +330,33 @@ FLAC_API void FLAC__stream_decoder_delete(FLAC__StreamDecoder *decoder)
 	free(decoder);
 }
 
+/* ESP8266 - Worst-case bytes a decoder allocates while playing a stream with the given
+ * limits, when every allocation is rounded up to 8 bytes and costs overhead bytes of
+ * bookkeeping.  Used to size a caller-supplied arena, see AudioGeneratorFLAC.
+ */
+FLAC_API size_t FLAC__stream_decoder_get_alloc_size(unsigned max_blocksize, unsigned channels, unsigned seek_points, unsigned overhead)
+{
+#define ALLOC_SIZE(x) ((((x) + 7) & ~7) + overhead)
+	size_t sz = 0;
+	unsigned order;
+
+	sz += ALLOC_SIZE(sizeof(FLAC__StreamDecoder));
+	sz += ALLOC_SIZE(sizeof(FLAC__StreamDecoderProtected));
+	sz += ALLOC_SIZE(sizeof(FLAC__StreamDecoderPrivate));
+	sz += ALLOC_SIZE((FLAC__STREAM_METADATA_APPLICATION_ID_LEN/8) * 16);
+	sz += FLAC__bitreader_get_alloc_size(overhead);
+	if(seek_points)
+		sz += ALLOC_SIZE(seek_points * sizeof(FLAC__StreamMetadata_SeekPoint));
+	/* output has 4 guard samples in front, residual is 32-byte aligned */
+	sz += channels * ALLOC_SIZE(sizeof(FLAC__int32) * (max_blocksize + 4));
+	sz += channels * ALLOC_SIZE(sizeof(FLAC__int32) * max_blocksize + 31);
+	/* rice parameters and raw bits are realloc()d up from order 6 as needed, older copies are not reclaimed */
+	for(order = 6; order <= FLAC__SUBSET_MAX_RICE_PARTITION_ORDER; order++)
+		sz += channels * 2 * ALLOC_SIZE(sizeof(unsigned) << order);
+#undef ALLOC_SIZE
+	return sz;
+}
+
 /***********************************************************************
  *
  * Public class methods
@@ -158,6 +158,7 @@ typedef struct _AACDecInfo {
 /* decoder functions which must be implemented for each platform */
 AACDecInfo *AllocateBuffers(void);
 AACDecInfo *AllocateBuffersPre(void **space, int *len);
+int AllocateBuffersPreSize(void);
 void FreeBuffers(AACDecInfo *aacDecInfo);
 void ClearBuffer(void *buf, int nBytes);
 
@@ -181,6 +182,7 @@ int IMDCT(AACDecInfo *aacDecInfo, int ch, int chBase, short *outbuf);
 /* SBR specific functions */
 int InitSBR(AACDecInfo *aacDecInfo);
 int InitSBRPre(AACDecInfo *aacDecInfo, void **ptr, int *sz);
+int InitSBRPreSize(void);
 void FreeSBR(AACDecInfo *aacDecInfo);
 int DecodeSBRBitstream(AACDecInfo *aacDecInfo, int chBase);
 int DecodeSBRData(AACDecInfo *aacDecInfo, int chBase, short *outbuf);
@@ -44,6 +44,7 @@
  **************************************************************************************/
 
 #include "aaccommon.h"
+#include "../AudioSyncScan.h"
 
 //#include "profile.h"
 
@@ -98,6 +99,16 @@ HAACDecoder AACInitDecoderPre(void *ptr, int sz)
         return (HAACDecoder)aacDecInfo;
 }
 
+/* bytes of preallocated space AACInitDecoderPre() will carve up */
+int AACInitDecoderPreSize(void)
+{
+        int sz = AllocateBuffersPreSize();
+#ifdef AAC_ENABLE_SBR
+        sz += InitSBRPreSize();
+#endif
+        return sz;
+}
+
 /**************************************************************************************
  * Function:    AACFreeDecoder
  *
@@ -135,18 +146,14 @@ void AACFreeDecoder(HAACDecoder hAACDecoder)
  *
  * Return:      offset to first sync word (bytes from start of buf)
  *              -1 if sync not found after searching nBytes
+ *
+ * Notes:       ESP8266 - uses the shared word-at-a-time scanner, which also rejects
+ *                candidates whose ADTS header is invalid or isn't followed by a matching one
  **************************************************************************************/
 int AACFindSyncWord(unsigned char *buf, int nBytes)
 {
-	int i;
-
 	/* find byte-aligned syncword (12 bits = 0xFFF) */
-	for (i = 0; i < nBytes - 1; i++) {
-		if ( (buf[i+0] & SYNCWORDH) == SYNCWORDH && (buf[i+1] & SYNCWORDL) == SYNCWORDL )
-			return i;
-	}
-	
-	return -1;
+	return AudioSyncFindADTS(buf, nBytes, 0);
 }
 
 /**************************************************************************************
@@ -60,7 +60,7 @@
 #
 #elif defined(__GNUC__) && defined(__i386__)
 #
-#elif defined(__GNUC__) && defined(__amd64__)
+#elif defined(__GNUC__) && (defined(__amd64__) || defined(__aarch64__))
 #
 #elif defined(__GNUC__) && (defined(__powerpc__) || defined(__POWERPC__))
 #
@@ -153,6 +153,7 @@ typedef void *HAACDecoder;
 /* public C API */
 HAACDecoder AACInitDecoder(void);
 HAACDecoder AACInitDecoderPre(void *ptr, int sz);
+int AACInitDecoderPreSize(void);
 void AACFreeDecoder(HAACDecoder hAACDecoder);
 int AACDecode(HAACDecoder hAACDecoder, unsigned char **inbuf, int *bytesLeft, short *outbuf);
 
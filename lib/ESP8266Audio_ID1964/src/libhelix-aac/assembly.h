@@ -426,6 +426,60 @@ static inline Word64 MADD64(Word64 sum64, int x, int y)
 	return u.w64;
 }
 
+/* toolchain:           gcc or clang
+ * target architecture: x86-64 or AArch64 hosts (tests/host and other desktop tools)
+ *
+ * Bit-exact with the portable C versions (tests/host fixedpoint checks it):  the
+ * 64-bit products are one instruction on these hosts, and CLZ is the compiler's
+ * builtin instead of a binary search.
+ */
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__)) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+
+typedef long long Word64;
+
+static __inline int MULSHIFT32(int x, int y)
+{
+	return (int)(((Word64)x * y) >> 32);
+}
+
+static __inline short CLIPTOSHORT(int x)
+{
+	int sign;
+
+	/* clip to [-32768, 32767] */
+	sign = x >> 31;
+	if (sign != (x >> 15))
+		x = sign ^ ((1 << 15) - 1);
+
+	return (short)x;
+}
+
+static __inline int FASTABS(int x)
+{
+	int sign = x >> 31;
+
+	return (x ^ sign) - sign;
+}
+
+static __inline int CLZ(int x)
+{
+	return x ? __builtin_clz((unsigned int)x) : 32;
+}
+
+typedef union _U64 {
+	Word64 w64;
+	struct {
+		/* both little endian */
+		unsigned int lo32;
+		signed int   hi32;
+	} r;
+} U64;
+
+static __inline Word64 MADD64(Word64 sum64, int x, int y)
+{
+	return sum64 + (Word64)x * y;
+}
+
 /* toolchain:           x86 gcc
  * target architecture: x86
  */
@@ -138,6 +138,11 @@ AACDecInfo *AllocateBuffersPre(void **ptr, int *sz)
         return aacDecInfo;
 }
 
+int AllocateBuffersPreSize(void)
+{
+        return ((sizeof(AACDecInfo) + 7) & ~7) + ((sizeof(PSInfoBase) + 7) & ~7);
+}
+
 #ifndef SAFE_FREE
 #define SAFE_FREE(x)	{if (x)	free(x);	(x) = 0;}	/* helper macro */
 #endif
@@ -135,6 +135,11 @@ int InitSBRPre(AACDecInfo *aacDecInfo, void **ptr, int *sz)
         return ERR_AAC_NONE;
 }
 
+int InitSBRPreSize(void)
+{
+        return sizeof(PSInfoSBR);
+}
+
 
 
 /**************************************************************************************
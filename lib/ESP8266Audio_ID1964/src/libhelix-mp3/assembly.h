@@ -316,6 +316,42 @@ static __inline Word64 xSAR64(Word64 x, int n)
 }
 //mw
 
+/* toolchain:           gcc or clang
+ * target architecture: x86-64 or AArch64 hosts (tests/host and other desktop tools)
+ *
+ * Bit-exact with the portable C under ARDUINO below, which is what the ESP8266 and
+ * ESP32 run (tests/host fixedpoint checks it):  the 64-bit products are one instruction
+ * on these hosts, and CLZ is the compiler's builtin instead of a loop.
+ */
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+
+static __inline int FASTABS(int x)
+{
+	int sign = x >> 31;
+
+	return (x ^ sign) - sign;
+}
+
+static __inline int CLZ(int x)
+{
+	return x ? __builtin_clz((unsigned int)x) : 32;
+}
+
+static __inline Word64 MADD64(Word64 sum64, int x, int y)
+{
+	return sum64 + (Word64)x * (Word64)y;
+}
+
+static __inline int MULSHIFT32(int x, int y)
+{
+	return (int)(((long long)x * y) >> 32);
+}
+
+static __inline Word64 SAR64(Word64 x, int n)
+{
+	return x >> n;
+}
+
 #elif defined(ARDUINO)
 
 static __inline int FASTABS(int x)
@@ -145,6 +145,48 @@ MP3DecInfo *AllocateBuffers(void)
 	return mp3DecInfo;
 }
 
+MP3DecInfo *AllocateBuffersPre(void **ptr, int *sz)
+{
+	MP3DecInfo *mp3DecInfo;
+	char *p = (char*)*ptr;
+
+	if (*sz < AllocateBuffersPreSize())
+		return 0;
+
+	mp3DecInfo = (MP3DecInfo *)p;
+	p += (sizeof(MP3DecInfo) + 7) & ~7;
+	ClearBuffer(mp3DecInfo, sizeof(MP3DecInfo));
+
+	mp3DecInfo->FrameHeaderPS =     (void *)p; p += (sizeof(FrameHeader) + 7) & ~7;
+	mp3DecInfo->SideInfoPS =        (void *)p; p += (sizeof(SideInfo) + 7) & ~7;
+	mp3DecInfo->ScaleFactorInfoPS = (void *)p; p += (sizeof(ScaleFactorInfo) + 7) & ~7;
+	mp3DecInfo->HuffmanInfoPS =     (void *)p; p += (sizeof(HuffmanInfo) + 7) & ~7;
+	mp3DecInfo->DequantInfoPS =     (void *)p; p += (sizeof(DequantInfo) + 7) & ~7;
+	mp3DecInfo->IMDCTInfoPS =       (void *)p; p += (sizeof(IMDCTInfo) + 7) & ~7;
+	mp3DecInfo->SubbandInfoPS =     (void *)p; p += (sizeof(SubbandInfo) + 7) & ~7;
+
+	/* important to do this - DSP primitives assume a bunch of state variables are 0 on first use */
+	ClearBuffer(mp3DecInfo->FrameHeaderPS,     sizeof(FrameHeader));
+	ClearBuffer(mp3DecInfo->SideInfoPS,        sizeof(SideInfo));
+	ClearBuffer(mp3DecInfo->ScaleFactorInfoPS, sizeof(ScaleFactorInfo));
+	ClearBuffer(mp3DecInfo->HuffmanInfoPS,     sizeof(HuffmanInfo));
+	ClearBuffer(mp3DecInfo->DequantInfoPS,     sizeof(DequantInfo));
+	ClearBuffer(mp3DecInfo->IMDCTInfoPS,       sizeof(IMDCTInfo));
+	ClearBuffer(mp3DecInfo->SubbandInfoPS,     sizeof(SubbandInfo));
+
+	*sz -= p - (char*)*ptr;
+	*ptr = p;
+
+	return mp3DecInfo;
+}
+
+int AllocateBuffersPreSize(void)
+{
+	return ((sizeof(MP3DecInfo) + 7) & ~7) + ((sizeof(FrameHeader) + 7) & ~7) + ((sizeof(SideInfo) + 7) & ~7) +
+	       ((sizeof(ScaleFactorInfo) + 7) & ~7) + ((sizeof(HuffmanInfo) + 7) & ~7) + ((sizeof(DequantInfo) + 7) & ~7) +
+	       ((sizeof(IMDCTInfo) + 7) & ~7) + ((sizeof(SubbandInfo) + 7) & ~7);
+}
+
 #define SAFE_FREE(x)	{if (x)	free(x);	(x) = 0;}	/* helper macro */
 
 /**************************************************************************************
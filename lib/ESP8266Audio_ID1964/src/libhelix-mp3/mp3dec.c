@@ -44,6 +44,7 @@
 #include "string.h"
 //#include "hlxclib/string.h"		/* for memmove, memcpy (can replace with different implementations if desired) */
 #include "mp3common.h"	/* includes mp3dec.h (public API) and internal, platform-independent API */
+#include "../AudioSyncScan.h"
 
 
 //#define PROFILE
@@ -72,6 +73,21 @@ HMP3Decoder MP3InitDecoder(void)
 	return (HMP3Decoder)mp3DecInfo;
 }
 
+HMP3Decoder MP3InitDecoderPre(void *ptr, int sz)
+{
+	MP3DecInfo *mp3DecInfo;
+
+	mp3DecInfo = AllocateBuffersPre(&ptr, &sz);
+
+	return (HMP3Decoder)mp3DecInfo;
+}
+
+/* bytes of preallocated space MP3InitDecoderPre() will carve up */
+int MP3InitDecoderPreSize(void)
+{
+	return AllocateBuffersPreSize();
+}
+
 /**************************************************************************************
  * Function:    MP3FreeDecoder
  *
@@ -106,18 +122,14 @@ void MP3FreeDecoder(HMP3Decoder hMP3Decoder)
  *
  * Return:      offset to first sync word (bytes from start of buf)
  *              -1 if sync not found after searching nBytes
+ *
+ * Notes:       ESP8266 - uses the shared word-at-a-time scanner, which also rejects
+ *                candidates whose header is invalid or isn't followed by a matching one
  **************************************************************************************/
 int MP3FindSyncWord(unsigned char *buf, int nBytes)
 {
-	int i;
-
 	/* find byte-aligned syncword - need 12 (MPEG 1,2) or 11 (MPEG 2.5) matching bits */
-	for (i = 0; i < nBytes - 1; i++) {
-		if ( (buf[i+0] & SYNCWORDH) == SYNCWORDH && (buf[i+1] & SYNCWORDL) == SYNCWORDL )
-			return i;
-	}
-	
-	return -1;
+	return AudioSyncFindMP3(buf, nBytes, SYNCWORDL, 0);
 }
 
 /**************************************************************************************
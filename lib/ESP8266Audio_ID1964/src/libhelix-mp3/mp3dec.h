@@ -59,6 +59,8 @@
 #
 #elif defined(__GNUC__) && defined(__i386__)
 #
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+#
 #elif defined(_OPENWAVE_SIMULATOR) || defined(_OPENWAVE_ARMULATOR)
 #
 #elif defined (ARDUINO)
@@ -122,6 +124,8 @@ typedef struct _MP3FrameInfo {
 
 /* public API */
 HMP3Decoder MP3InitDecoder(void);
+HMP3Decoder MP3InitDecoderPre(void *ptr, int sz);
+int MP3InitDecoderPreSize(void);
 void MP3FreeDecoder(HMP3Decoder hMP3Decoder);
 int MP3Decode(HMP3Decoder hMP3Decoder, unsigned char **inbuf, int *bytesLeft, short *outbuf, int useSize);
 
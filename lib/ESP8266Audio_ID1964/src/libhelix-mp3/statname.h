@@ -65,6 +65,8 @@
 #define	UnpackFrameHeader	STATNAME(UnpackFrameHeader)
 #define	UnpackSideInfo		STATNAME(UnpackSideInfo)
 #define	AllocateBuffers		STATNAME(AllocateBuffers)
+#define	AllocateBuffersPre	STATNAME(AllocateBuffersPre)
+#define	AllocateBuffersPreSize	STATNAME(AllocateBuffersPreSize)
 #define	FreeBuffers			STATNAME(FreeBuffers)
 #define	DecodeHuffman		STATNAME(DecodeHuffman)
 #define	Dequantize			STATNAME(Dequantize)
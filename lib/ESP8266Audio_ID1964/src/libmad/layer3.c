@@ -2452,7 +2452,8 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
   for (gr = 0; gr < ngr; ++gr) {
     struct granule *granule = &si->gr[gr];
     unsigned int const *sfbwidth[2];
-    unsigned int ch;
+    unsigned int ch, first, last;
+    int fold;
     enum mad_error error;
 
     for (ch = 0; ch < nch; ++ch) {
@@ -2493,11 +2494,49 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
       }
     }
 
+    /* single channel options:  just the left or right channel, or the mix
+       of both, goes through the rest and ends up in channel 0's subband
+       samples (see synth.c).  The mix is taken here when both channels'
+       blocks line up, as it then costs one channel's IMDCT; otherwise both
+       are decoded and mixed after, with overlap[0] always holding the mix. */
+
+    first = 0;
+    last  = nch;
+    fold  = 0;
+
+    if (nch == 2 && (frame->options & MAD_OPTION_SINGLECHANNEL)) {
+      switch (frame->options & MAD_OPTION_SINGLECHANNEL) {
+      case MAD_OPTION_LEFTCHANNEL:
+        last = 1;
+        break;
+
+      case MAD_OPTION_RIGHTCHANNEL:
+        first = 1;
+        break;
+
+      default:
+        if (granule->ch[0].block_type == granule->ch[1].block_type &&
+            (granule->ch[0].flags & mixed_block_flag) ==
+            (granule->ch[1].flags & mixed_block_flag)) {
+          unsigned int i;
+
+          for (i = 0; i < 576; ++i)
+            xr[0][i] = (xr[0][i] >> 1) + (xr[1][i] >> 1);
+
+          last = 1;
+        }
+        else {
+          memcpy(frame->overlap[1], frame->overlap[0], sizeof(frame->overlap[0]));
+          fold = 1;
+        }
+      }
+    }
+
     /* reordering, alias reduction, IMDCT, overlap-add, frequency inversion */
 
-    for (ch = 0; ch < nch; ++ch) {
+    for (ch = first; ch < last; ++ch) {
       struct channel const *channel = &granule->ch[ch];
-      mad_fixed_t (*sample)[32] = &frame->sbsample[ch][18 * gr];
+      mad_fixed_t (*sample)[32] = &frame->sbsample[ch - first][18 * gr];
       unsigned int sb, l, i, sblimit;
       mad_fixed_t output[36];
 
@@ -2588,6 +2627,22 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
           III_freqinver(sample, sb);
       }
     }
+
+    if (fold) {
+      unsigned int s, sb;
+
+      for (s = 18 * gr; s < 18 * gr + 18; ++s) {
+        for (sb = 0; sb < 32; ++sb)
+          frame->sbsample[0][s][sb] = (frame->sbsample[0][s][sb] >> 1) +
+                                      (frame->sbsample[1][s][sb] >> 1);
+      }
+
+      for (sb = 0; sb < 32; ++sb) {
+        for (s = 0; s < 18; ++s)
+          frame->overlap[0][sb][s] = (frame->overlap[0][sb][s] >> 1) +
+                                     (frame->overlap[1][sb][s] >> 1);
+      }
+    }
   }
 
 //  free(xr_raw);
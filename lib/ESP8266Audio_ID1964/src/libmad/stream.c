@@ -30,6 +30,7 @@
 
 # include "bit.h"
 # include "stream.h"
+# include "../AudioSyncScan.h"
 
 /*
  * NAME:	stream->init()
@@ -56,6 +57,8 @@ stack(__FUNCTION__, __FILE__, __LINE__);
 
   stream->options    = 0;
   stream->error      = MAD_ERROR_NONE;
+
+  stream->syncStats  = 0;
 }
 
 /*
@@ -107,14 +110,17 @@ stack(__FUNCTION__, __FILE__, __LINE__);
 int mad_stream_sync(struct mad_stream *stream)
 {
   register unsigned char const *ptr, *end;
+  int off;
 stack(__FUNCTION__, __FILE__, __LINE__);
 
   ptr = mad_bit_nextbyte(&stream->ptr);
   end = stream->bufend;
 
-  while (ptr < end - 1 &&
-	 !(ptr[0] == 0xff && (ptr[1] & 0xe0) == 0xe0))
-    ++ptr;
+  /* ESP8266 - shared scanner, skips candidates with bad or unconfirmed headers too */
+  off = AudioSyncFindMP3(ptr, end - ptr, 0xe0, stream->syncStats);
+  if (off < 0)
+    return -1;
+  ptr += off;
 
   if (end - ptr < MAD_BUFFER_GUARD)
     return -1;
@@ -541,8 +541,14 @@ void dct32(mad_fixed_t const in[32], unsigned int slot,
 #  if MAD_F_FRACBITS != 28
 #   error "MAD_F_FRACBITS must be 28 to use OPT_SSO"
 #  endif
-#  define ML0(hi, lo, x, y)	((lo)  = (x) * (y))
-#  define MLA(hi, lo, x, y)	((lo) += (x) * (y))
+#  if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+/* 64-bit hosts: the low 32 bits, as on the targets, without int overflow */
+#   define ML0(hi, lo, x, y)	((lo)  = (mad_fixed64lo_t) (x) * (y))
+#   define MLA(hi, lo, x, y)	((lo) += (mad_fixed64lo_t) (x) * (y))
+#  else
+#   define ML0(hi, lo, x, y)	((lo)  = (x) * (y))
+#   define MLA(hi, lo, x, y)	((lo) += (x) * (y))
+#  endif
 #  define MLN(hi, lo)		((lo)  = -(lo))
 #  define MLZ(hi, lo)		((void) (hi), (mad_fixed_t) (lo))
 #  define SHIFT(x)		((x) >> 2)
@@ -879,6 +885,12 @@ enum mad_flow mad_synth_frame(struct mad_synth *synth, struct mad_frame const *f
   nch = MAD_NCHANNELS(&frame->header);
   ns  = MAD_NSBSAMPLES(&frame->header);
 
+  /* the single channel options leave just channel 0, but only Layer III
+     does the folding (see layer3.c); Layer I/II stay stereo */
+  if ((frame->options & MAD_OPTION_SINGLECHANNEL) &&
+      frame->header.layer == MAD_LAYER_III)
+    nch = 1;
+
   synth->pcm.samplerate = frame->header.samplerate;
   synth->pcm.channels   = nch;
   synth->pcm.length     = 32;// * ns;
@@ -909,6 +921,10 @@ enum mad_flow mad_synth_frame_onens(struct mad_synth *synth, struct mad_frame co
   nch = MAD_NCHANNELS(&frame->header);
 //  ns  = MAD_NSBSAMPLES(&frame->header);
 
+  if ((frame->options & MAD_OPTION_SINGLECHANNEL) &&
+      frame->header.layer == MAD_LAYER_III)
+    nch = 1;
+
   synth->pcm.samplerate = frame->header.samplerate;
   synth->pcm.channels   = nch;
   synth->pcm.length     = 32;// * ns;
@@ -102,6 +102,21 @@ struct tsf_stream
 // Generic SoundFont loading method using the stream structure above
 TSFDEF tsf* tsf_load(struct tsf_stream* stream);
 
+// Loads only the SoundFont's directory, with room for maxPresets presets that are then read in
+// by tsf_preload().  Notes on any other preset are ignored.  For players that know beforehand
+// which instruments they need, and don't want to hold a table of every preset in the font.
+TSFDEF tsf* tsf_load_sparse(struct tsf_stream* stream, int maxPresets);
+
+// Reads in a preset's regions now rather than at its first note.  Returns the number of regions,
+// or -1 if there is no such preset or a sparse tsf has no room left for it.
+TSFDEF int tsf_preload(tsf* f, int preset);
+
+// Returns the preset index for a bank and preset number, or -1 if the SoundFont has no such preset
+TSFDEF int tsf_get_presetindex(tsf* f, int bank, int preset_number);
+
+// Bytes held for the preset table and the regions of the presets loaded so far
+TSFDEF int tsf_get_preset_memory(tsf* f);
+
 // Free the memory related to this tsf instance
 TSFDEF void tsf_close(tsf* f);
 
@@ -140,18 +155,63 @@ TSFDEF void tsf_set_output(tsf* f, enum TSFOutputMode outputmode, int samplerate
 //   vel: velocity as a float between 0.0 (equal to note off) and 1.0 (full)
 TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel);
 
+// tsf_note_on() for a note of the given priority, which TSF_STEAL_LOWEST_PRIORITY takes voices from
+// last.  tsf_note_on() plays notes at priority 0.
+TSFDEF void tsf_note_on_priority(tsf* f, int preset, int key, float vel, int priority);
+
 // Stop playing a note
 TSFDEF void tsf_note_off(tsf* f, int preset, int key);
 
+// Stop playing all notes
+TSFDEF void tsf_note_off_all(tsf* f);
+
 // Render output samples into a buffer
 // You can either render as signed 16-bit values (tsf_render_short) or
 // as 32-bit float values (tsf_render_float)
 //   buffer: target buffer of size samples * output_channels * sizeof(type)
 //   samples: number of samples to render
 //   flag_mixing: if 0 clear the buffer first, otherwise mix into existing data
+// tsf_render_short (tsf_render_short_fast is the same) does all its work in integers, for CPUs without
+// an FPU, with the same result everywhere.  It leaves out the lowpass filter that tsf_render_float runs.
 TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0);
+TSFDEF void tsf_render_short_fast(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 
+// Sample cache activity since tsf_load()
+struct tsf_cache_stats
+{
+	// Voices moving onto another page of samples that was already cached, or wasn't.
+	// Everything else is read straight through the voice's cursor without a lookup.
+	unsigned int hits, misses;
+	// Pages read from the SoundFont ahead of a voice playing forwards
+	unsigned int readAheads;
+};
+TSFDEF void tsf_get_cache_stats(tsf* f, struct tsf_cache_stats* stats);
+
+// How a note picks the voice to take over once tsf_set_max_voices()' cap is reached
+enum TSFStealPolicy
+{
+	TSF_STEAL_QUIETEST,        // The one sounding quietest right now
+	TSF_STEAL_OLDEST_RELEASED, // The oldest already let go of, or failing that the oldest
+	TSF_STEAL_LOWEST_PRIORITY  // The lowest priority (see tsf_note_on_priority()), released then oldest first
+};
+
+// Cap the voices sounding at once, 0 (the default) for no cap.  A note that needs a voice past the cap takes
+// one over, which fades out in TSF_FASTRELEASETIME rather than cutting off, so for a moment there can be a few
+// more voices than the cap rendering.  Lowering the cap below the voices playing fades the extra ones out.
+TSFDEF void tsf_set_max_voices(tsf* f, int maxVoices, enum TSFStealPolicy policy);
+
+// Voices sounding, not counting those fading out after being taken over
+TSFDEF int tsf_active_voice_count(tsf* f);
+
+// Voice use since tsf_load()
+struct tsf_voice_stats
+{
+	unsigned int stolen; // Voices taken over by a note or faded out as the cap came down
+	int peak;            // Most voices sounding at once
+};
+TSFDEF void tsf_get_voice_stats(tsf* f, struct tsf_voice_stats* stats);
+
 #ifdef __cplusplus
 #  undef CPP_DEFAULT0
 }
@@ -170,6 +230,11 @@ TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing
 #define TSF_RENDER_EFFECTSAMPLEBLOCK 64
 #endif
 
+// Samples tsf_render_short() mixes at a time, 4 bytes for each per channel
+#ifndef TSF_MIXSAMPLES
+#define TSF_MIXSAMPLES 256
+#endif
+
 // Grace release time for quick voice off (avoid clicking noise)
 #define TSF_FASTRELEASETIME 0.01f
 #if !defined(TSF_MALLOC) || !defined(TSF_FREE) || !defined(TSF_REALLOC)
@@ -224,35 +289,51 @@ typedef char tsf_char20[20];
 
 #define TSF_FourCCEquals(value1, value2) (value1[0] == value2[0] && value1[1] == value2[1] && value1[2] == value2[2] && value1[3] == value2[3])
 
-// Samples cache, number and sample count
+// Samples cache, number of pages and samples in each.  Pages are found by page number through a
+// small hash table, and each voice keeps a cursor on the page it's playing from.
+#ifndef TSF_BUFFS
 #define TSF_BUFFS 16
+#endif
+#ifndef TSF_BUFFSIZE
 #define TSF_BUFFSIZE 512
+#endif
+#define TSF_HASHSIZE (2 * TSF_BUFFS)
+#define TSF_NOPAGE 0x80000000u // Start of no page, so any sample position is out of range of it
 
 struct tsf
 {
 	struct tsf_preset* presets;
-	int presetNum;
+	int presetNum;                  // Presets in the font, indexed in the order of their headers
+	short* presetMap;               // Sparse tables only:  the preset index held in each slot, -1 if free
+	int presetSlots;                // Entries in presets[], presetNum unless sparse
 
 	int fontSamplesOffset;
 	int fontSampleCount;
 
 	struct tsf_voice *voices;
 	int voiceNum;
+	int maxVoices;                  // Cap on the voices sounding, 0 for none, see tsf_set_max_voices()
+	enum TSFStealPolicy stealPolicy;
+	unsigned int voicePlayIndex;    // Counts note ons, so voices can tell which started first
+	struct tsf_voice_stats voiceStats;
 
 	float outSampleRate;
 	enum TSFOutputMode outputmode;
 	float globalGainDB;
 
-	float* outputSamples;
-	int outputSampleSize;
-
 	struct tsf_hydra *hydra;
 
-	// Cached sample read 
+	// tsf_render_short()'s 32 bit mix, allocated for the output mode at the first render after tsf_set_output()
+	int32_t *mix;
+
+	// Cached sample pages
 	short *buffer[TSF_BUFFS];
-	int offset[TSF_BUFFS];
-	int timestamp[TSF_BUFFS];
-	int epoch;
+	unsigned int page[TSF_BUFFS];   // Page number held in each slot, TSF_NOPAGE when empty
+	short hashNext[TSF_BUFFS];      // Next slot in the same hash chain, -1 at the end
+	short hashHead[TSF_HASHSIZE];   // First slot of each hash chain, -1 if none
+	char referenced[TSF_BUFFS];     // Looked up since the eviction hand last went past
+	int hand;
+	struct tsf_cache_stats stats;
 };
 
 struct tsf_stream_cached_data {
@@ -346,12 +427,12 @@ static int tsf_stream_cached_seek(void* v, unsigned int pos)
 static int tsf_stream_cached_close(void* v)
 {
 	struct tsf_stream_cached_data *d = (struct tsf_stream_cached_data*)v;
-	free(d->timestamp);
-	free(d->offset);
-	for (int i = d->buffs - 1; i >=0; i--) free(d->buffer[i]);
-	free(d->buffer);
+	TSF_FREE(d->timestamp);
+	TSF_FREE(d->offset);
+	for (int i = d->buffs - 1; i >=0; i--) TSF_FREE(d->buffer[i]);
+	TSF_FREE(d->buffer);
 	int ret = d->stream->close(d->stream->data);
-	free(d);
+	TSF_FREE(d);
 	return ret;
 }
 
@@ -497,14 +578,16 @@ typedef int32_t fixed30p2;
 typedef int32_t fixed24p8;
 typedef int32_t fixed16p16;
 typedef int32_t fixed8p24;
+typedef int32_t fixed2p30;
 
 
 
 struct tsf_riffchunk { tsf_fourcc id; tsf_u32 size; };
 struct tsf_envelope { float delay, start, attack, hold, decay, sustain, release, keynumToHold, keynumToDecay; };
-struct tsf_voice_envelope { float level, slope; int samplesUntilNextSegment; int segment; struct tsf_envelope parameters; TSF_BOOL segmentIsExponential, exponentialDecay; };
+// The fixed point level is what tsf_render_short() plays, with the step added to it or the factor it's multiplied by each sample
+struct tsf_voice_envelope { float level, slope; int samplesUntilNextSegment; int segment; struct tsf_envelope parameters; TSF_BOOL segmentIsExponential, exponentialDecay; fixed8p24 levelF8P24, stepF8P24; fixed2p30 factorF2P30, blockFactorF2P30; };
 struct tsf_voice_lowpass { double QInv, a0, a1, b1, b2, z1, z2; TSF_BOOL active; };
-struct tsf_voice_lfo { int samplesUntil; float level, delta; };
+struct tsf_voice_lfo { int samplesUntil; float level, delta; fixed8p24 levelF8P24, deltaF8P24; };
 
 struct tsf_region
 {
@@ -539,7 +622,17 @@ struct tsf_voice
 	double sourceSamplePosition;
   fixed32p32 sourceSamplePositionF32P32;
 	float  noteGainDB, panFactorLeft, panFactorRight;
+	// Worked out at note on for tsf_render_short(), which has no floating point in it
+	fixed16p16 pitchRatioF16P16, noteGainF16P16, panLeftF16P16, panRightF16P16;
 	unsigned int sampleEnd, loopStart, loopEnd;
+	// The note on that started it and that note's priority, and whether it's fading out after being taken over
+	unsigned int playIndex;
+	int priority;
+	TSF_BOOL stolen;
+	// Cursor on the cached page being played from, see tsf_voice_sample()
+	const short* pageData;
+	unsigned int pageStart;
+	int pageSlot;
 	struct tsf_voice_envelope ampenv, modenv;
 	struct tsf_voice_lowpass lowpass;
 	struct tsf_voice_lfo modlfo, viblfo;
@@ -671,28 +764,27 @@ static void tsf_region_envtosecs(struct tsf_envelope* p, TSF_BOOL sustainIsGain)
 	else p->sustain = p->sustain / 10.0f;
 }
 
-static void tsf_load_preset(tsf* res, struct tsf_hydra *hydra, int presetToLoad)
+// The slot holding a preset, TSF_NULL if it has none (sparse tables only hold what was preloaded)
+static struct tsf_preset* tsf_preset_slot(tsf* f, int preset)
+{
+	int i;
+	if (preset < 0 || preset >= f->presetNum) return TSF_NULL;
+	if (!f->presetMap) return &f->presets[preset];
+	for (i = 0; i < f->presetSlots; i++) if (f->presetMap[i] == preset) return &f->presets[i];
+	return TSF_NULL;
+}
+
+static void tsf_load_preset(struct tsf_hydra *hydra, int presetToLoad, struct tsf_preset* preset)
 {
 	enum { GenInstrument = 41, GenSampleID = 53 };
-	// Read each preset.
+	// Read the preset.  Presets keep the index of their header, so they're found without reading
+	// the others to work out where they'd fall in bank and preset number order.
 	struct tsf_hydra_phdr phdr;
 	int phdrIdx, phdrMaxIdx;
 	for (phdrIdx = presetToLoad, get_phdr(hydra, phdrIdx, &phdr), phdrMaxIdx = presetToLoad + 1 /*hydra->phdrNum - 1*/; phdrIdx != phdrMaxIdx; phdrIdx++, get_phdr(hydra, phdrIdx, &phdr))
 	{
-		int sortedIndex = 0, region_index = 0;
-		struct tsf_hydra_phdr otherPhdr;
-		int otherPhdrIdx;
-		struct tsf_preset* preset;
-		for (otherPhdrIdx = 0, get_phdr(hydra, otherPhdrIdx, &otherPhdr); otherPhdrIdx != phdrMaxIdx; otherPhdrIdx++, get_phdr(hydra, otherPhdrIdx, &otherPhdr))
-		{
-			if (otherPhdrIdx == phdrIdx || otherPhdr.bank > phdr.bank) continue;
-			else if (otherPhdr.bank < phdr.bank) sortedIndex++;
-			else if (otherPhdr.preset > phdr.preset) continue;
-			else if (otherPhdr.preset < phdr.preset) sortedIndex++;
-			else if (otherPhdrIdx < phdrIdx) sortedIndex++;
-		}
+		int region_index = 0;
 
-		preset = &res->presets[sortedIndex];
 		TSF_MEMCPY(preset->presetName, phdr.presetName, sizeof(preset->presetName));
 		preset->presetName[sizeof(preset->presetName)-1] = '\0'; //should be zero terminated in source file but make sure
 		preset->bank = phdr.bank;
@@ -884,7 +976,7 @@ static void tsf_load_samples(int *fontSamplesOffset, int* fontSampleCount, struc
 	stream->skip(stream->data, samplesLeft * sizeof(short));
 }
 
-static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, int active_segment, float outSampleRate)
+static void tsf_voice_envelope_segment(struct tsf_voice_envelope* e, int active_segment, float outSampleRate)
 {
 	switch (active_segment)
 	{
@@ -979,6 +1071,41 @@ static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, int act
 	}
 }
 
+// x to the nth power, by squaring
+static fixed2p30 tsf_fixed_pow(fixed2p30 x, int n)
+{
+	int64_t r = 1 << 30, b = x;
+	for (; n; n >>= 1)
+	{
+		if (n & 1) r = (r * b) >> 30;
+		b = (b * b) >> 30;
+	}
+	return (fixed2p30)r;
+}
+
+static void tsf_voice_envelope_nextsegment(struct tsf_voice_envelope* e, int active_segment, float outSampleRate)
+{
+	tsf_voice_envelope_segment(e, active_segment, outSampleRate);
+
+	// Release carries on from wherever the level got to, every other segment starts from a set level.
+	// Linear segments step to the level the next one starts at.
+	if (e->segment != TSF_SEGMENT_RELEASE) e->levelF8P24 = (fixed8p24)(e->level * (1 << 24));
+	e->stepF8P24 = 0;
+	e->factorF2P30 = e->blockFactorF2P30 = 1 << 30;
+	if (e->segmentIsExponential)
+	{
+		e->factorF2P30 = (fixed2p30)(e->slope * (1 << 30));
+		e->blockFactorF2P30 = tsf_fixed_pow(e->factorF2P30, TSF_RENDER_EFFECTSAMPLEBLOCK);
+	}
+	else if (e->slope)
+	{
+		fixed8p24 target = 0;
+		if (e->segment == TSF_SEGMENT_ATTACK) target = 1 << 24;
+		else if (e->segment == TSF_SEGMENT_DECAY) target = (fixed8p24)(e->parameters.sustain / 100.0f * (1 << 24));
+		e->stepF8P24 = (target - e->levelF8P24) / e->samplesUntilNextSegment;
+	}
+}
+
 static void tsf_voice_envelope_setup(struct tsf_voice_envelope* e, struct tsf_envelope* new_parameters, int midiNoteNumber, TSF_BOOL setExponentialDecay, float outSampleRate)
 {
 	e->parameters = *new_parameters;
@@ -1007,6 +1134,22 @@ static void tsf_voice_envelope_process(struct tsf_voice_envelope* e, int numSamp
 		tsf_voice_envelope_nextsegment(e, e->segment, outSampleRate);
 }
 
+static void tsf_voice_envelope_process_fixed(struct tsf_voice_envelope* e, int numSamples, float outSampleRate)
+{
+	if (e->segmentIsExponential)
+	{
+		fixed2p30 factor = (numSamples == TSF_RENDER_EFFECTSAMPLEBLOCK ? e->blockFactorF2P30 : tsf_fixed_pow(e->factorF2P30, numSamples));
+		e->levelF8P24 = (fixed8p24)(((int64_t)e->levelF8P24 * factor) >> 30);
+	}
+	else if (e->stepF8P24)
+	{
+		e->levelF8P24 += e->stepF8P24 * numSamples;
+		if (e->levelF8P24 < 0) e->levelF8P24 = 0;
+	}
+	if ((e->samplesUntilNextSegment -= numSamples) <= 0)
+		tsf_voice_envelope_nextsegment(e, e->segment, outSampleRate);
+}
+
 static void tsf_voice_lowpass_setup(struct tsf_voice_lowpass* e, float Fc)
 {
 	// Lowpass filter from http://www.earlevel.com/main/2012/11/26/biquad-c-source-code/
@@ -1028,6 +1171,8 @@ static void tsf_voice_lfo_setup(struct tsf_voice_lfo* e, float delay, int freqCe
 	e->samplesUntil = (int)(delay * outSampleRate);
 	e->delta = (4.0f * tsf_cents2Hertz((float)freqCents) / outSampleRate);
 	e->level = 0;
+	e->deltaF8P24 = (fixed8p24)(e->delta * (1 << 24));
+	e->levelF8P24 = 0;
 }
 
 static void tsf_voice_lfo_process(struct tsf_voice_lfo* e, int blockSamples)
@@ -1038,6 +1183,42 @@ static void tsf_voice_lfo_process(struct tsf_voice_lfo* e, int blockSamples)
 	else if (e->level < -1.0f) { e->delta = -e->delta; e->level = -2.0f - e->level; }
 }
 
+static void tsf_voice_lfo_process_fixed(struct tsf_voice_lfo* e, int blockSamples)
+{
+	if (e->samplesUntil > blockSamples) { e->samplesUntil -= blockSamples; return; }
+	e->levelF8P24 += e->deltaF8P24 * blockSamples;
+	if      (e->levelF8P24 >  (1 << 24)) { e->deltaF8P24 = -e->deltaF8P24; e->levelF8P24 =  (2 << 24) - e->levelF8P24; }
+	else if (e->levelF8P24 < -(1 << 24)) { e->deltaF8P24 = -e->deltaF8P24; e->levelF8P24 = -(2 << 24) - e->levelF8P24; }
+}
+
+// 2 to the power of each 64th of an octave
+static const unsigned int tsf_exp2_table[65] = {
+	1073741824u, 1085434106u, 1097253708u, 1109202018u, 1121280436u, 1133490379u,
+	1145833280u, 1158310587u, 1170923762u, 1183674286u, 1196563654u, 1209593378u,
+	1222764986u, 1236080024u, 1249540052u, 1263146652u, 1276901417u, 1290805962u,
+	1304861917u, 1319070932u, 1333434672u, 1347954824u, 1362633090u, 1377471191u,
+	1392470869u, 1407633882u, 1422962010u, 1438457051u, 1454120821u, 1469955159u,
+	1485961921u, 1502142985u, 1518500250u, 1535035634u, 1551751076u, 1568648537u,
+	1585730000u, 1602997467u, 1620452965u, 1638098541u, 1655936265u, 1673968228u,
+	1692196547u, 1710623359u, 1729250827u, 1748081133u, 1767116489u, 1786359126u,
+	1805811301u, 1825475297u, 1845353420u, 1865448001u, 1885761398u, 1906295993u,
+	1927054196u, 1948038440u, 1969251188u, 1990694927u, 2012372174u, 2034285470u,
+	2056437387u, 2078830522u, 2101467502u, 2124350982u, 2147483648u,
+};
+
+// value * 2^octaves, interpolating between the table's steps, for pitch and volume modulation
+static fixed16p16 tsf_fixed_exp2(fixed16p16 value, fixed16p16 octaves)
+{
+	int shift = (octaves >> 16) - 30;
+	unsigned int frac = octaves & 0xffff, i = frac >> 10;
+	int64_t factor = tsf_exp2_table[i] + ((((int64_t)(tsf_exp2_table[i + 1] - tsf_exp2_table[i])) * (frac & 0x3ff)) >> 10);
+	int64_t r = (int64_t)value * factor;
+	if (shift >= 0) return (shift > 1 ? 0x7fffffff : (fixed16p16)(r << shift));
+	if (shift < -62) return 0;
+	r >>= -shift;
+	return (r > 0x7fffffff ? 0x7fffffff : (fixed16p16)r);
+}
+
 static void tsf_voice_kill(struct tsf_voice* v)
 {
 	v->region = TSF_NULL;
@@ -1072,40 +1253,117 @@ static void tsf_voice_calcpitchratio(struct tsf_voice* v, float outSampleRate)
 
 	v->pitchInputTimecents = adjustedPitch * 100.0;
 	v->pitchOutputFactor = v->region->sample_rate / (tsf_timecents2Secsd(v->region->pitch_keycenter * 100.0) * outSampleRate);
+	v->pitchRatioF16P16 = (fixed16p16)(tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor * 65536.0);
+}
+
+static void tsf_voice_dropcursor(struct tsf_voice* v)
+{
+	v->pageData = TSF_NULL;
+	v->pageStart = TSF_NOPAGE;
+	v->pageSlot = -1;
+}
+
+static int tsf_cache_find(tsf* f, unsigned int page)
+{
+	int i;
+	for (i = f->hashHead[page % TSF_HASHSIZE]; i >= 0; i = f->hashNext[i])
+		if (f->page[i] == page) return i;
+	return -1;
+}
+
+// Picks a slot to reuse, going round them like a clock:  the first one no voice is playing from that
+// hasn't been looked up since the hand last went past.  If voices are playing from every page one of
+// them will have to look its page up again.
+static int tsf_cache_victim(tsf* f, int keep)
+{
+	char busy[TSF_BUFFS];
+	struct tsf_voice *v, *vEnd;
+	int i, slot;
+
+	TSF_MEMSET(busy, 0, sizeof(busy));
+	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+		if (v->playingPreset != -1 && v->pageSlot >= 0) busy[v->pageSlot] = 1;
+	if (keep >= 0) busy[keep] = 1;
+
+	for (i = 0; i < 2 * TSF_BUFFS; i++)
+	{
+		slot = f->hand;
+		f->hand = (f->hand + 1) % TSF_BUFFS;
+		if (busy[slot]) continue;
+		if (f->referenced[slot]) { f->referenced[slot] = 0; continue; }
+		return slot;
+	}
+	do { slot = f->hand; f->hand = (f->hand + 1) % TSF_BUFFS; } while (slot == keep);
+	return slot;
+}
+
+static int tsf_cache_load(tsf* f, unsigned int page, int keep)
+{
+	struct tsf_stream* stream = f->hydra->stream;
+	unsigned int want = f->fontSamplesOffset + page * TSF_BUFFSIZE * sizeof(short);
+	struct tsf_voice *v, *vEnd;
+	int slot = tsf_cache_victim(f, keep);
+
+	if (f->page[slot] != TSF_NOPAGE)
+	{
+		short* link = &f->hashHead[f->page[slot] % TSF_HASHSIZE];
+		while (*link != slot) link = &f->hashNext[*link];
+		*link = f->hashNext[slot];
+		for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+			if (v->pageSlot == slot) tsf_voice_dropcursor(v);
+	}
+
+	// After a read-ahead the stream is already where the next page starts
+	if ((unsigned int)stream->tell(stream->data) != want) stream->seek(stream->data, want);
+	stream->read(stream->data, f->buffer[slot], TSF_BUFFSIZE * sizeof(short));
+	f->page[slot] = page;
+	f->referenced[slot] = 1;
+	f->hashNext[slot] = f->hashHead[page % TSF_HASHSIZE];
+	f->hashHead[page % TSF_HASHSIZE] = slot;
+	return slot;
 }
 
-short tsf_read_short_cached(tsf *f, int pos)
+// Moves the voice's cursor onto the page holding pos, reading it in if it isn't cached
+static short tsf_voice_sample_page(tsf* f, struct tsf_voice* v, unsigned int pos)
 {
-	static int hits = 0;
-	static int misses = 0;
-//	static int call =0;
-//	call++;
-//	if ((call % 88000) ==0) printf("Hit: %d, Miss: %d, Ratio: %f\n", hits, misses, (double)hits/(double)(misses+hits));
+	unsigned int page = pos / TSF_BUFFSIZE;
+	TSF_BOOL backwards = (v->pageStart != TSF_NOPAGE && pos < v->pageStart);
+	int slot = tsf_cache_find(f, page);
 
-	for (int i=0; i<TSF_BUFFS; i++) {
-		if ((f->offset[i] <= pos) && ((f->offset[i] + TSF_BUFFSIZE) > pos) ) {
-			f->timestamp[i] = f->epoch++;
-			if (f->epoch==0) {
-				for (int i=0; i<TSF_BUFFS; i++) f->timestamp[i] = f->epoch++;
+	if (slot >= 0)
+	{
+		f->stats.hits++;
+	}
+	else
+	{
+		f->stats.misses++;
+		slot = tsf_cache_load(f, page, -1);
+
+		// Unless this is a jump back to the start of a loop, the voice will want the next page
+		// soon, and the stream is sitting right at it now
+		if (!backwards)
+		{
+			unsigned int end = (v->loopStart < v->loopEnd ? v->loopEnd + 1 : v->sampleEnd);
+			if ((page + 1) * TSF_BUFFSIZE < end && tsf_cache_find(f, page + 1) < 0)
+			{
+				f->stats.readAheads++;
+				tsf_cache_load(f, page + 1, slot);
 			}
-			hits++;
-      return f->buffer[i][pos - f->offset[i]];
 		}
 	}
-	int repl = 0;
-	for (int i=1; i<TSF_BUFFS; i++) {
-		if (f->timestamp[i] < f->timestamp[repl]) repl = i;
-	}
-	int readOff = pos - (pos % TSF_BUFFSIZE);
-// for (int i=0; i<TSF_BUFFSIZE; i++) { f->buffer[repl][i] = i; }
-	f->hydra->stream->seek(f->hydra->stream->data, readOff * sizeof(short));
-	f->hydra->stream->read(f->hydra->stream->data, f->buffer[repl], TSF_BUFFSIZE * sizeof(short));
-//static uint32_t *bp = NULL; if (!bp) bp = (uint32_t*)malloc(512);
-//printf("off=%08x, buff=%p, len=%08x\n", readOff * sizeof(short), bp, TSF_BUFFSIZE); spi_flash_read(0x0000, bp, 512/4-4) ;
-	f->timestamp[repl] = f->epoch++;
-	f->offset[repl] = readOff;
-	misses++;
-	return f->buffer[repl][pos - readOff];
+	f->referenced[slot] = 1;
+	v->pageData = f->buffer[slot];
+	v->pageStart = page * TSF_BUFFSIZE;
+	v->pageSlot = slot;
+	return v->pageData[pos - v->pageStart];
+}
+
+// One sample of the voice's region, read straight from its cursor while it stays on the same page
+static inline short tsf_voice_sample(tsf* f, struct tsf_voice* v, unsigned int pos)
+{
+	unsigned int off = pos - v->pageStart;
+	if (off < TSF_BUFFSIZE) return v->pageData[off];
+	return tsf_voice_sample_page(f, v, pos);
 }
 
 static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, int numSamples)
@@ -1180,8 +1438,8 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 				{
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 					float inputPos, inputNextPos;
-					inputPos = (float)(tsf_read_short_cached(f, pos) / 32767.0);
-					inputNextPos = (float)(tsf_read_short_cached(f, nextPos) / 32767.0);
+					inputPos = (float)(tsf_voice_sample(f, v, pos) / 32767.0);
+					inputNextPos = (float)(tsf_voice_sample(f, v, nextPos) / 32767.0);
 					// Simple linear interpolation.
 					float alpha = (float)(tmpSourceSamplePosition - pos), val = (inputPos * (1.0f - alpha) + inputNextPos * alpha);
 
@@ -1203,8 +1461,8 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 				{
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 					float inputPos, inputNextPos;
-					inputPos = (float)(tsf_read_short_cached(f, pos) / 32767.0);
-					inputNextPos = (float)(tsf_read_short_cached(f, nextPos) / 32767.0);
+					inputPos = (float)(tsf_voice_sample(f, v, pos) / 32767.0);
+					inputNextPos = (float)(tsf_voice_sample(f, v, nextPos) / 32767.0);
 
 					// Simple linear interpolation.
 					float alpha = (float)(tmpSourceSamplePosition - pos), val = (inputPos * (1.0f - alpha) + inputNextPos * alpha);
@@ -1226,8 +1484,8 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 				{
 					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 					float inputPos, inputNextPos;
-					inputPos = (float)(tsf_read_short_cached(f, pos) / 32767.0);
-					inputNextPos = (float)(tsf_read_short_cached(f, nextPos) / 32767.0);
+					inputPos = (float)(tsf_voice_sample(f, v, pos) / 32767.0);
+					inputNextPos = (float)(tsf_voice_sample(f, v, nextPos) / 32767.0);
 
 					// Simple linear interpolation.
 					float alpha = (float)(tmpSourceSamplePosition - pos), val = (inputPos * (1.0f - alpha) + inputNextPos * alpha);
@@ -1256,114 +1514,129 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 }
 
 
-void DumpF32P32(char *name, long long x) {
-  printf("%s = %08x.%08x\n", name, (int32_t)((x>>32)&0xffffffff), (int32_t)(x&0xffffffff));
-}
-static void tsf_voice_render_fast(tsf* f, struct tsf_voice* v, short* outputBuffer, int numSamples)
-{
-  struct tsf_region* region = v->region;
-  short* outL = outputBuffer;
-  short* outR = (f->outputmode == TSF_STEREO_UNWEAVED ? outL + numSamples : TSF_NULL);
-
-  // Cache some values, to give them at least some chance of ending up in registers.
-  TSF_BOOL updateModEnv = (region->modEnvToPitch || region->modEnvToFilterFc);
-  TSF_BOOL updateModLFO = (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume));
-  TSF_BOOL updateVibLFO = (v->viblfo.delta && (region->vibLfoToPitch));
-  TSF_BOOL isLooping    = (v->loopStart < v->loopEnd);
-  unsigned int tmpLoopStart = v->loopStart, tmpLoopEnd = v->loopEnd;
-  //double tmpSampleEndDbl = (double)v->sampleEnd, tmpLoopEndDbl = (double)tmpLoopEnd + 1.0;
-  //double tmpSourceSamplePosition = v->sourceSamplePosition;
-  fixed32p32 tmpSampleEndF32P32 = ((fixed32p32)(v->sampleEnd)) << 32;
-  fixed32p32 tmpLoopEndF32P32 = ((fixed32p32)(tmpLoopEnd + 1)) << 32;
-  fixed32p32 tmpSourceSamplePositionF32P32 = v->sourceSamplePositionF32P32;
-  struct tsf_voice_lowpass tmpLowpass = v->lowpass;
-
-  TSF_BOOL dynamicLowpass = (region->modLfoToFilterFc || region->modEnvToFilterFc);
-  float tmpSampleRate, tmpInitialFilterFc, tmpModLfoToFilterFc, tmpModEnvToFilterFc;
-
-  TSF_BOOL dynamicPitchRatio = (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch);
-  //double pitchRatio;
-  fixed32p32 pitchRatioF32P32;
-  float tmpModLfoToPitch, tmpVibLfoToPitch, tmpModEnvToPitch;
-
-  TSF_BOOL dynamicGain = (region->modLfoToVolume != 0);
-  float noteGain, tmpModLfoToVolume;
+// The voice's sample at pos, plus frac 65536ths of the way to the next one it will play.  Up to last, the
+// sample before it loops or ends, that's the one after it, and usually on the same page.
+static inline int tsf_voice_interpolate(tsf* f, struct tsf_voice* v, unsigned int pos, unsigned int frac, unsigned int last)
+{
+	unsigned int off = pos - v->pageStart;
+	int val, next;
+	if (off < TSF_BUFFSIZE - 1 && pos < last)
+	{
+		val = v->pageData[off];
+		next = v->pageData[off + 1];
+	}
+	else
+	{
+		val = tsf_voice_sample(f, v, pos);
+		if (pos < last) next = tsf_voice_sample(f, v, pos + 1);
+		else if (v->loopStart < v->loopEnd && pos == v->loopEnd) next = tsf_voice_sample(f, v, v->loopStart);
+		else next = val;
+	}
+	return val + (((next - val) * (int)(frac >> 1)) >> 15);
+}
 
-  if (dynamicLowpass) tmpSampleRate = f->outSampleRate, tmpInitialFilterFc = (float)region->initialFilterFc, tmpModLfoToFilterFc = (float)region->modLfoToFilterFc, tmpModEnvToFilterFc = (float)region->modEnvToFilterFc;
-  else tmpSampleRate = 0, tmpInitialFilterFc = 0, tmpModLfoToFilterFc = 0, tmpModEnvToFilterFc = 0;
+// Gain in 15 bits for a note gain and envelope level, pinned to just under 2
+static inline int tsf_fixed_gain(fixed16p16 noteGain, fixed8p24 level)
+{
+	int64_t gain = ((int64_t)noteGain * level) >> 25;
+	return (int)(gain > 65535 ? 65535 : gain);
+}
 
-  if (dynamicPitchRatio) pitchRatioF32P32 = 0, tmpModLfoToPitch = (float)region->modLfoToPitch, tmpVibLfoToPitch = (float)region->vibLfoToPitch, tmpModEnvToPitch = (float)region->modEnvToPitch;
-  else {
-    double pr = tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor;
-    fixed32p32 adj = 1LL<<32;
-    pr *= adj;
-    pitchRatioF32P32 = (int64_t)pr, tmpModLfoToPitch = 0, tmpVibLfoToPitch = 0, tmpModEnvToPitch = 0;
-  }
+// Mixes the voice into 32 bit samples using integers only:  a 16.16 phase through the samples, linear interpolation
+// between them, and a gain that ramps over each effect block from where the envelope was at its start to where it is
+// at its end.  The lowpass filter is left out.
+static void tsf_voice_render_fixed(tsf* f, struct tsf_voice* v, int32_t* mix, int numSamples)
+{
+	struct tsf_region* region = v->region;
 
-  if (dynamicGain) noteGain = 0, tmpModLfoToVolume = (float)region->modLfoToVolume * 0.1f;
-  else noteGain = tsf_decibelsToGain(v->noteGainDB), tmpModLfoToVolume = 0;
+	// Cache some values, to give them at least some chance of ending up in registers.
+	TSF_BOOL updateModEnv = (region->modEnvToPitch || region->modEnvToFilterFc);
+	TSF_BOOL updateModLFO = (v->modlfo.deltaF8P24 && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume));
+	TSF_BOOL updateVibLFO = (v->viblfo.deltaF8P24 && (region->vibLfoToPitch));
+	TSF_BOOL dynamicPitchRatio = (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch);
+	TSF_BOOL isLooping    = (v->loopStart < v->loopEnd);
+	TSF_BOOL mono         = (f->outputmode == TSF_MONO);
+	unsigned int loopEnd = v->loopEnd, loopLength = v->loopEnd + 1 - v->loopStart, sampleEnd = v->sampleEnd;
+	unsigned int last = (isLooping && loopEnd < sampleEnd - 1 ? loopEnd : sampleEnd - 1);
+	unsigned int pos = (unsigned int)(v->sourceSamplePositionF32P32 >> 32);
+	unsigned int frac = ((unsigned int)v->sourceSamplePositionF32P32) >> 16;
+	int panLeft = v->panLeftF16P16 >> 1, panRight = v->panRightF16P16 >> 1;
 
-  while (numSamples)
-  {
-    float gainMono;
-    int blockSamples = (numSamples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples);
-    numSamples -= blockSamples;
+	while (numSamples)
+	{
+		fixed16p16 pitchRatio = v->pitchRatioF16P16, noteGain = v->noteGainF16P16;
+		unsigned int step, stepFrac;
+		int gain, gainStep;
+		int blockSamples = (numSamples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples);
+		numSamples -= blockSamples;
 
-    if (dynamicLowpass)
-    {
-      float fres = tmpInitialFilterFc + v->modlfo.level * tmpModLfoToFilterFc + v->modenv.level * tmpModEnvToFilterFc;
-      tmpLowpass.active = (fres <= 13500.0f);
-      if (tmpLowpass.active) tsf_voice_lowpass_setup(&tmpLowpass, tsf_cents2Hertz(fres) / tmpSampleRate);
-    }
+		if (dynamicPitchRatio)
+		{
+			// Levels cut to 14 fractional bits so the cents fit, and 1200 cents (of 16384ths) to the octave
+			int cents = (v->modlfo.levelF8P24 >> 10) * region->modLfoToPitch + (v->viblfo.levelF8P24 >> 10) * region->vibLfoToPitch + (v->modenv.levelF8P24 >> 10) * region->modEnvToPitch;
+			pitchRatio = tsf_fixed_exp2(pitchRatio, cents / 300);
+		}
+		step = (unsigned int)pitchRatio >> 16;
+		stepFrac = pitchRatio & 0xffff;
 
-    if (dynamicPitchRatio) {
-      pitchRatioF32P32 = tsf_timecents2Secsd(v->pitchInputTimecents + (v->modlfo.level * tmpModLfoToPitch + v->viblfo.level * tmpVibLfoToPitch + v->modenv.level * tmpModEnvToPitch)) * v->pitchOutputFactor * (1LL<<32);
-   }
+		// Centibels of tremolo, 200 / log2(10) of them (65536 / 1089) to the octave
+		if (region->modLfoToVolume)
+			noteGain = tsf_fixed_exp2(noteGain, (fixed16p16)(((int64_t)(v->modlfo.levelF8P24 >> 8) * region->modLfoToVolume * 1089) >> 16));
 
-    if (dynamicGain)
-      noteGain = tsf_decibelsToGain(v->noteGainDB + (v->modlfo.level * tmpModLfoToVolume));
+		gain = tsf_fixed_gain(noteGain, v->ampenv.levelF8P24);
 
-    gainMono = noteGain * v->ampenv.level;
-    short gainMonoFP = gainMono * 32767;
-    
-    // Update EG.
-    tsf_voice_envelope_process(&v->ampenv, blockSamples, f->outSampleRate);
-    if (updateModEnv) tsf_voice_envelope_process(&v->modenv, blockSamples, f->outSampleRate);
+		// Update EG.
+		tsf_voice_envelope_process_fixed(&v->ampenv, blockSamples, f->outSampleRate);
+		if (updateModEnv) tsf_voice_envelope_process_fixed(&v->modenv, blockSamples, f->outSampleRate);
 
-    // Update LFOs.
-    if (updateModLFO) tsf_voice_lfo_process(&v->modlfo, blockSamples);
-    if (updateVibLFO) tsf_voice_lfo_process(&v->viblfo, blockSamples);
+		// Update LFOs.
+		if (updateModLFO) tsf_voice_lfo_process_fixed(&v->modlfo, blockSamples);
+		if (updateVibLFO) tsf_voice_lfo_process_fixed(&v->viblfo, blockSamples);
 
-    while (blockSamples-- && tmpSourceSamplePositionF32P32 < tmpSampleEndF32P32)
-    {
-      unsigned int pos = (unsigned int)(tmpSourceSamplePositionF32P32>>32);
-      short val = tsf_read_short_cached(f, pos);
-      int32_t val32 = (int)val * (int)gainMonoFP;
+		gainStep = (tsf_fixed_gain(noteGain, v->ampenv.levelF8P24) - gain) / blockSamples;
 
-      *outL++ += val32>>16;
-      if (f->outputmode != TSF_MONO) *outR++ += val32>>16;
+		if (mono)
+		{
+			while (blockSamples-- && pos < sampleEnd)
+			{
+				*mix++ += (tsf_voice_interpolate(f, v, pos, frac, last) * gain) >> 16;
+				gain += gainStep;
+
+				// Next sample.
+				frac += stepFrac;
+				pos += step + (frac >> 16);
+				frac &= 0xffff;
+				while (isLooping && pos > loopEnd) pos -= loopLength;
+			}
+		}
+		else
+		{
+			while (blockSamples-- && pos < sampleEnd)
+			{
+				int val = (tsf_voice_interpolate(f, v, pos, frac, last) * gain) >> 16;
+				*mix++ += (val * panLeft) >> 15;
+				*mix++ += (val * panRight) >> 15;
+				gain += gainStep;
+
+				frac += stepFrac;
+				pos += step + (frac >> 16);
+				frac &= 0xffff;
+				while (isLooping && pos > loopEnd) pos -= loopLength;
+			}
+		}
 
-      // Next sample.
-      tmpSourceSamplePositionF32P32 += pitchRatioF32P32;
-      if (tmpSourceSamplePositionF32P32 >= tmpLoopEndF32P32 && isLooping)
-        tmpSourceSamplePositionF32P32 -= (tmpLoopEndF32P32 - tmpLoopStart + (1LL<<32));
-    }
+		if (pos >= sampleEnd || v->ampenv.segment == TSF_SEGMENT_DONE)
+		{
+			tsf_voice_kill(v);
+			return;
+		}
+	}
 
-    if (tmpSourceSamplePositionF32P32 >= tmpSampleEndF32P32 || v->ampenv.segment == TSF_SEGMENT_DONE)
-    {
-      tsf_voice_kill(v);
-      return;
-    }
-  }
-
-  v->sourceSamplePositionF32P32 = tmpSourceSamplePositionF32P32;
-  if (tmpLowpass.active || dynamicLowpass) v->lowpass = tmpLowpass;
+	v->sourceSamplePositionF32P32 = ((fixed32p32)pos << 32) | (unsigned int)(frac << 16);
 }
 
-
-
-
-TSFDEF tsf* tsf_load(struct tsf_stream* stream)
+// maxPresets < 0 loads a table for every preset in the font
+TSFDEF tsf* tsf_load_sparse(struct tsf_stream* stream, int maxPresets)
 {
 	tsf* res = TSF_NULL;
 	struct tsf_riffchunk chunkHead;
@@ -1434,8 +1707,15 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		res = (tsf*)TSF_MALLOC(sizeof(tsf));
 		TSF_MEMSET(res, 0, sizeof(tsf));
 		res->presetNum = hydra.phdrNum - 1;
-		res->presets = (struct tsf_preset*)TSF_MALLOC(res->presetNum * sizeof(struct tsf_preset));
-		TSF_MEMSET(res->presets, 0, res->presetNum * sizeof(struct tsf_preset));
+		res->presetSlots = res->presetNum;
+		if (maxPresets >= 0)
+		{
+			res->presetSlots = maxPresets;
+			res->presetMap = (short*)TSF_MALLOC(maxPresets * sizeof(short));
+			TSF_MEMSET(res->presetMap, 0xff, maxPresets * sizeof(short));
+		}
+		res->presets = (struct tsf_preset*)TSF_MALLOC(res->presetSlots * sizeof(struct tsf_preset));
+		TSF_MEMSET(res->presets, 0, res->presetSlots * sizeof(struct tsf_preset));
 		res->fontSamplesOffset = fontSamplesOffset;
 		res->fontSampleCount = fontSampleCount;
 		res->outSampleRate = 44100.0f;
@@ -1444,26 +1724,66 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		res->hydra->stream = (struct tsf_stream*)TSF_MALLOC(sizeof(struct tsf_stream));
 		TSF_MEMCPY(res->hydra->stream, stream, sizeof(*res->hydra->stream));
 
-		// Cached sample
+		// Cached sample pages
 		for (int i=0; i<TSF_BUFFS; i++) {
 			res->buffer[i] = (short*)TSF_MALLOC(TSF_BUFFSIZE * sizeof(short));
-			res->offset[i] = 0xfffffff;
-			res->timestamp[i] = -1;
+			res->page[i] = TSF_NOPAGE;
+			res->hashNext[i] = -1;
 		}
-		res->epoch = 0;
+		for (int i=0; i<TSF_HASHSIZE; i++) res->hashHead[i] = -1;
 	}
 	return res;
 }
 
+TSFDEF tsf* tsf_load(struct tsf_stream* stream)
+{
+	return tsf_load_sparse(stream, -1);
+}
+
+TSFDEF int tsf_preload(tsf* f, int preset)
+{
+	struct tsf_preset* p = tsf_preset_slot(f, preset);
+	int i;
+	if (!p && f->presetMap && preset >= 0 && preset < f->presetNum)
+	{
+		for (i = 0; i < f->presetSlots; i++)
+			if (f->presetMap[i] == -1) { f->presetMap[i] = (short)preset; p = &f->presets[i]; break; }
+	}
+	if (!p) return -1;
+	if (p->regions == NULL) tsf_load_preset(f->hydra, preset, p);
+	return p->regionNum;
+}
+
+TSFDEF int tsf_get_presetindex(tsf* f, int bank, int preset_number)
+{
+	struct tsf_hydra_phdr phdr;
+	int i;
+	for (i = 0; i < f->presetNum; i++)
+	{
+		get_phdr(f->hydra, i, &phdr);
+		if (phdr.bank == bank && phdr.preset == preset_number) return i;
+	}
+	return -1;
+}
+
+TSFDEF int tsf_get_preset_memory(tsf* f)
+{
+	int bytes = f->presetSlots * sizeof(struct tsf_preset), i;
+	if (f->presetMap) bytes += f->presetSlots * sizeof(short);
+	for (i = 0; i < f->presetSlots; i++) bytes += f->presets[i].regionNum * sizeof(struct tsf_region);
+	return bytes;
+}
+
 TSFDEF void tsf_close(tsf* f)
 {
 	struct tsf_preset *preset, *presetEnd;
 	if (!f) return;
-	for (preset = f->presets, presetEnd = preset + f->presetNum; preset != presetEnd; preset++)
+	for (preset = f->presets, presetEnd = preset + f->presetSlots; preset != presetEnd; preset++)
 		TSF_FREE(preset->regions);
 	TSF_FREE(f->presets);
+	TSF_FREE(f->presetMap);
 	TSF_FREE(f->voices);
-	TSF_FREE(f->outputSamples);
+	TSF_FREE(f->mix);
 	f->hydra->stream->close(f->hydra->stream->data);
 	TSF_FREE(f->hydra->stream);
 	TSF_FREE(f->hydra);
@@ -1471,6 +1791,78 @@ TSFDEF void tsf_close(tsf* f)
 	TSF_FREE(f);
 }
 
+TSFDEF void tsf_get_cache_stats(tsf* f, struct tsf_cache_stats* stats)
+{
+	*stats = f->stats;
+}
+
+TSFDEF int tsf_active_voice_count(tsf* f)
+{
+	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+	int n = 0;
+	for (; v != vEnd; v++)
+		if (v->playingPreset != -1 && !v->stolen) n++;
+	return n;
+}
+
+TSFDEF void tsf_get_voice_stats(tsf* f, struct tsf_voice_stats* stats)
+{
+	*stats = f->voiceStats;
+}
+
+// The voice the steal policy gives up first, out of those counting towards the cap that the note on
+// playIndex didn't start.  Higher scores go first, ties to the older voice.  Scores are unsigned with
+// the age in the low 31 bits, the released flag above it and the policy's main key in the top 32.
+static struct tsf_voice* tsf_voice_victim(tsf* f, unsigned int playIndex)
+{
+	struct tsf_voice *v, *vEnd, *victim = TSF_NULL;
+	uint64_t score, best = 0;
+	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+	{
+		uint64_t age, released;
+		int gain;
+		if (v->playingPreset == -1 || v->stolen || v->playIndex == playIndex) continue;
+		age = (unsigned int)(playIndex - v->playIndex);
+		if (age > 0x7fffffff) age = 0x7fffffff;
+		released = (v->ampenv.segment >= TSF_SEGMENT_RELEASE);
+		switch (f->stealPolicy)
+		{
+			case TSF_STEAL_QUIETEST:
+				gain = tsf_fixed_gain(v->noteGainF16P16, v->ampenv.levelF8P24);
+				score = ((uint64_t)(65535 - (gain < 0 ? 0 : gain)) << 32) | age;
+				break;
+			case TSF_STEAL_OLDEST_RELEASED:
+				score = (released << 31) | age;
+				break;
+			case TSF_STEAL_LOWEST_PRIORITY:
+			default:
+				// Flipping every bit but the sign's turns the int into an unsigned that's larger for lower priorities
+				score = ((uint64_t)((unsigned int)v->priority ^ 0x7fffffffu) << 32) | (released << 31) | age;
+				break;
+		}
+		if (!victim || score > best) { victim = v; best = score; }
+	}
+	return victim;
+}
+
+static void tsf_voice_steal(tsf* f, struct tsf_voice* v)
+{
+	tsf_voice_endquick(v, f->outSampleRate);
+	v->stolen = TSF_TRUE;
+	f->voiceStats.stolen++;
+}
+
+TSFDEF void tsf_set_max_voices(tsf* f, int maxVoices, enum TSFStealPolicy policy)
+{
+	struct tsf_voice* v;
+	f->maxVoices = (maxVoices > 0 ? maxVoices : 0);
+	f->stealPolicy = policy;
+	// No voice has the next play index, so any can go
+	if (f->maxVoices)
+		while (tsf_active_voice_count(f) > f->maxVoices && (v = tsf_voice_victim(f, f->voicePlayIndex + 1)) != TSF_NULL)
+			tsf_voice_steal(f, v);
+}
+
 TSFDEF int tsf_get_presetcount(tsf* f)
 {
 	return f->presetNum;
@@ -1478,25 +1870,36 @@ TSFDEF int tsf_get_presetcount(tsf* f)
 
 TSFDEF const char* tsf_get_presetname(tsf* f, int preset)
 {
-	if (f->presets[preset].regions == NULL && preset >= 0 && preset < f->presetNum) tsf_load_preset(f, f->hydra, preset);
-	return (preset < 0 || preset >= f->presetNum ? TSF_NULL : f->presets[preset].presetName);
+	struct tsf_preset* p = tsf_preset_slot(f, preset);
+	if (!p) return TSF_NULL;
+	if (p->regions == NULL) tsf_load_preset(f->hydra, preset, p);
+	return p->presetName;
 }
 
 TSFDEF void tsf_set_output(tsf* f, enum TSFOutputMode outputmode, int samplerate, float globalgaindb)
 {
 	f->outSampleRate = (float)(samplerate >= 1 ? samplerate : 44100.0f);
 	f->outputmode = outputmode;
+	TSF_FREE(f->mix);
+	f->mix = TSF_NULL;
 	f->globalGainDB = globalgaindb;
 }
 
 TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel)
 {
-	int midiVelocity = (int)(vel * 127);
+	tsf_note_on_priority(f, preset, key, vel, 0);
+}
+
+TSFDEF void tsf_note_on_priority(tsf* f, int preset, int key, float vel, int priority)
+{
+	int midiVelocity = (int)(vel * 127), active;
+	unsigned int playIndex = ++f->voicePlayIndex;
 	TSF_BOOL haveGroupedNotesPlaying = TSF_FALSE;
 	struct tsf_voice *v, *vEnd; struct tsf_region *region, *regionEnd;
+	struct tsf_preset* p = tsf_preset_slot(f, preset);
 
-	if (preset < 0 || preset >= f->presetNum) return;
-	if (f->presets[preset].regions == NULL) tsf_load_preset(f, f->hydra, preset);
+	if (!p) return;
+	if (p->regions == NULL) tsf_load_preset(f->hydra, preset, p);
 
 	// Are any grouped notes playing? (Needed for group stopping) Also stop any voices still playing this note.
 	for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
@@ -1507,7 +1910,7 @@ TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel)
 	}
 
 	// Play all matching regions.
-	for (region = f->presets[preset].regions, regionEnd = region + f->presets[preset].regionNum; region != regionEnd; region++)
+	for (region = p->regions, regionEnd = region + p->regionNum; region != regionEnd; region++)
 	{
 		struct tsf_voice* voice = TSF_NULL; double adjustedPan; TSF_BOOL doLoop; float filterQDB;
 		if (key < region->lokey || key > region->hikey || midiVelocity < region->lovel || midiVelocity > region->hivel) continue;
@@ -1517,7 +1920,20 @@ TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel)
 				if (v->playingPreset == preset && v->region->group == region->group)
 					tsf_voice_endquick(v, f->outSampleRate);
 
+		// At the cap another voice has to make way, unless all of them are this note's
+		active = tsf_active_voice_count(f);
+		if (f->maxVoices && active >= f->maxVoices)
+		{
+			if (!(v = tsf_voice_victim(f, playIndex))) continue;
+			tsf_voice_steal(f, v);
+			active--;
+		}
+
 		for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++) if (v->playingPreset == -1) { voice = v; break; }
+		// Voices fading out after a steal get a few extra slots, past those the quietest one is cut short
+		if (!voice && f->maxVoices && f->voiceNum >= f->maxVoices + 4)
+			for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+				if (v->stolen && (!voice || v->ampenv.levelF8P24 < voice->ampenv.levelF8P24)) voice = v;
 		if (!voice)
 		{
 			f->voiceNum += 4;
@@ -1525,6 +1941,7 @@ TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel)
 			f->voices = (struct tsf_voice*)TSF_REALLOC(f->voices, f->voiceNum * sizeof(struct tsf_voice));
 			if (!f->voices) {
 				f->voices = saveVoice;
+				f->voiceNum -= 4;
 				printf("OOM, no room for new voice.  Ignoring note_on\n");
 				return;
 			}
@@ -1535,6 +1952,11 @@ TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel)
 		voice->region = region;
 		voice->playingPreset = preset;
 		voice->playingKey = key;
+		voice->playIndex = playIndex;
+		voice->priority = priority;
+		voice->stolen = TSF_FALSE;
+		if (++active > f->voiceStats.peak) f->voiceStats.peak = active;
+		tsf_voice_dropcursor(voice);
 
 		// Pitch.
 		voice->curPitchWheel = 8192;
@@ -1548,6 +1970,9 @@ TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel)
 		adjustedPan = (region->pan + 100.0) / 200.0;
 		voice->panFactorLeft = (float)TSF_SQRT(1.0 - adjustedPan);
 		voice->panFactorRight = (float)TSF_SQRT(adjustedPan);
+		voice->noteGainF16P16 = (fixed16p16)(tsf_decibelsToGain(voice->noteGainDB) * 65536.0f);
+		voice->panLeftF16P16 = (fixed16p16)(voice->panFactorLeft * 65536.0f);
+		voice->panRightF16P16 = (fixed16p16)(voice->panFactorRight * 65536.0f);
 
 		// Offset/end.
 		voice->sourceSamplePosition = region->offset;
@@ -1580,39 +2005,23 @@ TSFDEF void tsf_note_on(tsf* f, int preset, int key, float vel)
 TSFDEF void tsf_note_off(tsf* f, int preset, int key)
 {
 	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+	if (preset < 0) return; // Free voices are marked with preset -1
 	for (; v != vEnd; v++)
 		if (v->playingPreset == preset && v->playingKey == key)
 			tsf_voice_end(v, f->outSampleRate);
 }
 
-TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing)
+TSFDEF void tsf_note_off_all(tsf* f)
 {
-	float *floatSamples;
-	int channelSamples = (f->outputmode == TSF_MONO ? 1 : 2) * samples, floatBufferSize = channelSamples * sizeof(float);
-	short* bufferEnd = buffer + channelSamples;
-	if (floatBufferSize > f->outputSampleSize)
-	{
-		TSF_FREE(f->outputSamples);
-		f->outputSamples = (float*)TSF_MALLOC(floatBufferSize);
-		f->outputSampleSize = floatBufferSize;
-	}
-
-	tsf_render_float(f, f->outputSamples, samples, TSF_FALSE);
+	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+	for (; v != vEnd; v++)
+		if (v->playingPreset != -1)
+			tsf_voice_end(v, f->outSampleRate);
+}
 
-	floatSamples = f->outputSamples;
-	if (flag_mixing) 
-		while (buffer != bufferEnd)
-		{
-			float v = *floatSamples++;
-			int vi = *buffer + (v < -1.00004566f ? (int)-32768 : (v > 1.00001514f ? (int)32767 : (int)(v * 32767.5f)));
-			*buffer++ = (vi < -32768 ? (short)-32768 : (vi > 32767 ? (short)32767 : (short)vi));
-		}
-	else
-		while (buffer != bufferEnd)
-		{
-			float v = *floatSamples++;
-			*buffer++ = (v < -1.00004566f ? (short)-32768 : (v > 1.00001514f ? (short)32767 : (short)(v * 32767.5f)));
-		}
+TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing)
+{
+	tsf_render_short_fast(f, buffer, samples, flag_mixing);
 }
 
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing)
@@ -1624,15 +2033,42 @@ TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing
 			tsf_voice_render(f, v, buffer, samples);
 }
 
+// Voices are mixed in 32 bits, up to TSF_MIXSAMPLES at a time, and only pinned to 16 as that's written out.
+// Each voice plays its whole stretch in one go, so it stays on its page of cached samples.
 TSFDEF void tsf_render_short_fast(tsf* f, short* buffer, int samples, int flag_mixing)
 {
-  struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
-  if (!flag_mixing) TSF_MEMSET(buffer, 0, (f->outputmode == TSF_MONO ? 1 : 2) * sizeof(short) * samples);
-  for (; v != vEnd; v++) {
-    if (v->playingPreset != -1)
-      tsf_voice_render_fast(f, v, buffer, samples);
-    yield();
-  }
+	int channels = (f->outputmode == TSF_MONO ? 1 : 2), done, chunk, i, c;
+	int stride = (f->outputmode == TSF_STEREO_UNWEAVED ? 1 : channels);
+	struct tsf_voice *v, *vEnd;
+
+	if (!f->mix) f->mix = (int32_t*)TSF_MALLOC(channels * TSF_MIXSAMPLES * sizeof(int32_t));
+	if (!f->mix)
+	{
+		if (!flag_mixing) TSF_MEMSET(buffer, 0, channels * sizeof(short) * samples);
+		return;
+	}
+
+	for (done = 0; done < samples; done += chunk)
+	{
+		chunk = (samples - done > TSF_MIXSAMPLES ? TSF_MIXSAMPLES : samples - done);
+		TSF_MEMSET(f->mix, 0, channels * chunk * sizeof(int32_t));
+		for (v = f->voices, vEnd = v + f->voiceNum; v != vEnd; v++)
+		{
+			if (v->playingPreset != -1)
+				tsf_voice_render_fixed(f, v, f->mix, chunk);
+			yield();
+		}
+
+		for (c = 0; c < channels; c++)
+		{
+			short* out = (f->outputmode == TSF_STEREO_UNWEAVED ? buffer + c * samples + done : buffer + done * channels + c);
+			for (i = 0; i < chunk; i++, out += stride)
+			{
+				int32_t val = f->mix[i * channels + c] + (flag_mixing ? *out : 0);
+				*out = (short)(val < -32768 ? -32768 : (val > 32767 ? 32767 : val));
+			}
+		}
+	}
 }
 
 
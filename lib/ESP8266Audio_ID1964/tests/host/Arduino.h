@@ -14,6 +14,7 @@
 #define PROGMEM
 #define PSTR
 #define memcpy_P memcpy
+#define memcmp_P memcmp
 #define sprintf_P sprintf
 #define yield() do {} while(0)
 #define printf_P printf
@@ -21,6 +22,10 @@
 #define snprintf_P snprintf
 #define strncpy_P strncpy
 
+#include <sys/time.h>
+static inline unsigned long micros() { struct timeval tv; gettimeofday(&tv, NULL); return tv.tv_sec * 1000000UL + tv.tv_usec; }
+static inline unsigned long millis() { return micros() / 1000; }
+
 #ifdef __cplusplus
 class SerialEmulator {
   public:
@@ -0,0 +1,247 @@
+#include <Arduino.h>
+#include <unistd.h>
+#include "AudioFileSourceBuffer.h"
+
+// Runs AudioFileSourceBuffer over an in-memory source that only hands non-blocking reads what the test
+// lets "arrive":  refilling to the start watermark after running below the low one, growing the buffer
+// while it's empty, the stats and status counts, and seeks and reads that straddle a refill, all checking
+// the bytes that come out are the ones at getPos().  Prints "ok" when every case passes.
+
+static bool allOk = true;
+
+static void Check(const char *name, uint32_t got, uint32_t expect)
+{
+  if (got != expect) {
+    printf("%-44s got %u, expected %u\n", name, got, expect);
+    allOk = false;
+  }
+}
+
+static void CheckTrue(const char *name, bool cond)
+{
+  if (!cond) {
+    printf("%-44s failed\n", name);
+    allOk = false;
+  }
+}
+
+static uint8_t Byte(uint32_t pos) { return (pos * 7 + (pos >> 8)) & 0xff; }
+
+// Blocking reads get whatever's asked for, non-blocking ones at most trickle bytes
+class MemSource : public AudioFileSource
+{
+  public:
+    MemSource(uint32_t size) : size(size) { pos = 0; trickle = 0; reads = seeks = 0; }
+    virtual uint32_t read(void *data, uint32_t len) override {
+      reads++;
+      if (len > size - pos) len = size - pos;
+      for (uint32_t i = 0; i < len; i++) ((uint8_t*)data)[i] = Byte(pos + i);
+      pos += len;
+      return len;
+    }
+    virtual uint32_t readNonBlock(void *data, uint32_t len) override {
+      return read(data, (len < trickle) ? len : trickle);
+    }
+    virtual bool seek(int32_t p, int dir) override {
+      seeks++;
+      if (dir == SEEK_CUR) p += pos;
+      else if (dir == SEEK_END) p += size;
+      if ((p < 0) || ((uint32_t)p > size)) return false;
+      pos = p;
+      return true;
+    }
+    virtual bool close() override { return true; }
+    virtual bool isOpen() override { return true; }
+    virtual uint32_t getSize() override { return size; }
+    virtual uint32_t getPos() override { return pos; }
+    uint32_t size;
+    uint32_t pos;
+    uint32_t trickle;
+    uint32_t reads;
+    uint32_t seeks;
+};
+
+// Reads len bytes and checks they're the ones from where getPos() said we were
+static uint32_t ReadCheck(AudioFileSourceBuffer *buff, uint32_t len)
+{
+  static uint8_t tmp[8192];
+  uint32_t pos = buff->getPos();
+  uint32_t n = buff->read(tmp, len);
+  for (uint32_t i = 0; i < n; i++) {
+    if (tmp[i] != Byte(pos + i)) {
+      printf("Byte %u read wrong\n", pos + i);
+      allOk = false;
+      break;
+    }
+  }
+  if (buff->getPos() != pos + n) {
+    printf("getPos() %u after reading %u bytes from %u\n", buff->getPos(), n, pos);
+    allOk = false;
+  }
+  return n;
+}
+
+static void TestWatermarks()
+{
+  MemSource *src = new MemSource(100000);
+  AudioFileSourceBuffer *buff = new AudioFileSourceBuffer(src, 4096);
+  buff->SetWatermarks(1024, 2048);
+
+  // Only the start watermark gets read before the first bytes come back
+  ReadCheck(buff, 100);
+  Check("Fill after the first read", buff->getFillLevel(), 2048 - 100);
+  Check("Filling reported", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_FILLING), 1);
+
+  // Nothing arriving, so reading takes it under the low watermark, reported once
+  while (buff->getFillLevel() >= 1024) ReadCheck(buff, 100);
+  Check("Low water reported", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_LOWWATER), 1);
+  ReadCheck(buff, 100);
+  ReadCheck(buff, 100);
+  Check("Low water reported only once", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_LOWWATER), 1);
+
+  // Back up to the start watermark rearms it
+  src->trickle = 512;
+  while (buff->getFillLevel() < 2048) buff->loop();
+  src->trickle = 0;
+  while (buff->getFillLevel() >= 1024) ReadCheck(buff, 100);
+  Check("Low water reported again after rearming", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_LOWWATER), 2);
+  Check("No underflow yet", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_UNDERFLOW), 0);
+
+  // Asking for more than's left runs it dry:  the rest comes straight from the source, then it refills
+  uint32_t left = buff->getFillLevel();
+  Check("Read past the end of the buffer", ReadCheck(buff, left + 300), left + 300);
+  Check("Underflow reported", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_UNDERFLOW), 1);
+  ReadCheck(buff, 10);
+  Check("Refilled to the start watermark", buff->getFillLevel(), 2048 - 10);
+  Check("Filling reported after the underflow", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_FILLING), 2);
+
+  delete buff;
+  delete src;
+}
+
+static void TestGrowth()
+{
+  MemSource *src = new MemSource(100000);
+  AudioFileSourceBuffer *buff = new AudioFileSourceBuffer(src, 1000);
+  buff->SetGrowLimit(2000);
+
+  ReadCheck(buff, 10);
+  Check("Starting size", buff->getBufferSize(), 1000);
+  // Each time it runs dry it grows by half, up to the limit, and what's read is still the right bytes
+  ReadCheck(buff, buff->getFillLevel() + 1);
+  Check("Grown once", buff->getBufferSize(), 1500);
+  ReadCheck(buff, 10);
+  Check("Fills the grown buffer", buff->getFillLevel(), 1500 - 10);
+  ReadCheck(buff, buff->getFillLevel() + 1);
+  Check("Grown to the limit", buff->getBufferSize(), 2000);
+  ReadCheck(buff, 10);
+  ReadCheck(buff, buff->getFillLevel() + 1);
+  Check("Stays at the limit", buff->getBufferSize(), 2000);
+  ReadCheck(buff, 10);
+  Check("Fills the whole buffer at the limit", buff->getFillLevel(), 2000 - 10);
+  delete buff;
+
+  // One handed in by the app can't be reallocated
+  static uint8_t space[1000];
+  src->seek(0, SEEK_SET);
+  buff = new AudioFileSourceBuffer(src, space, sizeof(space));
+  buff->SetGrowLimit(2000);
+  ReadCheck(buff, 10);
+  ReadCheck(buff, buff->getFillLevel() + 1);
+  Check("App's buffer doesn't grow", buff->getBufferSize(), sizeof(space));
+  delete buff;
+  delete src;
+}
+
+static void TestStats()
+{
+  MemSource *src = new MemSource(100000);
+  AudioFileSourceBuffer *buff = new AudioFileSourceBuffer(src, 4096);
+  ReadCheck(buff, 96);
+  buff->ResetStats();
+  AudioFileSourceBuffer::Stats st;
+  buff->GetStats(&st);
+  Check("minFill after ResetStats()", st.minFill, 4000);
+  Check("avgFill after ResetStats()", st.avgFill, 4000);
+
+  // Draining 100 bytes a read with nothing arriving walks both down
+  for (int i = 0; i < 30; i++) ReadCheck(buff, 100);
+  buff->GetStats(&st);
+  Check("minFill is the lowest level read at", st.minFill, buff->getFillLevel());
+  CheckTrue("avgFill lags behind the level", (st.avgFill > st.minFill) && (st.avgFill < 4000));
+
+  // Rates come out once a second has gone by, over everything since ResetStats():  3200 bytes read
+  // and at most 2 trickles a fill() arriving
+  src->trickle = 200;
+  ReadCheck(buff, 100);
+  usleep(1050 * 1000);
+  ReadCheck(buff, 100);
+  buff->GetStats(&st);
+  CheckTrue("inRate counted", (st.inRate > 0) && (st.inRate <= 800));
+  CheckTrue("outRate counted", (st.outRate > 2000) && (st.outRate <= 3200));
+
+  delete buff;
+  delete src;
+}
+
+static void TestSeek()
+{
+  MemSource *src = new MemSource(100000);
+  AudioFileSourceBuffer *buff = new AudioFileSourceBuffer(src, 3000);
+  buff->SetWatermarks(0, 1000);
+
+  ReadCheck(buff, 500);
+  // A short hop forward stays in the buffer
+  uint32_t seeks = src->seeks;
+  buff->seek(200, SEEK_CUR);
+  Check("Short hop position", buff->getPos(), 700);
+  Check("Short hop doesn't touch the source", src->seeks, seeks);
+  ReadCheck(buff, 100);
+
+  // A longer one goes to the source at the right place, and reading picks up there after refilling
+  uint32_t fill = buff->getFillLevel();
+  buff->seek(fill + 1000, SEEK_CUR);
+  Check("Long hop position", buff->getPos(), 800 + fill + 1000);
+  Check("Long hop seeks the source", src->seeks, seeks + 1);
+  Check("Long hop empties the buffer", buff->getFillLevel(), 0);
+  ReadCheck(buff, 50);
+  Check("Refilled after the long hop", buff->getFillLevel(), 1000 - 50);
+  CheckTrue("Seek isn't an underflow", buff->GetStatusCount(AudioFileSourceBuffer::STATUS_UNDERFLOW) == 0);
+
+  // A read that takes the rest of the buffer and carries on into the source, then one after the refill
+  buff->seek(50000, SEEK_SET);
+  ReadCheck(buff, 10);
+  src->trickle = 700;
+  for (int i = 0; i < 8; i++) buff->loop();
+  src->trickle = 0;
+  CheckTrue("Ring wrapped and full", buff->getFillLevel() > 2000);
+  fill = buff->getFillLevel();
+  Check("Read across the refill", ReadCheck(buff, fill + 1234), fill + 1234);
+  Check("Position after reading across the refill", buff->getPos(), 50000 + 10 + fill + 1234);
+  ReadCheck(buff, 2000);
+
+  // And a mix of everything, with data arriving unevenly, always matching the source
+  srand(1);
+  for (int i = 0; i < 2000; i++) {
+    src->trickle = rand() % 400;
+    if ((rand() % 16) == 0) buff->seek(rand() % 90000, SEEK_SET);
+    else if ((rand() % 8) == 0) buff->seek(rand() % 4000, SEEK_CUR);
+    if (rand() & 1) buff->loop();
+    ReadCheck(buff, 1 + rand() % ((rand() & 7) ? 200 : 4000));
+  }
+
+  delete buff;
+  delete src;
+}
+
+int main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+  TestWatermarks();
+  TestGrowth();
+  TestStats();
+  TestSeek();
+  if (allOk) printf("ok\n");
+  return allOk ? 0 : 1;
+}
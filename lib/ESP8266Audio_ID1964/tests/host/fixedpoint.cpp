@@ -0,0 +1,100 @@
+#include <Arduino.h>
+#include <limits.h>
+#include "libmad/config.h"
+#include "libmad/fixed.h"
+
+// Checks the x86-64/AArch64 fixed-point helpers the host build picks up from libmad's fixed.h and both
+// Helix assembly.h files against the portable C the ESP8266 and ESP32 builds use, over edge cases and
+// a few million random operands of every size.  Each has to come out the same to the bit.
+
+// libhelix-mp3 gets Word64 from mp3dec.h, as an unsigned type
+namespace helixmp3 {
+#define Word64 uint64_t
+#include "libhelix-mp3/assembly.h"
+#undef Word64
+}
+#undef _ASSEMBLY_H
+namespace helixaac {
+#include "libhelix-aac/assembly.h"
+}
+
+// The portable versions, as written for the 32-bit targets, with a 32-bit multiply keeping the low word
+static mad_fixed_t RefMadMul(mad_fixed_t x, mad_fixed_t y) { return (mad_fixed_t)((uint32_t)(x >> 12) * (uint32_t)(y >> 16)); }
+
+static int RefMULSHIFT32(int x, int y) { return (int)((uint64_t)x * (uint64_t)y >> 32); }
+
+static int RefFASTABS(int x)
+{
+  int sign = x >> (sizeof(int) * 8 - 1);
+  x ^= sign;
+  x -= sign;
+  return x;
+}
+
+static int RefCLZ(int x)
+{
+  if (!x) return 32;
+  int numZeros = 0;
+  while (!(x & 0x80000000)) {
+    numZeros++;
+    x <<= 1;
+  }
+  return numZeros;
+}
+
+static long long RefMADD64(long long sum, int x, int y) { return (long long)((uint64_t)sum + (uint64_t)x * (uint64_t)y); }
+
+static uint32_t rng = 2463534242u;
+static int Random()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  // Every magnitude, not just the big numbers most 32-bit values are
+  return (int)rng >> (rng % 32);
+}
+
+static const int edges[] = { 0, 1, -1, 2, -2, 0x7fff, 0x8000, -0x8000, 0xffff, 0x10000, 0x0fffffff, 0x10000000, -0x10000000,
+                             0x40000000, -0x40000000, INT_MAX, INT_MIN, INT_MIN + 1, 0x12345678, -0x12345678 };
+
+static int failures = 0;
+
+static void Check(const char *what, long long got, long long want, int x, int y)
+{
+  if ((got != want) && (failures++ < 10)) printf("%s(%d, %d) = %lld, should be %lld\n", what, x, y, got, want);
+}
+
+static void Pair(int x, int y, long long sum)
+{
+  Check("mad_f_mul", mad_f_mul(x, y), RefMadMul(x, y), x, y);
+  Check("mp3 MULSHIFT32", helixmp3::MULSHIFT32(x, y), RefMULSHIFT32(x, y), x, y);
+  Check("aac MULSHIFT32", helixaac::MULSHIFT32(x, y), RefMULSHIFT32(x, y), x, y);
+  Check("mp3 MADD64", (long long)helixmp3::MADD64(sum, x, y), RefMADD64(sum, x, y), x, y);
+  Check("aac MADD64", helixaac::MADD64(sum, x, y), RefMADD64(sum, x, y), x, y);
+  Check("mp3 SAR64", (long long)helixmp3::SAR64(sum, y & 31), (long long)((uint64_t)sum >> (y & 31)), x, y & 31);
+}
+
+static void Single(int x)
+{
+  Check("mp3 CLZ", helixmp3::CLZ(x), RefCLZ(x), x, 0);
+  Check("aac CLZ", helixaac::CLZ(x), RefCLZ(x), x, 0);
+  Check("mp3 FASTABS", helixmp3::FASTABS(x), RefFASTABS(x), x, 0);
+  Check("aac FASTABS", helixaac::FASTABS(x), RefFASTABS(x), x, 0);
+}
+
+int main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+  for (int x : edges) {
+    Single(x);
+    for (int y : edges) Pair(x, y, ((long long)x << 32) | (uint32_t)y);
+  }
+  for (int i = 0; i < 4000000; i++) {
+    int x = Random(), y = Random();
+    Single(x);
+    Pair(x, y, ((long long)Random() << 32) | (uint32_t)Random());
+  }
+  printf("%s\n", failures ? "DIFFERS" : "ok");
+  return failures ? 1 : 0;
+}
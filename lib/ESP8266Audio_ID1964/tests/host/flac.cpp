@@ -0,0 +1,112 @@
+#include <Arduino.h>
+#include "AudioFileSourcePROGMEM.h"
+#include "AudioGeneratorFLAC.h"
+#include "../../examples/PlayFLACFromPROGMEMToDAC/sample.h"
+
+// Plays the PROGMEM example's FLAC on the heap, then again out of a block of preAllocSize(), which has to
+// play the same audio without the arena ever going past that size.  Then plays it on two decoders at once,
+// each out of its own block and taking turns a loop() at a time, which must keep to their own arenas.
+//
+//   flac
+
+// Just a checksum of the samples
+class AudioOutputSum : public AudioOutput
+{
+  public:
+    virtual bool begin() override { sum = 2166136261u; count = 0; return true; }
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      sum = (sum ^ (uint16_t)sample[LEFTCHANNEL]) * 16777619u;
+      sum = (sum ^ (uint16_t)sample[RIGHTCHANNEL]) * 16777619u;
+      count++;
+      return true;
+    }
+    virtual bool stop() override { return true; }
+    uint32_t sum;
+    uint32_t count;
+};
+
+// Plays the whole sample on each of the n decoders together, returning false unless they all got some audio
+static bool Play(AudioGeneratorFLAC **flac, int n, uint32_t *sum)
+{
+  AudioFileSourcePROGMEM *in[2];
+  AudioOutputSum *out[2];
+  bool ok = true;
+  for (int i = 0; i < n; i++) {
+    in[i] = new AudioFileSourcePROGMEM(sample_flac, sizeof(sample_flac));
+    out[i] = new AudioOutputSum();
+    ok &= flac[i]->begin(in[i], out[i]);
+  }
+  bool running = ok;
+  while (running) {
+    running = false;
+    for (int i = 0; i < n; i++) {
+      if (flac[i]->isRunning()) running |= flac[i]->loop();
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    flac[i]->stop();
+    sum[i] = out[i]->sum;
+    ok &= (out[i]->count > 0);
+    delete out[i];
+    delete in[i];
+  }
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+
+  AudioGeneratorFLAC *flac[2];
+  uint32_t heapSum;
+  flac[0] = new AudioGeneratorFLAC();
+  if (!Play(flac, 1, &heapSum)) {
+    printf("Can't play the sample\n");
+    return 1;
+  }
+  delete flac[0];
+
+  int size = AudioGeneratorFLAC::preAllocSize();
+  void *space[2] = { malloc(size), malloc(size) };
+  bool ok = true;
+
+  flac[0] = new AudioGeneratorFLAC(space[0], size);
+  uint32_t arenaSum;
+  if (!Play(flac, 1, &arenaSum)) {
+    printf("Didn't play from a block of preAllocSize()\n");
+    ok = false;
+  } else if (arenaSum != heapSum) {
+    printf("Playing from the block DIFFERS from the heap\n");
+    ok = false;
+  }
+  int peak = flac[0]->getArenaPeak();
+  printf("preAllocSize() %d bytes, %d used\n", size, peak);
+  if (!peak || (peak > size)) {
+    printf("Arena peak isn't within preAllocSize()\n");
+    ok = false;
+  }
+  delete flac[0];
+
+  flac[0] = new AudioGeneratorFLAC(space[0], size);
+  flac[1] = new AudioGeneratorFLAC(space[1], size);
+  uint32_t bothSum[2];
+  if (!Play(flac, 2, bothSum)) {
+    printf("Didn't play on two decoders at once\n");
+    ok = false;
+  } else if ((bothSum[0] != heapSum) || (bothSum[1] != heapSum)) {
+    printf("Playing on two decoders at once DIFFERS from the heap\n");
+    ok = false;
+  }
+  for (int i = 0; i < 2; i++) {
+    if (!flac[i]->getArenaPeak() || (flac[i]->getArenaPeak() > size)) {
+      printf("Decoder %d's arena peak isn't within preAllocSize()\n", i);
+      ok = false;
+    }
+    delete flac[i];
+    free(space[i]);
+  }
+
+  if (ok) printf("ok\n");
+  return ok ? 0 : 1;
+}
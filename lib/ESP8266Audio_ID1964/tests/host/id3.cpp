@@ -0,0 +1,287 @@
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "AudioFileSourcePROGMEM.h"
+#include "AudioFileSourceID3.h"
+
+// Builds ID3v2.3 and v2.4 tags around some fake audio and reads them through AudioFileSourceID3:  a v2.3
+// one unsynchronized as a whole with an extended header, a frame whose size needs unsync and tags at the
+// end, and a v2.4 one with syncsafe sizes, a frame unsynchronized on its own with a data length indicator
+// and an ID3v1 tag after the audio.  Both have frames that must be skipped unread.  Checks the values the
+// metadata callback gets, and that read() and acquire() both start at exactly the first audio byte and
+// stop at the last.  Prints "ok" when every case passes.
+
+typedef std::vector<uint8_t> Bytes;
+
+static bool allOk = true;
+
+static void Check(const char *name, bool ok)
+{
+  if (!ok) {
+    printf("%s failed\n", name);
+    allOk = false;
+  }
+}
+
+static void Append(Bytes *b, const char *s, int len)
+{
+  b->insert(b->end(), (const uint8_t *)s, (const uint8_t *)s + len);
+}
+
+static void Append(Bytes *b, const Bytes &more)
+{
+  b->insert(b->end(), more.begin(), more.end());
+}
+
+static void BigEndian(Bytes *b, uint32_t v)
+{
+  for (int i = 3; i >= 0; i--) b->push_back((v >> (i * 8)) & 0xff);
+}
+
+static void Syncsafe(Bytes *b, uint32_t v)
+{
+  for (int i = 3; i >= 0; i--) b->push_back((v >> (i * 7)) & 0x7f);
+}
+
+// Puts a 0x00 after every 0xff, which reading takes back out
+static Bytes Unsync(const Bytes &b)
+{
+  Bytes out;
+  for (size_t i = 0; i < b.size(); i++) {
+    out.push_back(b[i]);
+    if (b[i] == 0xff) out.push_back(0);
+  }
+  return out;
+}
+
+// A text frame's body, ISO-8859-1 and no terminator
+static Bytes Text(const std::string &s)
+{
+  Bytes b;
+  b.push_back(0);
+  Append(&b, s.data(), s.size());
+  return b;
+}
+
+static Bytes Frame23(const char *id, const Bytes &body, uint8_t flags2 = 0)
+{
+  Bytes b;
+  Append(&b, id, 4);
+  BigEndian(&b, body.size());
+  b.push_back(0);
+  b.push_back(flags2);
+  Append(&b, body);
+  return b;
+}
+
+static Bytes Frame24(const char *id, const Bytes &body, uint8_t flags2 = 0)
+{
+  Bytes b;
+  Append(&b, id, 4);
+  Syncsafe(&b, body.size());
+  b.push_back(0);
+  b.push_back(flags2);
+  Append(&b, body);
+  return b;
+}
+
+static Bytes Header(int rev, uint8_t flags, uint32_t size)
+{
+  Bytes b;
+  Append(&b, "ID3", 3);
+  b.push_back(rev);
+  b.push_back(0);
+  b.push_back(flags);
+  Syncsafe(&b, size);
+  return b;
+}
+
+// Filler for frames nobody reads, with a false sync in it, and audio with the same
+static Bytes Junk(int len, int seed)
+{
+  Bytes b;
+  for (int i = 0; i < len; i++) b.push_back((i % 50) ? (i * 13 + seed) & 0xff : 0xff);
+  return b;
+}
+
+static Bytes Audio(int len)
+{
+  Bytes b;
+  Append(&b, "\xff\xfb\x90\x00", 4);
+  for (int i = 4; i < len; i++) b.push_back((i * 7) & 0xff);
+  return b;
+}
+
+static Bytes ID3v1()
+{
+  Bytes b;
+  Append(&b, "TAG", 3);
+  b.resize(128, 'x');
+  return b;
+}
+
+static Bytes APE(uint32_t items)
+{
+  // Header and footer are alike but for the flag saying which one it is
+  Bytes b;
+  for (int part = 0; part < 2; part++) {
+    if (part) b.resize(b.size() + items, 'a');
+    Append(&b, "APETAGEX", 8);
+    b.push_back(0xd0); b.push_back(0x07); b.push_back(0); b.push_back(0); // Version 2000
+    uint32_t size = items + 32;
+    for (int i = 0; i < 4; i++) b.push_back((size >> (i * 8)) & 0xff);
+    for (int i = 0; i < 4; i++) b.push_back(0); // Item count
+    b.push_back(0); b.push_back(0); b.push_back(0); b.push_back(part ? 0x80 : 0xa0); // Has a header, is the header
+    b.resize(b.size() + 8, 0);
+  }
+  return b;
+}
+
+typedef struct {
+  std::string title, performer, album, year;
+  int count;
+} Values;
+
+static void MDCallback(void *cbData, const char *type, bool isUnicode, const char *string)
+{
+  (void) isUnicode;
+  Values *v = reinterpret_cast<Values *>(cbData);
+  std::string s(string);
+  if (!strcmp(type, "Title")) v->title = s;
+  else if (!strcmp(type, "Performer")) v->performer = s;
+  else if (!strcmp(type, "Album")) v->album = s;
+  else if (!strcmp(type, "Year")) v->year = s;
+  v->count++;
+}
+
+// Reads the file through the tag parser, with read() or acquire(), and returns what came out as audio
+static Bytes Play(const Bytes &file, bool acquire, Values *v)
+{
+  AudioFileSourcePROGMEM *src = new AudioFileSourcePROGMEM(file.data(), file.size());
+  AudioFileSourceID3 *id3 = new AudioFileSourceID3(src);
+  if (v) {
+    v->count = 0;
+    id3->RegisterMetadataCB(MDCallback, v);
+  }
+  Bytes out;
+  uint8_t buff[333];
+  while (true) {
+    if (acquire) {
+      uint32_t got;
+      const uint8_t *p = id3->acquire(sizeof(buff), &got);
+      if (!p || !got) break;
+      out.insert(out.end(), p, p + got);
+      id3->release(got);
+    } else {
+      uint32_t got = id3->read(buff, sizeof(buff));
+      if (!got) break;
+      out.insert(out.end(), buff, buff + got);
+    }
+  }
+  delete id3;
+  delete src;
+  return out;
+}
+
+static void Test(const char *name, const Bytes &file, const Bytes &audio, const Values &expect)
+{
+  char what[128];
+  for (int acquire = 0; acquire < 2; acquire++) {
+    Values v;
+    Bytes out = Play(file, acquire, &v);
+    const char *how = acquire ? "acquire()" : "read()";
+    snprintf(what, sizeof(what), "%s, %s: audio starts at its first byte and ends at its last", name, how);
+    Check(what, out == audio);
+    snprintf(what, sizeof(what), "%s, %s: title", name, how);
+    Check(what, v.title == expect.title);
+    snprintf(what, sizeof(what), "%s, %s: performer", name, how);
+    Check(what, v.performer == expect.performer);
+    snprintf(what, sizeof(what), "%s, %s: album", name, how);
+    Check(what, v.album == expect.album);
+    snprintf(what, sizeof(what), "%s, %s: year", name, how);
+    Check(what, v.year == expect.year);
+    snprintf(what, sizeof(what), "%s, %s: callback count", name, how);
+    Check(what, v.count == expect.count);
+  }
+  // With nobody listening the tag is skipped whole
+  snprintf(what, sizeof(what), "%s, no callback: audio starts at its first byte and ends at its last", name);
+  Check(what, Play(file, false, NULL) == audio);
+}
+
+static void TestV23()
+{
+  Bytes body;
+  // Extended header:  6 bytes after the size, flags and a padding size
+  BigEndian(&body, 6);
+  body.push_back(0); body.push_back(0);
+  BigEndian(&body, 40);
+  Append(&body, Frame23("TIT2", Text("Caf\xff Song")));
+  Append(&body, Frame23("APIC", Junk(255, 1))); // 255 byte size is ff in the frame header, unsync'd too
+  Append(&body, Frame23("TALB", Junk(30, 2), 0x80)); // Compressed, skipped
+  Append(&body, Frame23("TPE1", Text("Some Band")));
+  Append(&body, Frame23("COMM", Junk(90, 3)));
+  Append(&body, Frame23("TYER", Text("1999")));
+  body.resize(body.size() + 40, 0);
+  Bytes tag = Unsync(body);
+
+  Bytes audio = Audio(3000);
+  Bytes file = Header(3, 0x80 | 0x40, tag.size());
+  Append(&file, tag);
+  Append(&file, audio);
+  Append(&file, APE(100));
+  Append(&file, ID3v1());
+
+  Values expect;
+  expect.title = "Caf\xff Song";
+  expect.performer = "Some Band";
+  expect.album = "";
+  expect.year = "1999";
+  expect.count = 3;
+  Test("v2.3 unsync", file, audio, expect);
+}
+
+static void TestV24()
+{
+  Bytes body;
+  // Unsync'd on its own, with the data length ahead of the unsync'd text
+  Bytes title = Text("\xff\xe0 Intro");
+  Bytes titleBody;
+  Syncsafe(&titleBody, title.size());
+  Append(&titleBody, Unsync(title));
+  Append(&body, Frame24("TIT2", titleBody, 0x02 | 0x01));
+  Append(&body, Frame24("APIC", Junk(300, 4))); // Over 127 bytes, so the syncsafe size matters
+  Append(&body, Frame24("TPE1", Text("Another Band")));
+  Append(&body, Frame24("TALB", Junk(20, 5), 0x04)); // Encrypted, skipped
+  Append(&body, Frame24("TDRC", Text("2004")));
+  Append(&body, Frame24("PRIV", Junk(200, 6)));
+  body.resize(body.size() + 100, 0);
+
+  Bytes audio = Audio(5000);
+  Bytes file = Header(4, 0, body.size());
+  Append(&file, body);
+  Append(&file, audio);
+  Append(&file, ID3v1());
+
+  Values expect;
+  expect.title = "\xff\xe0 Intro";
+  expect.performer = "Another Band";
+  expect.album = "";
+  expect.year = "2004";
+  expect.count = 3;
+  Test("v2.4 with ID3v1", file, audio, expect);
+
+  // No tags at all goes straight through
+  Values none;
+  none.count = 0;
+  Test("No tags", audio, audio, none);
+}
+
+int main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+  TestV23();
+  TestV24();
+  if (allOk) printf("ok\n");
+  return allOk ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+#include <Arduino.h>
+#include "AudioFileSourceSTDIO.h"
+#include "AudioGeneratorMIDI.h"
+
+// Plays the MIDI example's song once on the heap to learn what it needs, then again out of a block of
+// exactly the preAllocSize() that comes to, which has to begin() and play the same audio through.
+//
+//   midi [song.mid] [soundfont.sf2]
+
+// Just a checksum of the samples
+class AudioOutputSum : public AudioOutput
+{
+  public:
+    virtual bool begin() override { sum = 2166136261u; count = 0; return true; }
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      sum = (sum ^ (uint16_t)sample[LEFTCHANNEL]) * 16777619u;
+      count++;
+      return true;
+    }
+    virtual bool stop() override { return true; }
+    uint32_t sum;
+    uint32_t count;
+};
+
+static bool Play(AudioGeneratorMIDI *midi, const char *mid, const char *sf2, uint32_t *sum, int *events)
+{
+  AudioFileSourceSTDIO *sf = new AudioFileSourceSTDIO(sf2);
+  AudioFileSourceSTDIO *in = new AudioFileSourceSTDIO(mid);
+  AudioOutputSum *out = new AudioOutputSum();
+  midi->SetSoundfont(sf);
+  bool ok = midi->begin(in, out);
+  // The timeline goes at stop()
+  *events = midi->getTimelineEvents();
+  if (ok) {
+    while (midi->loop()) { /*noop*/ }
+    midi->stop();
+  }
+  *sum = out->sum;
+  ok &= (out->count > 0);
+  delete out;
+  delete in;
+  delete sf;
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  const char *mid = (argc > 1) ? argv[1] : "../../examples/PlayMIDIFromSPIFFS/data/furelise.mid";
+  const char *sf2 = (argc > 2) ? argv[2] : "../../examples/PlayMIDIFromSPIFFS/data/1mgm.sf2";
+
+  AudioGeneratorMIDI *midi = new AudioGeneratorMIDI();
+  uint32_t heapSum;
+  int events;
+  if (!Play(midi, mid, sf2, &heapSum, &events)) {
+    printf("Can't play %s with %s\n", mid, sf2);
+    return 1;
+  }
+  AudioGeneratorMIDI::SongStats song;
+  midi->GetSongStats(&song);
+  AudioGeneratorMIDI::VoiceStats voices;
+  midi->GetVoiceStats(&voices);
+  int size = AudioGeneratorMIDI::preAllocSize(0, song.presets, song.regions, voices.peak, events);
+  delete midi;
+
+  void *space = malloc(size);
+  midi = new AudioGeneratorMIDI(space, size);
+  uint32_t arenaSum;
+  bool ok = Play(midi, mid, sf2, &arenaSum, &events);
+  printf("%d presets, %d regions, %d voices, %d events:  preAllocSize() %d bytes, %d used\n", song.presets, song.regions,
+         voices.peak, events, size, midi->getArenaPeak());
+  delete midi;
+  free(space);
+
+  if (!ok) printf("Didn't play from a block of preAllocSize()\n");
+  else if (arenaSum != heapSum) printf("Playing from the block DIFFERS from the heap\n");
+  else printf("ok\n");
+  return (ok && (arenaSum == heapSum)) ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include <Arduino.h>
+#include <limits.h>
+#define TSF_IMPLEMENTATION
+#include "libtinysoundfont/tsf.h"
+
+// Holds chords of 1 to 32 notes on the example SoundFont's sustained instruments and times rendering
+// them through tsf_render_short(), the integer renderer AudioGeneratorMIDI uses, against the float one
+// behind tsf_render_float().  Reports voices kept going in real time per MHz of this CPU (the float
+// numbers flatter it here, the ESP8266 has to do every float operation in software), and checks the
+// integer output comes out identically every time.  Then plays the biggest chord again under an 8 voice
+// cap with each way of stealing voices, checks the cap holds, and checks which voice each one takes.
+//
+//   midibench [cpu MHz] [soundfont.sf2]
+
+static const int rate = 44100;
+static const int seconds = 10;
+static const int presets[] = { 19, 48, 52, 73 }; // Organ, strings, choir, flute:  looped, so they hold
+
+static tsf *Chord(const char *sf2, int notes, int cap = 0, enum TSFStealPolicy policy = TSF_STEAL_QUIETEST)
+{
+  tsf *f = tsf_load_filename(sf2);
+  if (!f) return NULL;
+  tsf_set_output(f, TSF_MONO, rate, -10);
+  tsf_set_max_voices(f, cap, policy);
+  // Each instrument at its own priority, for TSF_STEAL_LOWEST_PRIORITY
+  for (int i = 0; i < notes; i++) tsf_note_on_priority(f, presets[i % 4], 40 + (i * 7) % 48, 0.8f, i % 4);
+  return f;
+}
+
+static int Playing(tsf *f)
+{
+  int n = 0;
+  for (int i = 0; i < f->voiceNum; i++) n += (f->voices[i].playingPreset != -1);
+  return n;
+}
+
+// Voice samples rendered per microsecond, and a checksum of the output when it's the integer renderer
+static double Render(const char *sf2, int notes, bool fixed, uint32_t *sum)
+{
+  tsf *f = Chord(sf2, notes);
+  short out[256];
+  float outf[256];
+  uint64_t voiceSamples = 0;
+  uint32_t hash = 2166136261u;
+  unsigned long us = 0;
+  for (int done = 0; done < rate * seconds; done += 256) {
+    voiceSamples += (uint64_t)Playing(f) * 256;
+    unsigned long start = micros();
+    if (fixed) tsf_render_short(f, out, 256, 0);
+    else tsf_render_float(f, outf, 256, 0);
+    us += micros() - start;
+    if (fixed) for (int i = 0; i < 256; i++) hash = (hash ^ (uint16_t)out[i]) * 16777619u;
+  }
+  tsf_close(f);
+  if (sum) *sum = hash;
+  return (double)voiceSamples / (us ? us : 1);
+}
+
+// Whether the 32 note chord stays within the cap, while every note asks for a voice
+static bool Capped(const char *sf2, enum TSFStealPolicy policy, const char *name)
+{
+  const int cap = 8;
+  tsf *f = Chord(sf2, 32, cap, policy);
+  short out[256];
+  int most = 0;
+  for (int done = 0; done < rate; done += 256) {
+    tsf_render_short(f, out, 256, 0);
+    if (tsf_active_voice_count(f) > most) most = tsf_active_voice_count(f);
+  }
+  struct tsf_voice_stats stats;
+  tsf_get_voice_stats(f, &stats);
+  bool ok = (stats.peak <= cap) && (most <= cap) && (f->voiceNum <= cap + 4);
+  printf("%-16s peak %2d, %2d stolen, %2d voice slots%s\n", name, stats.peak, stats.stolen, f->voiceNum, ok ? "" : "  OVER THE CAP");
+  tsf_close(f);
+  return ok;
+}
+
+// Which voice each policy gives up, out of four set up by hand:  0 the oldest, held and loud; 1 let go
+// of and loud but a notch more important; 2 held and quietest; 3 the newest, let go of and loud.
+static bool Victims(const char *sf2)
+{
+  static const struct {
+    enum TSFStealPolicy policy;
+    const char *name;
+    int priority[4];
+    int expect;
+  } cases[] = {
+    { TSF_STEAL_QUIETEST,         "quietest",        { 0, 1, 0, 0 }, 2 },
+    { TSF_STEAL_OLDEST_RELEASED,  "oldest released", { 0, 1, 0, 0 }, 1 },
+    { TSF_STEAL_LOWEST_PRIORITY,  "lowest priority", { 0, 1, 0, 0 }, 3 }, // Released first among the lowest
+    { TSF_STEAL_LOWEST_PRIORITY,  "lowest priority", { 0, 0, 0, 0 }, 1 }, // The older released
+    { TSF_STEAL_LOWEST_PRIORITY,  "lowest priority", { -5, 1, 0, 0 }, 0 }, // Below zero beats released
+    { TSF_STEAL_LOWEST_PRIORITY,  "lowest priority", { INT_MIN, INT_MAX, INT_MAX, INT_MAX }, 0 },
+    { TSF_STEAL_LOWEST_PRIORITY,  "lowest priority", { INT_MAX, INT_MAX, INT_MIN + 1, INT_MAX }, 2 },
+  };
+  tsf *f = Chord(sf2, 4);
+  bool ok = true;
+  for (unsigned c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    for (int i = 0; i < f->voiceNum; i++) f->voices[i].playingPreset = -1;
+    for (int i = 0; i < 4; i++) {
+      struct tsf_voice *v = &f->voices[i];
+      v->playingPreset = 0;
+      v->stolen = TSF_FALSE;
+      v->playIndex = 100 + i;
+      v->priority = cases[c].priority[i];
+      v->noteGainF16P16 = 1 << 16;
+      v->ampenv.levelF8P24 = (i == 2) ? (1 << 20) : (1 << 24);
+      v->ampenv.segment = ((i == 1) || (i == 3)) ? TSF_SEGMENT_RELEASE : TSF_SEGMENT_SUSTAIN;
+    }
+    f->stealPolicy = cases[c].policy;
+    struct tsf_voice *v = tsf_voice_victim(f, 200);
+    int got = v ? (int)(v - f->voices) : -1;
+    if (got != cases[c].expect) {
+      printf("%-16s took voice %d instead of %d\n", cases[c].name, got, cases[c].expect);
+      ok = false;
+    }
+  }
+  tsf_close(f);
+  if (ok) printf("Each policy takes the expected voice\n");
+  return ok;
+}
+
+static double CpuMHz()
+{
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+  char line[256];
+  double mhz = 0;
+  while (fp && fgets(line, sizeof(line), fp) && !mhz) sscanf(line, "cpu MHz : %lf", &mhz);
+  if (fp) fclose(fp);
+  return mhz;
+}
+
+int main(int argc, char **argv)
+{
+  double mhz = (argc > 1) ? atof(argv[1]) : CpuMHz();
+  const char *sf2 = (argc > 2) ? argv[2] : "../../examples/PlayMIDIFromSPIFFS/data/1mgm.sf2";
+  tsf *f = tsf_load_filename(sf2);
+  if (!f) {
+    printf("Can't load %s\n", sf2);
+    return 1;
+  }
+  tsf_close(f);
+  if (mhz <= 0) {
+    printf("Don't know the CPU clock, give it in MHz on the command line.  Assuming 1000.\n");
+    mhz = 1000;
+  }
+
+  bool same = true;
+  printf("%d seconds at %d Hz, %.0f MHz\n", seconds, rate, mhz);
+  printf("%6s %16s %16s %8s %10s\n", "notes", "int voices/MHz", "float voices/MHz", "int/float", "checksum");
+  static const int chords[] = { 1, 4, 8, 16, 32 };
+  for (int i = 0; i < 5; i++) {
+    uint32_t sum, again;
+    // Voices per MHz is voice-samples per microsecond over samples per second of one voice, times a million
+    double fixedRate = Render(sf2, chords[i], true, &sum);
+    Render(sf2, chords[i], true, &again);
+    double floatRate = Render(sf2, chords[i], false, NULL);
+    printf("%6d %16.2f %16.2f %8.2f   %08x%s\n", chords[i], fixedRate * 1e6 / rate / mhz, floatRate * 1e6 / rate / mhz,
+           fixedRate / floatRate, sum, (sum == again) ? "" : " DIFFERS");
+    same &= (sum == again);
+  }
+
+  printf("32 notes, 8 voice cap:\n");
+  bool capped = Capped(sf2, TSF_STEAL_QUIETEST, "quietest");
+  capped &= Capped(sf2, TSF_STEAL_OLDEST_RELEASED, "oldest released");
+  capped &= Capped(sf2, TSF_STEAL_LOWEST_PRIORITY, "lowest priority");
+  capped &= Victims(sf2);
+  return (same && capped) ? 0 : 1;
+}
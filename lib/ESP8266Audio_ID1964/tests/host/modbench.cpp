@@ -0,0 +1,151 @@
+#include <Arduino.h>
+#include <algorithm>
+#include <vector>
+#include "AudioFileSourcePROGMEM.h"
+#include "AudioGeneratorMOD.h"
+#include "../../examples/PlayMODFromPROGMEMToDAC/enigma.h"
+
+// Plays the first minute of the PROGMEM example's MOD with its samples streamed through the per-channel
+// buffers, mixed in place from a source that lends its memory, and preloaded into RAM, and times each.
+// Reports the CPU each channel costs in MHz of this CPU, the reads and seeks it took, and checks every
+// way of getting at the samples mixes exactly the same audio.  Then does the same for copies of the song
+// with its 4 channels repeated out to 6, 8, 16 and 32, and an FLT8 one laid out the StarTrekker way.
+// Repeating all 4 channels the same number of times mixes to exactly the 4 channel song's audio.
+//
+//   modbench [cpu MHz]
+
+static const int seconds = 60;
+
+// Counts what the generator asks of the source, and can refuse to lend so samples have to stream
+class AudioFileSourceCount : public AudioFileSourcePROGMEM
+{
+  public:
+    AudioFileSourceCount(const void *data, uint32_t len, bool lend) : AudioFileSourcePROGMEM(data, len), lend(lend) { reads = seeks = 0; }
+    virtual uint32_t read(void *data, uint32_t len) override { reads++; return AudioFileSourcePROGMEM::read(data, len); }
+    virtual bool seek(int32_t pos, int dir) override { seeks++; return AudioFileSourcePROGMEM::seek(pos, dir); }
+    virtual const uint8_t *acquire(uint32_t len, uint32_t *avail) override {
+      if (lend) return AudioFileSourcePROGMEM::acquire(len, avail);
+      *avail = 0;
+      return NULL;
+    }
+    bool lend;
+    uint32_t reads, seeks;
+};
+
+// Just a checksum of the samples, so the timing is the mixer's
+class AudioOutputSum : public AudioOutput
+{
+  public:
+    virtual bool begin() override { sum = 2166136261u; return true; }
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      sum = (sum ^ (uint16_t)sample[LEFTCHANNEL]) * 16777619u;
+      sum = (sum ^ (uint16_t)sample[RIGHTCHANNEL]) * 16777619u;
+      return true;
+    }
+    virtual bool stop() override { return true; }
+    uint32_t sum;
+};
+
+// The example song with each row's 4 channels repeated out to channels, under that tag.  FLT8 stores
+// every 8 channel pattern as a 4 channel one for channels 0-3 and the next for 4-7, numbered in 4
+// channel patterns in the order list.
+static std::vector<uint8_t> Widen(int channels, const char *tag)
+{
+  const int rowBytes = 4 * 4;
+  const uint8_t *order = enigma_mod + 952;
+  int patterns = 0;
+  for (int i = 0; i < 128; i++) patterns = std::max(patterns, order[i] + 1);
+  const uint8_t *pattern = enigma_mod + 1084;
+  const uint8_t *samples = pattern + patterns * 64 * rowBytes;
+  bool flt8 = !strcmp(tag, "FLT8");
+
+  std::vector<uint8_t> mod(enigma_mod, enigma_mod + 1080);
+  if (flt8) for (int i = 0; i < 128; i++) mod[952 + i] *= 2;
+  mod.insert(mod.end(), tag, tag + 4);
+  for (int p = 0; p < patterns; p++) {
+    const uint8_t *rows = pattern + p * 64 * rowBytes;
+    if (flt8) {
+      mod.insert(mod.end(), rows, rows + 64 * rowBytes);
+      mod.insert(mod.end(), rows, rows + 64 * rowBytes);
+      continue;
+    }
+    for (int r = 0; r < 64; r++)
+      for (int c = 0; c < channels; c++) mod.insert(mod.end(), rows + r * rowBytes + (c % 4) * 4, rows + r * rowBytes + (c % 4) * 4 + 4);
+  }
+  mod.insert(mod.end(), samples, enigma_mod + sizeof(enigma_mod));
+  return mod;
+}
+
+static double CpuMHz()
+{
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+  char line[256];
+  double mhz = 0;
+  while (fp && fgets(line, sizeof(line), fp) && !mhz) sscanf(line, "cpu MHz : %lf", &mhz);
+  if (fp) fclose(fp);
+  return mhz;
+}
+
+static const char *modes[] = { "streamed", "lent", "loaded" };
+
+static uint32_t Play(const char *name, const uint8_t *song, uint32_t len, bool lend, bool preload, bool interpolate, double mhz)
+{
+  AudioFileSourceCount *in = new AudioFileSourceCount(song, len, lend);
+  AudioOutputSum *out = new AudioOutputSum();
+  AudioGeneratorMOD *mod = new AudioGeneratorMOD();
+  mod->SetPreload(preload);
+  mod->SetInterpolation(interpolate);
+  mod->SetLoopBudget(0, 2048);
+  unsigned long start = micros();
+  if (!mod->begin(in, out)) printf("%s didn't begin\n", name);
+  unsigned long loaded = micros();
+  int channels = mod->GetChannels();
+  // The song loops forever, so stop after a minute of it
+  while (mod->loop() && (mod->tell() < seconds * 1000)) { /*noop*/ }
+  unsigned long us = micros() - loaded;
+  int data = mod->GetSampleData();
+  mod->stop();
+  // MHz spent per channel is the share of real time it took, times the clock, over the channels
+  printf("%-28s %-8s %8.2f %8.2f %8u %8u   %08x\n", name, modes[data], (double)us / (seconds * 1e6) * mhz / std::max(channels, 1),
+         (double)(loaded - start) / 1000, in->reads, in->seeks, out->sum);
+  uint32_t sum = out->sum;
+  delete mod;
+  delete out;
+  delete in;
+  return sum;
+}
+
+int main(int argc, char **argv)
+{
+  double mhz = (argc > 1) ? atof(argv[1]) : CpuMHz();
+  if (mhz <= 0) {
+    printf("Don't know the CPU clock, give it in MHz on the command line.  Assuming 1000.\n");
+    mhz = 1000;
+  }
+
+  printf("%d seconds of 4 channels, %.0f MHz\n", seconds, mhz);
+  printf("%-28s %-8s %8s %8s %8s %8s   %8s\n", "", "samples", "MHz/chan", "begin ms", "reads", "seeks", "checksum");
+  uint32_t streamed = Play("buffer per channel", enigma_mod, sizeof(enigma_mod), false, false, true, mhz);
+  uint32_t lent = Play("lent by the source", enigma_mod, sizeof(enigma_mod), true, false, true, mhz);
+  uint32_t loaded = Play("preloaded", enigma_mod, sizeof(enigma_mod), false, true, true, mhz);
+  Play("preloaded, no interpolation", enigma_mod, sizeof(enigma_mod), false, true, false, mhz);
+  bool same = (streamed == lent) && (lent == loaded);
+  if (!same) printf("Mixing from memory DIFFERS from streaming\n");
+
+  printf("\nThe same song widened, preloaded\n");
+  static const struct { int channels; const char *tag; } widths[] = {
+    { 6, "6CHN" }, { 8, "8CHN" }, { 8, "FLT8" }, { 16, "16CH" }, { 32, "32CH" }
+  };
+  bool widened = true;
+  for (auto w : widths) {
+    std::vector<uint8_t> song = Widen(w.channels, w.tag);
+    char name[32];
+    snprintf(name, sizeof(name), "%d channels, %s", w.channels, w.tag);
+    uint32_t sum = Play(name, song.data(), song.size(), false, true, true, mhz);
+    if ((w.channels % 4 == 0) && (sum != loaded)) {
+      printf("%s DIFFERS from the 4 channel song\n", name);
+      widened = false;
+    }
+  }
+  return (same && widened) ? 0 : 1;
+}
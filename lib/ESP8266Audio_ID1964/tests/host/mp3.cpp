@@ -54,8 +54,8 @@ int main(int argc, char **argv)
     out->SetFilename("jamonit.wav");
     AudioOutputMixer *mix = new AudioOutputMixer(17, out);
     AudioOutputMixerStub *stub = mix->NewInput();
-    void *space = malloc(29192);
-    AudioGeneratorMP3 *mp3 = new AudioGeneratorMP3(space, 29192);
+    void *space = malloc(AudioGeneratorMP3::preAllocSize());
+    AudioGeneratorMP3 *mp3 = new AudioGeneratorMP3(space, AudioGeneratorMP3::preAllocSize());
 
     mp3->begin(id3, stub);
     while (mp3->loop()) { /*noop*/ }
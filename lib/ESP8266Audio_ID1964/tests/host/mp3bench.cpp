@@ -0,0 +1,162 @@
+#include <Arduino.h>
+#include <math.h>
+#include <vector>
+#include "AudioFileSourceMMAP.h"
+#include "AudioGeneratorMP3.h"
+#include "AudioGeneratorMP3a.h"
+
+// Times AudioGeneratorMP3 decoding jamonit.mp3 (or the file given) with each of its cheaper decode modes
+// against a full decode, and checks what comes out:  just the left or right channel has to be exactly that
+// channel of the full decode, the mono mix has to be close to the full decode's two channels averaged,
+// and a mono output has to get the mix without being asked.  Half rate is only timed, there's
+// nothing to hold it to bit for bit.  The Helix decoder behind AudioGeneratorMP3a is timed on the same file
+// for comparison.  Both are fed from a memory mapped file, which lends its bytes, so neither should copy any.
+//
+//   mp3bench [file.mp3]
+
+// Counts the bytes the decoders had to copy out of the file instead of being lent
+class AudioFileSourceCount : public AudioFileSourceMMAP
+{
+  public:
+    AudioFileSourceCount(const char *name) : AudioFileSourceMMAP(name) { copied = 0; }
+    virtual uint32_t read(void *data, uint32_t len) override { uint32_t got = AudioFileSourceMMAP::read(data, len); copied += got; return got; }
+    uint32_t copied;
+};
+
+// Keeps every sample it's given, as one channel when it's only given one.  The very first is the silent
+// sample loop() sends before anything is decoded, when the channels aren't known yet, so that's dropped.
+class AudioOutputCollect : public AudioOutput
+{
+  public:
+    AudioOutputCollect(bool mono = false) : mono(mono) { }
+    virtual bool begin() override { samples.clear(); first = true; return true; }
+    virtual bool IsMono() override { return mono; }
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      if (first) {
+        first = false;
+        return true;
+      }
+      samples.push_back(sample[LEFTCHANNEL]);
+      if (channels == 2) samples.push_back(sample[RIGHTCHANNEL]);
+      return true;
+    }
+    virtual bool stop() override { return true; }
+    int getRate() { return hertz; }
+    int getChannels() { return channels; }
+    std::vector<int16_t> samples;
+    bool mono;
+    bool first;
+};
+
+typedef struct {
+  unsigned long us;
+  uint32_t copied;
+  int rate;
+  int channels;
+  std::vector<int16_t> samples;
+} Decoded;
+
+// Best of three, as the first pass also pages the file in.  A mode of -1 decodes with Helix instead.
+static Decoded Decode(const char *name, int mode, bool monoOutput = false)
+{
+  Decoded d;
+  d.us = ~0UL;
+  for (int i = 0; i < 3; i++) {
+    AudioFileSourceCount *in = new AudioFileSourceCount(name);
+    AudioOutputCollect *out = new AudioOutputCollect(monoOutput);
+    AudioGenerator *mp3;
+    if (mode < 0) {
+      mp3 = new AudioGeneratorMP3a();
+    } else {
+      AudioGeneratorMP3 *mad = new AudioGeneratorMP3();
+      mad->SetDecodeMode(mode);
+      mp3 = mad;
+    }
+    unsigned long start = micros();
+    mp3->begin(in, out);
+    while (mp3->loop()) { /*noop*/ }
+    mp3->stop();
+    unsigned long us = micros() - start;
+    if (us < d.us) d.us = us ? us : 1;
+    d.copied = in->copied;
+    d.rate = out->getRate();
+    d.channels = out->getChannels();
+    d.samples = out->samples;
+    delete mp3;
+    delete out;
+    delete in;
+  }
+  return d;
+}
+
+// One channel of a stereo decode, or the two averaged for channel -1
+static std::vector<int16_t> Channel(const Decoded &d, int channel)
+{
+  std::vector<int16_t> v;
+  for (size_t i = 0; i + 1 < d.samples.size(); i += 2)
+    v.push_back((channel < 0) ? (d.samples[i] + d.samples[i + 1]) >> 1 : d.samples[i + channel]);
+  return v;
+}
+
+static double SNR(const std::vector<int16_t> &ref, const std::vector<int16_t> &test)
+{
+  double sig = 0, err = 0;
+  size_t n = (ref.size() < test.size()) ? ref.size() : test.size();
+  for (size_t i = 0; i < n; i++) {
+    double e = (double)ref[i] - test[i];
+    sig += (double)ref[i] * ref[i];
+    err += e * e;
+  }
+  return err ? 10 * log10(sig / err) : 999;
+}
+
+int main(int argc, char **argv)
+{
+  const char *name = (argc > 1) ? argv[1] : "jamonit.mp3";
+  Decoded full = Decode(name, AudioGeneratorMP3::DECODE_FULL);
+  if (!full.samples.size()) {
+    printf("Can't decode %s\n", name);
+    return 1;
+  }
+  double secs = (double)full.samples.size() / full.channels / full.rate;
+  printf("%.1f seconds, %d Hz, %d channel(s)\n", secs, full.rate, full.channels);
+  printf("%-18s %6s %3s %9s %9s %8s %8s\n", "mode", "Hz", "ch", "ms", "xrealtime", "cost", "SNR dB");
+  printf("%-18s %6d %3d %9.1f %9.1f %8.2f %8s\n", "full", full.rate, full.channels, full.us / 1000.0, secs * 1e6 / full.us, 1.0, "-");
+
+  static const struct { const char *name; int mode; bool monoOutput; int channel; } modes[] = {
+    { "ignore CRC",       AudioGeneratorMP3::DECODE_IGNORECRC, false, -2 },
+    { "mono",             AudioGeneratorMP3::DECODE_MONO,      false, -1 },
+    { "left",             AudioGeneratorMP3::DECODE_LEFT,      false,  0 },
+    { "right",            AudioGeneratorMP3::DECODE_RIGHT,     false,  1 },
+    { "mono output",      AudioGeneratorMP3::DECODE_FULL,      true,  -1 },
+    { "half rate",        AudioGeneratorMP3::DECODE_HALFRATE,  false, -2 },
+    { "half rate, mono",  AudioGeneratorMP3::DECODE_HALFRATE | AudioGeneratorMP3::DECODE_MONO, false, -2 },
+    { "Helix (MP3a)",     -1,                                  false, -2 }
+  };
+  bool ok = true;
+  uint32_t copied = full.copied;
+  for (auto m : modes) {
+    Decoded d = Decode(name, m.mode, m.monoOutput);
+    copied += d.copied;
+    // The cost is the share of the full decode's time this mode takes
+    printf("%-18s %6d %3d %9.1f %9.1f %8.2f ", m.name, d.rate, d.channels, d.us / 1000.0, secs * 1e6 / d.us, (double)d.us / full.us);
+    if (m.channel == -2) {
+      printf("%8s\n", "-");
+      continue;
+    }
+    if (full.channels != 2) {
+      printf("%8s\n", "mono file");
+      continue;
+    }
+    std::vector<int16_t> ref = Channel(full, m.channel);
+    double snr = SNR(ref, d.samples);
+    // A single channel is the same sums as in the full decode.  The mix is taken ahead of the IMDCT and
+    // synthesis, whose multiplies (FPM_DEFAULT's drop the low 14 bits of each side) come out a few LSBs
+    // differently on it than on the two channels, so it's only held to being well within that noise.
+    bool good = (d.channels == 1) && (ref.size() == d.samples.size()) && ((m.channel < 0) ? (snr > 50) : (snr == 999));
+    printf("%8.1f%s\n", snr, good ? "" : "  WRONG");
+    ok &= good;
+  }
+  if (copied) printf("%u bytes were copied out of the mapped file instead of lent\n", copied);
+  return (ok && !copied) ? 0 : 1;
+}
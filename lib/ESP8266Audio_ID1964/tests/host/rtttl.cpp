@@ -0,0 +1,145 @@
+#include <Arduino.h>
+#include <vector>
+#include "AudioFileSourcePROGMEM.h"
+#include "AudioGeneratorRTTTL.h"
+
+// Plays a known RTTTL song and checks it compiles to the right notes and lengths, plays exactly that
+// many samples, keeps within its quarter of full scale with both channels the same, has no DC offset
+// in any note and is silent in the rests.  Then plays it again out of a block of preAllocSize() and to
+// an output that keeps refusing samples, which must both come out the same.  Prints "ok" when every
+// check passes.
+
+static const char song[] = "Test:d=4,o=5,b=120:8c,8d,e.,p,16f#6,4g7,2a4,8b.,C,8b5.,32p,8a#";
+
+// Note number (1-48 from C4, 0 for a rest) and length in ms of each, at 120bpm a whole note is 2s
+static const struct {
+  int note;
+  int ms;
+} expect[] = {
+  { 13, 250 }, { 15, 250 }, { 17, 750 }, { 0, 500 }, { 31, 125 }, { 44, 500 }, { 10, 1000 },
+  { 24, 375 }, { 13, 500 }, { 24, 375 }, { 0, 62 }, { 23, 250 }
+};
+static const int expectNotes = sizeof(expect) / sizeof(expect[0]);
+
+static bool allOk = true;
+
+static void Check(const char *name, bool ok)
+{
+  if (!ok) {
+    printf("%s failed\n", name);
+    allOk = false;
+  }
+}
+
+// Lets the test see the compiled song
+class AudioGeneratorRTTTLProbe : public AudioGeneratorRTTTL
+{
+  public:
+    AudioGeneratorRTTTLProbe() : AudioGeneratorRTTTL() {}
+    AudioGeneratorRTTTLProbe(void *space, int size) : AudioGeneratorRTTTL(space, size) {}
+    int Notes() const { return songNotes; }
+    int Note(int i) const { return song[i] >> NOTESHIFT; }
+    int Samples(int i) const { return song[i] & SAMPLEMASK; }
+};
+
+// Keeps every sample, optionally refusing every few calls like a full DMA buffer would
+class AudioOutputKeep : public AudioOutput
+{
+  public:
+    AudioOutputKeep(bool stingy) : stingy(stingy) { calls = 0; }
+    virtual bool begin() override { return true; }
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      if (stingy && ((++calls % 7) == 0)) return false;
+      left.push_back(sample[LEFTCHANNEL]);
+      right.push_back(sample[RIGHTCHANNEL]);
+      return true;
+    }
+    virtual bool stop() override { return true; }
+    bool stingy;
+    int calls;
+    std::vector<int16_t> left, right;
+};
+
+static std::vector<int16_t> Play(AudioGeneratorRTTTLProbe *rtttl, bool stingy, bool checkSong)
+{
+  AudioFileSourcePROGMEM *in = new AudioFileSourcePROGMEM(song, strlen(song));
+  AudioOutputKeep *out = new AudioOutputKeep(stingy);
+  bool ok = rtttl->begin(in, out);
+  Check("begin()", ok);
+  if (ok && checkSong) {
+    Check("Note count", rtttl->Notes() == expectNotes);
+    for (int i = 0; (i < rtttl->Notes()) && (i < expectNotes); i++) {
+      char what[64];
+      snprintf(what, sizeof(what), "Note %d pitch", i);
+      Check(what, rtttl->Note(i) == expect[i].note);
+      snprintf(what, sizeof(what), "Note %d length", i);
+      Check(what, rtttl->Samples(i) == (22050 * expect[i].ms) / 1000);
+    }
+  }
+  while (ok && rtttl->loop()) { /*noop*/ }
+  rtttl->stop();
+  Check("Both channels the same", out->left == out->right);
+  std::vector<int16_t> samples = out->left;
+  delete out;
+  delete in;
+  return samples;
+}
+
+int main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+
+  AudioGeneratorRTTTLProbe *rtttl = new AudioGeneratorRTTTLProbe();
+  std::vector<int16_t> out = Play(rtttl, false, true);
+  delete rtttl;
+
+  // Exactly the notes' samples, and each note on its own
+  size_t total = 0;
+  for (int i = 0; i < expectNotes; i++) total += (22050 * expect[i].ms) / 1000;
+  Check("Samples played", out.size() == total);
+  size_t pos = 0;
+  int peak = 0;
+  for (int i = 0; (i < expectNotes) && (pos < out.size()); i++) {
+    size_t n = (22050 * expect[i].ms) / 1000;
+    if (pos + n > out.size()) n = out.size() - pos;
+    int64_t sum = 0;
+    int notePeak = 0;
+    for (size_t j = pos; j < pos + n; j++) {
+      sum += out[j];
+      if (abs(out[j]) > notePeak) notePeak = abs(out[j]);
+    }
+    char what[64];
+    if (!expect[i].note) {
+      snprintf(what, sizeof(what), "Rest %d is silent", i);
+      Check(what, !notePeak);
+    } else {
+      // A square wave has none, but each note starts on the high half so a part cycle is left over
+      // at the end:  no more than half a cycle's worth, half a cycle of C4 at 22050Hz is 42 samples
+      snprintf(what, sizeof(what), "Note %d has no DC offset", i);
+      Check(what, llabs(sum) <= 42LL * 8192);
+      snprintf(what, sizeof(what), "Note %d is loud enough", i);
+      Check(what, notePeak > 6000);
+    }
+    if (notePeak > peak) peak = notePeak;
+    pos += n;
+  }
+  Check("Output within a quarter of full scale", peak <= 8192);
+  int64_t sum = 0;
+  for (size_t i = 0; i < out.size(); i++) sum += out[i];
+  Check("No DC offset over the song", llabs(sum / (int64_t)out.size()) < 32);
+
+  int size = AudioGeneratorRTTTL::preAllocSize(strlen(song));
+  void *space = malloc(size);
+  rtttl = new AudioGeneratorRTTTLProbe(space, size);
+  Check("Preallocated plays the same", Play(rtttl, false, true) == out);
+  delete rtttl;
+  free(space);
+
+  rtttl = new AudioGeneratorRTTTLProbe();
+  Check("Refused samples are played later", Play(rtttl, true, false) == out);
+  delete rtttl;
+
+  if (allOk) printf("ok\n");
+  return allOk ? 0 : 1;
+}
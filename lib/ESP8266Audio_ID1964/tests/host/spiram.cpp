@@ -0,0 +1,106 @@
+#include <Arduino.h>
+#include <vector>
+#include "AudioFileSourceSTDIO.h"
+#include "AudioFileSourceSPIRAMBuffer.h"
+
+// Streams jamonit.mp3 through AudioFileSourceSPIRAMBuffer with a fake RAM chip and a source
+// that trickles data in like a socket would, checks every byte comes out in order, and
+// reports how many SPI transactions it took against one per read and per 128 bytes written.
+
+// Rough cost of a 23LC1024 transaction at 40MHz: command and address, the data, and the
+// few microseconds of driver and chip select setup around each one
+static double TransactionUs(uint32_t len) { return 5.0 + (4 + len) * 8 / 40.0; }
+
+class FakeSPIRAM : public AudioSPIRAMDriver
+{
+  public:
+    FakeSPIRAM(uint32_t size) : mem(size) { ops = bytes = 0; us = 0; bad = false; }
+    virtual void read(uint32_t addr, uint8_t *data, uint32_t len) override {
+      if (addr + len > mem.size()) { bad = true; return; }
+      memcpy(data, mem.data() + addr, len);
+      Count(len);
+    }
+    virtual void write(uint32_t addr, const uint8_t *data, uint32_t len) override {
+      if (addr + len > mem.size()) { bad = true; return; }
+      memcpy(mem.data() + addr, data, len);
+      Count(len);
+    }
+    void Count(uint32_t len) { ops++; bytes += len; us += TransactionUs(len); }
+    std::vector<uint8_t> mem;
+    uint32_t ops;
+    uint32_t bytes;
+    double us;
+    bool bad;
+};
+
+// Blocking reads get everything, non-blocking ones only the little that has "arrived"
+class TrickleSource : public AudioFileSourceSTDIO
+{
+  public:
+    TrickleSource(const char *name) : AudioFileSourceSTDIO(name) {}
+    virtual uint32_t readNonBlock(void *data, uint32_t len) override {
+      uint32_t n = rand() % 300;
+      return read(data, (n < len) ? n : len);
+    }
+};
+
+static bool Stream(const std::vector<uint8_t> &ref, uint32_t ramSize, uint32_t prefill)
+{
+  FakeSPIRAM *ram = new FakeSPIRAM(ramSize);
+  TrickleSource *in = new TrickleSource("jamonit.mp3");
+  AudioFileSourceSPIRAMBuffer *buff = new AudioFileSourceSPIRAMBuffer(in, ram, ramSize);
+  buff->SetPrefill(prefill);
+
+  std::vector<uint8_t> got;
+  uint8_t tmp[2048];
+  uint32_t reads = 0;
+  srand(1);
+  while (true) {
+    for (int i = rand() % 4; i > 0; i--) buff->loop();
+    uint32_t want = 1 + rand() % ((rand() & 7) ? 200 : sizeof(tmp)); // Mostly small reads, like the decoders
+    uint32_t pos = buff->getPos();
+    uint32_t n = buff->read(tmp, want);
+    if (!n) break;
+    if (pos != got.size()) {
+      printf("FAIL: getPos() %u but %u bytes read\n", pos, (uint32_t)got.size());
+      return false;
+    }
+    got.insert(got.end(), tmp, tmp + n);
+    reads++;
+  }
+
+  bool ok = !ram->bad && (got == ref);
+  // The old code made a transaction for every read and every 128 bytes written
+  uint32_t oldOps = reads + (ref.size() + 127) / 128;
+  double oldUs = reads * TransactionUs(ref.size() / reads) + ((ref.size() + 127) / 128) * TransactionUs(128);
+  printf("%s ram %6u prefill %6u: %5u transactions of %3u bytes, %5.1f ms of SPI (per-read: %5u, %5.1f ms)\n",
+         ok ? "ok  " : "FAIL", ramSize, prefill, ram->ops, ram->ops ? ram->bytes / ram->ops : 0,
+         ram->us / 1000, oldOps, oldUs / 1000);
+  delete buff;
+  delete in;
+  delete ram;
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    FILE *f = fopen("jamonit.mp3", "rb");
+    if (!f) {
+      printf("Need jamonit.mp3\n");
+      return 1;
+    }
+    std::vector<uint8_t> ref;
+    uint8_t b[4096];
+    size_t n;
+    while ((n = fread(b, 1, sizeof(b), f)) > 0) ref.insert(ref.end(), b, b + n);
+    fclose(f);
+
+    bool ok = true;
+    ok &= Stream(ref, 131072, 0);
+    ok &= Stream(ref, 131072, 8192);
+    ok &= Stream(ref, 32768, 2048);
+    ok &= Stream(ref, 1000, 100); // Smaller than a burst, and an odd size so transfers wrap
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+#include <Arduino.h>
+#include <vector>
+#include "AudioSyncScan.h"
+
+// Feeds the shared MP3/ADTS sync scanner hand-built frames:  the last frame of a file followed by an
+// ID3v1 tag, an APE footer, padding or nothing, which must all be found, and false syncs (bad headers,
+// headers whose next frame disagrees) which must be stepped over.  Prints "ok" when every case passes.
+
+typedef std::vector<uint8_t> Bytes;
+
+static bool allOk = true;
+
+static void Check(const char *name, int got, int expect)
+{
+  if (got != expect) {
+    printf("%-40s got %d, expected %d\n", name, got, expect);
+    allOk = false;
+  }
+}
+
+// A frame with the given header and a body that has no 0xff in it, so no sync word either
+static void Frame(Bytes *b, const uint8_t *hdr, int hdrLen, int len)
+{
+  b->insert(b->end(), hdr, hdr + hdrLen);
+  for (int i = hdrLen; i < len; i++) b->push_back((i * 7) & 0x7f);
+}
+
+static void Append(Bytes *b, const char *s, int len)
+{
+  b->insert(b->end(), (const uint8_t *)s, (const uint8_t *)s + len);
+}
+
+static void Zeros(Bytes *b, int len)
+{
+  b->insert(b->end(), len, 0);
+}
+
+static const uint8_t mp3At44k[4] = { 0xff, 0xfb, 0x90, 0x00 }; // MPEG1 layer III, 128kbps, 44.1kHz:  417 bytes
+static const uint8_t mp3At48k[4] = { 0xff, 0xfb, 0x94, 0x00 }; // The same at 48kHz:  384 bytes
+static const int mp3Len44k = 417;
+static const int mp3Len48k = 384;
+
+static int FindMP3(const Bytes &b, AudioSyncStats *stats = NULL)
+{
+  return AudioSyncFindMP3(b.data(), b.size(), 0xe0, stats);
+}
+
+static void TestMP3()
+{
+  Check("MP3 frame length", AudioSyncMP3FrameBytes(mp3At44k), mp3Len44k);
+  Check("MP3 frame length at 48kHz", AudioSyncMP3FrameBytes(mp3At48k), mp3Len48k);
+  static const uint8_t reserved[4] = { 0xff, 0xfb, 0x9c, 0x00 };
+  Check("MP3 reserved sample rate", AudioSyncMP3SampleRate(reserved), -1);
+  Check("MP3 reserved sample rate length", AudioSyncMP3FrameBytes(reserved), -1);
+  Check("MP3 sample rate", AudioSyncMP3SampleRate(mp3At44k), 44100);
+
+  Bytes b;
+  Frame(&b, mp3At44k, 4, mp3Len44k);
+  Check("MP3 last frame alone", FindMP3(b), 0);
+
+  Bytes tag = b;
+  Append(&tag, "TAG", 3);
+  Zeros(&tag, 125);
+  Check("MP3 last frame before ID3v1", FindMP3(tag), 0);
+
+  Bytes ape = b;
+  Append(&ape, "APETAGEX", 8);
+  Zeros(&ape, 24);
+  Check("MP3 last frame before APE footer", FindMP3(ape), 0);
+
+  Bytes pad = b;
+  Zeros(&pad, 64);
+  Check("MP3 last frame before padding", FindMP3(pad), 0);
+
+  Bytes two;
+  Frame(&two, mp3At44k, 4, mp3Len44k);
+  Frame(&two, mp3At44k, 4, mp3Len44k);
+  Append(&two, "TAG", 3);
+  Zeros(&two, 125);
+  Check("MP3 first of two before ID3v1", FindMP3(two), 0);
+  Check("MP3 second of two before ID3v1", AudioSyncFindMP3(two.data() + mp3Len44k, two.size() - mp3Len44k, 0xe0, NULL), 0);
+
+  // A plausible header in junk whose next frame would land mid-frame, ahead of real ones:  the real ones win
+  Bytes junk;
+  Append(&junk, "\x01\xff\xfb\x94\x00\x02", 6);
+  Frame(&junk, mp3At44k, 4, mp3Len44k);
+  Frame(&junk, mp3At44k, 4, mp3Len44k);
+  Check("MP3 unconfirmed junk before real frames", FindMP3(junk), 6);
+
+  // A 44.1kHz header followed a frame later by a 48kHz one is a false sync, the 48kHz stream is real
+  Bytes disagree;
+  Frame(&disagree, mp3At44k, 4, mp3Len44k);
+  Frame(&disagree, mp3At48k, 4, mp3Len48k);
+  Frame(&disagree, mp3At48k, 4, mp3Len48k);
+  AudioSyncStats stats, other;
+  memset(&stats, 0, sizeof(stats));
+  memset(&other, 0, sizeof(other));
+  Check("MP3 next header disagrees", FindMP3(disagree, &stats), mp3Len44k);
+  Check("MP3 false sync counted", stats.falseSyncs >= 1, 1);
+  Check("MP3 skipped bytes counted", stats.bytesSkipped, mp3Len44k);
+
+  // A candidate with an invalid header (bitrate index 15) is thrown out
+  Bytes bad;
+  Append(&bad, "\xff\xfe\xf0\x00\x00", 5);
+  Frame(&bad, mp3At44k, 4, mp3Len44k);
+  Check("MP3 invalid header skipped", FindMP3(bad, &other), 5);
+
+  Bytes none;
+  Append(&none, "\xff\xfe\xf0\x00\x00", 5);
+  Zeros(&none, 600);
+  Check("MP3 nothing valid", FindMP3(none, &other), -1);
+
+  // Each decoder's counts are its own
+  Check("MP3 stats scans", stats.scans, 1);
+  Check("MP3 other stats scans", other.scans, 2);
+}
+
+// ADTS header for an AAC LC stereo frame of len bytes at sample rate index sr, no CRC
+static void ADTSHeader(uint8_t *hdr, int sr, int len)
+{
+  hdr[0] = 0xff;
+  hdr[1] = 0xf1;
+  hdr[2] = 0x40 | (sr << 2);
+  hdr[3] = 0x80 | ((len >> 11) & 3);
+  hdr[4] = (len >> 3) & 0xff;
+  hdr[5] = ((len & 7) << 5) | 0x1f;
+  hdr[6] = 0xfc;
+}
+
+static int FindADTS(const Bytes &b, AudioSyncStats *stats = NULL)
+{
+  return AudioSyncFindADTS(b.data(), b.size(), stats);
+}
+
+static void TestADTS()
+{
+  uint8_t at44k[7], at48k[7], reserved[7];
+  ADTSHeader(at44k, 4, 300);
+  ADTSHeader(at48k, 3, 200);
+  ADTSHeader(reserved, 13, 200);
+  Check("ADTS frame length", AudioSyncADTSFrameBytes(at44k), 300);
+  Check("ADTS sample rate", AudioSyncADTSSampleRate(at44k), 44100);
+  Check("ADTS reserved sample rate", AudioSyncADTSSampleRate(reserved), -1);
+  Check("ADTS reserved sample rate length", AudioSyncADTSFrameBytes(reserved), -1);
+
+  Bytes b;
+  Frame(&b, at44k, 7, 300);
+  Check("ADTS last frame alone", FindADTS(b), 0);
+
+  Bytes tag = b;
+  Append(&tag, "TAG", 3);
+  Zeros(&tag, 125);
+  Check("ADTS last frame before ID3v1", FindADTS(tag), 0);
+
+  Bytes pad = b;
+  Zeros(&pad, 64);
+  Check("ADTS last frame before padding", FindADTS(pad), 0);
+
+  Bytes disagree;
+  Frame(&disagree, at44k, 7, 300);
+  Frame(&disagree, at48k, 7, 200);
+  Frame(&disagree, at48k, 7, 200);
+  AudioSyncStats stats;
+  memset(&stats, 0, sizeof(stats));
+  Check("ADTS next header disagrees", FindADTS(disagree, &stats), 300);
+  Check("ADTS false sync counted", stats.falseSyncs >= 1, 1);
+
+  Bytes none;
+  Zeros(&none, 400);
+  Check("ADTS nothing there", FindADTS(none), -1);
+}
+
+int main(int argc, char **argv)
+{
+  (void) argc;
+  (void) argv;
+  TestMP3();
+  TestADTS();
+  if (allOk) printf("ok\n");
+  return allOk ? 0 : 1;
+}
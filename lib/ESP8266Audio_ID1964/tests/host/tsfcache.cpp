@@ -0,0 +1,99 @@
+#include <Arduino.h>
+#include <vector>
+
+// Plays the same run of overlapping notes on the example SoundFont's looped and one-shot instruments
+// through tsf_render_short() twice:  with the sample cache this file is built with, big enough to
+// hold every page of the SoundFont so none is ever read twice, and with the same file built again
+// as tsfcache_small.o with a cache of 4 pages of 64 samples, 512 bytes against the SoundFont's 1MB,
+// so pages are evicted and read back all the time.  The two have to come out sample for sample the
+// same.  Prints "ok" when they do.
+//
+//   tsfcache [soundfont.sf2]
+
+#ifdef TSFCACHE_SMALL
+#define TSF_BUFFS 4
+#define TSF_BUFFSIZE 64
+#define tsf tsf_small        // This build's struct tsf is laid out differently from the other's
+#define Render RenderSmall
+#else
+#define TSF_BUFFS 2048
+#endif
+#define TSF_STATIC
+#define TSF_IMPLEMENTATION
+#include "libtinysoundfont/tsf.h"
+
+static const int rate = 22050;
+static const int seconds = 20;
+static const int presets[] = { 0, 19, 48, 73, 24, 52, 11, 33 }; // Piano, organ, strings, flute, guitar, choir, vibes, bass
+
+bool Render(const char *sf2, std::vector<short> *out, struct tsf_cache_stats *stats);
+#ifndef TSFCACHE_SMALL
+bool RenderSmall(const char *sf2, std::vector<short> *out, struct tsf_cache_stats *stats);
+#endif
+
+// A note starts every 50ms, on each preset in turn, and is let go of 0.2 to 1.5s later
+bool Render(const char *sf2, std::vector<short> *out, struct tsf_cache_stats *stats)
+{
+  tsf *f = tsf_load_filename(sf2);
+  if (!f) return false;
+  tsf_set_output(f, TSF_STEREO_INTERLEAVED, rate, -10);
+  const int block = rate / 20;
+  const int npresets = sizeof(presets) / sizeof(presets[0]);
+  int notes = seconds * 20;
+  std::vector<int> offAt(notes, -1);
+  out->resize(2 * rate * seconds);
+  for (int n = 0; n < notes; n++) {
+    int key = 36 + (n * 11) % 48;
+    tsf_note_on(f, presets[n % npresets], key, 0.5f + (n % 5) * 0.1f);
+    offAt[n] = n + 4 + (n * 7) % 26;
+    for (int m = 0; m < n; m++) {
+      if (offAt[m] == n) tsf_note_off(f, presets[m % npresets], 36 + (m * 11) % 48);
+    }
+    tsf_render_short(f, out->data() + 2 * n * block, block, 0);
+  }
+  tsf_get_cache_stats(f, stats);
+  tsf_close(f);
+  return true;
+}
+
+#ifndef TSFCACHE_SMALL
+int main(int argc, char **argv)
+{
+  const char *sf2 = (argc > 1) ? argv[1] : "../../examples/PlayMIDIFromSPIFFS/data/1mgm.sf2";
+
+  std::vector<short> big, small;
+  struct tsf_cache_stats bigStats, smallStats;
+  if (!Render(sf2, &big, &bigStats) || !RenderSmall(sf2, &small, &smallStats)) {
+    printf("Can't load %s\n", sf2);
+    return 1;
+  }
+  printf("Whole SoundFont cached:  %u hits, %u misses, %u read-aheads\n", bigStats.hits, bigStats.misses, bigStats.readAheads);
+  printf("4 pages of 64 samples:   %u hits, %u misses, %u read-aheads\n", smallStats.hits, smallStats.misses, smallStats.readAheads);
+
+  size_t differ = 0, first = 0;
+  for (size_t i = 0; i < big.size(); i++) {
+    if (big[i] != small[i]) {
+      if (!differ) first = i;
+      differ++;
+    }
+  }
+  int loud = 0;
+  for (size_t i = 0; i < big.size(); i++) loud += (abs(big[i]) > 1000);
+
+  bool ok = true;
+  if (differ) {
+    printf("%u samples DIFFER with the small cache, the first at %.3fs\n", (unsigned)differ, (first / 2) / (double)rate);
+    ok = false;
+  }
+  if (!loud) {
+    printf("Rendered nothing but silence\n");
+    ok = false;
+  }
+  if (smallStats.misses <= bigStats.misses) {
+    printf("The small cache didn't have to read pages back\n");
+    ok = false;
+  }
+  if (ok) printf("ok\n");
+  return ok ? 0 : 1;
+}
+#endif
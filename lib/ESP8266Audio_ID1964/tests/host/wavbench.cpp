@@ -0,0 +1,320 @@
+#include <Arduino.h>
+#include <math.h>
+#include <vector>
+#include "AudioFileSourceMMAP.h"
+#include "AudioGeneratorMP3.h"
+#include "AudioGeneratorWAV.h"
+
+// Decodes jamonit.mp3, re-encodes it as PCM, IMA ADPCM, MS ADPCM, u-law and A-law WAVs, and
+// times AudioGeneratorWAV playing each one back against the MP3 decoder doing the same clip.
+
+// Keeps every sample it's given, or just takes them when keep is false so the timing is the decoder's
+class AudioOutputCollect : public AudioOutput
+{
+  public:
+    virtual bool begin() override { samples.clear(); return true; }
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      if (!keep) return true;
+      samples.push_back(sample[LEFTCHANNEL]);
+      if (channels == 2) samples.push_back(sample[RIGHTCHANNEL]);
+      return true;
+    }
+    virtual bool stop() override { return true; }
+    int getRate() { return hertz; }
+    int getChannels() { return channels; }
+    std::vector<int16_t> samples;
+    bool keep = true;
+};
+
+static const int imaStep[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+  12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int imaIndex[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+static const int msAdapt[16] = { 230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230 };
+static const int msCoef[7][2] = { {256, 0}, {512, -256}, {0, 0}, {192, 64}, {240, 0}, {460, -208}, {392, -232} };
+
+static int Clip16(int v) { return (v > 32767) ? 32767 : (v < -32768) ? -32768 : v; }
+
+static void Put16(std::vector<uint8_t> &v, int x) { v.push_back(x & 0xff); v.push_back((x >> 8) & 0xff); }
+static void Put32(std::vector<uint8_t> &v, uint32_t x) { Put16(v, x & 0xffff); Put16(v, x >> 16); }
+static void PutTag(std::vector<uint8_t> &v, const char *t) { v.insert(v.end(), t, t + 4); }
+
+static int IMAEncode(int *pred, int *index, int x)
+{
+  int step = imaStep[*index];
+  int diff = x - *pred;
+  int nib = 0;
+  if (diff < 0) { nib = 8; diff = -diff; }
+  if (diff >= step) { nib |= 4; diff -= step; }
+  if (diff >= step >> 1) { nib |= 2; diff -= step >> 1; }
+  if (diff >= step >> 2) { nib |= 1; }
+  // Track the decoder exactly
+  int d = step >> 3;
+  if (nib & 4) d += step;
+  if (nib & 2) d += step >> 1;
+  if (nib & 1) d += step >> 2;
+  *pred = Clip16((nib & 8) ? *pred - d : *pred + d);
+  *index += imaIndex[nib];
+  if (*index < 0) *index = 0;
+  if (*index > 88) *index = 88;
+  return nib;
+}
+
+static int MSEncode(int *s1, int *s2, int *delta, int x)
+{
+  // Always uses the first coefficient pair, it's only here to have something to decode
+  int pred = (*s1 * msCoef[0][0] + *s2 * msCoef[0][1]) >> 8;
+  int e = x - pred;
+  int n = (e + ((e < 0) ? -*delta / 2 : *delta / 2)) / *delta;
+  if (n < -8) n = -8;
+  if (n > 7) n = 7;
+  int s = Clip16(pred + n * *delta);
+  *s2 = *s1;
+  *s1 = s;
+  int nib = n & 0x0f;
+  *delta = (*delta * msAdapt[nib]) >> 8;
+  if (*delta < 16) *delta = 16;
+  return nib;
+}
+
+// The usual segment search encoders from the G.711 reference code
+static int G711Segment(int x, int first)
+{
+  int seg = 0;
+  for (int lim = first; (seg < 8) && (x > lim); lim = (lim << 1) | 1) seg++;
+  return seg;
+}
+
+static uint8_t ULawEncode(int x)
+{
+  int mask = 0xff;
+  x >>= 2;
+  if (x < 0) { x = -x; mask = 0x7f; }
+  x += 33;
+  if (x > 8191) x = 8191;
+  int seg = G711Segment(x, 0x3f);
+  if (seg >= 8) return 0x7f ^ mask;
+  return ((seg << 4) | ((x >> (seg + 1)) & 0x0f)) ^ mask;
+}
+
+static uint8_t ALawEncode(int x)
+{
+  int mask = 0xd5;
+  x >>= 3;
+  if (x < 0) { x = -x - 1; mask = 0x55; }
+  int seg = G711Segment(x, 0x1f);
+  if (seg >= 8) return 0x7f ^ mask;
+  int a = seg << 4;
+  a |= (seg < 2) ? ((x >> 1) & 0x0f) : ((x >> seg) & 0x0f);
+  return a ^ mask;
+}
+
+static std::vector<uint8_t> WAVHeader(int format, int channels, int rate, int blockAlign, int bits, int spb, uint32_t dataBytes)
+{
+  std::vector<uint8_t> fmt;
+  Put16(fmt, format);
+  Put16(fmt, channels);
+  Put32(fmt, rate);
+  Put32(fmt, spb ? (uint64_t)rate * blockAlign / spb : rate * blockAlign);
+  Put16(fmt, blockAlign);
+  Put16(fmt, bits);
+  if (format == 0x11) {
+    Put16(fmt, 2);
+    Put16(fmt, spb);
+  } else if (format == 2) {
+    Put16(fmt, 32);
+    Put16(fmt, spb);
+    Put16(fmt, 7);
+    for (int i = 0; i < 7; i++) { Put16(fmt, msCoef[i][0]); Put16(fmt, msCoef[i][1]); }
+  }
+  std::vector<uint8_t> h;
+  PutTag(h, "RIFF");
+  Put32(h, 4 + 8 + fmt.size() + 8 + dataBytes);
+  PutTag(h, "WAVE");
+  PutTag(h, "fmt ");
+  Put32(h, fmt.size());
+  h.insert(h.end(), fmt.begin(), fmt.end());
+  PutTag(h, "data");
+  Put32(h, dataBytes);
+  return h;
+}
+
+static void WriteWAV(const char *name, int format, int channels, int rate, int blockAlign, int bits, int spb, const std::vector<uint8_t> &data)
+{
+  std::vector<uint8_t> f = WAVHeader(format, channels, rate, blockAlign, bits, spb, data.size());
+  f.insert(f.end(), data.begin(), data.end());
+  FILE *fp = fopen(name, "wb");
+  fwrite(f.data(), 1, f.size(), fp);
+  fclose(fp);
+}
+
+static void EncodeAll(const std::vector<int16_t> &pcm, int channels, int rate)
+{
+  size_t frames = pcm.size() / channels;
+  std::vector<uint8_t> d;
+
+  for (size_t i = 0; i < pcm.size(); i++) Put16(d, pcm[i]);
+  WriteWAV("bench_pcm.wav", 1, channels, rate, 2 * channels, 16, 0, d);
+
+  d.clear();
+  for (size_t i = 0; i < pcm.size(); i++) d.push_back(ULawEncode(pcm[i]));
+  WriteWAV("bench_ulaw.wav", 7, channels, rate, channels, 8, 0, d);
+
+  d.clear();
+  for (size_t i = 0; i < pcm.size(); i++) d.push_back(ALawEncode(pcm[i]));
+  WriteWAV("bench_alaw.wav", 6, channels, rate, channels, 8, 0, d);
+
+  // IMA, 512 bytes per channel per block
+  int align = 512 * channels;
+  int spb = (align - 4 * channels) * 2 / channels + 1;
+  d.clear();
+  int pred[2] = {0, 0}, index[2] = {0, 0};
+  for (size_t f = 0; f < frames; f += spb) {
+    for (int c = 0; c < channels; c++) {
+      pred[c] = pcm[f * channels + c];
+      Put16(d, pred[c]);
+      d.push_back(index[c]);
+      d.push_back(0);
+    }
+    for (int g = 1; g < spb; g += 8) {
+      for (int c = 0; c < channels; c++) {
+        for (int i = 0; i < 8; i += 2) {
+          size_t a = f + g + i, b = a + 1;
+          int lo = IMAEncode(&pred[c], &index[c], (a < frames) ? pcm[a * channels + c] : 0);
+          int hi = IMAEncode(&pred[c], &index[c], (b < frames) ? pcm[b * channels + c] : 0);
+          d.push_back(lo | (hi << 4));
+        }
+      }
+    }
+  }
+  WriteWAV("bench_ima.wav", 0x11, channels, rate, align, 4, spb, d);
+
+  // MS, 256 bytes per channel per block
+  align = 256 * channels;
+  spb = (align - 7 * channels) * 2 / channels + 2;
+  d.clear();
+  for (size_t f = 0; f < frames; f += spb) {
+    int s1[2], s2[2], delta[2];
+    for (int c = 0; c < channels; c++) d.push_back(0);
+    for (int c = 0; c < channels; c++) { delta[c] = 16; Put16(d, delta[c]); }
+    for (int c = 0; c < channels; c++) { s1[c] = (f + 1 < frames) ? pcm[(f + 1) * channels + c] : 0; Put16(d, s1[c]); }
+    for (int c = 0; c < channels; c++) { s2[c] = pcm[f * channels + c]; Put16(d, s2[c]); }
+    int nib = -1;
+    for (int i = 2; i < spb; i++) {
+      for (int c = 0; c < channels; c++) {
+        size_t a = f + i;
+        int n = MSEncode(&s1[c], &s2[c], &delta[c], (a < frames) ? pcm[a * channels + c] : 0);
+        if (nib < 0) {
+          nib = n;
+        } else {
+          d.push_back((nib << 4) | n);
+          nib = -1;
+        }
+      }
+    }
+  }
+  WriteWAV("bench_ms.wav", 2, channels, rate, align, 4, spb, d);
+}
+
+static unsigned long Play(AudioGenerator *gen, const char *name, AudioOutputCollect *out, bool keep)
+{
+  out->keep = keep;
+  AudioFileSourceMMAP *in = new AudioFileSourceMMAP(name);
+  unsigned long start = micros();
+  gen->begin(in, out);
+  while (gen->loop()) { /*noop*/ }
+  gen->stop();
+  unsigned long us = micros() - start;
+  delete in;
+  return us ? us : 1;
+}
+
+volatile uint8_t copySink; // Keeps the copies from being optimized away
+
+// What it costs just to move the PCM file's bytes through a buffer the size of the WAV generator's
+static unsigned long CopyTime(const char *name)
+{
+  FILE *fp = fopen(name, "rb");
+  if (!fp) return 1;
+  std::vector<uint8_t> data;
+  uint8_t b[4096];
+  size_t n;
+  while ((n = fread(b, 1, sizeof(b), fp)) > 0) data.insert(data.end(), b, b + n);
+  fclose(fp);
+  unsigned long start = micros();
+  for (size_t i = 0; i < data.size(); i += 128) {
+    memcpy(b, data.data() + i, (data.size() - i < 128) ? data.size() - i : 128);
+    copySink = b[0];
+  }
+  unsigned long us = micros() - start;
+  return us ? us : 1;
+}
+
+static double SNR(const std::vector<int16_t> &ref, const std::vector<int16_t> &test)
+{
+  double sig = 0, err = 0;
+  size_t n = (ref.size() < test.size()) ? ref.size() : test.size();
+  for (size_t i = 0; i < n; i++) {
+    double e = (double)ref[i] - test[i];
+    sig += (double)ref[i] * ref[i];
+    err += e * e;
+  }
+  return err ? 10 * log10(sig / err) : 999;
+}
+
+static long FileBytes(const char *name)
+{
+  FILE *fp = fopen(name, "rb");
+  if (!fp) return 0;
+  fseek(fp, 0, SEEK_END);
+  long n = ftell(fp);
+  fclose(fp);
+  return n;
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+    AudioOutputCollect *out = new AudioOutputCollect();
+
+    AudioGeneratorMP3 *mp3 = new AudioGeneratorMP3();
+    Play(mp3, "jamonit.mp3", out, true);
+    delete mp3;
+    std::vector<int16_t> pcm = out->samples;
+    int channels = out->getChannels();
+    int rate = out->getRate();
+    double secs = (double)pcm.size() / channels / rate;
+    if (!pcm.size()) {
+      Serial.printf("Can't decode jamonit.mp3\n");
+      return 1;
+    }
+    EncodeAll(pcm, channels, rate);
+    mp3 = new AudioGeneratorMP3();
+    unsigned long mp3us = Play(mp3, "jamonit.mp3", out, false);
+    delete mp3;
+    unsigned long copyus = CopyTime("bench_pcm.wav");
+
+    Serial.printf("%.1f seconds, %d Hz, %d channel(s)\n", secs, rate, channels);
+    Serial.printf("%-6s %9s %9s %9s %9s %8s\n", "format", "bytes", "ms", "xrealtime", "vs mp3", "SNR dB");
+    Serial.printf("%-6s %9ld %9.1f %9.1f %9.2f %8s\n", "mp3", FileBytes("jamonit.mp3"), mp3us / 1000.0, secs * 1e6 / mp3us, 1.0, "-");
+    Serial.printf("%-6s %9ld %9.1f %9.1f %9.2f %8s\n", "memcpy", FileBytes("bench_pcm.wav"), copyus / 1000.0, secs * 1e6 / copyus, (double)mp3us / copyus, "-");
+
+    static const char *names[] = { "pcm", "ulaw", "alaw", "ima", "ms" };
+    for (int i = 0; i < 5; i++) {
+      char file[32];
+      sprintf(file, "bench_%s.wav", names[i]);
+      AudioGeneratorWAV *wav = new AudioGeneratorWAV();
+      unsigned long us = Play(wav, file, out, false);
+      Play(wav, file, out, true);
+      delete wav;
+      Serial.printf("%-6s %9ld %9.1f %9.1f %9.2f %8.1f\n", names[i], FileBytes(file), us / 1000.0, secs * 1e6 / us, (double)mp3us / us, SNR(pcm, out->samples));
+    }
+
+    delete out;
+}